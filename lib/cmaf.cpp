@@ -1,4 +1,7 @@
+#include "checksum.h"
 #include "cmaf.h"
+#include "shared_memory.h"
+#include <map>
 
 static uint64_t unixBootDiff = Util::unixMS();
 
@@ -285,4 +288,146 @@ namespace CMAF{
 
     return header.str();
   }
+
+  // Generated headers are shared between all output processes of a stream through a per-track
+  // page of fixed-size slots. Each slot is guarded by a sequence counter that is odd while a writer
+  // is busy with it; readers retry nothing and simply regenerate on a mismatch. Slots are keyed on
+  // a checksum of the track's init data as well, so nothing is served from an earlier track with
+  // the same number. The pages are created (empty) and removed together with the track, see
+  // DTSC::Meta::addTrack and DTSC::Meta::removeTrack; outputs keep them mapped between requests.
+
+#define CMAF_CACHE_SIMPLIFY 1
+#define CMAF_CACHE_INIT 4
+
+  struct headerSlot{
+    volatile uint32_t seq;
+    uint32_t size;
+    uint64_t startTime;
+    uint64_t endTime;
+    uint64_t segmentNum;
+    uint64_t payload;
+    uint32_t flags;
+    uint32_t generation; ///< Checksum of the init data of the track the header was made for
+    char data[CMAF_HEADER_SLOTSIZE - 48];
+  };
+
+  /// Header cache pages mapped by this process, by page name
+  static std::map<std::string, IPC::sharedPage *> cachePages;
+
+  /// Returns the header cache page for the given track, mapping it on first use.
+  /// Returns null if the track has no header cache page.
+  static IPC::sharedPage *openCache(const DTSC::Meta &M, size_t track){
+    if (!M.getStreamName().size()){return 0;}
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_CMAF_HEADERS, M.getStreamName().c_str(), track);
+    IPC::sharedPage *&page = cachePages[pageName];
+    // Let go of pages that were removed since we mapped them; the track may have a new one
+    if (page && *(volatile uint32_t *)page->mapped){
+      delete page;
+      page = 0;
+    }
+    if (!page){
+      page = new IPC::sharedPage(pageName, 0, false, false);
+      if (!page->mapped || page->len < CMAF_HEADER_SLOTS * CMAF_HEADER_SLOTSIZE || *(volatile uint32_t *)page->mapped){
+        delete page;
+        cachePages.erase(pageName);
+        return 0;
+      }
+    }
+    return page;
+  }
+
+  /// Returns the checksum of the init data of a track, identifying this particular track.
+  static uint32_t trackGeneration(const DTSC::Meta &M, size_t track){
+    std::string init = M.getInit(track);
+    return checksum::crc32(0, init.data(), init.size());
+  }
+
+  static headerSlot *findSlot(IPC::sharedPage &page, uint64_t startTime, uint64_t endTime,
+                              uint64_t segmentNum, uint32_t flags){
+    uint64_t hash = startTime * 31 + endTime * 17 + segmentNum * 7 + flags;
+    // Slot 0 holds the page header
+    return (headerSlot *)(page.mapped + (1 + hash % (CMAF_HEADER_SLOTS - 1)) * CMAF_HEADER_SLOTSIZE);
+  }
+
+  static bool readSlot(headerSlot *S, uint64_t startTime, uint64_t endTime, uint64_t segmentNum,
+                       uint32_t flags, uint32_t generation, std::string &header, uint64_t &payload){
+    uint32_t seq = S->seq;
+    __sync_synchronize();
+    if ((seq & 1) || !S->size || S->size > sizeof(S->data)){return false;}
+    if (S->startTime != startTime || S->endTime != endTime || S->segmentNum != segmentNum ||
+        S->flags != flags || S->generation != generation){
+      return false;
+    }
+    header.assign(S->data, S->size);
+    payload = S->payload;
+    __sync_synchronize();
+    return S->seq == seq;
+  }
+
+  static void writeSlot(headerSlot *S, uint64_t startTime, uint64_t endTime, uint64_t segmentNum,
+                        uint32_t flags, uint32_t generation, const std::string &header, uint64_t payload){
+    if (header.size() > sizeof(S->data)){return;}
+    uint32_t seq = S->seq;
+    // Someone else is writing this slot; we'll leave it to them.
+    if ((seq & 1) || !__sync_bool_compare_and_swap(&S->seq, seq, seq + 1)){return;}
+    S->startTime = startTime;
+    S->endTime = endTime;
+    S->segmentNum = segmentNum;
+    S->flags = flags;
+    S->generation = generation;
+    S->payload = payload;
+    S->size = header.size();
+    memcpy(S->data, header.data(), header.size());
+    __sync_synchronize();
+    S->seq = seq + 2;
+  }
+
+  /// Returns the initialization segment for the given track, from the shared header cache if possible.
+  std::string cachedTrackHeader(const DTSC::Meta &M, size_t track, bool simplifyTrackIds){
+    // Anything that changes the init segment changes this checksum
+    uint32_t generation = trackGeneration(M, track);
+    std::string codec = M.getCodec(track);
+    uint32_t crc = checksum::crc32(generation, codec.data(), codec.size());
+    uint64_t fields[6] ={M.getWidth(track), M.getHeight(track), M.getRate(track), M.getChannels(track),
+                         M.getVod() ? DTSC::Fragments(M.fragments(track)).getEndValid() : 0, M.getVod() ? M.getLastms(track) : 0};
+    crc = checksum::crc32(crc, (const char *)fields, sizeof(fields));
+    uint32_t flags = CMAF_CACHE_INIT | (simplifyTrackIds ? CMAF_CACHE_SIMPLIFY : 0);
+
+    IPC::sharedPage *page = openCache(M, track);
+    if (!page){return trackHeader(M, track, simplifyTrackIds);}
+    headerSlot *S = findSlot(*page, 0, 0, crc, flags);
+    std::string header;
+    uint64_t payload;
+    if (readSlot(S, 0, 0, crc, flags, generation, header, payload)){return header;}
+    header = trackHeader(M, track, simplifyTrackIds);
+    writeSlot(S, 0, 0, crc, flags, generation, header, 0);
+    return header;
+  }
+
+  /// Returns the 'moof' box for a DTSC::Key based CMAF fragment and sets payload to the size of
+  /// its 'mdat' contents. Uses the shared header cache once the fragment can no longer change.
+  std::string cachedKeyHeader(const DTSC::Meta &M, size_t track, uint64_t startTime, uint64_t endTime,
+                              uint64_t segmentNum, uint64_t &payload, bool simplifyTrackIds, bool UTCTime){
+    // UTC-based decode times depend on the process-local boot difference, so are never shared.
+    // Live fragments are only final once data past their end time exists.
+    if (UTCTime || (!M.getVod() && M.getLastms(track) < endTime)){
+      payload = payloadSize(M, track, startTime, endTime);
+      return keyHeader(M, track, startTime, endTime, segmentNum, simplifyTrackIds, UTCTime);
+    }
+    uint32_t flags = (simplifyTrackIds ? CMAF_CACHE_SIMPLIFY : 0);
+    IPC::sharedPage *page = openCache(M, track);
+    headerSlot *S = 0;
+    uint32_t generation = 0;
+    std::string header;
+    if (page){
+      generation = trackGeneration(M, track);
+      S = findSlot(*page, startTime, endTime, segmentNum, flags);
+      if (readSlot(S, startTime, endTime, segmentNum, flags, generation, header, payload)){return header;}
+    }
+    payload = payloadSize(M, track, startTime, endTime);
+    header = keyHeader(M, track, startTime, endTime, segmentNum, simplifyTrackIds, UTCTime);
+    if (S){writeSlot(S, startTime, endTime, segmentNum, flags, generation, header, payload);}
+    return header;
+  }
 }// namespace CMAF
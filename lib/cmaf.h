@@ -9,4 +9,9 @@ namespace CMAF{
   size_t keyHeaderSize(const DTSC::Meta &M, size_t track, size_t fragment);
   size_t keyHeaderSize(const DTSC::Meta &M, size_t track, uint64_t startTime, uint64_t endTime);
   std::string keyHeader(const DTSC::Meta &M, size_t track, uint64_t startTime, uint64_t endTime, uint64_t segmentNum, bool simplifyTrackIds = false, bool UTCTime = false);
+
+  std::string cachedTrackHeader(const DTSC::Meta &M, size_t track, bool simplifyTrackIds = false);
+  std::string cachedKeyHeader(const DTSC::Meta &M, size_t track, uint64_t startTime, uint64_t endTime,
+                              uint64_t segmentNum, uint64_t &payload, bool simplifyTrackIds = false,
+                              bool UTCTime = false);
 }// namespace CMAF
@@ -44,13 +44,14 @@ namespace Comms{
     index = INVALID_RECORD_INDEX;
     currentSize = 0;
     master = false;
+    borrowed = false;
   }
 
   Comms::~Comms(){
     if (dataPage && index != INVALID_RECORD_INDEX && status){
       setStatus(COMM_STATUS_DISCONNECT | getStatus());
     }
-    if (master){
+    if (master && !borrowed){
       if (dataPage.mapped){
         finishAll();
         dataPage.master = true;
@@ -124,6 +125,40 @@ namespace Comms{
     dataPage.master = _master;
   }
 
+  /// Opens an existing page with access to all of its records, without taking ownership of it.
+  /// Used by processes that keep many records on a page owned by another process.
+  void Comms::borrow(const std::string &prefix){
+    master = true;
+    borrowed = true;
+    dataPage.init(prefix, 0, false, false);
+    if (!dataPage){return;}
+    dataAccX = Util::RelAccX(dataPage.mapped);
+    if (dataAccX.isExit()){
+      dataPage.close();
+      return;
+    }
+    fieldAccess();
+  }
+
+  /// Claims a free record on a borrowed page, returning its index or INVALID_RECORD_INDEX.
+  /// The given status flags are set together with COMM_STATUS_ACTIVE.
+  size_t Comms::claimRecord(uint8_t flags){
+    if (!dataPage){return INVALID_RECORD_INDEX;}
+    size_t reqCount = dataAccX.getRCount();
+    size_t prevIndex = index;
+    for (size_t i = 0; i < reqCount; ++i){
+      if (getStatus(i) != COMM_STATUS_INVALID){continue;}
+      IPC::semGuard G(&sem);
+      if (getStatus(i) != COMM_STATUS_INVALID){continue;}
+      index = i;
+      nullFields();
+      setStatus(COMM_STATUS_ACTIVE | defaultCommFlags | flags, i);
+      index = prevIndex;
+      return i;
+    }
+    return INVALID_RECORD_INDEX;
+  }
+
   void Comms::reload(const std::string & prefix, size_t baseSize, bool _master, bool reIssue){
     master = _master;
     if (!currentSize){currentSize = baseSize;}
@@ -182,13 +217,7 @@ namespace Comms{
     Comms::reload(COMMS_STATISTICS, COMMS_STATISTICS_INITSIZE, _master, reIssue);
   }
 
-  std::string Sessions::getSessId() const{return sessId.string(index);}
-  std::string Sessions::getSessId(size_t idx) const{return (master ? sessId.string(idx) : 0);}
-  void Sessions::setSessId(std::string _sid){sessId.set(_sid, index);}
-  void Sessions::setSessId(std::string _sid, size_t idx){
-    if (!master){return;}
-    sessId.set(_sid, idx);
-  }
+  void Sessions::borrow(){Comms::borrow(COMMS_STATISTICS);}
 
   bool Sessions::sessIdExists(std::string _sid){
     for (size_t i = 0; i < recordCount(); i++){
@@ -205,19 +234,16 @@ namespace Comms{
   void Sessions::addFields(){
     Connections::addFields();
     dataAccX.addField("tags", RAX_STRING, 512);
-    dataAccX.addField("sessid", RAX_STRING, 80);
   }
 
   void Sessions::nullFields(){
     Connections::nullFields();
-    setSessId("");
     setTags("");
   }
 
   void Sessions::fieldAccess(){
     Connections::fieldAccess();
     tags = dataAccX.getFieldAccX("tags");
-    sessId = dataAccX.getFieldAccX("sessid");
   }
 
   std::string Sessions::getTags() const{return tags.string(index);}
@@ -298,7 +324,17 @@ namespace Comms{
 
 
 
+  Connections::Connections() : Comms(){hosted = false;}
+
   void Connections::reload(const std::string & sessId, bool _master, bool reIssue){
+    if (hosted){
+      // Switching over from the session host's connection table
+      if (dataPage){unload();}
+      sem.close();
+      dataPage.close();
+      index = INVALID_RECORD_INDEX;
+      hosted = false;
+    }
     // Open SEM_SESSION
     if(!sem){
       char semName[NAME_BUFFER_SIZE];
@@ -311,9 +347,83 @@ namespace Comms{
     Comms::reload(userPageName, COMMS_SESSIONS_INITSIZE, _master, reIssue);
   }
 
+  /// Opens the given shard of the session host's connection table. The session host is its master.
+  void Connections::reloadShard(size_t shardIdx, bool _master, bool reIssue){
+    // A connection always claims a new record, as its session (and so its shard) may have changed
+    if (!_master && dataPage){unload();}
+    char name[NAME_BUFFER_SIZE];
+    snprintf(name, NAME_BUFFER_SIZE, SEM_SESSCONN, shardIdx);
+    sem.close();
+    sem.open(name, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    if (!sem){return;}
+    snprintf(name, NAME_BUFFER_SIZE, COMMS_SESSCONN, shardIdx);
+    index = INVALID_RECORD_INDEX;
+    hosted = true;
+    Comms::reload(name, COMMS_SESSCONN_INITSIZE, _master, reIssue);
+  }
+
+  /// Returns the shard of the session host's connection table holding the connections of the
+  /// given session. All connections of a session are always in the same shard.
+  size_t Connections::sessionShard(const std::string &sessId){
+    size_t sum = 0;
+    for (size_t i = 0; i < sessId.size(); ++i){sum += (uint8_t)sessId[i];}
+    return sum % COMMS_SESSCONN_SHARDS;
+  }
+
+  /// Claims a record for this connection on the session host's connection table, requests the
+  /// session from the host if needed, and waits until the host admits or rejects the connection.
+  /// Rejected connections keep their record, so that getExit() reports them.
+  /// Returns false if the session host went away or has no room, in which case nothing was claimed.
+  bool Connections::hostedReload(const std::string &streamName, const std::string &ip, const std::string &tkn,
+                                 const std::string &protocol, const std::string &reqUrl, bool reIssue){
+    reloadShard(sessionShard(sessionId), false, reIssue);
+    if (!dataPage || index == INVALID_RECORD_INDEX){return false;}
+    setStatus(getStatus() | COMM_STATUS_WAITING);
+    setConnector(protocol);
+    setHost(ip);
+    setStream(streamName);
+    // The session only needs to be requested if it has no admitted connections yet
+    bool known = false;
+    size_t reqCount = dataAccX.getRCount();
+    for (size_t i = 0; i < reqCount && !known; ++i){
+      uint8_t s = status.uint(i);
+      if (i == index || !(s & COMM_STATUS_ACTIVE) || (s & (COMM_STATUS_WAITING | COMM_STATUS_DISCONNECT | COMM_STATUS_REQDISCONNECT))){
+        continue;
+      }
+      known = (sessId.string(i) == sessionId);
+    }
+    // The host picks the record up as soon as the session ID is set, so it must be written last
+    __sync_synchronize();
+    setSessId(sessionId);
+
+    uint64_t waitStart = Util::bootMS();
+    uint64_t lastRequest = 0;
+    while ((getStatus() & COMM_STATUS_WAITING) && !(getStatus() & COMM_STATUS_REQDISCONNECT)){
+      uint64_t now = Util::bootMS();
+      // Request the session if it is new, or if it did not admit us within a second after all
+      if ((!known || now - waitStart >= 1000) && (!lastRequest || now - lastRequest >= 1000)){
+        if (lastRequest && !SessionRequests::hostActive()){
+          WARN_MSG("Session host went away while starting session %s", sessionId.c_str());
+          unload();
+          return false;
+        }
+        SessionRequests sessReq;
+        if (sessReq.request(sessionId, streamName, ip, tkn, protocol, reqUrl)){
+          VERYHIGH_MSG("Requested session %s from session host", sessionId.c_str());
+        }else{
+          WARN_MSG("Could not request session %s from session host, retrying", sessionId.c_str());
+        }
+        lastRequest = now;
+      }
+      Util::sleep(20);
+    }
+    return true;
+  }
+
   /// \brief Claims a spot on the connections page for the input/output which calls this function
-  ///        Starts the MistSession binary for each session, which handles the statistics
-  ///         and the USER_NEW and USER_END triggers
+  ///        Sessions are handled by the session host if it is running, and its connection table is
+  ///        used. Otherwise the MistSession binary is started for each session. Either handles the
+  ///        statistics and the USER_NEW and USER_END triggers
   /// \param streamName: Name of the stream the input is providing or an output is making available to viewers
   /// \param ip: IP address of the viewer which wants to access streamName. For inputs this value can be set to any value
   /// \param tkn: Session token given by the player or randomly generated
@@ -351,9 +461,13 @@ namespace Comms{
         sessionId = generateSession(streamName, ip, tkn, protocol, sessMode);
       }
     }
+    // Connections of sessions handled by the session host go on its connection table
+    if (!_master && SessionRequests::hostActive()){
+      if (hostedReload(streamName, ip, tkn, protocol, reqUrl, reIssue)){return;}
+    }
     char userPageName[NAME_BUFFER_SIZE];
     snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, sessionId.c_str());
-    // Check if the page exists, if not, spawn new session process
+    // Without a session host, check if the page exists, if not, spawn new session process
     if (!_master){
       dataPage.init(userPageName, 0, false, false);
       if (!dataPage){
@@ -419,6 +533,11 @@ namespace Comms{
   }
 
   bool Connections::getExit(){
+    if (hosted){
+      if (master || index == INVALID_RECORD_INDEX){return false;}
+      uint8_t s = getStatus();
+      return (s & COMM_STATUS_WAITING) && (s & COMM_STATUS_REQDISCONNECT);
+    }
     return dataAccX.isExit();
   }
 
@@ -441,6 +560,9 @@ namespace Comms{
     dataAccX.addField("pktcount", RAX_64UINT);
     dataAccX.addField("pktloss", RAX_64UINT);
     dataAccX.addField("pktretrans", RAX_64UINT);
+    dataAccX.addField("rtt", RAX_64UINT);
+    dataAccX.addField("bufms", RAX_64UINT);
+    dataAccX.addField("sessid", RAX_STRING, 80);
   }
 
   void Connections::nullFields(){
@@ -456,6 +578,9 @@ namespace Comms{
     setPacketCount(0);
     setPacketLostCount(0);
     setPacketRetransmitCount(0);
+    setRoundTripTime(0);
+    setBufferFill(0);
+    setSessId("");
   }
 
   void Connections::fieldAccess(){
@@ -471,6 +596,18 @@ namespace Comms{
     pktcount = dataAccX.getFieldAccX("pktcount");
     pktloss = dataAccX.getFieldAccX("pktloss");
     pktretrans = dataAccX.getFieldAccX("pktretrans");
+    rtt = dataAccX.getFieldAccX("rtt");
+    bufms = dataAccX.getFieldAccX("bufms");
+    sessId = dataAccX.getFieldAccX("sessid");
+  }
+
+  /// Session ID of the connection. Only set for connections on the session host's connection table.
+  std::string Connections::getSessId() const{return sessId.string(index);}
+  std::string Connections::getSessId(size_t idx) const{return (master ? sessId.string(idx) : "");}
+  void Connections::setSessId(std::string _sid){sessId.set(_sid, index);}
+  void Connections::setSessId(std::string _sid, size_t idx){
+    if (!master){return;}
+    sessId.set(_sid, idx);
   }
 
   uint64_t Connections::getNow() const{return now.uint(index);}
@@ -585,6 +722,24 @@ namespace Comms{
     pktretrans.set(_retrans, idx);
   }
 
+  /// Round trip time of the connection in milliseconds, for transports that measure it (e.g. SRT).
+  uint64_t Connections::getRoundTripTime() const{return rtt.uint(index);}
+  uint64_t Connections::getRoundTripTime(size_t idx) const{return (master ? rtt.uint(idx) : 0);}
+  void Connections::setRoundTripTime(uint64_t _rtt){rtt.set(_rtt, index);}
+  void Connections::setRoundTripTime(uint64_t _rtt, size_t idx){
+    if (!master){return;}
+    rtt.set(_rtt, idx);
+  }
+
+  /// Amount of data waiting in the transport buffer of the connection, in milliseconds.
+  uint64_t Connections::getBufferFill() const{return bufms.uint(index);}
+  uint64_t Connections::getBufferFill(size_t idx) const{return (master ? bufms.uint(idx) : 0);}
+  void Connections::setBufferFill(uint64_t _bufms){bufms.set(_bufms, index);}
+  void Connections::setBufferFill(uint64_t _bufms, size_t idx){
+    if (!master){return;}
+    bufms.set(_bufms, idx);
+  }
+
   /// \brief Generates a session ID which is unique per viewer
   /// \return generated session ID as string
   std::string Connections::generateSession(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & connector, uint64_t sessionMode){
@@ -615,4 +770,111 @@ namespace Comms{
     VERYHIGH_MSG("%s", debugMsg.c_str());
     return Secure::sha256(concat.c_str(), concat.length());
   }
+
+  SessionRequests::SessionRequests() : Comms(){sem.open(SEM_SESSREQ, O_CREAT | O_RDWR, ACCESSPERMS, 1);}
+
+  void SessionRequests::reload(bool _master, bool reIssue){
+    Comms::reload(COMMS_SESSREQ, COMMS_SESSREQ_INITSIZE, _master, reIssue);
+  }
+
+  /// Returns the PID of the session host owning the request page, or 0 if there is none.
+  /// The host marks its own record on the page with COMM_STATUS_SOURCE.
+  pid_t SessionRequests::hostPid(){
+    IPC::sharedPage reqPage(COMMS_SESSREQ, 0, false, false);
+    if (!reqPage.mapped){return 0;}
+    Util::RelAccX reqAccX(reqPage.mapped, false);
+    if (!reqAccX.isReady() || reqAccX.isExit()){return 0;}
+    Util::FieldAccX reqStatus = reqAccX.getFieldAccX("status");
+    Util::FieldAccX reqPid = reqAccX.getFieldAccX("pid");
+    size_t reqCount = reqAccX.getRCount();
+    for (size_t i = 0; i < reqCount; ++i){
+      if (reqStatus.uint(i) & COMM_STATUS_SOURCE){return reqPid.uint(i);}
+    }
+    return 0;
+  }
+
+  /// Returns true if a session host is currently accepting session requests.
+  bool SessionRequests::hostActive(){
+    pid_t host = hostPid();
+    return host > 1 && Util::Procs::isRunning(host);
+  }
+
+  /// Stops accepting new session requests.
+  void SessionRequests::setExit(){
+    if (!master){return;}
+    dataAccX.setExit();
+  }
+
+  /// Queues a session for the session host. Returns false if no request could be placed.
+  /// The record belongs to the host as soon as the session ID is written, so it is released here.
+  bool SessionRequests::request(const std::string &_sessId, const std::string &_stream, const std::string &_host,
+                                const std::string &_tkn, const std::string &_protocol, const std::string &_reqUrl){
+    reload();
+    if (!*this){return false;}
+    // The host must never kill the requesting process when it cleans up this page
+    setStatus(getStatus() | COMM_STATUS_NOKILL);
+    std::string binHost = _host.substr(0, 16);
+    if (binHost.size() < 16){binHost.append(16 - binHost.size(), '\000');}
+    setStream(_stream);
+    setHost(binHost);
+    setTkn(_tkn);
+    setProtocol(_protocol);
+    setReqUrl(_reqUrl);
+    // The host starts reading as soon as the session ID is set, so it must be written last
+    __sync_synchronize();
+    setSessId(_sessId);
+    index = INVALID_RECORD_INDEX;
+    return true;
+  }
+
+  void SessionRequests::addFields(){
+    Comms::addFields();
+    dataAccX.addField("sessid", RAX_STRING, 80);
+    dataAccX.addField("stream", RAX_STRING, 100);
+    dataAccX.addField("host", RAX_RAW, 16);
+    dataAccX.addField("tkn", RAX_STRING, 256);
+    dataAccX.addField("protocol", RAX_STRING, 32);
+    dataAccX.addField("requrl", RAX_STRING, 1024);
+  }
+
+  void SessionRequests::nullFields(){
+    Comms::nullFields();
+    setStream("");
+    setHost(std::string(16, '\0'));
+    setTkn("");
+    setProtocol("");
+    setReqUrl("");
+    setSessId("");
+  }
+
+  void SessionRequests::fieldAccess(){
+    Comms::fieldAccess();
+    sessId = dataAccX.getFieldAccX("sessid");
+    stream = dataAccX.getFieldAccX("stream");
+    host = dataAccX.getFieldAccX("host");
+    tkn = dataAccX.getFieldAccX("tkn");
+    protocol = dataAccX.getFieldAccX("protocol");
+    reqUrl = dataAccX.getFieldAccX("requrl");
+  }
+
+  std::string SessionRequests::getSessId(size_t idx) const{return (master ? sessId.string(idx) : "");}
+  void SessionRequests::setSessId(const std::string &_sid){sessId.set(_sid, index);}
+
+  std::string SessionRequests::getStream(size_t idx) const{return (master ? stream.string(idx) : "");}
+  void SessionRequests::setStream(const std::string &_stream){stream.set(_stream, index);}
+
+  std::string SessionRequests::getHost(size_t idx) const{
+    if (!master){return std::string((size_t)16, (char)'\000');}
+    return std::string(host.ptr(idx), 16);
+  }
+  void SessionRequests::setHost(const std::string &_host){host.set(_host, index);}
+
+  std::string SessionRequests::getTkn(size_t idx) const{return (master ? tkn.string(idx) : "");}
+  void SessionRequests::setTkn(const std::string &_tkn){tkn.set(_tkn, index);}
+
+  std::string SessionRequests::getProtocol(size_t idx) const{return (master ? protocol.string(idx) : "");}
+  void SessionRequests::setProtocol(const std::string &_protocol){protocol.set(_protocol, index);}
+
+  std::string SessionRequests::getReqUrl(size_t idx) const{return (master ? reqUrl.string(idx) : "");}
+  void SessionRequests::setReqUrl(const std::string &_reqUrl){reqUrl.set(_reqUrl, index);}
 }// namespace Comms
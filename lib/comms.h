@@ -53,10 +53,13 @@ namespace Comms{
     void setPid(uint32_t _pid, size_t idx);
     void finishAll();
     void setMaster(bool _master);
+    void borrow(const std::string &prefix);
+    size_t claimRecord(uint8_t flags = 0);
     const std::string &pageName() const{return dataPage.name;}
 
   protected:
     bool master;
+    bool borrowed;
     uint64_t index;
     size_t currentSize;
     IPC::semaphore sem;
@@ -68,8 +71,11 @@ namespace Comms{
 
   class Connections : public Comms{
   public:
+    Connections();
     void reload(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & protocol, const std::string & reqUrl, bool _master = false, bool reIssue = false);
     void reload(const std::string & sessId, bool _master = false, bool reIssue = false);
+    void reloadShard(size_t shardIdx, bool _master = false, bool reIssue = false);
+    static size_t sessionShard(const std::string &sessId);
     void unload();
     operator bool() const{return dataPage.mapped && (master || index != INVALID_RECORD_INDEX);}
     std::string generateSession(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & connector, uint64_t sessionMode);
@@ -85,6 +91,11 @@ namespace Comms{
 
     const std::string & getTkn() const{return initialTkn;}
 
+    std::string getSessId() const;
+    std::string getSessId(size_t idx) const;
+    void setSessId(std::string _sid);
+    void setSessId(std::string _sid, size_t idx);
+
     uint64_t getNow() const;
     uint64_t getNow(size_t idx) const;
     void setNow(uint64_t _now);
@@ -141,7 +152,20 @@ namespace Comms{
     void setPacketRetransmitCount(uint64_t _retransmit);
     void setPacketRetransmitCount(uint64_t _retransmit, size_t idx);
 
+    uint64_t getRoundTripTime() const;
+    uint64_t getRoundTripTime(size_t idx) const;
+    void setRoundTripTime(uint64_t _rtt);
+    void setRoundTripTime(uint64_t _rtt, size_t idx);
+
+    uint64_t getBufferFill() const;
+    uint64_t getBufferFill(size_t idx) const;
+    void setBufferFill(uint64_t _bufms);
+    void setBufferFill(uint64_t _bufms, size_t idx);
+
   protected:
+    bool hostedReload(const std::string &streamName, const std::string &ip, const std::string &tkn,
+                      const std::string &protocol, const std::string &reqUrl, bool reIssue);
+    bool hosted; ///< True if this connection is on the session host's connection table
     Util::FieldAccX now;
     Util::FieldAccX time;
     Util::FieldAccX lastSecond;
@@ -155,6 +179,8 @@ namespace Comms{
     Util::FieldAccX pktcount;
     Util::FieldAccX pktloss;
     Util::FieldAccX pktretrans;
+    Util::FieldAccX rtt;
+    Util::FieldAccX bufms;
   };
 
   class Users : public Comms{
@@ -190,10 +216,7 @@ namespace Comms{
     public:
       Sessions();
       void reload(bool _master = false, bool reIssue = false);
-      std::string getSessId() const;
-      std::string getSessId(size_t idx) const;
-      void setSessId(std::string _sid);
-      void setSessId(std::string _sid, size_t idx);
+      void borrow();
       bool sessIdExists(std::string _sid);
       virtual void addFields();
       virtual void nullFields();
@@ -204,4 +227,41 @@ namespace Comms{
       void setTags(std::string _sid);
       void setTags(std::string _sid, size_t idx);
   };
+
+  /// Queue of sessions waiting to be started by the session host (MistSession --host).
+  /// Outputs claim a record and fill it; the host owns the page and consumes the records.
+  class SessionRequests : public Comms{
+  public:
+    SessionRequests();
+    void reload(bool _master = false, bool reIssue = false);
+    static pid_t hostPid();
+    static bool hostActive();
+    void setExit();
+    bool request(const std::string &_sessId, const std::string &_stream, const std::string &_host,
+                 const std::string &_tkn, const std::string &_protocol, const std::string &_reqUrl);
+    virtual void addFields();
+    virtual void nullFields();
+    virtual void fieldAccess();
+
+    std::string getSessId(size_t idx) const;
+    void setSessId(const std::string &_sid);
+    std::string getStream(size_t idx) const;
+    void setStream(const std::string &_stream);
+    std::string getHost(size_t idx) const;
+    void setHost(const std::string &_host);
+    std::string getTkn(size_t idx) const;
+    void setTkn(const std::string &_tkn);
+    std::string getProtocol(size_t idx) const;
+    void setProtocol(const std::string &_protocol);
+    std::string getReqUrl(size_t idx) const;
+    void setReqUrl(const std::string &_reqUrl);
+
+  protected:
+    Util::FieldAccX sessId;
+    Util::FieldAccX stream;
+    Util::FieldAccX host;
+    Util::FieldAccX tkn;
+    Util::FieldAccX protocol;
+    Util::FieldAccX reqUrl;
+  };
 }// namespace Comms
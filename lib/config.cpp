@@ -9,6 +9,8 @@
 #include <signal.h>
 #include <string.h>
 #include "procs.h"
+#include "shared_memory.h"
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -17,6 +19,8 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <iostream>
+#include <map>
+#include <poll.h>
 #include <pwd.h>
 #include <stdarg.h> // for va_list
 #include <stdlib.h>
@@ -464,14 +468,143 @@ int Util::Config::threadServer(Socket::Server &server_socket, int (*callback)(So
   return 0;
 }
 
+/// Idle pre-forked children ("zygotes") of forkServer, waiting for a connection to handle.
+/// Maps their PID to our end of the Unix socket their connection will be passed over.
+static std::map<pid_t, int> zygotes;
+
+/// Closes our end of the control socket of an idle zygote, which makes it exit.
+static void dropZygote(std::map<pid_t, int>::iterator it){
+  close(it->second);
+  zygotes.erase(it);
+}
+
+/// Forks a new zygote. Returns -1 in the parent, or the received connection's socket in the child.
+/// Returns -2 in a child that was told to exit before receiving a connection.
+static int spawnZygote(Socket::Server &server_socket){
+  int ctrl[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, ctrl)){
+    WARN_MSG("Could not create zygote control socket: %s", strerror(errno));
+    return -1;
+  }
+  pid_t myid = fork();
+  if (myid == 0){
+    close(ctrl[0]);
+    server_socket.drop();
+    for (std::map<pid_t, int>::iterator it = zygotes.begin(); it != zygotes.end(); ++it){close(it->second);}
+    zygotes.clear();
+    int fd = -1;
+    do{
+      errno = 0;
+      fd = Socket::recvFD(ctrl[1]);
+    }while (fd < 0 && errno == EINTR && Util::Config::is_active);
+    close(ctrl[1]);
+    return fd < 0 ? -2 : fd;
+  }
+  close(ctrl[1]);
+  if (myid < 0){
+    WARN_MSG("Could not fork zygote: %s", strerror(errno));
+    close(ctrl[0]);
+    return -1;
+  }
+  HIGH_MSG("Forked new zygote %i", (int)myid);
+  zygotes[myid] = ctrl[0];
+  return -1;
+}
+
+/// Accepts connections on server_socket and forks a child process per connection, which then calls
+/// callback with the connection. If a pool high watermark is configured ("poolmax"), a pool of
+/// idle pre-forked children is kept ready, and accepted connections are passed to one of those
+/// instead, taking the fork out of the connection setup path. The pool grows towards the high
+/// watermark under load, and shrinks back to the low watermark ("poolmin") when idle.
 int Util::Config::forkServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &)){
   Util::Procs::socketList.insert(server_socket.getSocket());
+  uint64_t poolMin = hasOption("poolmin") ? getInteger("poolmin") : 0;
+  uint64_t poolMax = hasOption("poolmax") ? getInteger("poolmax") : 0;
+  if (poolMax && poolMax < poolMin){poolMax = poolMin;}
+  uint64_t poolTarget = poolMin;
+  uint64_t handoffs = 0, misses = 0;
+  uint64_t lastPoolChange = Util::bootMS(), lastPoolStat = 0;
+  std::string connector = getString("cmd");
+  if (connector.rfind('/') != std::string::npos){connector.erase(0, connector.rfind('/') + 1);}
   while (is_active && server_socket.connected()){
+    if (poolMax){
+      uint64_t now = Util::bootMS();
+      // Idle zygotes never write to their control socket; if it becomes readable, they are gone.
+      std::map<pid_t, int>::iterator it = zygotes.begin();
+      while (it != zygotes.end()){
+        struct pollfd pfd;
+        pfd.fd = it->second;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) > 0){
+          WARN_MSG("Zygote %i exited while idle", (int)it->first);
+          dropZygote(it++);
+        }else{
+          ++it;
+        }
+      }
+      if (poolTarget > poolMin && now - lastPoolChange > 5000){
+        --poolTarget;
+        lastPoolChange = now;
+      }
+      while (zygotes.size() > poolTarget){dropZygote(zygotes.begin());}
+      while (is_active && zygotes.size() < poolTarget){
+        size_t prevSize = zygotes.size();
+        int fd = spawnZygote(server_socket);
+        if (fd == -2){return 0;}
+        if (fd >= 0){
+          Socket::Connection S(fd);
+          return callback(S);
+        }
+        if (zygotes.size() == prevSize){break;}
+      }
+      // Only report when running under a controller, as waiting for one would stall accepting
+      if (now - lastPoolStat > 5000 && IPC::sharedPage(SHM_GLOBAL_CONF, 0, false, false).mapped){
+        lastPoolStat = now;
+        JSON::Value APIcall;
+        JSON::Value &zStat = APIcall["zygote_stat"];
+        zStat["connector"] = connector;
+        zStat["port"] = Util::listenPort;
+        zStat["idle"] = (uint64_t)zygotes.size();
+        zStat["target"] = poolTarget;
+        zStat["min"] = poolMin;
+        zStat["max"] = poolMax;
+        zStat["handoffs"] = handoffs;
+        zStat["misses"] = misses;
+        Util::sendUDPApi(APIcall);
+      }
+      // Wake up at least once a second to maintain the pool, even if no connections come in
+      struct pollfd pfd;
+      pfd.fd = server_socket.getSocket();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 1000) < 1){continue;}
+    }
     Socket::Connection S = server_socket.accept();
     if (S.connected()){// check if the new connection is valid
+      if (poolMax){
+        bool handedOff = false;
+        while (!handedOff && zygotes.size()){
+          std::map<pid_t, int>::iterator it = zygotes.begin();
+          handedOff = Socket::sendFD(it->second, S.getSocket());
+          if (handedOff){HIGH_MSG("Passed socket %d to zygote %i", S.getSocket(), (int)it->first);}
+          dropZygote(it);
+        }
+        // Grow the pool under load, whether or not it kept up
+        if (poolTarget < poolMax){++poolTarget;}
+        lastPoolChange = Util::bootMS();
+        if (handedOff){
+          ++handoffs;
+          S.drop();
+          continue;
+        }
+        ++misses;
+      }
       pid_t myid = fork();
       if (myid == 0){// if new child, start MAINHANDLER
         server_socket.drop();
+        for (std::map<pid_t, int>::iterator it = zygotes.begin(); it != zygotes.end(); ++it){close(it->second);}
+        zygotes.clear();
         return callback(S);
       }else{// otherwise, do nothing or output debugging text
         HIGH_MSG("Forked new process %i for socket %i", (int)myid, S.getSocket());
@@ -481,6 +614,7 @@ int Util::Config::forkServer(Socket::Server &server_socket, int (*callback)(Sock
       Util::sleep(10); // sleep 10ms
     }
   }
+  while (zygotes.size()){dropZygote(zygotes.begin());}
   Util::Procs::socketList.erase(server_socket.getSocket());
   if (!is_restarting){server_socket.close();}
   return 0;
@@ -707,6 +841,22 @@ void Util::Config::addConnectorOptions(int port, JSON::Value &capabilities){
   capabilities["optional"]["interface"]["short"] = "i";
   capabilities["optional"]["interface"]["type"] = "str";
 
+  capabilities["optional"]["poolmin"]["name"] = "Process pool low watermark";
+  capabilities["optional"]["poolmin"]["help"] =
+      "Minimum amount of idle pre-forked processes to keep ready for new connections";
+  capabilities["optional"]["poolmin"]["option"] = "--pool-min";
+  capabilities["optional"]["poolmin"]["short"] = "o";
+  capabilities["optional"]["poolmin"]["type"] = "uint";
+  capabilities["optional"]["poolmin"]["default"] = (int64_t)0;
+
+  capabilities["optional"]["poolmax"]["name"] = "Process pool high watermark";
+  capabilities["optional"]["poolmax"]["help"] = "Maximum amount of idle pre-forked processes to "
+                                                "keep ready under load. Zero disables the pool";
+  capabilities["optional"]["poolmax"]["option"] = "--pool-max";
+  capabilities["optional"]["poolmax"]["short"] = "O";
+  capabilities["optional"]["poolmax"]["type"] = "uint";
+  capabilities["optional"]["poolmax"]["default"] = (int64_t)0;
+
   addBasicConnectorOptions(capabilities);
 }// addConnectorOptions
 
@@ -904,6 +1054,12 @@ void Util::Config::addStandardPushCapabilities(JSON::Value &cap){
   pp["append"]["format"] = "set_or_unset";
   pp["append"]["sort"] = "bf";
 
+  pp["pipeline"]["name"] = "Pipelined writing";
+  pp["pipeline"]["help"] = "If set, file recordings are written from a separate thread through a buffer of this many KiB (4096 when left empty), so slow storage does not hold up muxing. The buffer size is capped by the system's maximum pipe size.";
+  pp["pipeline"]["type"] = "int";
+  pp["pipeline"]["unit"] = "KiB";
+  pp["pipeline"]["sort"] = "bfb";
+
 }
 
 /// Sets the current process' running user
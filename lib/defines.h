@@ -177,14 +177,14 @@ static inline void show_stackframe(){}
 #define RAW_FRAME_COUNT 30
 
 /// \TODO These values are hardcoded for now, but the dtsc_sizing_test binary can calculate them accurately.
-#define META_META_OFFSET 138
-#define META_META_RECORDSIZE 548
+#define META_META_OFFSET 161
+#define META_META_RECORDSIZE 564
 
 #define META_TRACK_OFFSET 148
 #define META_TRACK_RECORDSIZE 1893
 
 #define TRACK_TRACK_OFFSET 193
-#define TRACK_TRACK_RECORDSIZE 1049060
+#define TRACK_TRACK_RECORDSIZE 1049077
 
 #define TRACK_FRAGMENT_OFFSET 68
 #define TRACK_FRAGMENT_RECORDSIZE 14
@@ -195,8 +195,8 @@ static inline void show_stackframe(){}
 #define TRACK_PART_OFFSET 60
 #define TRACK_PART_RECORDSIZE 8
 
-#define TRACK_PAGE_OFFSET 100
-#define TRACK_PAGE_RECORDSIZE 36
+#define TRACK_PAGE_OFFSET 108
+#define TRACK_PAGE_RECORDSIZE 37
 
 #define COMMS_STATISTICS "/MstStat"
 #define COMMS_STATISTICS_INITSIZE 16 * 1024 * 1024
@@ -207,6 +207,13 @@ static inline void show_stackframe(){}
 #define COMMS_SESSIONS "/MstSession%s"
 #define COMMS_SESSIONS_INITSIZE 8 * 1024 * 1024
 
+#define COMMS_SESSREQ "/MstSessReq"
+#define COMMS_SESSREQ_INITSIZE 4 * 1024 * 1024
+
+#define COMMS_SESSCONN "/MstSessConn%zu" //%zu shard number
+#define COMMS_SESSCONN_INITSIZE 2 * 1024 * 1024
+#define COMMS_SESSCONN_SHARDS 16 // Connections of hosted sessions are spread over this many pages
+
 #define CUSTOM_VARIABLES_INITSIZE 64 * 1024
 
 #define EXTWRITERS "/MstExtWriters"
@@ -217,6 +224,15 @@ static inline void show_stackframe(){}
 #define SEM_USERS "/MstUser%s" //%s stream name
 
 #define SHM_TRACK_DATA "/MstData%s@%zu_%" PRIu32 //%s stream name, %zu track ID, %PRIu32 page #
+#define SHM_CMAF_HEADERS "/MstCMAF%s@%zu" //%s stream name, %zu track ID
+// The first slot of a CMAF header page is its header; its first 32 bits become non-zero once the
+// page has been removed, telling outputs that still have it mapped to let go of it.
+#define CMAF_HEADER_SLOTS 32
+#define CMAF_HEADER_SLOTSIZE 16384
+#define SHM_THUMBS "/MstThmb%s"  //%s stream name
+#define SHM_SPRITES "/MstSprt%s" //%s stream name
+#define THUMB_SLOTS 32
+#define THUMB_SLOTSIZE (512 * 1024)
 // End new meta
 
 #define INPUT_USER_INTERVAL 250
@@ -240,6 +256,8 @@ static inline void show_stackframe(){}
 #define SEM_TRACKLIST "/MstTRKS%s"  //%s stream name
 #define SEM_SESSION "/MstSess%s"
 #define SEM_SESSCACHE "/MstSessCacheLock"
+#define SEM_SESSREQ "/MstSReqLock"
+#define SEM_SESSCONN "/MstSConn%zu" //%zu shard number
 #define SESS_TIMEOUT 600 // Session timeout in seconds
 #define SHM_CAPA "/MstCapa"
 #define SHM_PROTO "/MstProt"
@@ -286,6 +304,8 @@ static inline void show_stackframe(){}
 #define COMM_STATUS_DISCONNECT 0x20
 #define COMM_STATUS_REQDISCONNECT 0x10
 #define COMM_STATUS_NOKILL 0x8
+#define COMM_STATUS_REQTRIGGER 0x4
+#define COMM_STATUS_WAITING 0x2 // Waiting to be admitted by the session host; rejected if REQDISCONNECT is set too
 #define COMM_STATUS_ACTIVE 0x1
 #define COMM_STATUS_INVALID 0x0
 #define SESS_BUNDLE_DEFAULT_VIEWER 14
@@ -214,7 +214,8 @@ namespace DTSC{
   /// If given a NULL pointer and a zero size, an empty packet is created.
   void Packet::genericFill(uint64_t packTime, int64_t packOffset, uint32_t packTrack, const char *packData,
                            size_t packDataSize, uint64_t packBytePos, bool isKeyframe){
-    null();
+    // keep our own buffer around for re-use; it is grown as needed by resize()
+    if (!master){null();}
     master = true;
     // time and trackID are part of the 20-byte header.
     // the container object adds 4 bytes (plus 2+namelen for each content, see below)
@@ -225,6 +226,7 @@ namespace DTSC{
     if (packData && packDataSize < 1){
       FAIL_MSG("Attempted to fill a packet with %zu bytes for timestamp %" PRIu64 ", track %" PRIu32 "!",
                packDataSize, packTime, packTrack);
+      null();
       return;
     }
     unsigned int sendLen =
@@ -1182,6 +1184,8 @@ namespace DTSC{
       stream.addField("bootmsoffset", RAX_64INT);
       stream.addField("utcoffset", RAX_64INT);
       stream.addField("minfragduration", RAX_64UINT);
+      stream.addField("liveedge", RAX_64UINT);
+      stream.addField("metaversion", RAX_64UINT);
       stream.setRCount(1);
       stream.addRecords(1);
 
@@ -1213,6 +1217,10 @@ namespace DTSC{
     streamBootMsOffsetField = stream.getFieldData("bootmsoffset");
     streamUTCOffsetField = stream.getFieldData("utcoffset");
     streamMinimumFragmentDurationField = stream.getFieldData("minfragduration");
+    streamLiveEdgeField = stream.getFieldData("liveedge");
+    streamMetaVersionField = stream.getFieldData("metaversion");
+    // Start from a unique value, so versions of a restarted stream never match those seen before
+    if (isMaster){stream.setInt(streamMetaVersionField, Util::getMicros());}
 
     trackValidField = trackList.getFieldData("valid");
     trackIdField = trackList.getFieldData("id");
@@ -1291,6 +1299,7 @@ namespace DTSC{
       stream.setInt("bootmsoffset", origStream.getInt("bootmsoffset"));
       stream.setInt("utcoffset", origStream.getInt("utcoffset"));
       stream.setInt("minfragduration", origStream.getInt("minfragduration"));
+      stream.setInt("liveedge", origStream.getInt("liveedge"));
       // Copy tracks
       Util::RelAccX origTracks(origStream.getPointer("tracks"), false);
       if (origTracks.isReady()){trackList.flowFrom(origTracks);}
@@ -1800,6 +1809,7 @@ namespace DTSC{
       Util::FieldAccX origPageAvailAccX = origPages.getFieldAccX("avail");
       Util::FieldAccX origPageFirsttimeAccX = origPages.getFieldAccX("firsttime");
       Util::FieldAccX origPageLastkeytimeAccX = origPages.getFieldAccX("lastkeytime");
+      Util::FieldAccX origPageOndiskAccX = origPages.getFieldAccX("ondisk");
 
       Util::FieldAccX pageFirstkeyAccX = t.pages.getFieldAccX("firstkey");
       Util::FieldAccX pageKeycountAccX = t.pages.getFieldAccX("keycount");
@@ -1808,6 +1818,7 @@ namespace DTSC{
       Util::FieldAccX pageAvailAccX = t.pages.getFieldAccX("avail");
       Util::FieldAccX pageFirsttimeAccX = t.pages.getFieldAccX("firsttime");
       Util::FieldAccX pageLastkeytimeAccX = t.pages.getFieldAccX("lastkeytime");
+      Util::FieldAccX pageOndiskAccX = t.pages.getFieldAccX("ondisk");
 
       size_t firstPage = origPages.getStartPos();
       size_t endPage = origPages.getEndPos();
@@ -1819,6 +1830,7 @@ namespace DTSC{
         pageAvailAccX.set(origPageAvailAccX.uint(i), i);
         pageFirsttimeAccX.set(origPageFirsttimeAccX.uint(i), i);
         pageLastkeytimeAccX.set(origPageLastkeytimeAccX.uint(i), i);
+        pageOndiskAccX.set(origPageOndiskAccX.uint(i), i);
       }
     }
     t.track.setReady();
@@ -1831,6 +1843,17 @@ namespace DTSC{
     return addTrack(fragCount, keyCount, partCount, pageCount, false);
   }
 
+  /// Removes the shared fragment header cache of a track, flagging it first so outputs that
+  /// still have it mapped know to let go of it.
+  static void removeHeaderCache(const std::string &streamName, size_t trackIdx){
+    char cachePageName[NAME_BUFFER_SIZE];
+    snprintf(cachePageName, NAME_BUFFER_SIZE, SHM_CMAF_HEADERS, streamName.c_str(), trackIdx);
+    IPC::sharedPage cachePage(cachePageName, 0, false, false);
+    if (!cachePage){return;}
+    *(volatile uint32_t *)cachePage.mapped = 1;
+    cachePage.master = true;
+  }
+
   /// Adds a track to the metadata structure.
   /// To be called from the various inputs/outputs whenever they want to add a track.
   size_t Meta::addTrack(size_t fragCount, size_t keyCount, size_t partCount, size_t pageCount, bool setValid, size_t frameSize){
@@ -1888,6 +1911,15 @@ namespace DTSC{
     }
     initializeTrack(t, fragCount, keyCount, partCount, pageCount, frameSize);
     t.track.setReady();
+    if (!isMemBuf){
+      // Start with an empty shared fragment header cache, even if an earlier track with this
+      // number left one behind; outputs only ever open it.
+      removeHeaderCache(streamName, tNumber);
+      char cachePageName[NAME_BUFFER_SIZE];
+      snprintf(cachePageName, NAME_BUFFER_SIZE, SHM_CMAF_HEADERS, streamName.c_str(), tNumber);
+      IPC::sharedPage cachePage(cachePageName, CMAF_HEADER_SLOTS * CMAF_HEADER_SLOTSIZE, true, false);
+      cachePage.master = false;
+    }
     trackList.setString(trackPageField, pageName, tNumber);
     trackList.setInt(trackPidField, getpid(), tNumber);
     trackList.setInt(trackSourceTidField, INVALID_TRACK_ID, tNumber);
@@ -2056,6 +2088,7 @@ namespace DTSC{
     t.pages.addField("avail", RAX_32UINT);
     t.pages.addField("firsttime", RAX_64UINT);
     t.pages.addField("lastkeytime", RAX_64UINT);
+    t.pages.addField("ondisk", RAX_UINT);
     t.pages.setRCount(pageCount);
     t.pages.setReady();
   }
@@ -2087,6 +2120,14 @@ namespace DTSC{
     return std::string(src + 2, size);
   }
 
+  /// Points data at the init data of the given track, without copying it.
+  void Meta::getInit(size_t idx, char *&data, size_t &len) const{
+    const DTSC::Track &t = tracks.at(idx);
+    char *src = t.track.getPointer(t.trackInitField);
+    len = Bit::btohs(src);
+    data = src + 2;
+  }
+
   void Meta::setSource(const std::string &src){stream.setString(streamSourceField, src);}
   std::string Meta::getSource() const{return stream.getPointer(streamSourceField);}
 
@@ -2122,6 +2163,7 @@ namespace DTSC{
 
   void Meta::setChannels(size_t trackIdx, uint16_t channels){
     DTSC::Track &t = tracks.at(trackIdx);
+    if (t.track.getInt(t.trackChannelsField) != channels){bumpMetaVersion();}
     t.track.setInt(t.trackChannelsField, channels);
   }
   uint16_t Meta::getChannels(size_t trackIdx) const{
@@ -2131,6 +2173,7 @@ namespace DTSC{
 
   void Meta::setWidth(size_t trackIdx, uint32_t width){
     DTSC::Track &t = tracks.at(trackIdx);
+    if (t.track.getInt(t.trackWidthField) != width){bumpMetaVersion();}
     t.track.setInt(t.trackWidthField, width);
   }
   uint32_t Meta::getWidth(size_t trackIdx) const{
@@ -2140,6 +2183,7 @@ namespace DTSC{
 
   void Meta::setHeight(size_t trackIdx, uint32_t height){
     DTSC::Track &t = tracks.at(trackIdx);
+    if (t.track.getInt(t.trackHeightField) != height){bumpMetaVersion();}
     t.track.setInt(t.trackHeightField, height);
   }
   uint32_t Meta::getHeight(size_t trackIdx) const{
@@ -2149,6 +2193,7 @@ namespace DTSC{
 
   void Meta::setRate(size_t trackIdx, uint32_t rate){
     DTSC::Track &t = tracks.at(trackIdx);
+    if (t.track.getInt(t.trackRateField) != rate){bumpMetaVersion();}
     t.track.setInt(t.trackRateField, rate);
   }
   uint32_t Meta::getRate(size_t trackIdx) const{
@@ -2166,6 +2211,7 @@ namespace DTSC{
   }
 
   void Meta::setType(size_t trackIdx, const std::string &type){
+    if (getType(trackIdx) != type){bumpMetaVersion();}
     trackList.setString(trackTypeField, type, trackIdx);
     DTSC::Track &t = tracks.at(trackIdx);
     t.track.setString(t.trackTypeField, type);
@@ -2175,6 +2221,7 @@ namespace DTSC{
   }
 
   void Meta::setCodec(size_t trackIdx, const std::string &codec){
+    if (getCodec(trackIdx) != codec){bumpMetaVersion();}
     trackList.setString(trackCodecField, codec, trackIdx);
     DTSC::Track &t = tracks.at(trackIdx);
     t.track.setString(t.trackCodecField, codec);
@@ -2185,6 +2232,7 @@ namespace DTSC{
 
   void Meta::setLang(size_t trackIdx, const std::string &lang){
     DTSC::Track &t = tracks.at(trackIdx);
+    if (getLang(trackIdx) != lang){bumpMetaVersion();}
     t.track.setString(t.trackLangField, lang);
   }
   std::string Meta::getLang(size_t trackIdx) const{
@@ -2284,6 +2332,7 @@ namespace DTSC{
   }
 
   void Meta::setEncryption(size_t trackIdx, const std::string &encryption){
+    if (getEncryption(trackIdx) != encryption){bumpMetaVersion();}
     trackList.setString(trackEncryptionField, encryption, trackIdx);
   }
   std::string Meta::getEncryption(size_t trackIdx) const{
@@ -2326,6 +2375,7 @@ namespace DTSC{
   }
 
   void Meta::setLive(bool live){
+    if ((bool)stream.getInt(streamLiveField) != live){bumpMetaVersion();}
     stream.setInt(streamLiveField, live ? 1 : 0);
   }
   bool Meta::getLive() const{
@@ -2370,6 +2420,20 @@ namespace DTSC{
   }
   int64_t Meta::getUTCOffset() const{return stream.getInt(streamUTCOffsetField);}
 
+  /// Sets the newest keyframe time at which all tracks of a live stream have data, or 0 if unknown.
+  /// Published by the buffer so new viewers can start at the live edge without searching for it.
+  void Meta::setLiveEdge(uint64_t liveEdge){stream.setInt(streamLiveEdgeField, liveEdge);}
+  uint64_t Meta::getLiveEdge() const{return stream.getInt(streamLiveEdgeField);}
+
+  /// Returns a number that changes whenever a track is validated or removed, or changes one of the
+  /// properties track selection depends on (other than bit rate and B-frame presence).
+  uint64_t Meta::getMetaVersion() const{return stream.getInt(streamMetaVersionField);}
+
+  void Meta::bumpMetaVersion(){
+    if (!stream.isReady()){return;}
+    stream.setInt(streamMetaVersionField, stream.getInt(streamMetaVersionField) + 1);
+  }
+
   /*LTS-START*/
   void Meta::setMinimumFragmentDuration(uint64_t fragmentDuration){
     stream.setInt(streamMinimumFragmentDurationField, fragmentDuration);
@@ -2425,6 +2489,7 @@ namespace DTSC{
   void Meta::validateTrack(size_t trackIdx, uint8_t validType){
     markUpdated(trackIdx);
     trackList.setInt(trackValidField, validType, trackIdx);
+    bumpMetaVersion();
   }
 
   void Meta::removeEmptyTracks(){
@@ -2449,11 +2514,13 @@ namespace DTSC{
         p.master = true;
       }
     }
+    if (!isMemBuf){removeHeaderCache(streamName, trackIdx);}
     tM[trackIdx].master = true;
     tM.erase(trackIdx);
     tracks.erase(trackIdx);
 
     trackList.setInt(trackValidField, 0, trackIdx);
+    bumpMetaVersion();
   }
 
   /// Removes the first key from the memory structure and caches.
@@ -2506,6 +2573,7 @@ namespace DTSC{
         // Set the master flag so that the page will be destroyed once it leaves scope
         toErase.master = true;
       }
+      tPages.setInt("ondisk", 0, firstPage);
       tPages.deleteRecords(1);
     } else if (tPages.getInt("avail", firstPage) == 0){
       tPages.setInt("keycount", keyCount - 1, firstPage);
@@ -3454,6 +3522,14 @@ namespace DTSC{
     return pages.getInt("firstkey", res);
   }
 
+  /// Returns true if the page with the given record index was moved from memory to the buffer's
+  /// disk tier.
+  bool Meta::pageOnDisk(uint32_t idx, uint64_t pageIdx) const{
+    const Util::RelAccX &pages = tracks.at(idx).pages;
+    if (pageIdx < pages.getDeleted() || pageIdx >= pages.getEndPos()){return false;}
+    return pages.getInt("ondisk", pageIdx);
+  }
+
   /// Returns the key number containing a given time.
   /// Or, closest key if given time is not available.
   /// Or, INVALID_KEY_NUM if no keys are available at all.
@@ -358,6 +358,7 @@ namespace DTSC{
     void setInit(size_t trackIdx, const std::string &init);
     void setInit(size_t trackIdx, const char *init, size_t initLen);
     std::string getInit(size_t idx) const;
+    void getInit(size_t idx, char *&data, size_t &len) const;
 
     void setSource(const std::string &src);
     std::string getSource() const;
@@ -469,6 +470,11 @@ namespace DTSC{
     void setUTCOffset(int64_t UTCOffset);
     int64_t getUTCOffset() const;
 
+    void setLiveEdge(uint64_t liveEdge);
+    uint64_t getLiveEdge() const;
+
+    uint64_t getMetaVersion() const;
+
     std::set<size_t> getValidTracks(bool skipEmpty = false) const;
     std::set<size_t> getMySourceTracks(size_t pid) const;
 
@@ -493,6 +499,7 @@ namespace DTSC{
     bool nextPageAvailable(uint32_t idx, size_t currentPage) const;
     size_t getPageNumberForTime(uint32_t idx, uint64_t time) const;
     size_t getPageNumberForKey(uint32_t idx, uint64_t keynumber) const;
+    bool pageOnDisk(uint32_t idx, uint64_t pageIdx) const;
     size_t getKeyNumForTime(uint32_t idx, uint64_t time) const;
     bool keyTimingsMatch(size_t idx1, size_t idx2) const;
 
@@ -533,6 +540,7 @@ namespace DTSC{
     void sBufShm(const std::string &_streamName, size_t trackCount = DEFAULT_TRACK_COUNT, bool master = true, bool autoBackOff = true);
     void streamInit(size_t trackCount = DEFAULT_TRACK_COUNT);
     void resizeTrackList(size_t newTrackCount);
+    void bumpMetaVersion();
 
     std::string streamName;
 
@@ -563,6 +571,8 @@ namespace DTSC{
     Util::RelAccXFieldData streamBootMsOffsetField;
     Util::RelAccXFieldData streamUTCOffsetField;
     Util::RelAccXFieldData streamMinimumFragmentDurationField;
+    Util::RelAccXFieldData streamLiveEdgeField;
+    Util::RelAccXFieldData streamMetaVersionField;
 
     Util::RelAccXFieldData trackValidField;
     Util::RelAccXFieldData trackIdField;
@@ -3,16 +3,185 @@
 #include "encryption.h"
 #include "h264.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AES_NI 1
+#include <wmmintrin.h>
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#endif
+
 namespace Encryption{
-  AES::AES(){mbedtls_aes_init(&ctx);}
+#ifdef AES_NI
+  // AES-128 kernels using the AES-NI instructions. Contrary to calling mbedtls once per block,
+  // CTR and CBC decryption keep eight independent blocks in flight, hiding the instruction latency.
+
+  AESNI_TARGET static inline __m128i expandStep(__m128i key, __m128i gen){
+    gen = _mm_shuffle_epi32(gen, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, gen);
+  }
+
+#define EXPAND_ROUND(n, rcon) \
+  K[n] = expandStep(K[n - 1], _mm_aeskeygenassist_si128(K[n - 1], rcon));
+
+  /// Expands a 128-bit key into the encryption and decryption round keys.
+  AESNI_TARGET static void aesniSetKey(const char *key, uint8_t *enc, uint8_t *dec){
+    __m128i K[11];
+    K[0] = _mm_loadu_si128((const __m128i *)key);
+    EXPAND_ROUND(1, 0x01);
+    EXPAND_ROUND(2, 0x02);
+    EXPAND_ROUND(3, 0x04);
+    EXPAND_ROUND(4, 0x08);
+    EXPAND_ROUND(5, 0x10);
+    EXPAND_ROUND(6, 0x20);
+    EXPAND_ROUND(7, 0x40);
+    EXPAND_ROUND(8, 0x80);
+    EXPAND_ROUND(9, 0x1b);
+    EXPAND_ROUND(10, 0x36);
+    for (size_t i = 0; i < 11; ++i){
+      _mm_storeu_si128((__m128i *)(enc + 16 * i), K[i]);
+      // Equivalent inverse cipher: reversed order, InvMixColumns applied to the middle rounds
+      __m128i D = (i == 0 || i == 10) ? K[i] : _mm_aesimc_si128(K[i]);
+      _mm_storeu_si128((__m128i *)(dec + 16 * (10 - i)), D);
+    }
+  }
+#undef EXPAND_ROUND
+
+  AESNI_TARGET static inline void loadRounds(const uint8_t *rounds, __m128i *K){
+    for (size_t i = 0; i < 11; ++i){K[i] = _mm_loadu_si128((const __m128i *)(rounds + 16 * i));}
+  }
+
+  AESNI_TARGET static inline __m128i encryptOne(const __m128i *K, __m128i B){
+    B = _mm_xor_si128(B, K[0]);
+    for (size_t r = 1; r < 10; ++r){B = _mm_aesenc_si128(B, K[r]);}
+    return _mm_aesenclast_si128(B, K[10]);
+  }
+
+  /// CTR mode with a big-endian 64-bit counter in the last half of the 16-byte nonce/counter block.
+  AESNI_TARGET static void aesniCTR(const uint8_t *rounds, uint64_t ivec, const char *src, char *dest, size_t dataLen){
+    __m128i K[11];
+    loadRounds(rounds, K);
+    char ctrBlocks[8 * 16];
+    memset(ctrBlocks, 0, sizeof(ctrBlocks));
+    uint64_t counter = 0;
+    size_t offset = 0;
+    while (dataLen - offset >= 8 * 16){
+      __m128i B[8];
+      for (size_t i = 0; i < 8; ++i){
+        Bit::htobll(ctrBlocks + 16 * i, ivec);
+        Bit::htobll(ctrBlocks + 16 * i + 8, counter++);
+        B[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(ctrBlocks + 16 * i)), K[0]);
+      }
+      for (size_t r = 1; r < 10; ++r){
+        for (size_t i = 0; i < 8; ++i){B[i] = _mm_aesenc_si128(B[i], K[r]);}
+      }
+      for (size_t i = 0; i < 8; ++i){
+        B[i] = _mm_aesenclast_si128(B[i], K[10]);
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + offset + 16 * i));
+        _mm_storeu_si128((__m128i *)(dest + offset + 16 * i), _mm_xor_si128(in, B[i]));
+      }
+      offset += 8 * 16;
+    }
+    while (offset < dataLen){
+      Bit::htobll(ctrBlocks, ivec);
+      Bit::htobll(ctrBlocks + 8, counter++);
+      char stream[16];
+      _mm_storeu_si128((__m128i *)stream, encryptOne(K, _mm_loadu_si128((const __m128i *)ctrBlocks)));
+      size_t len = std::min(dataLen - offset, (size_t)16);
+      for (size_t i = 0; i < len; ++i){dest[offset + i] = src[offset + i] ^ stream[i];}
+      offset += len;
+    }
+  }
+
+  /// CBC encryption; inherently serial. Updates ivec to the last ciphertext block.
+  AESNI_TARGET static void aesniEncryptCBC(const uint8_t *rounds, char *ivec, const char *src, char *dest, size_t dataLen){
+    __m128i K[11];
+    loadRounds(rounds, K);
+    __m128i prev = _mm_loadu_si128((const __m128i *)ivec);
+    for (size_t offset = 0; offset < dataLen; offset += 16){
+      __m128i in = _mm_loadu_si128((const __m128i *)(src + offset));
+      prev = encryptOne(K, _mm_xor_si128(in, prev));
+      _mm_storeu_si128((__m128i *)(dest + offset), prev);
+    }
+    _mm_storeu_si128((__m128i *)ivec, prev);
+  }
+
+  /// CBC decryption, eight blocks at a time. Updates ivec to the last ciphertext block.
+  /// Safe to use in-place, as all ciphertext is read before the plaintext is written.
+  AESNI_TARGET static void aesniDecryptCBC(const uint8_t *rounds, char *ivec, const char *src, char *dest, size_t dataLen){
+    __m128i K[11];
+    loadRounds(rounds, K);
+    __m128i prev = _mm_loadu_si128((const __m128i *)ivec);
+    size_t offset = 0;
+    while (dataLen - offset >= 8 * 16){
+      __m128i C[8], B[8];
+      for (size_t i = 0; i < 8; ++i){
+        C[i] = _mm_loadu_si128((const __m128i *)(src + offset + 16 * i));
+        B[i] = _mm_xor_si128(C[i], K[0]);
+      }
+      for (size_t r = 1; r < 10; ++r){
+        for (size_t i = 0; i < 8; ++i){B[i] = _mm_aesdec_si128(B[i], K[r]);}
+      }
+      for (size_t i = 0; i < 8; ++i){
+        B[i] = _mm_xor_si128(_mm_aesdeclast_si128(B[i], K[10]), prev);
+        prev = C[i];
+        _mm_storeu_si128((__m128i *)(dest + offset + 16 * i), B[i]);
+      }
+      offset += 8 * 16;
+    }
+    for (; offset < dataLen; offset += 16){
+      __m128i C = _mm_loadu_si128((const __m128i *)(src + offset));
+      __m128i B = _mm_xor_si128(C, K[0]);
+      for (size_t r = 1; r < 10; ++r){B = _mm_aesdec_si128(B, K[r]);}
+      _mm_storeu_si128((__m128i *)(dest + offset), _mm_xor_si128(_mm_aesdeclast_si128(B, K[10]), prev));
+      prev = C;
+    }
+    _mm_storeu_si128((__m128i *)ivec, prev);
+  }
+#endif
+
+  static bool hwAESDisabled = false;
+
+  /// Returns true if the CPU supports the AES-NI instructions and their use was not disabled.
+  bool hasHardwareAES(){
+#ifdef AES_NI
+    if (hwAESDisabled){return false;}
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes");
+#else
+    return false;
+#endif
+  }
+
+  /// Enables (the default) or disables the AES-NI kernels for keys set from now on.
+  /// Disabling forces the portable mbedtls implementation, e.g. to test it on machines with AES-NI.
+  /// Returns false if enabling was requested but the CPU or build does not support AES-NI.
+  bool setHardwareAES(bool enable){
+    hwAESDisabled = !enable;
+    return !enable || hasHardwareAES();
+  }
+
+  AES::AES(){
+    mbedtls_aes_init(&ctx);
+    hwAES = false;
+  }
 
   AES::~AES(){mbedtls_aes_free(&ctx);}
 
   void AES::setEncryptKey(const char *key){
     mbedtls_aes_setkey_enc(&ctx, (const unsigned char *)key, 128);
+#ifdef AES_NI
+    hwAES = hasHardwareAES();
+    if (hwAES){aesniSetKey(key, encRounds, decRounds);}
+#endif
   }
   void AES::setDecryptKey(const char *key){
     mbedtls_aes_setkey_dec(&ctx, (const unsigned char *)key, 128);
+#ifdef AES_NI
+    hwAES = hasHardwareAES();
+    if (hwAES){aesniSetKey(key, encRounds, decRounds);}
+#endif
   }
 
   DTSC::Packet AES::encryptPacketCTR(const DTSC::Meta &M, const DTSC::Packet &src, uint64_t ivec, size_t newTrack){
@@ -60,6 +229,12 @@ namespace Encryption{
   }
 
   bool AES::encryptBlockCTR(uint64_t ivec, const char *src, char *dest, size_t dataLen){
+#ifdef AES_NI
+    if (hwAES){
+      aesniCTR(encRounds, ivec, src, dest, dataLen);
+      return true;
+    }
+#endif
     size_t ncOff = 0;
     unsigned char streamBlock[] ={0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
@@ -164,7 +339,29 @@ namespace Encryption{
 
   bool AES::encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen){
     if (dataLen % 16){WARN_MSG("Encrypting a non-multiple of 16 bytes: %zu", dataLen);}
+#ifdef AES_NI
+    if (hwAES){
+      if (dataLen % 16){return false;}
+      aesniEncryptCBC(encRounds, ivec, src, dest, dataLen);
+      return true;
+    }
+#endif
     return mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, dataLen, (unsigned char *)ivec,
                                  (const unsigned char *)src, (unsigned char *)dest) == 0;
   }
+
+  bool AES::decryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen){
+    if (dataLen % 16){
+      WARN_MSG("Decrypting a non-multiple of 16 bytes: %zu", dataLen);
+      return false;
+    }
+#ifdef AES_NI
+    if (hwAES){
+      aesniDecryptCBC(decRounds, ivec, src, dest, dataLen);
+      return true;
+    }
+#endif
+    return mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_DECRYPT, dataLen, (unsigned char *)ivec,
+                                 (const unsigned char *)src, (unsigned char *)dest) == 0;
+  }
 }// namespace Encryption
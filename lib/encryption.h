@@ -4,6 +4,9 @@
 #include <string>
 
 namespace Encryption{
+  bool hasHardwareAES();
+  bool setHardwareAES(bool enable);
+
   class AES{
   public:
     AES();
@@ -21,8 +24,12 @@ namespace Encryption{
     DTSC::Packet encryptPacketCBC(const DTSC::Meta &M, const DTSC::Packet &src, char *ivec, size_t newTrack);
     std::string encryptBlockCBC(char *ivec, const std::string &inp);
     bool encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen);
+    bool decryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen);
 
   protected:
     mbedtls_aes_context ctx;
+    bool hwAES; ///< True if the AES-NI kernels are used instead of mbedtls
+    uint8_t encRounds[176]; ///< Expanded AES-128 encryption key for the AES-NI kernels
+    uint8_t decRounds[176]; ///< Expanded AES-128 decryption key for the AES-NI kernels
   };
 }// namespace Encryption
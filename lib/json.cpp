@@ -2,9 +2,11 @@
 
 #include "bitfields.h"
 #include "defines.h"
+#include "http_parser.h"
 #include "json.h"
 #include <arpa/inet.h> //for htonl
 #include <fstream>
+#include <new>
 #include <sstream>
 #include <stdint.h> //for uint64_t
 #include <stdlib.h>
@@ -335,6 +337,13 @@ static void skipToEnd(std::istream &fromstream){
 
 /// Sets this JSON::Value to null;
 JSON::Value::Value(){
+  arena = 0;
+  null();
+}
+
+/// Sets this JSON::Value to null, allocating all future child nodes from the given Arena.
+JSON::Value::Value(Arena &A){
+  arena = &A;
   null();
 }
 
@@ -344,12 +353,14 @@ JSON::Value::~Value(){
 }
 
 JSON::Value::Value(const Value &rhs){
+  arena = 0;
   null();
   *this = rhs;
 }
 
 /// Sets this JSON::Value to read from this position in the std::istream
 JSON::Value::Value(std::istream &fromstream){
+  arena = 0;
   null();
   bool reading_object = false;
   bool reading_array = false;
@@ -465,6 +476,7 @@ JSON::Value::Value(std::istream &fromstream){
 
 /// Sets this JSON::Value to the given string.
 JSON::Value::Value(const std::string &val){
+  arena = 0;
   myType = STRING;
   strVal = val;
   intVal = 0;
@@ -472,6 +484,7 @@ JSON::Value::Value(const std::string &val){
 
 /// Sets this JSON::Value to the given string.
 JSON::Value::Value(const char *val){
+  arena = 0;
   myType = STRING;
   strVal = val;
   intVal = 0;
@@ -479,11 +492,13 @@ JSON::Value::Value(const char *val){
 
 /// Sets this JSON::Value to the given integer.
 JSON::Value::Value(uint32_t val){
+  arena = 0;
   myType = INTEGER;
   intVal = val;
 }
 /// Sets this JSON::Value to the given integer.
 JSON::Value::Value(uint64_t val){
+  arena = 0;
   myType = INTEGER;
   intVal = val;
 }
@@ -491,6 +506,7 @@ JSON::Value::Value(uint64_t val){
 #if defined(__APPLE__)
 /// Sets this JSON::Value to the given integer.
 JSON::Value::Value(unsigned long val){
+  arena = 0;
   myType = INTEGER;
   intVal = val;
 }
@@ -498,23 +514,27 @@ JSON::Value::Value(unsigned long val){
 
 /// Sets this JSON::Value to the given integer.
 JSON::Value::Value(int32_t val){
+  arena = 0;
   myType = INTEGER;
   intVal = val;
 }
 /// Sets this JSON::Value to the given integer.
 JSON::Value::Value(int64_t val){
+  arena = 0;
   myType = INTEGER;
   intVal = val;
 }
 
 /// Sets this JSON::Value to the given double.
 JSON::Value::Value(double val){
+  arena = 0;
   myType = DOUBLE;
   dblVal = val;
 }
 
 /// Sets this JSON::Value to the given integer.
 JSON::Value::Value(bool val){
+  arena = 0;
   myType = BOOL;
   intVal = (val ? 1 : 0);
 }
@@ -800,7 +820,7 @@ JSON::Value &JSON::Value::operator[](const std::string &i){
   }
   Value *pntr = objVal[i];
   if (!pntr){
-    objVal[i] = new JSON::Value();
+    objVal[i] = newChild();
     pntr = objVal[i];
   }
   return *pntr;
@@ -815,7 +835,7 @@ JSON::Value &JSON::Value::operator[](const char *i){
   }
   Value *pntr = objVal[i];
   if (!pntr){
-    objVal[i] = new JSON::Value();
+    objVal[i] = newChild();
     pntr = objVal[i];
   }
   return *pntr;
@@ -1228,6 +1248,30 @@ std::string JSON::Value::toPrettyString(size_t indentation) const{
   return "null"; // should never get here...
 }
 
+/// Creates a new, empty child node for this value, from the arena if this value has one.
+JSON::Value *JSON::Value::newChild(){
+  if (!arena){return new JSON::Value();}
+  return arena->alloc();
+}
+
+/// Creates a new child node for this value that is a copy of the given value.
+/// The copy is allocated from this value's arena, if it has one.
+JSON::Value *JSON::Value::newChild(const JSON::Value &rhs){
+  if (!arena){return new JSON::Value(rhs);}
+  JSON::Value *ret = arena->alloc();
+  *ret = rhs;
+  return ret;
+}
+
+/// Deletes a child node, returning it to the arena it came from if needed.
+void JSON::Value::delChild(JSON::Value *child){
+  if (!child->arena){
+    delete child;
+    return;
+  }
+  child->arena->release(child);
+}
+
 /// Appends the given value to the end of this JSON::Value array.
 /// Turns this value into an array if it is not already one.
 void JSON::Value::append(const JSON::Value &rhs){
@@ -1235,7 +1279,7 @@ void JSON::Value::append(const JSON::Value &rhs){
     null();
     myType = ARRAY;
   }
-  arrVal.push_back(new JSON::Value(rhs));
+  arrVal.push_back(newChild(rhs));
 }
 
 /// Appends a null value to the end of this JSON::Value array.
@@ -1246,7 +1290,7 @@ JSON::Value & JSON::Value::append(){
     null();
     myType = ARRAY;
   }
-  arrVal.push_back(new JSON::Value());
+  arrVal.push_back(newChild());
   return **arrVal.rbegin();
 }
 
@@ -1257,7 +1301,7 @@ void JSON::Value::prepend(const JSON::Value &rhs){
     null();
     myType = ARRAY;
   }
-  arrVal.push_front(new JSON::Value(rhs));
+  arrVal.push_front(newChild(rhs));
 }
 
 /// For array and object JSON::Value objects, reduces them
@@ -1268,11 +1312,11 @@ void JSON::Value::prepend(const JSON::Value &rhs){
 /// given size.
 void JSON::Value::shrink(unsigned int size){
   while (arrVal.size() > size){
-    delete arrVal.front();
+    delChild(arrVal.front());
     arrVal.pop_front();
   }
   while (objVal.size() > size){
-    delete objVal.begin()->second;
+    delChild(objVal.begin()->second);
     objVal.erase(objVal.begin());
   }
 }
@@ -1281,18 +1325,18 @@ void JSON::Value::shrink(unsigned int size){
 /// the given name, if it exists. Has no effect otherwise.
 void JSON::Value::removeMember(const std::string &name){
   if (objVal.count(name)){
-    delete objVal[name];
+    delChild(objVal[name]);
     objVal.erase(name);
   }
 }
 
 void JSON::Value::removeMember(const std::deque<Value *>::iterator &it){
-  delete (*it);
+  delChild(*it);
   arrVal.erase(it);
 }
 
 void JSON::Value::removeMember(const std::map<std::string, Value *>::iterator &it){
-  delete it->second;
+  delChild(it->second);
   objVal.erase(it);
 }
 
@@ -1501,3 +1545,219 @@ JSON::Value JSON::fromDTMI2(const char *data, uint64_t len, uint32_t &i){
   fromDTMI2(data, len, i, ret);
   return ret;
 }
+
+/// Creates an empty arena, that will allocate nodes in slabs of the given amount of nodes.
+JSON::Arena::Arena(size_t nodesPerSlab){
+  slabNodes = nodesPerSlab ? nodesPerSlab : 1;
+  inUse = 0;
+}
+
+/// Frees all slabs. All values allocated from this arena must have been released before this.
+JSON::Arena::~Arena(){
+  if (inUse){WARN_MSG("Destroying JSON arena with %zu nodes still in use", inUse);}
+  while (slabs.size()){
+    delete[] slabs.front();
+    slabs.pop_front();
+  }
+}
+
+/// Returns a new, empty value that allocates its own children from this arena as well.
+/// Allocates a new slab if there are no free nodes left.
+JSON::Value *JSON::Arena::alloc(){
+  if (!freeList.size()){
+    char *slab = new char[sizeof(JSON::Value) * slabNodes];
+    slabs.push_back(slab);
+    freeList.reserve(freeList.size() + slabNodes);
+    for (size_t i = slabNodes; i > 0; --i){
+      freeList.push_back((JSON::Value *)(slab + sizeof(JSON::Value) * (i - 1)));
+    }
+  }
+  JSON::Value *ret = freeList.back();
+  freeList.pop_back();
+  ++inUse;
+  return new (ret) JSON::Value(*this);
+}
+
+/// Destructs the given value (and thereby all its children) and marks its node as free for reuse.
+void JSON::Arena::release(JSON::Value *v){
+  v->~Value();
+  freeList.push_back(v);
+  --inUse;
+}
+
+/// Returns the amount of nodes currently handed out by this arena.
+size_t JSON::Arena::used() const{
+  return inUse;
+}
+
+/// Returns the total amount of nodes this arena has allocated space for.
+size_t JSON::Arena::capacity() const{
+  return slabs.size() * slabNodes;
+}
+
+/// Creates a writer that appends to the given string.
+JSON::Writer::Writer(std::string &target) : buf(target){
+  conn = 0;
+  H = 0;
+  flushSize = 0;
+  autoFlush = false;
+  afterKey = false;
+}
+
+/// Creates a writer that sends its output as HTTP body over the given connection.
+/// The HTTP::Parser is expected to have had its StartResponse function called already.
+JSON::Writer::Writer(Socket::Connection &c, HTTP::Parser &http, size_t flushAt) : buf(ownBuf){
+  conn = &c;
+  H = &http;
+  flushSize = flushAt;
+  autoFlush = true;
+  afterKey = false;
+  ownBuf.reserve(flushSize);
+}
+
+/// Sends any data that is still pending.
+JSON::Writer::~Writer(){
+  flush();
+}
+
+/// Sends pending data, if this writer writes to a connection. Does nothing otherwise.
+void JSON::Writer::flush(){
+  if (!conn || !buf.size()){return;}
+  H->Chunkify(buf, *conn);
+  buf.clear();
+}
+
+/// Inserts a comma if needed, before a new array element or object key.
+void JSON::Writer::separate(){
+  if (afterKey){
+    afterKey = false;
+    return;
+  }
+  if (!hasItems.size()){return;}
+  if (hasItems.back()){
+    buf += ',';
+  }else{
+    hasItems.back() = true;
+  }
+}
+
+/// Called after each complete write, flushes if enough data is pending.
+void JSON::Writer::written(){
+  if (autoFlush && conn && buf.size() >= flushSize){flush();}
+}
+
+JSON::Writer &JSON::Writer::objBegin(){
+  separate();
+  buf += '{';
+  hasItems.push_back(false);
+  return *this;
+}
+
+JSON::Writer &JSON::Writer::objEnd(){
+  buf += '}';
+  if (hasItems.size()){hasItems.pop_back();}
+  written();
+  return *this;
+}
+
+JSON::Writer &JSON::Writer::arrBegin(){
+  separate();
+  buf += '[';
+  hasItems.push_back(false);
+  return *this;
+}
+
+JSON::Writer &JSON::Writer::arrEnd(){
+  buf += ']';
+  if (hasItems.size()){hasItems.pop_back();}
+  written();
+  return *this;
+}
+
+/// Writes an object key. Must be followed by exactly one value, object or array.
+JSON::Writer &JSON::Writer::key(const std::string &k){
+  separate();
+  buf += JSON::string_escape(k);
+  buf += ':';
+  afterKey = true;
+  return *this;
+}
+
+/// Writes a full JSON::Value, recursing into containers without converting them to strings first.
+JSON::Writer &JSON::Writer::value(const JSON::Value &v){
+  if (v.isObject()){
+    objBegin();
+    jsonForEachConst(v, i){
+      key(i.key());
+      value(*i);
+    }
+    return objEnd();
+  }
+  if (v.isArray()){
+    arrBegin();
+    jsonForEachConst(v, i){value(*i);}
+    return arrEnd();
+  }
+  separate();
+  buf += v.toString();
+  written();
+  return *this;
+}
+
+JSON::Writer &JSON::Writer::value(const std::string &v){
+  separate();
+  buf += JSON::string_escape(v);
+  written();
+  return *this;
+}
+
+JSON::Writer &JSON::Writer::value(const char *v){
+  return value(std::string(v));
+}
+
+JSON::Writer &JSON::Writer::value(int32_t v){
+  return value((int64_t)v);
+}
+
+JSON::Writer &JSON::Writer::value(int64_t v){
+  separate();
+  char tmp[24];
+  snprintf(tmp, 24, "%" PRId64, v);
+  buf += tmp;
+  written();
+  return *this;
+}
+
+JSON::Writer &JSON::Writer::value(uint32_t v){
+  return value((int64_t)v);
+}
+
+JSON::Writer &JSON::Writer::value(uint64_t v){
+  return value((int64_t)v);
+}
+
+JSON::Writer &JSON::Writer::value(double v){
+  return value(JSON::Value(v));
+}
+
+JSON::Writer &JSON::Writer::value(bool v){
+  separate();
+  buf += (v ? "true" : "false");
+  written();
+  return *this;
+}
+
+JSON::Writer &JSON::Writer::null(){
+  separate();
+  buf += "null";
+  written();
+  return *this;
+}
+
+/// Writes the given data as-is, without any escaping or separators.
+/// Meant for wrapping the JSON output, for example for JSONP callbacks.
+JSON::Writer &JSON::Writer::raw(const std::string &data){
+  buf += data;
+  written();
+  return *this;
+}
@@ -11,6 +11,10 @@
 
 static const std::set<std::string> emptyset;
 
+namespace HTTP{
+  class Parser;
+}
+
 /// JSON-related classes and functions
 namespace JSON{
 
@@ -20,12 +24,19 @@ namespace JSON{
   /// JSON-string-escapes a value
   std::string string_escape(const std::string &val);
 
+  class Arena;
+
   /// A JSON::Value is either a string or an integer, but may also be an object, array or null.
+  /// Values constructed with an Arena allocate all their child nodes from that Arena.
   class Value{
     friend class Iter;
     friend class ConstIter;
 
   private:
+    Arena *arena;
+    Value *newChild();
+    Value *newChild(const Value &rhs);
+    void delChild(Value *child);
     ValueType myType;
     long long int intVal;
     std::string strVal;
@@ -37,6 +48,7 @@ namespace JSON{
   public:
     // constructors/destructors
     Value();
+    Value(Arena &A);
     ~Value();
     Value(const Value &rhs);
     Value(std::istream &fromstream);
@@ -117,6 +129,71 @@ namespace JSON{
     void null();
   };
 
+  /// Slab allocator for JSON::Value nodes.
+  /// Trees rooted in a Value constructed with an Arena take all their nodes from it, and hand them
+  /// back to it when they are removed. Released nodes are reused, so building, clearing and
+  /// rebuilding large trees (such as API responses) does not hit the heap for every node.
+  /// An Arena must outlive all Values allocated from it, and is not thread-safe.
+  class Arena{
+  public:
+    Arena(size_t nodesPerSlab = 256);
+    ~Arena();
+    Value *alloc();
+    void release(Value *v);
+    size_t used() const;
+    size_t capacity() const;
+
+  private:
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+    size_t slabNodes;
+    size_t inUse;
+    std::deque<char *> slabs;
+    std::vector<Value *> freeList;
+  };
+
+  /// Incrementally serializes JSON to a string or connection, without building a Value tree.
+  /// Output is compact and identical to what Value::toString would produce for the same data.
+  /// When writing to a connection, data is buffered and sent as (chunked) HTTP body through the
+  /// given HTTP::Parser whenever more than flushSize bytes are pending and autoFlush is set.
+  class Writer{
+  public:
+    Writer(std::string &target);
+    Writer(Socket::Connection &conn, HTTP::Parser &H, size_t flushSize = 65536);
+    ~Writer();
+    Writer &objBegin();
+    Writer &objEnd();
+    Writer &arrBegin();
+    Writer &arrEnd();
+    Writer &key(const std::string &k);
+    Writer &value(const Value &v);
+    Writer &value(const std::string &v);
+    Writer &value(const char *v);
+    Writer &value(int32_t v);
+    Writer &value(int64_t v);
+    Writer &value(uint32_t v);
+    Writer &value(uint64_t v);
+    Writer &value(double v);
+    Writer &value(bool v);
+    Writer &null();
+    Writer &raw(const std::string &data);
+    void flush();
+    bool autoFlush;
+
+  private:
+    Writer(const Writer &);
+    Writer &operator=(const Writer &);
+    void separate();
+    void written();
+    std::string ownBuf;
+    std::string &buf;
+    Socket::Connection *conn;
+    HTTP::Parser *H;
+    size_t flushSize;
+    std::vector<bool> hasItems;
+    bool afterKey;
+  };
+
   Value fromDTMI2(const std::string &data);
   Value fromDTMI2(const char *data, uint64_t len, uint32_t &i);
   Value fromDTMI(const std::string &data);
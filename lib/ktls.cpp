@@ -0,0 +1,195 @@
+#include "defines.h"
+#include "ktls.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if HAVE_KTLS
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
+#define TLS_ALERT_RECORD 21
+
+namespace Socket{
+
+  TLSOffload::TLSOffload(){
+    active = false;
+    haveKeys = false;
+#if MBEDTLS_VERSION_MAJOR <= 2
+    conf = 0;
+    macLen = 0;
+    keyLen = 0;
+    ivLen = 0;
+#endif
+  }
+
+#if MBEDTLS_VERSION_MAJOR > 2
+  void TLSOffload::exportKeys(void *p, mbedtls_ssl_key_export_type type, const unsigned char *secret,
+                              size_t secretLen, const unsigned char clientRandom[32],
+                              const unsigned char serverRandom[32], mbedtls_tls_prf_types prf){
+    TLSOffload *self = (TLSOffload *)p;
+    if (type != MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET || secretLen != sizeof(self->secret)){return;}
+    memcpy(self->secret, secret, secretLen);
+    memcpy(self->randoms, serverRandom, 32);
+    memcpy(self->randoms + 32, clientRandom, 32);
+    self->prf = prf;
+    self->haveKeys = true;
+  }
+#else
+  int TLSOffload::exportKeys(void *p, const unsigned char *ms, const unsigned char *kb, size_t macLen,
+                             size_t keyLen, size_t ivLen){
+    TLSOffload *self = (TLSOffload *)p;
+    if (2 * (macLen + keyLen + ivLen) > sizeof(self->keyBlock)){return 0;}
+    memcpy(self->keyBlock, kb, 2 * (macLen + keyLen + ivLen));
+    self->macLen = macLen;
+    self->keyLen = keyLen;
+    self->ivLen = ivLen;
+    self->haveKeys = true;
+    return 0;
+  }
+#endif
+
+  /// Asks mbedtls to hand over the keys negotiated during the coming handshake.
+  void TLSOffload::prepare(mbedtls_ssl_context *ssl, mbedtls_ssl_config *sslConf){
+    active = false;
+    haveKeys = false;
+#if HAVE_KTLS
+#if MBEDTLS_VERSION_MAJOR > 2
+    mbedtls_ssl_set_export_keys_cb(ssl, exportKeys, this);
+#elif defined(MBEDTLS_SSL_EXPORT_KEYS)
+    // Older versions only have a per-config callback; every connection runs in its own process.
+    conf = sslConf;
+    mbedtls_ssl_conf_export_keys_cb(conf, exportKeys, this);
+#endif
+#endif
+  }
+
+  /// Installs the transmit keys of the just-completed handshake on the given socket.
+  /// Returns true if the kernel now encrypts all outgoing data, false if the connection should
+  /// keep using mbedtls for writing (unsupported kernel, TLS version or cipher).
+  bool TLSOffload::enable(int fd, mbedtls_ssl_context *ssl, bool isServer){
+#if MBEDTLS_VERSION_MAJOR <= 2 && defined(MBEDTLS_SSL_EXPORT_KEYS)
+    if (conf){
+      mbedtls_ssl_conf_export_keys_cb(conf, 0, 0);
+      conf = 0;
+    }
+#endif
+    if (active){return true;}
+#if HAVE_KTLS
+    if (!haveKeys){return false;}
+    const char *version = mbedtls_ssl_get_version(ssl);
+    const char *suite = mbedtls_ssl_get_ciphersuite(ssl);
+    if (!version || !suite || strcmp(version, "TLSv1.2")){
+      HIGH_MSG("Not offloading %s to the kernel, only TLSv1.2 is supported", version ? version : "TLS");
+      return false;
+    }
+    size_t cipherKeyLen = 0;
+    if (strstr(suite, "AES-128-GCM")){cipherKeyLen = 16;}
+#ifdef TLS_CIPHER_AES_GCM_256
+    if (strstr(suite, "AES-256-GCM")){cipherKeyLen = 32;}
+#endif
+    if (!cipherKeyLen){
+      HIGH_MSG("Not offloading %s to the kernel, unsupported cipher", suite);
+      return false;
+    }
+
+    // Key block layout: client MAC key, server MAC key, client key, server key, client IV, server IV
+#if MBEDTLS_VERSION_MAJOR > 2
+    size_t macLen = 0, keyLen = cipherKeyLen, ivLen = 4;
+    unsigned char keyBlock[2 * (32 + 4)];
+    if (mbedtls_ssl_tls_prf(prf, secret, sizeof(secret), "key expansion", randoms, sizeof(randoms),
+                            keyBlock, 2 * (keyLen + ivLen))){
+      WARN_MSG("Could not derive TLS keys for kernel offload");
+      return false;
+    }
+#endif
+    if (macLen || keyLen != cipherKeyLen || ivLen != 4){
+      HIGH_MSG("Not offloading %s to the kernel, unexpected key sizes", suite);
+      return false;
+    }
+    const unsigned char *key = keyBlock + (isServer ? keyLen : 0);
+    const unsigned char *salt = keyBlock + 2 * keyLen + (isServer ? ivLen : 0);
+    // The Finished message was record 0 of this epoch, so the first application record is 1.
+    // The explicit nonce is kept equal to the sequence number, as mbedtls does.
+    static const unsigned char recSeq[8] ={0, 0, 0, 0, 0, 0, 0, 1};
+
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls"))){
+      HIGH_MSG("Kernel TLS not available: %s", strerror(errno));
+      return false;
+    }
+    int r;
+    if (keyLen == 16){
+      struct tls12_crypto_info_aes_gcm_128 info;
+      memset(&info, 0, sizeof(info));
+      info.info.version = TLS_1_2_VERSION;
+      info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+      memcpy(info.key, key, keyLen);
+      memcpy(info.salt, salt, ivLen);
+      memcpy(info.iv, recSeq, sizeof(info.iv));
+      memcpy(info.rec_seq, recSeq, sizeof(info.rec_seq));
+      r = setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+      memset(&info, 0, sizeof(info));
+    }else{
+#ifdef TLS_CIPHER_AES_GCM_256
+      struct tls12_crypto_info_aes_gcm_256 info;
+      memset(&info, 0, sizeof(info));
+      info.info.version = TLS_1_2_VERSION;
+      info.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+      memcpy(info.key, key, keyLen);
+      memcpy(info.salt, salt, ivLen);
+      memcpy(info.iv, recSeq, sizeof(info.iv));
+      memcpy(info.rec_seq, recSeq, sizeof(info.rec_seq));
+      r = setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+      memset(&info, 0, sizeof(info));
+#else
+      r = -1;
+#endif
+    }
+    memset(keyBlock, 0, sizeof(keyBlock));
+    if (r){
+      HIGH_MSG("Kernel does not accept %s keys: %s", suite, strerror(errno));
+      return false;
+    }
+    active = true;
+    HIGH_MSG("Offloaded %s encryption to the kernel", suite);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /// Sends a close_notify alert through the kernel. Only valid while the offload is active, as
+  /// mbedtls can no longer write records with the right sequence numbers.
+  void TLSOffload::closeNotify(int fd){
+#if HAVE_KTLS
+    if (!active){return;}
+    unsigned char alert[2] ={1, 0}; // warning, close_notify
+    struct iovec vec;
+    vec.iov_base = alert;
+    vec.iov_len = sizeof(alert);
+    char cBuf[CMSG_SPACE(sizeof(unsigned char))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cBuf;
+    msg.msg_controllen = sizeof(cBuf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(cmsg) = TLS_ALERT_RECORD;
+    sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+  }
+
+}// namespace Socket
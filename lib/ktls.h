@@ -0,0 +1,45 @@
+/// \file ktls.h
+/// Kernel TLS offload for connections that did their handshake through mbedtls.
+
+#pragma once
+#include <mbedtls/ssl.h>
+#include <mbedtls/version.h>
+#include <stddef.h>
+
+namespace Socket{
+
+  /// Moves the encryption of outgoing TLS records from mbedtls into the kernel (Linux kTLS).
+  /// Call prepare() after mbedtls_ssl_setup and before the handshake, so the negotiated keys can be
+  /// captured, then enable() right after the handshake, before any data is written through mbedtls.
+  /// Once enabled, plaintext written to the socket (through send, write, splice or sendfile) is
+  /// encrypted by the kernel. Reading is left to mbedtls.
+  /// Only TLS 1.2 with AES-GCM is offloaded; anything else stays in userspace.
+  class TLSOffload{
+  public:
+    TLSOffload();
+    void prepare(mbedtls_ssl_context *ssl, mbedtls_ssl_config *conf);
+    bool enable(int fd, mbedtls_ssl_context *ssl, bool isServer);
+    void closeNotify(int fd);
+    bool active; ///< True once the kernel encrypts everything written to the socket
+
+  private:
+#if MBEDTLS_VERSION_MAJOR > 2
+    static void exportKeys(void *p, mbedtls_ssl_key_export_type type, const unsigned char *secret,
+                           size_t secretLen, const unsigned char clientRandom[32],
+                           const unsigned char serverRandom[32], mbedtls_tls_prf_types prf);
+    unsigned char secret[48];
+    unsigned char randoms[64]; ///< Server random followed by client random
+    mbedtls_tls_prf_types prf;
+#else
+    static int exportKeys(void *p, const unsigned char *ms, const unsigned char *kb, size_t macLen,
+                          size_t keyLen, size_t ivLen);
+    mbedtls_ssl_config *conf;
+    unsigned char keyBlock[256];
+    size_t macLen;
+    size_t keyLen;
+    size_t ivLen;
+#endif
+    bool haveKeys;
+  };
+
+}// namespace Socket
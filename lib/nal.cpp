@@ -10,7 +10,161 @@
 #include "defines.h"
 #include "nal.h"
 
+#if defined(__SSE2__)
+#define NAL_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAL_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define NAL_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace nalu{
+  // All scanners below look for the first offset i where data[i] and data[i+1] are zero and
+  // data[i+2] equals the wanted byte (1 for start codes, 3 for emulation prevention).
+  // They return the offset when found, dataSize otherwise.
+  typedef size_t (*findFunc)(const char *data, size_t dataSize, char third);
+
+  /// Scalar reference implementation, also used for the tail end of the vectorized versions.
+  static size_t findScalar(const char *data, size_t dataSize, char third){
+    if (dataSize < 3){return dataSize;}
+    size_t maxData = dataSize - 2;
+    size_t i = 0;
+    while (i < maxData){
+      char c = data[i + 2];
+      if (!c){
+        // Skipping a single byte here is faster than inspecting the second byte (benchmarked).
+        ++i;
+        continue;
+      }
+      if (c == third && !data[i] && !data[i + 1]){return i;}
+      // The third byte is not zero, so none of the next three offsets can match
+      i += 3;
+    }
+    return dataSize;
+  }
+
+#ifdef NAL_SSE2
+  static size_t findSSE2(const char *data, size_t dataSize, char third){
+    size_t i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i want = _mm_set1_epi8(third);
+    for (; i + 18 <= dataSize; i += 16){
+      __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), zero);
+      __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 1)), zero);
+      __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 2)), want);
+      unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+      if (mask){return i + __builtin_ctz(mask);}
+    }
+    return i + findScalar(data + i, dataSize - i, third);
+  }
+#endif
+
+#ifdef NAL_AVX2
+  __attribute__((target("avx2"))) static size_t findAVX2(const char *data, size_t dataSize, char third){
+    size_t i = 0;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i want = _mm256_set1_epi8(third);
+    for (; i + 34 <= dataSize; i += 32){
+      __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), zero);
+      __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 1)), zero);
+      __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 2)), want);
+      unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c));
+      if (mask){return i + __builtin_ctz(mask);}
+    }
+    return i + findScalar(data + i, dataSize - i, third);
+  }
+#endif
+
+#ifdef NAL_NEON
+  static size_t findNEON(const char *data, size_t dataSize, char third){
+    size_t i = 0;
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t want = vdupq_n_u8(third);
+    const uint8_t *d = (const uint8_t *)data;
+    for (; i + 18 <= dataSize; i += 16){
+      uint8x16_t a = vceqq_u8(vld1q_u8(d + i), zero);
+      uint8x16_t b = vceqq_u8(vld1q_u8(d + i + 1), zero);
+      uint8x16_t c = vceqq_u8(vld1q_u8(d + i + 2), want);
+      // NEON has no movemask; locate the exact offset in this block with the scalar scanner
+      if (vmaxvq_u8(vandq_u8(vandq_u8(a, b), c))){return i + findScalar(data + i, 18, third);}
+    }
+    return i + findScalar(data + i, dataSize - i, third);
+  }
+#endif
+
+  static findFunc findImpl = 0;
+  static const char *findImplName = "none";
+
+  static void autoSelect(){
+#ifdef NAL_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+      findImpl = findAVX2;
+      findImplName = "avx2";
+      return;
+    }
+#endif
+#ifdef NAL_SSE2
+    findImpl = findSSE2;
+    findImplName = "sse2";
+#elif defined(NAL_NEON)
+    findImpl = findNEON;
+    findImplName = "neon";
+#else
+    findImpl = findScalar;
+    findImplName = "scalar";
+#endif
+  }
+
+  static inline size_t findStart(const char *data, size_t dataSize, char third){
+    if (!findImpl){autoSelect();}
+    return findImpl(data, dataSize, third);
+  }
+
+  /// Forces a specific scanner implementation, for testing and benchmarking.
+  /// Returns false (leaving the current selection unchanged) if it is not available.
+  bool setScanImpl(scanImpl impl){
+    switch (impl){
+    case SCAN_AUTO: autoSelect(); return true;
+    case SCAN_SCALAR:
+      findImpl = findScalar;
+      findImplName = "scalar";
+      return true;
+#ifdef NAL_SSE2
+    case SCAN_SSE2:
+      findImpl = findSSE2;
+      findImplName = "sse2";
+      return true;
+#endif
+#ifdef NAL_AVX2
+    case SCAN_AVX2:
+      __builtin_cpu_init();
+      if (!__builtin_cpu_supports("avx2")){return false;}
+      findImpl = findAVX2;
+      findImplName = "avx2";
+      return true;
+#endif
+#ifdef NAL_NEON
+    case SCAN_NEON:
+      findImpl = findNEON;
+      findImplName = "neon";
+      return true;
+#endif
+    default: return false;
+    }
+  }
+
+  /// Returns the name of the currently selected scanner implementation.
+  const char *scanImplName(){
+    if (!findImpl){autoSelect();}
+    return findImplName;
+  }
+
   std::deque<int> parseNalSizes(DTSC::Packet &pack){
     std::deque<int> result;
     char *data;
@@ -26,25 +180,23 @@ namespace nalu{
   }
 
   std::string removeEmulationPrevention(const std::string &data){
+    size_t dataLen = data.size();
+    if (dataLen < 3){return data;}
+    const char *d = data.data();
     std::string result;
-    result.resize(data.size());
-    result[0] = data[0];
-    result[1] = data[1];
+    result.reserve(dataLen);
+    // The first two bytes are always copied as-is, so start looking at the third
     size_t dataPtr = 2;
-    size_t dataLen = data.size();
-    size_t resPtr = 2;
+    size_t copied = 0;
     while (dataPtr + 2 < dataLen){
-      if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){// We have found an emulation prevention
-        result[resPtr++] = data[dataPtr++];
-        result[resPtr++] = data[dataPtr++];
-        dataPtr++; // Skip the emulation prevention byte
-      }else{
-        result[resPtr++] = data[dataPtr++];
-      }
+      size_t found = dataPtr + findStart(d + dataPtr, dataLen - dataPtr, 3);
+      if (found >= dataLen){break;}
+      // Copy up to and including the two zero bytes, skip the emulation prevention byte
+      result.append(d + copied, found + 2 - copied);
+      copied = dataPtr = found + 3;
     }
-
-    while (dataPtr < dataLen){result[resPtr++] = data[dataPtr++];}
-    return result.substr(0, resPtr);
+    result.append(d + copied, dataLen - copied);
+    return result;
   }
 
   unsigned long toAnnexB(const char *data, unsigned long dataSize, char *&result){
@@ -67,63 +219,66 @@ namespace nalu{
 
   /// Scans data for the last non-zero byte, returning a pointer to it.
   const char *nalEndPosition(const char *data, uint32_t dataSize){
+    // Skip whole words of trailing zeroes first; padding can be several kilobytes long
+    while (dataSize >= 8){
+      uint64_t word;
+      memcpy(&word, data + dataSize - 8, 8);
+      if (word){break;}
+      dataSize -= 8;
+    }
     while (dataSize && !data[dataSize - 1]){--dataSize;}
     return data + dataSize;
   }
 
   /// Scan data for Annex B start code. Returns pointer to it when found, null otherwise.
   const char *scanAnnexB(const char *data, uint32_t dataSize){
-    char *offset = (char *)data;
-    const char *maxData = data + dataSize - 2;
-    while (offset < maxData){
-      if (offset[2] > 1){
-        // We have no zero in the third byte, so we need to skip at least 3 bytes forward
-        offset += 3;
-        continue;
-      }
-      if (!offset[2]){
-        // We COULD skip forward 1 or 2 bytes depending on contents of the second byte
-        // offset += (offset[1]?2:1);
-        //... but skipping a single byte (removing the 'if') is actually faster (benchmarked).
-        ++offset;
-        continue;
-      }
-      if (!offset[0] && !offset[1]){return offset;}
-      // We have no zero in the third byte, so we need to skip at least 3 bytes forward
-      offset += 3;
+    size_t found = findStart(data, dataSize, 1);
+    return (found < dataSize) ? data + found : 0;
+  }
+
+  /// Locates the NAL unit following the first start code at or after pos.
+  /// Sets begin/end to the bounds of its payload, returns false if there is no start code left.
+  /// A zero byte directly before the next start code is considered part of a 4-byte lead-in.
+  static bool nextNalUnit(const char *data, size_t dataSize, size_t pos, size_t &begin, size_t &end){
+    size_t start = pos + findStart(data + pos, dataSize - pos, 1);
+    if (start >= dataSize){return false;}
+    begin = start + 3;
+    end = begin + findStart(data + begin, dataSize - begin, 1);
+    if (end > begin && end != dataSize && !data[end - 1]){--end;}
+    return true;
+  }
+
+  /// Finds all NAL units in an Annex B buffer in a single pass, appending their positions to result.
+  /// Returns the amount of NAL units found.
+  size_t findNalUnits(const char *data, size_t dataSize, std::deque<nalPos> &result){
+    size_t count = 0;
+    size_t pos = 0;
+    size_t begin, end;
+    while (pos < dataSize && nextNalUnit(data, dataSize, pos, begin, end)){
+      nalPos P;
+      P.offset = begin;
+      P.size = end - begin;
+      result.push_back(P);
+      ++count;
+      pos = end;
     }
-    return 0;
+    return count;
   }
 
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result){
-    const char *lastCheck = data + dataSize - 3;
     if (!result){
       FAIL_MSG("No output buffer given to FromAnnexB");
       return 0;
     }
-    int offset = 0;
-    int newOffset = 0;
-    while (offset < dataSize){
-      const char *begin = data + offset;
-      while (begin < lastCheck && !(!begin[0] && !begin[1] && begin[2] == 0x01)){
-        begin++;
-        if (begin < lastCheck && begin[0]){begin++;}
-      }
-      begin += 3; // Initialize begin after the first 0x000001 pattern.
-      if (begin > data + dataSize){
-        offset = dataSize;
-        continue;
-      }
-      const char *end = (const char *)memmem(begin, dataSize - (begin - data), "\000\000\001", 3);
-      if (!end){end = data + dataSize;}
-      // Check for 4-byte lead in's. Yes, we access -1 here
-      if (end > begin && (end - data) != dataSize && end[-1] == 0x00){end--;}
-      unsigned int nalSize = end - begin;
+    unsigned long newOffset = 0;
+    size_t pos = 0;
+    size_t begin, end;
+    while (pos < dataSize && nextNalUnit(data, dataSize, pos, begin, end)){
+      uint32_t nalSize = end - begin;
       Bit::htobl(result + newOffset, nalSize);
-      memcpy(result + newOffset + 4, begin, nalSize);
-
+      memcpy(result + newOffset + 4, data + begin, nalSize);
       newOffset += 4 + nalSize;
-      offset = end - data;
+      pos = end;
     }
     return newOffset;
   }
@@ -10,6 +10,17 @@ namespace nalu{
     size_t nalSize;
   };
 
+  /// Location of a single NAL unit inside an Annex B buffer, excluding its start code.
+  struct nalPos{
+    size_t offset;
+    size_t size;
+  };
+
+  /// Start code scanner implementations. SCAN_AUTO picks the fastest one the CPU supports.
+  enum scanImpl{SCAN_AUTO, SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2, SCAN_NEON};
+  bool setScanImpl(scanImpl impl);
+  const char *scanImplName();
+
   std::deque<int> parseNalSizes(DTSC::Packet &pack);
   std::string removeEmulationPrevention(const std::string &data);
 
@@ -17,4 +28,5 @@ namespace nalu{
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result);
   const char *scanAnnexB(const char *data, uint32_t dataSize);
   const char *nalEndPosition(const char *data, uint32_t dataSize);
+  size_t findNalUnits(const char *data, size_t dataSize, std::deque<nalPos> &result);
 }// namespace nalu
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <getopt.h>
 #if defined(__APPLE__)
 #include <mach-o/dyld.h>
 #endif
@@ -381,6 +382,33 @@ int Util::Procs::ExecMist(std::deque<std::string> &argDeq){
   return execvp(argv[0], argv);
 }
 
+#ifdef ONE_BINARY
+// Generated entry point of the combined binary; takes the same arguments as its main()
+int MistMain(int argc, char *argv[]);
+#endif
+
+/// Replaces the current process with one of our Mist* binaries, without leaving the process.
+/// In the combined binary, the target's entry point is called directly and the process exits
+/// when it returns: this skips the exec, dynamic loading and re-mapping that ExecMist costs.
+/// Otherwise, this is identical to ExecMist. Only returns on failure.
+/// Entry points reached this way must reset any per-binary static state they rely on, as the
+/// caller's statics are still set; OutputMain does so for the output capabilities.
+int Util::Procs::HandoffMist(std::deque<std::string> &argDeq){
+#ifdef ONE_BINARY
+  mistifyDeque(argDeq);
+  char *const *argv = dequeToArgv(argDeq);
+  // getopt keeps its position between calls; make the target's argument parsing start over
+#ifdef __GLIBC__
+  optind = 0;
+#else
+  optind = 1;
+#endif
+  exit(MistMain(argDeq.size(), (char **)argv));
+#else
+  return ExecMist(argDeq);
+#endif
+}
+
 // Check whether a given Mist* binary is available for us to run
 bool Util::Procs::HasMistBinary(std::string binName){
 #ifdef ONE_BINARY
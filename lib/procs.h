@@ -46,6 +46,7 @@ namespace Util{
     static pid_t StartPiped(std::deque<std::string> &argDeq, int *fdin, int *fdout, int *fderr);
     static pid_t StartPipedMist(std::deque<std::string> &argDeq, int *fdin, int *fdout, int *fderr);
     static int ExecMist(std::deque<std::string> &argDeq);
+    static int HandoffMist(std::deque<std::string> &argDeq);
     static bool HasMistBinary(std::string binName);
     static void Stop(pid_t name);
     static void Murder(pid_t name);
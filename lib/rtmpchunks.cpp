@@ -334,8 +334,10 @@ std::string &RTMPStream::SendUSR(unsigned char type, unsigned int data, unsigned
 bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
   gettimeofday(&RTMPStream::lastrec, 0);
   unsigned int i = 0;
-  if (!buffer.available(3)){return false;}// we want at least 3 bytes
-  std::string indata = buffer.copy(3);
+  // The header and data are read in place, and only removed from the buffer once complete
+  const char *indata;
+  unsigned int avail = buffer.peek(indata);
+  if (avail < 3){return false;}// we want at least 3 bytes
 
   unsigned char chunktype = indata[i++];
   // read the chunkstream ID properly
@@ -358,11 +360,10 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
 
   switch (headertype){
   case 0x00:
-    if (!buffer.available(i + 11)){
+    if (avail < i + 11){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 11);
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
     timestamp += indata[i++];
@@ -379,11 +380,10 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
     msg_stream_id += indata[i++] * 256 * 256 * 256;
     break;
   case 0x40:
-    if (!buffer.available(i + 7)){
+    if (avail < i + 7){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 7);
     if (!allow_short){WARN_MSG("Warning: Header type 0x40 with no valid previous chunk!");}
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -401,11 +401,10 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
     msg_stream_id = prev.msg_stream_id;
     break;
   case 0x80:
-    if (!buffer.available(i + 3)){
+    if (avail < i + 3){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 3);
     if (!allow_short){WARN_MSG("Warning: Header type 0x80 with no valid previous chunk!");}
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -448,11 +447,10 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
 
   // read extended timestamp, if necessary
   if (ts_header == 0x00ffffff){
-    if (!buffer.available(i + 4)){
+    if (avail < i + 4){
       DONTEVEN_MSG("Cannot read timestamp");
       return false;
     }// can't read timestamp
-    indata = buffer.copy(i + 4);
     timestamp = indata[i++] * 256 * 256 * 256;
     timestamp += indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -463,16 +461,17 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
 
   // read data if length > 0, and allocate it
   if (real_len > 0){
-    if (!buffer.available(i + real_len)){
+    if (avail < i + real_len){
       DONTEVEN_MSG("Cannot read all data yet");
       return false;
     }// can't read all data (yet)
-    buffer.remove(i);                                      // remove the header
     if (prev.len_left > 0){
-      data = prev.data + buffer.remove(real_len); // append the data and remove from buffer
+      data = prev.data;
+      data.append(indata + i, real_len); // append the data
     }else{
-      data = buffer.remove(real_len); // append the data and remove from buffer
+      data.assign(indata + i, real_len);
     }
+    buffer.consume(i + real_len); // remove the header and data from the buffer
     lastrecv[cs_id] = *this;
     RTMPStream::rec_cnt += i + real_len;
     if (RTMPStream::rec_cnt >= 0xf0000000){
@@ -486,9 +485,8 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       return Parse(buffer);
     }
   }else{
-    buffer.remove(i); // remove the header
+    buffer.consume(i); // remove the header
     data = "";
-    indata = indata.substr(i + real_len);
     lastrecv[cs_id] = *this;
     RTMPStream::rec_cnt += i + real_len;
     return true;
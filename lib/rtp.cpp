@@ -719,6 +719,29 @@ namespace RTP{
     preBuffer = true;
     lastBootMS = 0;
     lastNTP = 0;
+    buffered = 0;
+    memset(slotSeq, 0, sizeof(slotSeq));
+    memset(slotUsed, 0, sizeof(slotUsed));
+  }
+
+  /// Copies the given packet into its slot of the reorder ring, replacing whatever was there.
+  void Sorter::storePacket(const Packet &pack){
+    uint16_t seq = pack.getSequence();
+    size_t slot = seq % SORTER_SLOTS;
+    if (!slotData[slot].assign(pack.ptr(), pack.size())){return;}
+    if (!slotUsed[slot]){
+      slotUsed[slot] = true;
+      ++buffered;
+    }
+    slotSeq[slot] = seq;
+  }
+
+  /// Outputs the buffered packet with the given sequence number and frees its slot.
+  void Sorter::sendBuffered(uint16_t seq){
+    size_t slot = seq % SORTER_SLOTS;
+    outPacket(packTrack, Packet(slotData[slot], slotData[slot].size()));
+    slotUsed[slot] = false;
+    --buffered;
   }
 
   void Sorter::setCallback(uint64_t track, void (*cb)(const uint64_t track, const Packet &p)){
@@ -742,18 +765,24 @@ namespace RTP{
     DONTEVEN_MSG("Received packet #%u, current packet is #%u", pSNo, rtpSeq);
     if (preBuffer){
       //If we've buffered the first 5 packets, assume we have the first one known
-      if (packBuffer.size() >= 5){
+      if (buffered >= 5){
         preBuffer = false;
-        rtpSeq = packBuffer.begin()->first;
+        // Everything buffered is ahead of rtpSeq; continue from the lowest of those
+        for (uint16_t i = 0; i < SORTER_SLOTS && !hasPacket(rtpSeq); ++i){++rtpSeq;}
         rtpWSeq = rtpSeq;
       }
     }else{
       // packet is very early - assume dropped after PACKET_DROP_TIMEOUT packets
-      while ((int16_t)(rtpSeq - pSNo) < -(int)PACKET_DROP_TIMEOUT){
-        VERYHIGH_MSG("Giving up on track %" PRIu64 " packet %u", packTrack, rtpSeq);
+      int dropTimeout = PACKET_DROP_TIMEOUT < SORTER_SLOTS ? PACKET_DROP_TIMEOUT : SORTER_SLOTS - 1;
+      while ((int16_t)(rtpSeq - pSNo) < -dropTimeout){
+        if (hasPacket(rtpSeq)){
+          sendBuffered(rtpSeq);
+        }else{
+          VERYHIGH_MSG("Giving up on track %" PRIu64 " packet %u", packTrack, rtpSeq);
+          ++lostTotal;
+          ++lostCurrent;
+        }
         ++rtpSeq;
-        ++lostTotal;
-        ++lostCurrent;
         ++packTotal;
         ++packCurrent;
       }
@@ -763,27 +792,26 @@ namespace RTP{
     // packet is somewhat early - ask for packet after PACKET_REORDER_WAIT packets
     while ((int16_t)(rtpWSeq - pSNo) < -(int)PACKET_REORDER_WAIT){
       //Only wanted if we don't already have it
-      if (!packBuffer.count(rtpWSeq)){
+      if (!hasPacket(rtpWSeq)){
         wantedSeqs.insert(rtpWSeq);
       }
       ++rtpWSeq;
     }
     // send any buffered packets we may have
     uint16_t prertpSeq = rtpSeq;
-    while (packBuffer.count(rtpSeq)){
-      outPacket(packTrack, packBuffer[rtpSeq]);
-      packBuffer.erase(rtpSeq);
+    while (hasPacket(rtpSeq)){
+      sendBuffered(rtpSeq);
       ++rtpSeq;
       ++packTotal;
       ++packCurrent;
     }
     if (prertpSeq != rtpSeq){
-      INFO_MSG("Sent packets %" PRIu16 "-%" PRIu16 ", now %zu in buffer", prertpSeq, rtpSeq, packBuffer.size());
+      INFO_MSG("Sent packets %" PRIu16 "-%" PRIu16 ", now %zu in buffer", prertpSeq, rtpSeq, buffered);
     }
     // packet is slightly early - buffer it
     if ((int16_t)(rtpSeq - pSNo) < 0){
       VERYHIGH_MSG("Buffering early packet #%u->%u", rtpSeq, pack.getSequence());
-      packBuffer[pack.getSequence()] = pack;
+      storePacket(pack);
     }
     // packet is late
     if ((int16_t)(rtpSeq - pSNo) > 0){
@@ -940,9 +968,8 @@ namespace RTP{
     }
     // Trivial codecs just fill a packet with raw data and continue. Easy peasy, lemon squeezy.
     if (codec == "ALAW" || codec == "opus" || codec == "PCM" || codec == "ULAW"){
-      DTSC::Packet nextPack;
-      nextPack.genericFill(msTime, 0, trackId, pl, plSize, 0, false);
-      outPacket(nextPack);
+      outPack.genericFill(msTime, 0, trackId, pl, plSize, 0, false);
+      outPacket(outPack);
       return;
     }
     // If we don't know how to handle this codec in RTP, print an error and ignore the packet.
@@ -953,18 +980,17 @@ namespace RTP{
     // assume AAC packets are single AU units
     /// \todo Support other input than single AU units
     unsigned int headLen = (Bit::btohs(pl) >> 3) + 2; // in bits, so /8, plus two for the prepended size
-    DTSC::Packet nextPack;
     uint16_t samples = aac::AudSpecConf::samples(init);
     uint32_t sampleOffset = 0;
     uint32_t offset = 0;
     uint32_t auSize = 0;
     for (uint32_t i = 2; i < headLen; i += 2){
       auSize = Bit::btohs(pl + i) >> 3; // only the upper 13 bits
-      nextPack.genericFill(msTime + sampleOffset / multiplier, 0, trackId, pl + headLen + offset,
-                           std::min(auSize, plSize - headLen - offset), 0, false);
+      outPack.genericFill(msTime + sampleOffset / multiplier, 0, trackId, pl + headLen + offset,
+                          std::min(auSize, plSize - headLen - offset), 0, false);
       offset += auSize;
       sampleOffset += samples;
-      outPacket(nextPack);
+      outPacket(outPack);
     }
   }
 
@@ -973,9 +999,8 @@ namespace RTP{
       WARN_MSG("Empty packet ignored!");
       return;
     }
-    DTSC::Packet nextPack;
-    nextPack.genericFill(msTime, 0, trackId, pl + 4, plSize - 4, 0, false);
-    outPacket(nextPack);
+    outPack.genericFill(msTime, 0, trackId, pl + 4, plSize - 4, 0, false);
+    outPacket(outPack);
   }
 
   void toDTSC::handleMPEG2(uint64_t msTime, char *pl, uint32_t plSize){
@@ -985,9 +1010,8 @@ namespace RTP{
     }
     ///\TODO Merge packets with same timestamp together
     HIGH_MSG("Received MPEG2 packet: %s", RTP::MPEGVideoHeader(pl).toString().c_str());
-    DTSC::Packet nextPack;
-    nextPack.genericFill(msTime, 0, trackId, pl + 4, plSize - 4, 0, false);
-    outPacket(nextPack);
+    outPack.genericFill(msTime, 0, trackId, pl + 4, plSize - 4, 0, false);
+    outPacket(outPack);
   }
 
   void toDTSC::handleHEVC(uint64_t msTime, char *pl, uint32_t plSize, bool missed){
@@ -1111,10 +1135,9 @@ namespace RTP{
                    isKey ? "key" : "i", packCount);
     }
     // Fill the new DTSC packet, buffer it.
-    DTSC::Packet nextPack;
-    nextPack.genericFill(newTs, offset, trackId, buffer, len, 0, isKey);
+    outPack.genericFill(newTs, offset, trackId, buffer, len, 0, isKey);
     packCount++;
-    outPacket(nextPack);
+    outPacket(outPack);
   }
 
   /// Handles common H264 packets types, but not all.
@@ -1253,10 +1276,9 @@ namespace RTP{
                      isKey ? "key" : "i", packCount);
       }
       // Fill the new DTSC packet, buffer it.
-      DTSC::Packet nextPack;
-      nextPack.genericFill(newTs, offset, trackId, h264OutBuffer, h264OutBuffer.size(), 0, h264BufferWasKey);
+      outPack.genericFill(newTs, offset, trackId, h264OutBuffer, h264OutBuffer.size(), 0, h264BufferWasKey);
       packCount++;
-      outPacket(nextPack);
+      outPacket(outPack);
 
       //Clear the buffers, reset the time to current
       h264OutBuffer.assign(0, 0);
@@ -1432,10 +1454,9 @@ namespace RTP{
     if (vp8FrameBuffer.size()){
       // new frame and nothing missed? Send.
       if (start_of_frame && !missed){
-        DTSC::Packet nextPack;
-        nextPack.genericFill(msTime, 0, trackId, vp8FrameBuffer, vp8FrameBuffer.size(), 0, vp8BufferHasKeyframe);
+        outPack.genericFill(msTime, 0, trackId, vp8FrameBuffer, vp8FrameBuffer.size(), 0, vp8BufferHasKeyframe);
         packCount++;
-        outPacket(nextPack);
+        outPacket(outPack);
       }
       // Wipe the buffer clean if missed packets or we just sent data out.
       if (start_of_frame || missed){
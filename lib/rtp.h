@@ -29,6 +29,9 @@ namespace RTP{
   extern unsigned int PACKET_REORDER_WAIT;
   extern unsigned int PACKET_DROP_TIMEOUT;
 
+  /// Amount of packets a Sorter can hold for reordering. PACKET_DROP_TIMEOUT is capped below this.
+  const uint16_t SORTER_SLOTS = 1024;
+
     struct FecData{
     public:
       uint16_t sequence;
@@ -116,6 +119,7 @@ namespace RTP{
     Packet(const char *dat, uint64_t len);
     const char *getData();
     char *ptr() const{return data;}
+    uint32_t size() const{return maxDataLen;}
     std::string toString() const;
   };
 
@@ -143,8 +147,16 @@ namespace RTP{
     uint64_t lastBootMS; ///< bootMS time of last Sender Report
   private:
     uint64_t packTrack;
-    std::map<uint16_t, Packet> packBuffer;
-    std::map<uint16_t, Packet> packetHistory;
+    // Reorder buffer: a ring of slots indexed by sequence number, each allocated only once
+    Util::ResizeablePointer slotData[SORTER_SLOTS];
+    uint16_t slotSeq[SORTER_SLOTS];
+    bool slotUsed[SORTER_SLOTS];
+    size_t buffered; ///< Amount of slots in use
+    bool hasPacket(uint16_t seq) const{
+      return slotUsed[seq % SORTER_SLOTS] && slotSeq[seq % SORTER_SLOTS] == seq;
+    }
+    void storePacket(const Packet &pack);
+    void sendBuffered(uint16_t seq);
     void (*callback)(const uint64_t track, const Packet &p);
   };
 
@@ -201,6 +213,7 @@ namespace RTP{
     int64_t milliSync;
     void (*cbPack)(const DTSC::Packet &pkt);
     void (*cbInit)(const uint64_t track, const std::string &initData);
+    DTSC::Packet outPack; ///< Re-used for every outgoing packet, so its buffer is allocated only once
     // Codec-specific handlers
     void handleAAC(uint64_t msTime, char *pl, uint32_t plSize);
     void handleMP2(uint64_t msTime, char *pl, uint32_t plSize);
@@ -7,6 +7,7 @@
 #include "sdp.h"
 #include "url.h"
 #include "util.h"
+#include <arpa/inet.h>
 #include <sys/socket.h>
 
 //Dynamic types we hardcode:
@@ -890,4 +891,59 @@ namespace SDP{
     //myMeta->refresh();
     tracks.clear();
   }
+
+  /// Returns the RTP port of every track in an SDP generated by mediaDescription, indexed by track.
+  /// Tracks are recognized by their "a=control:track<N>" attribute.
+  std::map<size_t, uint32_t> mediaPorts(const std::string &sdp){
+    std::map<size_t, uint32_t> ret;
+    std::stringstream ss(sdp);
+    std::string line;
+    uint32_t port = 0;
+    while (std::getline(ss, line)){
+      if (line.size() && *line.rbegin() == '\r'){line.erase(line.size() - 1);}
+      if (line.substr(0, 2) == "m="){
+        size_t sp = line.find(' ');
+        port = (sp == std::string::npos) ? 0 : atoi(line.c_str() + sp + 1);
+        continue;
+      }
+      if (port && line.substr(0, 15) == "a=control:track"){ret[atoi(line.c_str() + 15)] = port;}
+    }
+    return ret;
+  }
+
+  /// Returns true if the given address is an IPv4 or IPv6 multicast address.
+  bool isMulticast(const std::string &addr){
+    struct in_addr a4;
+    struct in6_addr a6;
+    if (inet_pton(AF_INET, addr.c_str(), &a4) == 1){return (ntohl(a4.s_addr) & 0xF0000000) == 0xE0000000;}
+    if (inet_pton(AF_INET6, addr.c_str(), &a6) == 1){return a6.s6_addr[0] == 0xFF;}
+    return false;
+  }
+
+  /// Returns the address that SAP announcements for sessions on the given IPv4 multicast group
+  /// should be sent to: the last address of the administrative scope the group is in (RFC 2974,
+  /// section 3), or the global scope SAP address otherwise.
+  std::string sapAddress(const std::string &group){
+    if (group.substr(0, 8) == "239.255."){return "239.255.255.255";}
+    if (group.substr(0, 4) == "239."){return "239.195.255.255";}
+    return "224.2.127.254";
+  }
+
+  /// Wraps an SDP in a SAP announcement (or deletion) packet, as per RFC 2974.
+  /// \param origin IPv4 address of the sender; 0.0.0.0 is used if not parseable.
+  /// \param msgHash Identifier of this version of the announcement.
+  std::string sapPacket(const std::string &sdp, const std::string &origin, uint16_t msgHash, bool deletion){
+    std::string ret;
+    ret.reserve(24 + sdp.size());
+    ret += (char)(deletion ? 0x24 : 0x20); // version 1, IPv4 origin, not encrypted or compressed
+    ret += (char)0;                       // no authentication data
+    ret += (char)(msgHash >> 8);
+    ret += (char)(msgHash & 0xFF);
+    struct in_addr a4;
+    if (inet_pton(AF_INET, origin.c_str(), &a4) != 1){a4.s_addr = 0;}
+    ret.append((const char *)&a4.s_addr, 4);
+    ret.append("application/sdp", 16); // includes the terminating null byte
+    ret += sdp;
+    return ret;
+  }
 }// namespace SDP
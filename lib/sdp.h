@@ -70,4 +70,11 @@ namespace SDP{
   };
 
   std::string mediaDescription(const DTSC::Meta *M, size_t tid, uint64_t port = 0);
+  std::map<size_t, uint32_t> mediaPorts(const std::string &sdp);
+
+  // Session Announcement Protocol (RFC 2974) helpers
+  const uint16_t SAP_PORT = 9875;
+  bool isMulticast(const std::string &addr);
+  std::string sapAddress(const std::string &group);
+  std::string sapPacket(const std::string &sdp, const std::string &origin, uint16_t msgHash, bool deletion = false);
 }// namespace SDP
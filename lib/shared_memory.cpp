@@ -13,6 +13,28 @@
 
 namespace IPC{
 
+  /// Opens and privately maps a regular on-disk file, for read access to pages spilled to disk.
+  /// Writes to the mapping are never written back to the file.
+  /// Sets handle to -1 and mapped to 0 on failure.
+  static void mapDiskFile(const std::string &path, int &handle, uint64_t &len, char *&mapped){
+    mapped = 0;
+    len = 0;
+    handle = open(path.c_str(), O_RDONLY);
+    if (handle == -1){
+      FAIL_MSG("Could not open on-disk page %s: %s", path.c_str(), strerror(errno));
+      return;
+    }
+    struct stat buffStats;
+    if (fstat(handle, &buffStats) < 0 || !buffStats.st_size){return;}
+    len = buffStats.st_size;
+    mapped = (char *)mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, 0);
+    if (mapped == MAP_FAILED){
+      FAIL_MSG("mmap for on-disk page %s failed: %s", path.c_str(), strerror(errno));
+      mapped = 0;
+      len = 0;
+    }
+  }
+
   ///\brief Empty semaphore constructor, clears all values
   semaphore::semaphore(){
     mySem = SEM_FAILED;
@@ -362,6 +384,17 @@ namespace IPC{
     }
   }
 
+  /// Maps a regular file instead of a shared memory page, de-initializing before if needed.
+  /// Used for pages that were spilled to disk; the mapping is private, so the file is never
+  /// modified and is never unlinked by this object.
+  ///\param path The full path to the file to map
+  void sharedPage::initFile(const std::string &path){
+    close();
+    name = path;
+    master = false;
+    mapDiskFile(path, handle, len, mapped);
+  }
+
 #endif
 
   /// brief Creates a shared file
@@ -425,6 +458,17 @@ namespace IPC{
     return (sb.st_nlink > 0);
   }
 
+  /// Maps a regular file outside of the temporary folder, de-initializing before if needed.
+  /// Used for pages that were spilled to disk; the mapping is private, so the file is never
+  /// modified and is never unlinked by this object.
+  ///\param path The full path to the file to map
+  void sharedFile::initFile(const std::string &path){
+    close();
+    name = path;
+    master = false;
+    mapDiskFile(path, handle, len, mapped);
+  }
+
   ///\brief Initialize a page, de-initialize before if needed
   ///\param name_ The name of the page to be created
   ///\param len_ The size to make the page
@@ -61,6 +61,7 @@ namespace IPC{
     ~sharedFile();
     operator bool() const;
     void init(const std::string &name_, uint64_t len_, bool master_ = false, bool autoBackoff = true);
+    void initFile(const std::string &path);
     void operator=(sharedFile &rhs);
     bool operator<(const sharedFile &rhs) const{return name < rhs.name;}
     void close();
@@ -87,6 +88,7 @@ namespace IPC{
     ~sharedPage();
     operator bool() const;
     void init(const std::string &name_, uint64_t len_, bool master_ = false, bool autoBackoff = true);
+    void initFile(const std::string &path);
     void operator=(sharedPage &rhs);
     bool operator<(const sharedPage &rhs) const{return name < rhs.name;}
     void unmap();
@@ -327,6 +327,54 @@ bool Socket::getPeerName(int fd, std::string &host, uint32_t &port){
   return getPeerName(fd, host, port, (sockaddr*)&tmpaddr, &addrLen);
 }
 
+/// Passes file descriptor fd to the process on the other end of Unix socket sock (SCM_RIGHTS).
+/// The caller still owns (and should close) its own copy of fd.
+bool Socket::sendFD(int sock, int fd){
+  char dummy = 0;
+  struct iovec iov;
+  iov.iov_base = &dummy;
+  iov.iov_len = 1;
+  char ctrl[CMSG_SPACE(sizeof(int))];
+  memset(ctrl, 0, sizeof(ctrl));
+  struct msghdr mHdr;
+  memset(&mHdr, 0, sizeof(mHdr));
+  mHdr.msg_iov = &iov;
+  mHdr.msg_iovlen = 1;
+  mHdr.msg_control = ctrl;
+  mHdr.msg_controllen = sizeof(ctrl);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mHdr);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  int r;
+  do{r = sendmsg(sock, &mHdr, 0);}while (r < 0 && errno == EINTR);
+  return r == 1;
+}
+
+/// Blocks until a file descriptor is received over Unix socket sock, as sent by sendFD.
+/// Returns -1 if the other end closed the socket, on error, or when interrupted by a signal.
+int Socket::recvFD(int sock){
+  char dummy = 0;
+  struct iovec iov;
+  iov.iov_base = &dummy;
+  iov.iov_len = 1;
+  char ctrl[CMSG_SPACE(sizeof(int))];
+  memset(ctrl, 0, sizeof(ctrl));
+  struct msghdr mHdr;
+  memset(&mHdr, 0, sizeof(mHdr));
+  mHdr.msg_iov = &iov;
+  mHdr.msg_iovlen = 1;
+  mHdr.msg_control = ctrl;
+  mHdr.msg_controllen = sizeof(ctrl);
+  if (recvmsg(sock, &mHdr, 0) < 1){return -1;}
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mHdr);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS){return -1;}
+  int fd = -1;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
 std::string uint2string(unsigned int i){
   std::stringstream st;
   st << i;
@@ -334,200 +382,233 @@ std::string uint2string(unsigned int i){
 }
 
 Socket::Buffer::Buffer(){
+  data = 0;
+  capacity = 0;
+  start = 0;
+  end = 0;
   splitter = "\n";
 }
 
-/// Returns the amount of elements in the internal std::deque of std::string objects.
-/// The back is popped as long as it is empty, first - this way this function is
-/// guaranteed to return 0 if the buffer is empty.
+Socket::Buffer::Buffer(const Buffer &rhs){
+  data = 0;
+  capacity = 0;
+  start = 0;
+  end = 0;
+  *this = rhs;
+}
+
+Socket::Buffer &Socket::Buffer::operator=(const Buffer &rhs){
+  if (this == &rhs){return *this;}
+  clear();
+  splitter = rhs.splitter;
+  part = rhs.part;
+  if (rhs.end > rhs.start){append(rhs.data + rhs.start, rhs.end - rhs.start);}
+  return *this;
+}
+
+Socket::Buffer::~Buffer(){
+  if (data){free(data);}
+}
+
+/// Puts the given data back in front of the unread data, making room if needed.
+void Socket::Buffer::insertFront(const char *newdata, size_t newdatasize){
+  if (!newdatasize){return;}
+  if (start < newdatasize){
+    size_t used = end - start;
+    if (capacity < used + newdatasize){
+      size_t newCap = capacity ? capacity * 2 : BUFFER_BLOCKSIZE * 4;
+      while (newCap < used + newdatasize){newCap *= 2;}
+      char *newData = (char *)realloc(data, newCap);
+      if (!newData){
+        FAIL_MSG("Could not grow buffer to %zu bytes: aborting!", newCap);
+        return;
+      }
+      data = newData;
+      capacity = newCap;
+    }
+    memmove(data + newdatasize, data + start, used);
+    start = newdatasize;
+    end = newdatasize + used;
+  }
+  start -= newdatasize;
+  memcpy(data + start, newdata, newdatasize);
+}
+
+/// Returns the part handed out by get() to the unread data, if there is one.
+void Socket::Buffer::restorePart(){
+  if (part.empty()){return;}
+  insertFront(part.data(), part.size());
+  part.clear();
+}
+
+/// Returns the amount of parts in the buffer: the one handed out by get(), if any, and the
+/// unread data after it, if any. This way this function is guaranteed to return 0 if the buffer
+/// is empty, and more than 1 if there is more data after the part returned by get().
 unsigned int Socket::Buffer::size(){
-  while (data.size() > 0 && data.back().empty()){data.pop_back();}
-  return data.size();
+  return (part.size() ? 1 : 0) + (end > start ? 1 : 0);
 }
 
 /// Returns either the amount of total bytes available in the buffer or max, whichever is smaller.
 unsigned int Socket::Buffer::bytes(unsigned int max){
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= max){return max;}
-  }
-  return i;
+  size_t i = part.size() + end - start;
+  return i < max ? i : max;
 }
 
-/// Returns how many bytes to read until the next splitter, or 0 if none found.
+/// Returns how many bytes to read until and including the next splitter, or 0 if none found.
 unsigned int Socket::Buffer::bytesToSplit(){
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    i += (*it).size();
-    if ((*it).size() >= splitter.size() && (*it).substr((*it).size() - splitter.size()) == splitter){
-      return i;
-    }
+  restorePart();
+  if (splitter.empty()){return end - start;}
+  const char *p = data + start;
+  const char *stop = data + end;
+  while ((size_t)(stop - p) >= splitter.size()){
+    p = (const char *)memchr(p, splitter[0], stop - p - splitter.size() + 1);
+    if (!p){return 0;}
+    if (!memcmp(p, splitter.data(), splitter.size())){return p + splitter.size() - (data + start);}
+    ++p;
   }
   return 0;
 }
 
-/// Appends this string to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this string to the end of the buffer.
 void Socket::Buffer::append(const std::string &newdata){
   append(newdata.data(), newdata.size());
 }
 
-/// Helper function that does a short-circuiting string compare
-inline bool string_compare(const char *a, const char *b, const size_t len){
-  for (size_t i = 0; i < len; ++i){
-    if (a[i] != b[i]){return false;}
-  }
-  return true;
-}
-
-/// Appends this data block to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this data block to the end of the buffer.
 void Socket::Buffer::append(const char *newdata, const unsigned int newdatasize){
-  uint32_t i = 0;
-  while (i < newdatasize){
-    uint32_t j = 0;
-    if (!splitter.size()){
-      if (newdatasize - i > BUFFER_BLOCKSIZE){
-        j = BUFFER_BLOCKSIZE;
-      }else{
-        j = newdatasize - i;
-      }
-    }else{
-      while (j + i < newdatasize && j < BUFFER_BLOCKSIZE){
-        j++;
-        if (j >= splitter.size()){
-          if (string_compare(newdata + i + j - splitter.size(), splitter.data(), splitter.size())){
-            break;
-          }
-        }
-      }
-    }
-    if (j){
-      data.push_front("");
-      data.front().assign(newdata + i, (size_t)j);
-      i += j;
-    }else{
-      FAIL_MSG("Appended an empty string to buffer: aborting!");
-      break;
-    }
-  }
-  if (data.size() > 5000){
-    WARN_MSG("Warning: After %d new bytes, buffer has %d parts containing over %u bytes!",
-             newdatasize, (int)data.size(), bytes(9000));
-  }
+  if (!newdatasize){return;}
+  char *target = reserve(newdatasize);
+  if (!target){return;}
+  memcpy(target, newdata, newdatasize);
+  commit(newdatasize);
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this data block to the front of the buffer.
 void Socket::Buffer::prepend(const std::string &newdata){
-  data.push_back(newdata);
+  prepend(newdata.data(), newdata.size());
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this data block to the front of the buffer.
 void Socket::Buffer::prepend(const char *newdata, const unsigned int newdatasize){
-  data.push_back(std::string(newdata, (size_t)newdatasize));
+  restorePart();
+  insertFront(newdata, newdatasize);
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count){
-  size();
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
-  }
-  return false;
+  return part.size() + end - start >= count;
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count) const{
-  unsigned int i = 0;
-  for (std::deque<std::string>::const_iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
-  }
-  return false;
+  return part.size() + end - start >= count;
 }
 
 /// Removes count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::remove(unsigned int count){
-  size();
-  if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ret.append(*it, 0, count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  restorePart();
+  if (end - start < count){return "";}
+  std::string ret(data + start, (size_t)count);
+  consume(count);
   return ret;
 }
 
 /// Removes count bytes from the buffer, appending them to the given ptr.
 /// Does nothing if not all count bytes are available.
 void Socket::Buffer::remove(Util::ResizeablePointer & ptr, unsigned int count){
-  size();
-  if (!available(count)){return;}
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ptr.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ptr.append(it->data(), count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  restorePart();
+  if (end - start < count){return;}
+  ptr.append(data + start, count);
+  consume(count);
 }
 
 /// Copies count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::copy(unsigned int count){
-  size();
-  if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-    }else{
-      ret.append(*it, 0, count - i);
-      break;
-    }
-  }
-  return ret;
+  restorePart();
+  if (end - start < count){return "";}
+  return std::string(data + start, (size_t)count);
 }
 
-/// Gets a reference to the back of the internal std::deque of std::string objects.
+/// Gets a reference to the oldest part of the buffer: everything up to and including the next
+/// splitter, or all unread data if there is no splitter in it.
+/// The part is removed from the buffer once it has been emptied through the returned reference.
 std::string &Socket::Buffer::get(){
-  size();
-  static std::string empty;
-  if (data.size() > 0){
-    return data.back();
-  }else{
-    return empty;
+  if (part.size() || end == start){return part;}
+  size_t len = 0;
+  if (splitter.size()){len = bytesToSplit();}
+  if (!len){len = end - start;}
+  part.assign(data + start, len);
+  start += len;
+  if (start == end){
+    start = 0;
+    end = 0;
   }
+  return part;
 }
 
 /// Completely empties the buffer
 void Socket::Buffer::clear(){
-  data.clear();
+  part.clear();
+  start = 0;
+  end = 0;
+}
+
+/// Points ptr at all unread data in the buffer and returns its length.
+/// The data stays valid until the buffer is next modified.
+unsigned int Socket::Buffer::peek(const char *&ptr){
+  restorePart();
+  ptr = data + start;
+  return end - start;
+}
+
+/// Drops count bytes (or everything, if fewer are available) from the front of the buffer.
+void Socket::Buffer::consume(unsigned int count){
+  restorePart();
+  start += count;
+  if (start >= end){
+    start = 0;
+    end = 0;
+  }
+}
+
+/// Makes sure at least count bytes of free space follow the unread data, returning a pointer
+/// to it. Write into it and call commit() to add the written bytes to the buffer.
+/// The unread data is moved to the front of the storage when that frees enough space; the
+/// storage is only grown when it would be more than three quarters full.
+char *Socket::Buffer::reserve(unsigned int count){
+  if (capacity - end >= count){return data + end;}
+  size_t used = end - start;
+  if (used + count <= capacity - capacity / 4){
+    memmove(data, data + start, used);
+  }else{
+    size_t newCap = capacity ? capacity * 2 : BUFFER_BLOCKSIZE * 4;
+    while (used + count > newCap - newCap / 4){newCap *= 2;}
+    char *newData = (char *)malloc(newCap);
+    if (!newData){
+      FAIL_MSG("Could not grow buffer to %zu bytes: aborting!", newCap);
+      return 0;
+    }
+    if (used){memcpy(newData, data + start, used);}
+    if (data){free(data);}
+    data = newData;
+    capacity = newCap;
+  }
+  start = 0;
+  end = used;
+  return data + end;
+}
+
+/// Returns the amount of free space following the unread data, which is at least as much as
+/// was last asked for through reserve().
+unsigned int Socket::Buffer::spare() const{
+  return capacity - end;
+}
+
+/// Adds count bytes, written to the pointer returned by reserve(), to the end of the buffer.
+void Socket::Buffer::commit(unsigned int count){
+  end += count;
 }
 
 void Socket::Connection::setBoundAddr(){
@@ -607,6 +688,7 @@ void Socket::Connection::clear(){
   conf = 0;
   ctr_drbg = 0;
   entropy = 0;
+  ktls = TLSOffload();
 #endif
 }
 
@@ -692,7 +774,13 @@ void Socket::Connection::drop(){
 #ifdef SSL
   if (sslConnected){
     DONTEVEN_MSG("SSL close");
-    if (ssl){mbedtls_ssl_close_notify(ssl);}
+    if (ktls.active){
+      // mbedtls no longer knows the outgoing sequence numbers; the kernel has to send the alert
+      if (server_fd){ktls.closeNotify(server_fd->fd);}
+      ktls = TLSOffload();
+    }else if (ssl){
+      mbedtls_ssl_close_notify(ssl);
+    }
     if (server_fd){
       mbedtls_net_free(server_fd);
       delete server_fd;
@@ -829,6 +917,7 @@ bool Socket::Connection::sslAccept(mbedtls_ssl_config * sslConf, mbedtls_ctr_drb
     close();
     return false;
   }
+  ktls.prepare(ssl, sslConf);
 
   // Inform mbedtls how we'd like to use the connection (uses default bio handlers)
   // We tell it to use non-blocking IO here
@@ -848,6 +937,8 @@ bool Socket::Connection::sslAccept(mbedtls_ssl_config * sslConf, mbedtls_ctr_drb
     }
   }
   sslConnected = true;
+  // Let the kernel encrypt what we send, if it can; writes then go straight to the socket
+  ktls.enable(server_fd->fd, ssl, true);
   HIGH_MSG("Started SSL connection handler");
   return true;
 }
@@ -1031,7 +1122,7 @@ uint64_t Socket::Connection::dataDown(){
 /// Returns true if new data was received, false otherwise.
 bool Socket::Connection::spool(bool strictMode){
   /// \todo Provide better mechanism to prevent overbuffering.
-  if (!strictMode && downbuffer.size() > 10000){
+  if (!strictMode && downbuffer.bytes(BUFFER_BLOCKSIZE * 10000) >= BUFFER_BLOCKSIZE * 10000){
     return true;
   }else{
     return iread(downbuffer);
@@ -1091,7 +1182,7 @@ void Socket::Connection::skipBytes(uint32_t byteCount){
 /// \returns The amount of bytes actually written.
 unsigned int Socket::Connection::iwrite(const void *buffer, int len){
 #ifdef SSL
-  if (sslConnected){
+  if (sslConnected && !ktls.active){
     DONTEVEN_MSG("SSL iwrite");
     if (!connected() || len < 1){return 0;}
     int r;
@@ -1166,13 +1257,23 @@ unsigned int Socket::Connection::iwrite(const void *buffer, int len){
 /// \param flags Flags to use in the recv call. Ignored on fake sockets.
 /// \returns The amount of bytes actually read.
 int Socket::Connection::iread(void *buffer, int len, int flags){
+  if (len < 1){return 0;}
+  struct iovec vec;
+  vec.iov_base = buffer;
+  vec.iov_len = len;
+  return iread(&vec, 1, flags);
+}
+
+/// Incremental scatter read call, filling the given buffers in order.
+/// Only the first buffer is used for SSL connections.
+int Socket::Connection::iread(struct iovec *vec, int count, int flags){
 #ifdef SSL
   if (sslConnected){
     DONTEVEN_MSG("SSL iread");
-    if (!connected() || len < 1){return 0;}
+    if (!connected() || count < 1 || vec[0].iov_len < 1){return 0;}
     int r;
     /// \TODO Flags ignored... Bad.
-    r = mbedtls_ssl_read(ssl, (unsigned char *)buffer, len);
+    r = mbedtls_ssl_read(ssl, (unsigned char *)vec[0].iov_base, vec[0].iov_len);
     if (r < 0){
       switch (errno){
       case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
@@ -1202,12 +1303,16 @@ int Socket::Connection::iread(void *buffer, int len, int flags){
     return r;
   }
 #endif
-  if (!connected() || len < 1){return 0;}
+  if (!connected() || count < 1){return 0;}
   int r;
   if (sRecv != -1 || !isTrueSocket){
-    r = read(sRecv, buffer, len);
+    r = readv(sRecv, vec, count);
   }else{
-    r = recv(sSend, buffer, len, flags);
+    struct msghdr mHdr;
+    memset(&mHdr, 0, sizeof(mHdr));
+    mHdr.msg_iov = vec;
+    mHdr.msg_iovlen = count;
+    r = recvmsg(sSend, &mHdr, flags);
   }
   if (r < 0){
     switch (errno){
@@ -1232,15 +1337,26 @@ int Socket::Connection::iread(void *buffer, int len, int flags){
 
 /// Read call that is compatible with Socket::Buffer.
 /// Data is read using iread (which is nonblocking if the Socket::Connection itself is),
-/// then appended to end of buffer.
+/// directly into the free space at the end of the buffer. Anything that does not fit is read into
+/// a temporary block and appended, growing the buffer.
 /// \param buffer Socket::Buffer to append data to.
 /// \param flags Flags to use in the recv call. Ignored on fake sockets.
 /// \return True if new data arrived, false otherwise.
 bool Socket::Connection::iread(Buffer &buffer, int flags){
-  char cbuffer[BUFFER_BLOCKSIZE];
-  int num = iread(cbuffer, BUFFER_BLOCKSIZE, flags);
+  char cbuffer[BUFFER_BLOCKSIZE * 4];
+  struct iovec vec[2];
+  vec[0].iov_base = buffer.reserve(BUFFER_BLOCKSIZE);
+  vec[0].iov_len = vec[0].iov_base ? buffer.spare() : 0;
+  vec[1].iov_base = cbuffer;
+  vec[1].iov_len = sizeof(cbuffer);
+  int num = vec[0].iov_len ? iread(vec, 2, flags) : iread(vec + 1, 1, flags);
   if (num < 1){return false;}
-  buffer.append(cbuffer, num);
+  if ((size_t)num <= vec[0].iov_len){
+    buffer.commit(num);
+  }else{
+    buffer.commit(vec[0].iov_len);
+    buffer.append(cbuffer, num - vec[0].iov_len);
+  }
   return true;
 }// iread
 
@@ -1997,6 +2113,22 @@ void Socket::UDPConnection::setSocketFamily(int AF_TYPE){\
   family = AF_TYPE;
 }
 
+/// Sets the time-to-live (hop limit) of outgoing multicast datagrams.
+/// Must be called after SetDestination, as that may replace the socket.
+void Socket::UDPConnection::setMulticastTTL(int ttl){
+  if (sock < 0){return;}
+  if (family == AF_INET6){
+    if (setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl))){
+      WARN_MSG("Could not set multicast hop limit to %d: %s", ttl, strerror(errno));
+    }
+  }else{
+    unsigned char ttl4 = ttl;
+    if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl4, sizeof(ttl4))){
+      WARN_MSG("Could not set multicast TTL to %d: %s", ttl, strerror(errno));
+    }
+  }
+}
+
 /// Allocates enough space for the largest type of address we support, so that receive calls can write to it.
 void Socket::UDPConnection::allocateDestination(){
   if (destAddr && destAddr_size < sizeof(sockaddr_in6)){
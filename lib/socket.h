@@ -11,6 +11,7 @@
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include "util.h"
@@ -31,6 +32,7 @@
 #include <mbedtls/ssl_cookie.h>
 #include <mbedtls/timing.h>
 #include <mbedtls/version.h>
+#include "ktls.h"
 
 #if MBEDTLS_VERSION_MAJOR == 2
 #include <mbedtls/certs.h>
@@ -65,15 +67,31 @@ namespace Socket{
   bool getSocketName(int fd, std::string &host, uint32_t &port);
   bool getPeerName(int fd, std::string &host, uint32_t &port);
   bool getPeerName(int fd, std::string &host, uint32_t &port, sockaddr * tmpaddr, socklen_t * addrlen);
+  bool sendFD(int sock, int fd);
+  int recvFD(int sock);
 
-  /// A buffer made out of std::string objects that can be efficiently read from and written to.
+  /// A growable byte buffer that can be efficiently read from and written to.
+  /// All unread data is kept in a single contiguous block of memory, which sockets read into
+  /// directly. Binary protocols can inspect the data in place through peek() and drop it through
+  /// consume(), without any copies or allocations.
+  /// Line-based users may keep using get() and size(): get() hands out the oldest part of the
+  /// data, up to and including the next splitter, as a std::string that may be edited in place.
   class Buffer{
   private:
-    std::deque<std::string> data;
+    char *data;      ///< Storage; the unread data is data[start] up to data[end].
+    size_t capacity; ///< Allocated size of data.
+    size_t start;    ///< Offset of the first unread byte.
+    size_t end;      ///< Offset just past the last unread byte.
+    std::string part; ///< Part handed out by get(), logically in front of the unread data.
+    void insertFront(const char *newdata, size_t newdatasize);
+    void restorePart();
 
   public:
-    std::string splitter; ///< String to automatically split on if encountered. \n by default
+    std::string splitter; ///< String to split get() parts on. \n by default
     Buffer();
+    Buffer(const Buffer &rhs);
+    Buffer &operator=(const Buffer &rhs);
+    ~Buffer();
     unsigned int size();
     unsigned int bytes(unsigned int max);
     unsigned int bytesToSplit();
@@ -88,6 +106,12 @@ namespace Socket{
     void remove(Util::ResizeablePointer & ptr, unsigned int count);
     std::string copy(unsigned int count);
     void clear();
+    // Zero-copy access
+    unsigned int peek(const char *&ptr);
+    void consume(unsigned int count);
+    char *reserve(unsigned int count);
+    unsigned int spare() const;
+    void commit(unsigned int count);
   };
   // Buffer
 
@@ -108,6 +132,7 @@ namespace Socket{
     long long int conntime;
     Buffer downbuffer;                                ///< Stores temporary data coming in.
     int iread(void *buffer, int len, int flags = 0);  ///< Incremental read call.
+    int iread(struct iovec *vec, int count, int flags = 0); ///< Incremental scatter read call.
     bool iread(Buffer &buffer, int flags = 0); ///< Incremental write call that is compatible with Socket::Buffer.
     void setBoundAddr();
 
@@ -123,6 +148,7 @@ namespace Socket{
     mbedtls_ctr_drbg_context *ctr_drbg;
     mbedtls_ssl_context *ssl;
     mbedtls_ssl_config *conf;
+    TLSOffload ktls; ///< Kernel encryption of outgoing data, for accepted connections
 #endif
 
   public:
@@ -287,6 +313,7 @@ namespace Socket{
     void sendPaced(uint64_t uSendWindow);
     size_t timeToNextPace(uint64_t uTime = 0);
     void setSocketFamily(int AF_TYPE);
+    void setMulticastTTL(int ttl);
 
 
 #ifdef SSL
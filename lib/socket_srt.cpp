@@ -173,7 +173,6 @@ namespace Socket{
       lastGood = Util::bootMS();
     }
 
-    srt_bstats(sock, &performanceMonitor, false);
     return receivedBytes;
   }
 
@@ -207,7 +206,6 @@ namespace Socket{
     }else{
       lastGood = Util::bootMS();
     }
-    srt_bstats(sock, &performanceMonitor, false);
     return receivedBytes;
   }
 
@@ -349,7 +347,6 @@ namespace Socket{
     }else{
       lastGood = Util::bootMS();
     }
-    srt_bstats(sock, &performanceMonitor, false);
   }
 
   unsigned int SRTConnection::connTime(){
@@ -374,6 +371,25 @@ namespace Socket{
     return (direction == "output" ? performanceMonitor.pktRetransTotal : 0);
   }
 
+  /// Returns the smoothed round trip time in milliseconds.
+  uint64_t SRTConnection::roundTripTime(){
+    return (performanceMonitor.msRTT > 0 ? (uint64_t)performanceMonitor.msRTT : 0);
+  }
+
+  /// Returns how much data is waiting in the SRT send (output) or receive (input) buffer, in milliseconds.
+  uint64_t SRTConnection::bufferFill(){
+    int ms = (direction == "output" ? performanceMonitor.msSndBuf : performanceMonitor.msRcvBuf);
+    return (ms > 0 ? ms : 0);
+  }
+
+  /// Refreshes the statistics returned by the getters above.
+  /// Sending and receiving do not do this by themselves, so per-message I/O stays cheap;
+  /// callers refresh once per stats interval instead.
+  void SRTConnection::updateStats(){
+    if (sock == -1){return;}
+    srt_bstats(sock, &performanceMonitor, false);
+  }
+
   void SRTConnection::initializeEmpty(){
     memset(&performanceMonitor, 0, sizeof(performanceMonitor));
     prev_pktseq = 0;
@@ -556,6 +572,63 @@ namespace Socket{
 
   int SRTServer::getSocket(){return conn.getSocket();}
 
+  SRTPoller::SRTPoller(){
+    count = 0;
+    eid = srt_epoll_create();
+    if (eid < 0){
+      ERROR_MSG("Could not create SRT epoll instance: %s", srt_getlasterror_str());
+      return;
+    }
+    // Waiting without any sockets added is allowed, it simply times out
+    srt_epoll_set(eid, SRT_EPOLL_ENABLE_EMPTY);
+  }
+
+  SRTPoller::~SRTPoller(){
+    if (eid >= 0){srt_epoll_release(eid);}
+  }
+
+  /// Starts watching the given socket for incoming data, connections and errors.
+  bool SRTPoller::add(SRTSOCKET s){
+    if (eid < 0 || s == SRT_INVALID_SOCK){return false;}
+    int modes = SRT_EPOLL_IN | SRT_EPOLL_ERR;
+    if (srt_epoll_add_usock(eid, s, &modes) == SRT_ERROR){
+      WARN_MSG("Could not add SRT socket %" PRId32 " to epoll: %s", s, srt_getlasterror_str());
+      return false;
+    }
+    ++count;
+    return true;
+  }
+
+  void SRTPoller::remove(SRTSOCKET s){
+    if (eid < 0 || s == SRT_INVALID_SOCK){return;}
+    // Closed sockets are removed from the epoll by the library itself, so always lower the count
+    srt_epoll_remove_usock(eid, s);
+    if (count){--count;}
+  }
+
+  /// Waits up to msTimeout milliseconds for any of the sockets to become ready.
+  /// Readable sockets are put in ready, sockets with errors in failed. Returns the total amount.
+  size_t SRTPoller::wait(std::vector<SRTSOCKET> &ready, std::vector<SRTSOCKET> &failed, int64_t msTimeout){
+    ready.clear();
+    failed.clear();
+    if (eid < 0){
+      Util::sleep(msTimeout);
+      return 0;
+    }
+    events.resize(count ? count : 1);
+    int ret = srt_epoll_uwait(eid, &events[0], events.size(), msTimeout);
+    if (ret <= 0){return 0;}
+    if ((size_t)ret > events.size()){ret = events.size();}
+    for (int i = 0; i < ret; ++i){
+      if (events[i].events & SRT_EPOLL_ERR){
+        failed.push_back(events[i].fd);
+      }else{
+        ready.push_back(events[i].fd);
+      }
+    }
+    return ret;
+  }
+
   inline int SocketOption::setSo(int socket, int proto, int sym, const void *data, size_t size, bool isSrtOpt){
     if (isSrtOpt){return srt_setsockopt(socket, 0, SRT_SOCKOPT(sym), data, (int)size);}
     return ::setsockopt(socket, proto, sym, (const char *)data, (int)size);
@@ -3,6 +3,7 @@
 #include "url.h"
 #include <map>
 #include <string>
+#include <vector>
 #include <srt/srt.h>
 
 typedef std::map<std::string, int> SockOptVals;
@@ -66,6 +67,9 @@ namespace Socket{
     uint64_t packetCount();
     uint64_t packetLostCount();
     uint64_t packetRetransmitCount();
+    uint64_t roundTripTime();
+    uint64_t bufferFill();
+    void updateStats();
 
     std::string direction;
 
@@ -117,6 +121,25 @@ namespace Socket{
     std::string direction;
   };
 
+  /// Waits on many SRT sockets at once through an SRT epoll instance, so a single thread can
+  /// service many connections. Sockets are watched for readability and errors only.
+  class SRTPoller{
+  public:
+    SRTPoller();
+    ~SRTPoller();
+    bool add(SRTSOCKET s);
+    void remove(SRTSOCKET s);
+    size_t wait(std::vector<SRTSOCKET> &ready, std::vector<SRTSOCKET> &failed, int64_t msTimeout);
+    size_t size() const{return count;}
+
+  private:
+    SRTPoller(const SRTPoller &rhs);
+    SRTPoller &operator=(const SRTPoller &rhs);
+    int eid;
+    size_t count;
+    std::vector<SRT_EPOLL_EVENT> events;
+  };
+
   struct OptionValue{
     std::string s;
     int i;
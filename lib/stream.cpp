@@ -812,6 +812,59 @@ void Util::sendUDPApi(JSON::Value & cmd){
   uSock.SendNow(cmd.toString());
 }
 
+/// Returns the name of the output binary that can push to the given destination, or an empty
+/// string if there is none. Options (after '?') are ignored while matching.
+static std::string findPushOutput(DTSC::Scan &outputs, const std::string &dest){
+  std::string output_bin;
+  std::string checkTarget = dest.substr(0, dest.rfind('?'));
+  unsigned int outputs_size = outputs.getSize();
+  for (unsigned int i = 0; i < outputs_size && !output_bin.size(); ++i){
+    DTSC::Scan output = outputs.getIndice(i);
+    if (output.getMember("push_urls")){
+      unsigned int push_count = output.getMember("push_urls").getSize();
+      for (unsigned int j = 0; j < push_count; ++j){
+        std::string tar_match = output.getMember("push_urls").getIndice(j).asString();
+        std::string front = tar_match.substr(0, tar_match.find('*'));
+        std::string back = tar_match.substr(tar_match.find('*') + 1);
+        MEDIUM_MSG("Checking output %s: %s (%s)", outputs.getIndiceName(i).c_str(),
+                   output.getMember("name").asString().c_str(), checkTarget.c_str());
+        if (checkTarget.substr(0, front.size()) == front &&
+            checkTarget.size() >= back.size() && checkTarget.substr(checkTarget.size() - back.size()) == back){
+          output_bin = "MistOut" + output.getMember("name").asString();
+          break;
+        }
+        //Check for external writer support
+        if (front == "/" && back.size() && checkTarget.size() >= back.size() && checkTarget.substr(checkTarget.size() - back.size()) == back){
+          HTTP::URL tUri(dest);
+          // If it is a remote target, we might need to spawn an external binary
+          if (tUri.isLocalPath()){continue;}
+          // Read configured external writers
+          IPC::sharedPage extwriPage(EXTWRITERS, 0, false, false);
+          if (extwriPage.mapped){
+            Util::RelAccX extWri(extwriPage.mapped, false);
+            if (extWri.isReady()){
+              for (uint64_t i = 0; i < extWri.getEndPos(); i++){
+                Util::RelAccX protocols = Util::RelAccX(extWri.getPointer("protocols", i));
+                uint8_t protocolCount = protocols.getPresent();
+                JSON::Value protocolArray;
+                for (uint8_t idx = 0; idx < protocolCount; idx++){
+                  if (tUri.protocol == protocols.getPointer("protocol", idx)){
+                    output_bin = "MistOut" + output.getMember("name").asString();
+                    break;
+                  }
+                  if (output_bin.size()){break;}
+                }
+                if (output_bin.size()){break;}
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return output_bin;
+}
+
 /// Attempt to start a push for streamname to target.
 /// streamname MUST be pre-sanitized
 /// target gets variables replaced and may be altered by the PUSH_OUT_START trigger response.
@@ -845,51 +898,25 @@ pid_t Util::startPush(const std::string &streamname, std::string &target, int de
       FAIL_MSG("Capabilities not available, aborting! Is MistController running?");
       return 0;
     }
-    std::string checkTarget = target.substr(0, target.rfind('?'));
-    unsigned int outputs_size = outputs.getSize();
-    for (unsigned int i = 0; i < outputs_size && !output_bin.size(); ++i){
-      DTSC::Scan output = outputs.getIndice(i);
-      if (output.getMember("push_urls")){
-        unsigned int push_count = output.getMember("push_urls").getSize();
-        for (unsigned int j = 0; j < push_count; ++j){
-          std::string tar_match = output.getMember("push_urls").getIndice(j).asString();
-          std::string front = tar_match.substr(0, tar_match.find('*'));
-          std::string back = tar_match.substr(tar_match.find('*') + 1);
-          MEDIUM_MSG("Checking output %s: %s (%s)", outputs.getIndiceName(i).c_str(),
-                     output.getMember("name").asString().c_str(), checkTarget.c_str());
-          if (checkTarget.substr(0, front.size()) == front &&
-              checkTarget.size() >= back.size() && checkTarget.substr(checkTarget.size() - back.size()) == back){
-            output_bin = "MistOut" + output.getMember("name").asString();
-            break;
-          }
-          //Check for external writer support
-          if (front == "/" && back.size() && checkTarget.size() >= back.size() && checkTarget.substr(checkTarget.size() - back.size()) == back){
-            HTTP::URL tUri(target);
-            // If it is a remote target, we might need to spawn an external binary
-            if (tUri.isLocalPath()){continue;}
-            // Read configured external writers
-            IPC::sharedPage extwriPage(EXTWRITERS, 0, false, false);
-            if (extwriPage.mapped){
-              Util::RelAccX extWri(extwriPage.mapped, false);
-              if (extWri.isReady()){
-                for (uint64_t i = 0; i < extWri.getEndPos(); i++){
-                  Util::RelAccX protocols = Util::RelAccX(extWri.getPointer("protocols", i));
-                  uint8_t protocolCount = protocols.getPresent();
-                  JSON::Value protocolArray;
-                  for (uint8_t idx = 0; idx < protocolCount; idx++){
-                    if (tUri.protocol == protocols.getPointer("protocol", idx)){
-                      output_bin = "MistOut" + output.getMember("name").asString();
-                      break;
-                    }
-                    if (output_bin.size()){break;}
-                  }
-                  if (output_bin.size()){break;}
-                }
-              }
-            }
-          }
-        }
+    // Fan-out targets (joined by '|') are muxed by a single output, so every destination must be
+    // handled by the same output binary.
+    size_t pos = 0;
+    while (pos <= target.size()){
+      size_t end = target.find('|', pos);
+      if (end == std::string::npos){end = target.size();}
+      std::string dest = target.substr(pos, end - pos);
+      pos = end + 1;
+      std::string destBin = findPushOutput(outputs, dest);
+      if (!destBin.size()){
+        FAIL_MSG("No output found for target %s, aborting push.", dest.c_str());
+        return 0;
       }
+      if (output_bin.size() && destBin != output_bin){
+        FAIL_MSG("Destination %s needs %s instead of %s; all destinations of a push must use the same output, aborting push.",
+                 dest.c_str(), destBin.c_str(), output_bin.c_str());
+        return 0;
+      }
+      output_bin = destBin;
     }
   }
 
@@ -1313,6 +1340,10 @@ std::set<size_t> Util::pickTracks(const DTSC::Meta &M, const std::set<size_t> tr
 /// It is necessary to follow up with a selectDefaultTracks() call to strip unsupported
 /// codecs/combinations.
 std::set<size_t> Util::findTracks(const DTSC::Meta &M, const JSON::Value &capa, const std::string &trackType, const std::string &trackVal, const std::string &UA){
+  return findTracks(M, CodecCapa(capa), trackType, trackVal, UA);
+}
+
+std::set<size_t> Util::findTracks(const DTSC::Meta &M, const CodecCapa &capa, const std::string &trackType, const std::string &trackVal, const std::string &UA){
   std::set<size_t> validTracks = capa?getSupportedTracks(M, capa, "", UA):M.getValidTracks(true);
   return pickTracks(M, validTracks, trackType, trackVal);
 }
@@ -1325,8 +1356,191 @@ std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::string &track
   return wouldSelect(M, parsedVariables, capa, UA);
 }
 
+Util::CodecCapa::CodecCapa(){
+  isSet = false;
+  hasCodecs = false;
+  allowBFrames = true;
+  hasMaxDelay = false;
+  maxDelay = 0;
+}
+
+Util::CodecCapa::CodecCapa(const JSON::Value &capa){
+  compile(capa);
+}
+
+/// Parses the "codecs", "exceptions", "encryption", "methods" and "maxdelay" members of the given
+/// connector capabilities, replacing anything compiled before.
+void Util::CodecCapa::compile(const JSON::Value &capa){
+  isSet = capa;
+  combos.clear();
+  comboNames.clear();
+  encryption.clear();
+  exceptions.clear();
+  codecExceptions.clear();
+  lastUA.clear();
+  lastAllowed.clear();
+  allowBFrames = true;
+  hasMaxDelay = capa.isMember("maxdelay");
+  maxDelay = hasMaxDelay ? capa["maxdelay"].asInt() : 0;
+  if (capa.isMember("exceptions") && capa["exceptions"].isObject() && capa["exceptions"].size()){
+    jsonForEachConst(capa["exceptions"], ex){
+      if (ex.key().substr(0, 6) != "codec:"){continue;}
+      codecExceptions[ex.key().substr(6)] = exceptions.size();
+      exceptions.push_back(*ex);
+    }
+  }
+  if (capa.isMember("methods")){
+    jsonForEachConst(capa["methods"], mthd){
+      if (mthd->isMember("nobframes") && (*mthd)["nobframes"]){
+        allowBFrames = false;
+        break;
+      }
+    }
+  }
+  if (capa.isMember("encryption")){
+    jsonForEachConst(capa["encryption"], it){encryption.push_back(it->asStringRef());}
+  }
+  hasCodecs = capa.isMember("codecs");
+  if (!hasCodecs){return;}
+  jsonForEachConst(capa["codecs"], it){
+    combos.push_back(std::vector<std::vector<CapaCodec> >());
+    comboNames.push_back(it->toString());
+    jsonForEachConst(*it, itb){
+      combos.back().push_back(std::vector<CapaCodec>());
+      jsonForEachConst(*itb, itc){
+        const std::string &strRef = itc->asStringRef();
+        CapaCodec c;
+        uint8_t shift = 0;
+        c.byType = (strRef[shift] == '@');
+        if (c.byType){++shift;}
+        c.multi = (strRef[shift] == '+');
+        if (c.multi){++shift;}
+        c.name = strRef.substr(shift);
+        c.any = (c.name == "*");
+        std::map<std::string, size_t>::const_iterator ex = codecExceptions.find(c.name);
+        c.exception = (ex == codecExceptions.end()) ? -1 : (int)ex->second;
+        combos.back().back().push_back(c);
+      }
+    }
+  }
+}
+
+/// Evaluates all user agent exceptions for the given user agent, remembering the result for the last one.
+const std::vector<char> &Util::CodecCapa::checkUA(const std::string &UA) const{
+  if (lastAllowed.size() != exceptions.size() || UA != lastUA){
+    lastUA = UA;
+    lastAllowed.resize(exceptions.size());
+    for (size_t i = 0; i < exceptions.size(); ++i){lastAllowed[i] = Util::checkException(exceptions[i], UA);}
+  }
+  return lastAllowed;
+}
+
+/// Returns false if a user agent exception forbids the given codec entry for this user agent.
+bool Util::CodecCapa::allowed(const CapaCodec &c, const std::string &UA) const{
+  if (c.exception < 0){return true;}
+  return checkUA(UA)[c.exception];
+}
+
+/// Returns false if a user agent exception forbids the given codec name for this user agent.
+bool Util::CodecCapa::allowedCodec(const std::string &codec, const std::string &UA) const{
+  std::map<std::string, size_t>::const_iterator ex = codecExceptions.find(codec);
+  if (ex == codecExceptions.end()){return true;}
+  return checkUA(UA)[ex->second];
+}
+
+/// Returns a string identifying which user agent exceptions apply to the given user agent.
+/// User agents with the same class always get the same track selection.
+std::string Util::CodecCapa::uaClass(const std::string &UA) const{
+  const std::vector<char> &res = checkUA(UA);
+  std::string ret(res.size(), '0');
+  for (size_t i = 0; i < res.size(); ++i){
+    if (res[i]){ret[i] = '1';}
+  }
+  return ret;
+}
+
+Util::SelectionCache::SelectionCache(){
+  capaSet = false;
+}
+
+/// Compiles the given capabilities and drops all cached results.
+/// Connectors that change their capabilities at runtime (e.g. after codec negotiation) must call
+/// this again afterwards.
+void Util::SelectionCache::setCapa(const JSON::Value &capa){
+  compiled.compile(capa);
+  capaSet = true;
+  results.clear();
+}
+
+/// Returns the compiled form of the capabilities, compiling the given ones on first use.
+const Util::CodecCapa &Util::SelectionCache::getCapa(const JSON::Value &capa){
+  if (!capaSet){setCapa(capa);}
+  return compiled;
+}
+
+/// Appends the raw bytes of an integer to a cache key.
+static inline void keyInt(std::string &key, uint64_t val){
+  key.append((const char *)&val, sizeof(val));
+}
+
+/// Cached version of Util::wouldSelect.
+/// The result is reused as long as the selection parameters, the applicable user agent exceptions,
+/// the metadata version and the valid track set stay the same. Bit rates and B-frame presence are not
+/// covered by the metadata version, and are only added to the key when selection looks at them.
+/// Connectors with a maximum delay depend on the track timing, and are never cached.
+std::set<size_t> Util::SelectionCache::wouldSelect(const DTSC::Meta &M, const std::map<std::string, std::string> &targetParams,
+                                                   const JSON::Value &capa, const std::string &UA, uint64_t seekTarget){
+  const CodecCapa &cc = getCapa(capa);
+  if (cc.hasMaxDelay){return Util::wouldSelect(M, targetParams, cc, UA, seekTarget);}
+
+  key.clear();
+  bool selectors = false;
+  const char *selTypes[] = {"audio", "video", "subtitle", "meta"};
+  for (size_t i = 0; i < 4; ++i){
+    std::map<std::string, std::string>::const_iterator it = targetParams.find(selTypes[i]);
+    if (it == targetParams.end()){
+      keyInt(key, 0);
+      continue;
+    }
+    keyInt(key, it->second.size() + 1);
+    key += it->second;
+    selectors = true;
+  }
+  key += cc.uaClass(UA);
+  keyInt(key, M.getMetaVersion());
+  keyInt(key, M.getLive());
+  keyInt(key, Util::defaultTrackSortOrder);
+  // Selectors and non-ID sort orders look at bit rates too
+  bool bps = selectors || (Util::defaultTrackSortOrder != TRKSORT_DEFAULT &&
+                           Util::defaultTrackSortOrder != TRKSORT_ID_LTH &&
+                           Util::defaultTrackSortOrder != TRKSORT_ID_HTL);
+  bool bFrames = selectors || !cc.allowBFrames;
+  std::set<size_t> validTracks = M.getValidTracks(true);
+  for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+    keyInt(key, *it);
+    if (bps){keyInt(key, M.getBps(*it));}
+    if (bFrames){keyInt(key, M.hasBFrames(*it));}
+  }
+
+  std::map<std::string, std::set<size_t> >::iterator res = results.find(key);
+  if (res != results.end()){
+    HIGH_MSG("Reusing track selection");
+    return res->second;
+  }
+  // Bit rates change over time, so don't let stale entries pile up
+  if (results.size() >= 16){results.clear();}
+  std::set<size_t> ret = Util::wouldSelect(M, targetParams, cc, UA, seekTarget);
+  results[key] = ret;
+  return ret;
+}
+
 std::set<size_t> Util::getSupportedTracks(const DTSC::Meta &M, const JSON::Value &capa,
                                           const std::string &type, const std::string &UA){
+  return getSupportedTracks(M, CodecCapa(capa), type, UA);
+}
+
+std::set<size_t> Util::getSupportedTracks(const DTSC::Meta &M, const CodecCapa &capa,
+                                          const std::string &type, const std::string &UA){
   std::set<size_t> validTracks = M.getValidTracks(true);
   uint64_t maxLastMs = 0;
   std::set<size_t> toRemove;
@@ -1337,43 +1551,22 @@ std::set<size_t> Util::getSupportedTracks(const DTSC::Meta &M, const JSON::Value
       continue;
     }
     // Remove tracks for which we don't have codec support
-    if (capa.isMember("codecs")){
+    if (capa.hasCodecs){
       std::string codec = M.getCodec(*it);
       std::string type = M.getType(*it);
       bool found = false;
-      jsonForEachConst(capa["codecs"], itb){
-        jsonForEachConst(*itb, itc){
-          jsonForEachConst(*itc, itd){
-            const std::string &strRef = (*itd).asStringRef();
-            bool byType = false;
-            uint8_t shift = 0;
-            if (strRef[shift] == '@'){
-              byType = true;
-              ++shift;
-            }
-            if (strRef[shift] == '+'){
-              ++shift;
-            }// Multiselect is ignored here, we only need to determine the types...
-            if ((!byType && codec == strRef.substr(shift)) ||
-                (byType && type == strRef.substr(shift)) || strRef.substr(shift) == "*"){
+      for (size_t b = 0; b < capa.combos.size() && !found; ++b){
+        for (size_t c = 0; c < capa.combos[b].size() && !found; ++c){
+          const std::vector<CapaCodec> &slot = capa.combos[b][c];
+          for (size_t d = 0; d < slot.size(); ++d){
+            // Multiselect is ignored here, we only need to determine the types...
+            if (slot[d].matches(codec, type)){
               // user-agent-check
-              bool problems = false;
-              if (capa.isMember("exceptions") && capa["exceptions"].isObject() && capa["exceptions"].size()){
-                jsonForEachConst(capa["exceptions"], ex){
-                  if (ex.key() == "codec:" + strRef.substr(shift)){
-                    problems = !Util::checkException(*ex, UA);
-                    break;
-                  }
-                }
-              }
-              if (problems){break;}
-              found = true;
+              if (capa.allowed(slot[d], UA)){found = true;}
               break;
             }
           }
-          if (found){break;}
         }
-        if (found){break;}
       }
       if (!found){
         HIGH_MSG("Track %zu with codec %s not supported!", *it, codec.c_str());
@@ -1386,8 +1579,8 @@ std::set<size_t> Util::getSupportedTracks(const DTSC::Meta &M, const JSON::Value
       std::string encryptionType = M.getEncryption(*it);
       encryptionType = encryptionType.substr(0, encryptionType.find('/'));
       bool found = false;
-      jsonForEachConst(capa["encryption"], itb){
-        if (itb->asStringRef() == encryptionType){
+      for (size_t b = 0; b < capa.encryption.size(); ++b){
+        if (capa.encryption[b] == encryptionType){
           found = true;
           break;
         }
@@ -1398,7 +1591,7 @@ std::set<size_t> Util::getSupportedTracks(const DTSC::Meta &M, const JSON::Value
       }
     }
     //not removing this track? Keep track of highest lastMs
-    if (capa.isMember("maxdelay")){
+    if (capa.hasMaxDelay){
       uint64_t lMs = M.getLastms(*it);
       if (lMs > maxLastMs){maxLastMs = lMs;}
     }
@@ -1407,8 +1600,8 @@ std::set<size_t> Util::getSupportedTracks(const DTSC::Meta &M, const JSON::Value
     validTracks.erase(*it);
   }
   //if there is a max delay configured, remove tracks that are further behind than this
-  if (capa.isMember("maxdelay")){
-    uint64_t maxDelay = capa["maxdelay"].asInt();
+  if (capa.hasMaxDelay){
+    uint64_t maxDelay = capa.maxDelay;
     if (maxDelay > maxLastMs){maxDelay = maxLastMs;}
     toRemove.clear();
     for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); it++){
@@ -1423,6 +1616,11 @@ std::set<size_t> Util::getSupportedTracks(const DTSC::Meta &M, const JSON::Value
 
 std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::map<std::string, std::string> &targetParams,
                                    const JSON::Value &capa, const std::string &UA, uint64_t seekTarget){
+  return wouldSelect(M, targetParams, CodecCapa(capa), UA, seekTarget);
+}
+
+std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::map<std::string, std::string> &targetParams,
+                                   const CodecCapa &capa, const std::string &UA, uint64_t seekTarget){
   std::set<size_t> result;
 
   /*LTS-START*/
@@ -1474,30 +1672,12 @@ std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::map<std::stri
   unsigned int bestSoFar = 0;
   unsigned int bestSoFarCount = 0;
   unsigned int bestSoFarCountExtra = 0;
-  unsigned int index = 0;
-  bool allowBFrames = true;
-  if (capa.isMember("methods")){
-    jsonForEachConst(capa["methods"], mthd){
-      if (mthd->isMember("nobframes") && (*mthd)["nobframes"]){
-        allowBFrames = false;
-        break;
-      }
-    }
-  }
+  bool allowBFrames = capa.allowBFrames;
 
   /*LTS-START*/
-  if (!capa.isMember("codecs")){
+  if (!capa.hasCodecs){
     for (std::set<size_t>::iterator trit = validTracks.begin(); trit != validTracks.end(); trit++){
-        bool problems = false;
-        if (capa.isMember("exceptions") && capa["exceptions"].isObject() &&
-            capa["exceptions"].size()){
-          jsonForEachConst(capa["exceptions"], ex){
-            if (ex.key() == "codec:" + M.getCodec(*trit)){
-              problems = !Util::checkException(*ex, UA);
-              break;
-            }
-          }
-        }
+        bool problems = !capa.allowedCodec(M.getCodec(*trit), UA);
         if (!allowBFrames && M.hasBFrames(*trit)){problems = true;}
         if (problems){continue;}
         if (noSelAudio && M.getType(*trit) == "audio"){continue;}
@@ -1510,63 +1690,29 @@ std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::map<std::stri
   }
   /*LTS-END*/
 
-  jsonForEachConst(capa["codecs"], it){
+  for (unsigned int index = 0; index < capa.combos.size(); ++index){
+    const std::vector<std::vector<CapaCodec> > &combo = capa.combos[index];
     unsigned int selCounter = 0;
     unsigned int extraCounter = 0;
-    if ((*it).size() > 0){
-      jsonForEachConst((*it), itb){
-        if ((*itb).size() > 0){
-          jsonForEachConst(*itb, itc){
-            const std::string &strRef = (*itc).asStringRef();
-            bool byType = false;
-            bool multiSel = false;
-            uint8_t shift = 0;
-            if (strRef[shift] == '@'){
-              byType = true;
-              ++shift;
-            }
-            if (strRef[shift] == '+'){
-              multiSel = true;
-              ++shift;
-            }
-            for (std::set<size_t>::iterator itd = result.begin(); itd != result.end(); itd++){
-              if ((!byType && M.getCodec(*itd) == strRef.substr(shift)) ||
-                  (byType && M.getType(*itd) == strRef.substr(shift)) || strRef.substr(shift) == "*"){
-                // user-agent-check
-                bool problems = false;
-                if (capa.isMember("exceptions") && capa["exceptions"].isObject() &&
-                    capa["exceptions"].size()){
-                  jsonForEachConst(capa["exceptions"], ex){
-                    if (ex.key() == "codec:" + strRef.substr(shift)){
-                      problems = !Util::checkException(*ex, UA);
-                      break;
-                    }
-                  }
-                }
-                if (problems){break;}
-                selCounter++;
-                extraCounter++;
-                if (!multiSel){break;}
-              }
+    if (combo.size() > 0){
+      for (size_t b = 0; b < combo.size(); ++b){
+        for (size_t c = 0; c < combo[b].size(); ++c){
+          const CapaCodec &cc = combo[b][c];
+          for (std::set<size_t>::iterator itd = result.begin(); itd != result.end(); itd++){
+            if (cc.matches(M.getCodec(*itd), M.getType(*itd))){
+              // user-agent-check
+              if (!capa.allowed(cc, UA)){break;}
+              selCounter++;
+              extraCounter++;
+              if (!cc.multi){break;}
             }
-            for (std::set<size_t>::iterator itd = validTracks.begin(); itd != validTracks.end(); itd++){
-              if ((!byType && M.getCodec(*itd) == strRef.substr(shift)) ||
-                  (byType && M.getType(*itd) == strRef.substr(shift)) || strRef.substr(shift) == "*"){
-                // user-agent-check
-                bool problems = false;
-                if (capa.isMember("exceptions") && capa["exceptions"].isObject() &&
-                    capa["exceptions"].size()){
-                  jsonForEachConst(capa["exceptions"], ex){
-                    if (ex.key() == "codec:" + strRef.substr(shift)){
-                      problems = !Util::checkException(*ex, UA);
-                      break;
-                    }
-                  }
-                }
-                if (problems){break;}
-                extraCounter++;
-                if (!multiSel){break;}
-              }
+          }
+          for (std::set<size_t>::iterator itd = validTracks.begin(); itd != validTracks.end(); itd++){
+            if (cc.matches(M.getCodec(*itd), M.getType(*itd))){
+              // user-agent-check
+              if (!capa.allowed(cc, UA)){break;}
+              extraCounter++;
+              if (!cc.multi){break;}
             }
           }
         }
@@ -1576,103 +1722,64 @@ std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::map<std::stri
           bestSoFarCount = selCounter;
           bestSoFarCountExtra = extraCounter;
           bestSoFar = index;
-          HIGH_MSG("Matched %u: %s", selCounter, (*it).toString().c_str());
+          HIGH_MSG("Matched %u: %s", selCounter, capa.comboNames[index].c_str());
         }
       }else{
-        VERYHIGH_MSG("Not a match for currently selected tracks: %s", it->toString().c_str());
+        VERYHIGH_MSG("Not a match for currently selected tracks: %s", capa.comboNames[index].c_str());
       }
     }
-    index++;
   }
 
-  HIGH_MSG("Trying to fill: %s", capa["codecs"][bestSoFar].toString().c_str());
+  // An empty "codecs" member leaves nothing to fill
+  static const std::vector<std::vector<CapaCodec> > noCombo;
+  const std::vector<std::vector<CapaCodec> > &best = capa.combos.size() ? capa.combos[bestSoFar] : noCombo;
+  HIGH_MSG("Trying to fill: %s", capa.combos.size() ? capa.comboNames[bestSoFar].c_str() : "null");
 
   std::list<size_t> srtTrks;
   Util::sortTracks(validTracks, M, Util::defaultTrackSortOrder, srtTrks);
 
   // try to fill as many codecs simultaneously as possible
-  if (capa["codecs"][bestSoFar].size() > 0){
-    jsonForEachConst(capa["codecs"][bestSoFar], itb){
-      if (itb->size() && validTracks.size()){
-        bool found = false;
-        bool multiFind = false;
-        jsonForEachConst((*itb), itc){
-          const std::string &strRef = (*itc).asStringRef();
-          bool byType = false;
-          uint8_t shift = 0;
-          if (strRef[shift] == '@'){
-            byType = true;
-            ++shift;
-          }
-          if (strRef[shift] == '+'){
-            multiFind = true;
-            ++shift;
+  for (size_t b = 0; b < best.size(); ++b){
+    const std::vector<CapaCodec> &slot = best[b];
+    if (slot.size() && validTracks.size()){
+      bool found = false;
+      bool multiFind = false;
+      for (size_t c = 0; c < slot.size(); ++c){
+        const CapaCodec &cc = slot[c];
+        if (cc.multi){multiFind = true;}
+        for (std::set<size_t>::iterator itd = result.begin(); itd != result.end(); itd++){
+          if (cc.matches(M.getCodec(*itd), M.getType(*itd))){
+            // user-agent-check
+            if (!capa.allowed(cc, UA)){break;}
+            found = true;
+            break;
           }
-          for (std::set<size_t>::iterator itd = result.begin(); itd != result.end(); itd++){
-            if ((!byType && M.getCodec(*itd) == strRef.substr(shift)) ||
-                (byType && M.getType(*itd) == strRef.substr(shift)) || strRef.substr(shift) == "*"){
+        }
+      }
+      if (!found || multiFind){
+        for (size_t c = 0; c < slot.size(); ++c){
+          const CapaCodec &cc = slot[c];
+          if (found && !cc.multi){continue;}
+
+          for (std::list<size_t>::iterator trit = srtTrks.begin();
+               trit != srtTrks.end(); trit++){
+            if (cc.matches(M.getCodec(*trit), M.getType(*trit))){
               // user-agent-check
-              bool problems = false;
-              if (capa.isMember("exceptions") && capa["exceptions"].isObject() && capa["exceptions"].size()){
-                jsonForEachConst(capa["exceptions"], ex){
-                  if (ex.key() == "codec:" + strRef.substr(shift)){
-                    problems = !Util::checkException(*ex, UA);
-                    break;
-                  }
-                }
-              }
+              bool problems = !capa.allowed(cc, UA);
+              if (!allowBFrames && M.hasBFrames(*trit)){problems = true;}
               if (problems){break;}
-              found = true;
-              break;
-            }
-          }
-        }
-        if (!found || multiFind){
-          jsonForEachConst((*itb), itc){
-            const std::string &strRef = (*itc).asStringRef();
-            bool byType = false;
-            bool multiSel = false;
-            uint8_t shift = 0;
-            if (strRef[shift] == '@'){
-              byType = true;
-              ++shift;
-            }
-            if (strRef[shift] == '+'){
-              multiSel = true;
-              ++shift;
-            }
-            if (found && !multiSel){continue;}
-
-            for (std::list<size_t>::iterator trit = srtTrks.begin();
-                 trit != srtTrks.end(); trit++){
-              if ((!byType && M.getCodec(*trit) == strRef.substr(shift)) ||
-                  (byType && M.getType(*trit) == strRef.substr(shift)) || strRef.substr(shift) == "*"){
-                // user-agent-check
-                bool problems = false;
-                if (capa.isMember("exceptions") && capa["exceptions"].isObject() &&
-                    capa["exceptions"].size()){
-                  jsonForEachConst(capa["exceptions"], ex){
-                    if (ex.key() == "codec:" + strRef.substr(shift)){
-                      problems = !Util::checkException(*ex, UA);
-                      break;
-                    }
-                  }
-                }
-                if (!allowBFrames && M.hasBFrames(*trit)){problems = true;}
-                if (problems){break;}
-                /*LTS-START*/
-                if (noSelAudio && M.getType(*trit) == "audio"){continue;}
-                if (noSelVideo && M.getType(*trit) == "video"){continue;}
-                if (noSelMeta && M.getType(*trit) == "meta"){continue;}
-                if (noSelSub &&
-                    (M.getType(*trit) == "subtitle" || M.getCodec(*trit) == "subtitle")){
-                  continue;
-                }
-                /*LTS-END*/
-                result.insert(*trit);
-                found = true;
-                if (!multiSel){break;}
+              /*LTS-START*/
+              if (noSelAudio && M.getType(*trit) == "audio"){continue;}
+              if (noSelVideo && M.getType(*trit) == "video"){continue;}
+              if (noSelMeta && M.getType(*trit) == "meta"){continue;}
+              if (noSelSub &&
+                  (M.getType(*trit) == "subtitle" || M.getCodec(*trit) == "subtitle")){
+                continue;
               }
+              /*LTS-END*/
+              result.insert(*trit);
+              found = true;
+              if (!cc.multi){break;}
             }
           }
         }
@@ -1690,7 +1797,7 @@ std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::map<std::stri
     MEDIUM_MSG("Would select tracks: %s (%zu)", selected.str().c_str(), result.size());
   }
 
-  if (!result.size() && validTracks.size() && capa["codecs"][bestSoFar].size()){
+  if (!result.size() && validTracks.size() && best.size()){
     WARN_MSG("Would select no tracks (%zu total) for stream!", validTracks.size());
   }
   return result;
@@ -9,6 +9,8 @@
 #include "util.h"
 #include <string>
 #include <list>
+#include <map>
+#include <vector>
 
 const JSON::Value empty;
 
@@ -33,14 +35,78 @@ namespace Util{
   bool checkException(const JSON::Value &ex, const std::string &useragent);
   std::string codecString(const std::string &codec, const std::string &initData = "");
 
+  /// A single codec entry of a connector capabilities "codecs" list, with its prefixes parsed.
+  struct CapaCodec{
+    std::string name; ///< Codec name, or track type name if byType is set
+    bool byType;      ///< Entry was prefixed with '@' and matches on track type
+    bool multi;       ///< Entry was prefixed with '+' and may match multiple tracks
+    bool any;         ///< Entry is "*" and matches anything
+    int exception;    ///< Index of the user agent exception for this entry, or -1 if none
+    bool matches(const std::string &codec, const std::string &type) const{
+      return any || (byType ? type == name : codec == name);
+    }
+  };
+
+  /// Compiled form of the parts of connector capabilities that track selection looks at.
+  /// Parsing these once saves re-parsing the codec strings and searching the exceptions
+  /// for every track on every selection.
+  class CodecCapa{
+  public:
+    CodecCapa();
+    CodecCapa(const JSON::Value &capa);
+    void compile(const JSON::Value &capa);
+    operator bool() const{return isSet;}
+    bool allowed(const CapaCodec &c, const std::string &UA) const;
+    bool allowedCodec(const std::string &codec, const std::string &UA) const;
+    std::string uaClass(const std::string &UA) const;
+    std::vector<std::vector<std::vector<CapaCodec> > > combos; ///< "codecs" member
+    std::vector<std::string> comboNames; ///< "codecs" entries as JSON strings, for debugging
+    std::vector<std::string> encryption;
+    bool isSet;
+    bool hasCodecs;
+    bool allowBFrames;
+    bool hasMaxDelay;
+    uint64_t maxDelay;
+
+  private:
+    const std::vector<char> &checkUA(const std::string &UA) const;
+    std::vector<JSON::Value> exceptions;
+    std::map<std::string, size_t> codecExceptions; ///< Codec name to index in exceptions
+    mutable std::string lastUA;
+    mutable std::vector<char> lastAllowed; ///< Results of all exceptions for lastUA
+  };
+
+  /// Memoizes track selection results of a single connector, keyed by the selection parameters,
+  /// the user agent exceptions that apply, the metadata version and the valid tracks.
+  /// The capabilities are compiled once; call setCapa after changing them.
+  class SelectionCache{
+  public:
+    SelectionCache();
+    void setCapa(const JSON::Value &capa);
+    const CodecCapa &getCapa(const JSON::Value &capa);
+    std::set<size_t> wouldSelect(const DTSC::Meta &M, const std::map<std::string, std::string> &targetParams,
+                                 const JSON::Value &capa, const std::string &UA = "", uint64_t seekTarget = 0);
+
+  private:
+    CodecCapa compiled;
+    bool capaSet; ///< True once compiled holds the connector's capabilities
+    std::string key; ///< Kept between calls to reuse its buffer
+    std::map<std::string, std::set<size_t> > results;
+  };
+
   std::set<size_t> getSupportedTracks(const DTSC::Meta &M, const JSON::Value &capa,
                                       const std::string &type = "", const std::string &UA = "");
+  std::set<size_t> getSupportedTracks(const DTSC::Meta &M, const CodecCapa &capa,
+                                      const std::string &type = "", const std::string &UA = "");
   std::set<size_t> pickTracks(const DTSC::Meta &M, const std::set<size_t> trackList, const std::string &trackType, const std::string &trackVal);
   std::set<size_t> findTracks(const DTSC::Meta &M, const JSON::Value &capa, const std::string &trackType, const std::string &trackVal, const std::string &UA = "");
+  std::set<size_t> findTracks(const DTSC::Meta &M, const CodecCapa &capa, const std::string &trackType, const std::string &trackVal, const std::string &UA = "");
   std::set<size_t> wouldSelect(const DTSC::Meta &M, const std::string &trackSelector = "",
                                const JSON::Value &capa = empty, const std::string &UA = "");
   std::set<size_t> wouldSelect(const DTSC::Meta &M, const std::map<std::string, std::string> &targetParams,
                                const JSON::Value &capa = empty, const std::string &UA = "", uint64_t seekTarget = 0);
+  std::set<size_t> wouldSelect(const DTSC::Meta &M, const std::map<std::string, std::string> &targetParams,
+                               const CodecCapa &capa, const std::string &UA = "", uint64_t seekTarget = 0);
 
   enum trackSortOrder{
     TRKSORT_DEFAULT = 0,
@@ -0,0 +1,110 @@
+#include "thumbs.h"
+#include "defines.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+namespace Thumbs{
+
+  struct slotHeader{
+    volatile uint32_t seq;
+    uint32_t size;
+    Entry info;
+  };
+
+  static inline slotHeader *getSlot(const IPC::sharedPage &page, size_t slotNo){
+    return (slotHeader *)(page.mapped + (slotNo % THUMB_SLOTS) * (THUMB_SLOTSIZE));
+  }
+
+  /// Copies the slot contents into info (and data, if not null), returns false if the slot is
+  /// empty or was being written while reading it.
+  static bool readSlot(slotHeader *S, Entry &info, std::string *data){
+    uint32_t seq = S->seq;
+    __sync_synchronize();
+    if ((seq & 1) || !S->size || S->size > THUMB_SLOTSIZE - sizeof(slotHeader)){return false;}
+    memcpy(&info, &(S->info), sizeof(Entry));
+    if (data){data->assign((char *)S + sizeof(slotHeader), S->size);}
+    __sync_synchronize();
+    return S->seq == seq;
+  }
+
+  Cache::Cache(){}
+
+  /// Opens the thumbnail (or sprite sheet) cache of the given stream.
+  /// The writer creates the page and removes it again when it closes.
+  bool Cache::open(const std::string &streamName, bool sprites, bool writer){
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, sprites ? SHM_SPRITES : SHM_THUMBS, streamName.c_str());
+    page.init(pageName, writer ? THUMB_SLOTS * (THUMB_SLOTSIZE) : 0, writer, false);
+    if (page.mapped && page.len < THUMB_SLOTS * (THUMB_SLOTSIZE)){page.close();}
+    return page.mapped;
+  }
+
+  void Cache::close(){page.close();}
+
+  /// Stores an image in the given slot of the ring, replacing whatever was there.
+  /// Sprite sheets are rewritten in the same slot every time a tile is added.
+  bool Cache::write(size_t slotNo, const Entry &info, const char *data, size_t len){
+    if (!page.mapped || len > THUMB_SLOTSIZE - sizeof(slotHeader)){return false;}
+    slotHeader *S = getSlot(page, slotNo);
+    uint32_t seq = S->seq;
+    if (seq & 1){seq++;}
+    S->seq = seq + 1;
+    __sync_synchronize();
+    memcpy(&(S->info), &info, sizeof(Entry));
+    S->size = len;
+    memcpy((char *)S + sizeof(slotHeader), data, len);
+    __sync_synchronize();
+    S->seq = seq + 2;
+    return true;
+  }
+
+  /// Retrieves the image covering the given time: the newest one that starts at or before it.
+  /// If time is before all cached images, the oldest image is returned instead.
+  bool Cache::read(uint64_t time, std::string &data, Entry &info) const{
+    if (!page.mapped){return false;}
+    size_t best = THUMB_SLOTS;
+    size_t oldest = THUMB_SLOTS;
+    uint64_t bestTime = 0, oldestTime = 0;
+    Entry tmp;
+    for (size_t i = 0; i < THUMB_SLOTS; ++i){
+      if (!readSlot(getSlot(page, i), tmp, 0)){continue;}
+      if (tmp.time <= time && (best == THUMB_SLOTS || tmp.time > bestTime)){
+        best = i;
+        bestTime = tmp.time;
+      }
+      if (oldest == THUMB_SLOTS || tmp.time < oldestTime){
+        oldest = i;
+        oldestTime = tmp.time;
+      }
+    }
+    if (best == THUMB_SLOTS){best = oldest;}
+    if (best == THUMB_SLOTS){return false;}
+    return readSlot(getSlot(page, best), info, &data);
+  }
+
+  /// Lists all cached images, oldest first.
+  void Cache::list(std::deque<Entry> &entries) const{
+    entries.clear();
+    if (!page.mapped){return;}
+    std::map<uint64_t, size_t> order;
+    std::deque<Entry> found;
+    Entry tmp;
+    for (size_t i = 0; i < THUMB_SLOTS; ++i){
+      if (!readSlot(getSlot(page, i), tmp, 0)){continue;}
+      order[tmp.time] = found.size();
+      found.push_back(tmp);
+    }
+    for (std::map<uint64_t, size_t>::iterator it = order.begin(); it != order.end(); ++it){
+      entries.push_back(found[it->second]);
+    }
+  }
+
+  /// Formats a millisecond time as a WebVTT timestamp.
+  std::string vttTime(uint64_t ms){
+    char tmpBuf[50];
+    snprintf(tmpBuf, 50, "%.2" PRIu64 ":%.2" PRIu64 ":%.2" PRIu64 ".%.3" PRIu64, (ms / 3600000),
+             ((ms % 3600000) / 60000), (((ms % 3600000) % 60000) / 1000), ms % 1000);
+    return tmpBuf;
+  }
+}// namespace Thumbs
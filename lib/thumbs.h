@@ -0,0 +1,46 @@
+#pragma once
+#include "shared_memory.h"
+#include <deque>
+#include <string>
+
+#define THUMB_MAX_TILES 100
+
+namespace Thumbs{
+
+  /// Description of a single cached image, as returned by Cache::list.
+  struct Entry{
+    uint64_t time;    ///< Time of the (first) thumbnail in this image
+    uint64_t endTime; ///< Time of the last thumbnail in this image
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles;   ///< Amount of tiles filled in a sprite sheet
+    uint32_t columns; ///< Columns of a sprite sheet
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    uint64_t tileTimes[THUMB_MAX_TILES];
+  };
+
+  /// Shared memory cache of encoded thumbnail images of a stream, keyed by time.
+  /// There is one writer (the process generating the images) and any amount of readers.
+  /// Images are kept in a ring of THUMB_SLOTS fixed-size slots; each slot is guarded by a
+  /// sequence counter that is odd while the writer is busy with it.
+  class Cache{
+  public:
+    Cache();
+    bool open(const std::string &streamName, bool sprites, bool writer = false);
+    operator bool() const{return page.mapped;}
+    void close();
+
+    // Writer functions
+    bool write(size_t slotNo, const Entry &info, const char *data, size_t len);
+
+    // Reader functions
+    bool read(uint64_t time, std::string &data, Entry &info) const;
+    void list(std::deque<Entry> &entries) const;
+
+  private:
+    IPC::sharedPage page;
+  };
+
+  std::string vttTime(uint64_t ms);
+}// namespace Thumbs
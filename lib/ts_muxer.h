@@ -0,0 +1,45 @@
+/// \file ts_muxer.h
+/// Conversion of DTSC packets into MPEG-TS, shared by all TS-based outputs.
+
+#pragma once
+#include "dtsc.h"
+#include "ts_packet.h"
+#include <map>
+#include <set>
+#include <string>
+
+namespace TS{
+
+  /// Turns DTSC packets into 188-byte TS packets, which are handed to sendTS.
+  /// PAT, PMT and SDT are sent in front of the first TS packet, and again every
+  /// sendRepeatingHeaders milliseconds if that is set. Setting packCounter to zero makes the
+  /// headers go out again before the next TS packet.
+  class Muxer{
+  public:
+    Muxer();
+    virtual ~Muxer(){}
+    virtual void sendTS(const char *tsData, size_t len = 188){}
+    void muxPacket(const DTSC::Meta &M, size_t idx, const DTSC::Packet &pkt);
+    void fillPacket(char const *data, size_t dataLen, bool &firstPack, bool video, bool keyframe,
+                    size_t pkgPid, uint16_t &contPkg);
+
+  protected:
+    /// Fills the tracks to list in the PMT and the service name for the SDT.
+    virtual void getHeaderInfo(std::set<size_t> &tracks, std::string &serviceName){}
+    std::map<size_t, bool> first;
+    std::map<size_t, uint16_t> contCounters;
+    uint16_t contPAT;
+    uint16_t contPMT;
+    uint16_t contSDT;
+    size_t packCounter;
+    TS::Packet packData;
+    uint64_t sendRepeatingHeaders; ///< Amount of ms between PAT/PMT. Zero means do not repeat.
+    uint64_t lastHeaderTime;       ///< Timestamp last PAT/PMT were sent.
+
+  private:
+    const DTSC::Meta *muxMeta; ///< Metadata of the packet being muxed, for the PMT
+    std::string leadIn;        ///< PES headers and other small parts, kept to reuse its buffer
+    uint64_t muxTime;          ///< Timestamp in ms of the packet being muxed
+  };
+
+}// namespace TS
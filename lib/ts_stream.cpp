@@ -689,14 +689,12 @@ namespace TS{
       }
     }
     if (thisCodec == H264 || thisCodec == H265){
-      const char *nextPtr;
-      const char *pesEnd = pesPayload + realPayloadSize;
       bool isKeyFrame = false;
       uint32_t nalSize = 0;
 
-      nextPtr = nalu::scanAnnexB(pesPayload, realPayloadSize);
-      if (!nextPtr){
-        nextPtr = pesEnd;
+      // Split the PES payload into NAL units in a single pass
+      nalUnits.clear();
+      if (!nalu::findNalUnits(pesPayload, realPayloadSize, nalUnits)){
         nalSize = realPayloadSize;
         if (!alignment && timeStamp && buildPacket.count(tid) && timeStamp != buildPacket[tid].getTime()){
           FAIL_MSG("No startcode in packet @ %" PRIu64 " ms, and time is not equal to %" PRIu64
@@ -725,7 +723,7 @@ namespace TS{
           }
 
           // Check if this is a keyframe
-          parseNal(tid, pesPayload, nextPtr, isKeyFrame);
+          parseNal(tid, pesPayload, pesPayload + nalSize, isKeyFrame);
           // If yes, set the keyframe flag
           if (isKeyFrame){bp.setKeyFrame(true);}
 
@@ -733,14 +731,17 @@ namespace TS{
           bp.appendNal(pesPayload, nalSize);
         }else{
           bp.upgradeNal(pesPayload, nalSize);
-          return;
         }
+        return;
       }
 
-      while (nextPtr < pesEnd){
-        if (!nextPtr){nextPtr = pesEnd;}
-        // Calculate size of NAL unit, removing null bytes from the end
-        nalSize = nalu::nalEndPosition(pesPayload, nextPtr - pesPayload) - pesPayload;
+      // The data in front of the first start code is handled as a NAL unit of its own
+      const char *nalStart = pesPayload;
+      nalSize = nalUnits.front().offset - 3;
+      std::deque<nalu::nalPos>::iterator nalIt = nalUnits.begin();
+      while (true){
+        // Remove null bytes from the end of the NAL unit
+        nalSize = nalu::nalEndPosition(nalStart, nalSize) - nalStart;
 
         if (nalSize){
           // If we don't have a packet yet, init an empty packet with the key frame bit set to true
@@ -751,7 +752,7 @@ namespace TS{
           DTSC::Packet &bp = buildPacket[tid];
 
           // Check if this is a keyframe
-          parseNal(tid, pesPayload, pesPayload + nalSize, isKeyFrame);
+          parseNal(tid, nalStart, nalStart + nalSize, isKeyFrame);
           // If yes, set the keyframe flag
           if (isKeyFrame){bp.setKeyFrame(true);}
 
@@ -765,15 +766,13 @@ namespace TS{
             bp.setKeyFrame(false);
           }
           // No matter what, now append the current NAL unit to the current packet
-          bp.appendNal(pesPayload, nalSize);
+          bp.appendNal(nalStart, nalSize);
         }
 
-        if (((nextPtr - pesPayload) + 3) >= realPayloadSize){return;}// end of the line
-
-        realPayloadSize -= ((nextPtr - pesPayload) + 3); // decrease the total size
-        pesPayload = nextPtr + 3;
-
-        nextPtr = nalu::scanAnnexB(pesPayload, realPayloadSize);
+        if (nalIt == nalUnits.end()){return;}// end of the line
+        nalStart = pesPayload + nalIt->offset;
+        nalSize = nalIt->size;
+        ++nalIt;
       }
     }
     if (thisCodec == MPEG2){
@@ -1,6 +1,7 @@
 #pragma once
 #include "adts.h"
 #include "h265.h"
+#include "nal.h"
 #include "ts_packet.h"
 #include <deque>
 #include <map>
@@ -100,6 +101,7 @@ namespace TS{
     std::map<size_t, std::deque<uint64_t> > pesPositions;
     std::map<size_t, std::deque<DTSC::Packet> > outPackets;
     std::map<size_t, DTSC::Packet> buildPacket;
+    std::deque<nalu::nalPos> nalUnits; ///< NAL unit positions, reused by parseBitstream
     std::map<size_t, uint32_t> pidToCodec;
     std::map<size_t, aac::adts> adtsInfo;
     std::map<size_t, std::string> spsInfo;
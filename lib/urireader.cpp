@@ -1,13 +1,27 @@
+#include "auth.h"
 #include "defines.h"
 #include "shared_memory.h"
+#include "stream.h"
 #include "timing.h"
 #include "urireader.h"
 #include "util.h"
 #include "encode.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <map>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <sstream>
+#include <vector>
+
+#define BLOCKCACHE_BLOCK_SIZE 1048576 // Size of a single cached block
+#define BLOCKCACHE_READAHEAD 3        // Maximum amount of blocks fetched ahead of the requested one
+#define BLOCKCACHE_DEFAULT_SIZE 1024  // Cache size cap in MiB, if not set through the environment
+#define BLOCKCACHE_NO_BLOCK 0xFFFFFFFFFFFFFFFFull
 
 namespace HTTP{
 
@@ -65,12 +79,249 @@ namespace HTTP{
     return url;
   }
 
+  /// Identifies a version of a remote source by its URL (without credentials) and the Content-Length,
+  /// ETag and Last-Modified headers of the response in the given downloader.
+  inline std::string versionId(const HTTP::URL &url, HTTP::Downloader &downer){
+    HTTP::URL srcId = url;
+    srcId.user.clear();
+    srcId.pass.clear();
+    std::stringstream id;
+    id << srcId.getUrl() << " " << downer.getHeader("Content-Length") << " " << downer.getHeader("ETag") << " "
+       << downer.getHeader("Last-Modified");
+    return id.str();
+  }
+
   HTTP::URL localURIResolver(){
     char workDir[512];
     getcwd(workDir, 512);
     return HTTP::URL(std::string("file://") + workDir + "/");
   }
 
+  // Block cache activity of this process, reported to the controller as deltas
+  static uint64_t cacheHits = 0;      ///< Blocks read from the cache
+  static uint64_t cacheMisses = 0;    ///< Blocks that had to be fetched from the source
+  static uint64_t cacheReadahead = 0; ///< Blocks fetched ahead of being needed
+  static uint64_t cacheFetched = 0;   ///< Bytes fetched from sources through the cache
+  static uint64_t cacheEvicted = 0;   ///< Blocks removed to stay below the size cap
+  static uint64_t cacheSinceEvict = 0; ///< Bytes stored since the last eviction pass
+  static uint64_t lastCacheReport = 0;
+  static uint64_t reported[5] = {0, 0, 0, 0, 0};
+
+  /// Collects the response to a range request, ignoring anything past the requested length.
+  class RangeCollector : public Util::DataCallback{
+  public:
+    RangeCollector(Util::ResizeablePointer &b, uint64_t s, size_t l) : buf(b), start(s), len(l){
+      buf.truncate(0);
+    }
+    virtual void dataCallback(const char *ptr, size_t size){
+      if (buf.size() + size > len){size = len - buf.size();}
+      if (size){buf.append(ptr, size);}
+    }
+    virtual size_t getDataCallbackPos() const{return start + buf.size();}
+
+  private:
+    Util::ResizeablePointer &buf;
+    uint64_t start;
+    size_t len;
+  };
+
+  BlockCache::BlockCache(){
+    size = 0;
+    cap = 0;
+  }
+
+  /// Attempts to use the cache for the source identified by sourceId.
+  /// Returns false if the cache is disabled or unusable, in which case the source should be read directly.
+  bool BlockCache::open(const std::string &sourceId, uint64_t sourceSize){
+    close();
+    char *env = getenv("MIST_BLOCKCACHE_SIZE");
+    cap = (env ? strtoull(env, 0, 10) : BLOCKCACHE_DEFAULT_SIZE) * 1024 * 1024;
+    if (!cap){return false;}
+    env = getenv("MIST_BLOCKCACHE_DIR");
+    dir = env ? env : Util::getTmpFolder() + "blockcache";
+    if (!dir.size()){return false;}
+    if (dir[dir.size() - 1] != '/'){dir += '/';}
+    if (access(dir.c_str(), W_OK)){
+      mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+      if (access(dir.c_str(), W_OK)){
+        WARN_MSG("Block cache directory %s is not usable, reading without cache: %s", dir.c_str(), strerror(errno));
+        return false;
+      }
+    }
+    size = sourceSize;
+    id = Secure::sha256(sourceId).substr(0, 32);
+    return true;
+  }
+
+  void BlockCache::close(){
+    id.clear();
+    size = 0;
+  }
+
+  uint64_t BlockCache::blockSize() const{return BLOCKCACHE_BLOCK_SIZE;}
+
+  /// Returns the length of the given block, which is only less than the block size for the last one.
+  uint64_t BlockCache::blockLen(uint64_t block) const{
+    uint64_t start = block * BLOCKCACHE_BLOCK_SIZE;
+    if (start >= size){return 0;}
+    return (size - start < BLOCKCACHE_BLOCK_SIZE) ? size - start : BLOCKCACHE_BLOCK_SIZE;
+  }
+
+  std::string BlockCache::blockPath(uint64_t block) const{
+    std::stringstream path;
+    path << dir << id << "_" << block;
+    return path.str();
+  }
+
+  bool BlockCache::has(uint64_t block) const{return !access(blockPath(block).c_str(), R_OK);}
+
+  /// Reads the given block from the cache into data, marking it as recently used.
+  /// Returns false if the block is not (or no longer) cached.
+  bool BlockCache::read(uint64_t block, Util::ResizeablePointer &data) const{
+    std::string path = blockPath(block);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1){return false;}
+    struct stat st;
+    uint64_t len = blockLen(block);
+    if (fstat(fd, &st) || (uint64_t)st.st_size != len || !data.allocate(len)){
+      ::close(fd);
+      return false;
+    }
+    size_t got = 0;
+    while (got < len){
+      ssize_t r = ::read(fd, (char *)data + got, len - got);
+      if (r < 0 && errno == EINTR){continue;}
+      if (r <= 0){break;}
+      got += r;
+    }
+    if (got == len){futimens(fd, 0);}
+    ::close(fd);
+    if (got != len){return false;}
+    data.size() = len;
+    return true;
+  }
+
+  /// Locks the given block for fetching, waiting for any other reader currently fetching it if wait is set.
+  /// Returns the locked file descriptor, or -1 if the lock could not be taken.
+  /// After locking, callers should check again whether the block was stored in the meantime.
+  int BlockCache::lock(uint64_t block, bool wait) const{
+    std::string path = blockPath(block) + ".part";
+    while (true){
+      int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd == -1){return -1;}
+      if (flock(fd, wait ? LOCK_EX : (LOCK_EX | LOCK_NB))){
+        ::close(fd);
+        if (wait && errno == EINTR){continue;}
+        return -1;
+      }
+      // The previous holder of the lock renames or removes the file; only a lock on the current file counts
+      struct stat fdStat, pathStat;
+      if (!fstat(fd, &fdStat) && !stat(path.c_str(), &pathStat) && fdStat.st_dev == pathStat.st_dev &&
+          fdStat.st_ino == pathStat.st_ino){
+        return fd;
+      }
+      ::close(fd);
+    }
+  }
+
+  /// Stores the given data as block contents and releases the lock taken through lock().
+  void BlockCache::store(uint64_t block, int lockFd, const char *data, size_t len){
+    std::string path = blockPath(block);
+    size_t written = 0;
+    if (!ftruncate(lockFd, 0)){
+      while (written < len){
+        ssize_t r = ::write(lockFd, data + written, len - written);
+        if (r < 0 && errno == EINTR){continue;}
+        if (r <= 0){break;}
+        written += r;
+      }
+    }
+    if (written != len || rename((path + ".part").c_str(), path.c_str())){
+      WARN_MSG("Could not store block in cache: %s", strerror(errno));
+      unlink((path + ".part").c_str());
+    }
+    ::close(lockFd);
+    if (__sync_add_and_fetch(&cacheSinceEvict, len) >= cap / 16){
+      cacheSinceEvict = 0;
+      evict();
+    }
+  }
+
+  /// Releases a lock taken through lock() without storing anything.
+  void BlockCache::unlock(uint64_t block, int lockFd) const{
+    unlink((blockPath(block) + ".part").c_str());
+    ::close(lockFd);
+  }
+
+  /// Removes the least recently used blocks until the cache is below 90% of its size cap.
+  /// Only one process at a time does this; others skip it while it is in progress.
+  void BlockCache::evict(){
+    int lockFd = ::open((dir + "evict.lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (lockFd == -1){return;}
+    if (flock(lockFd, LOCK_EX | LOCK_NB)){
+      ::close(lockFd);
+      return;
+    }
+    DIR *d = opendir(dir.c_str());
+    if (!d){
+      ::close(lockFd);
+      return;
+    }
+    std::multimap<time_t, std::string> blocks;
+    uint64_t total = 0;
+    time_t now = time(0);
+    struct dirent *e;
+    while ((e = readdir(d))){
+      std::string name = e->d_name;
+      if (name[0] == '.' || name == "evict.lock"){continue;}
+      struct stat st;
+      if (stat((dir + name).c_str(), &st) || !S_ISREG(st.st_mode)){continue;}
+      if (name.size() > 5 && name.substr(name.size() - 5) == ".part"){
+        // Left behind by a reader that died mid-fetch and never touched again since
+        if (st.st_mtime + 600 < now){unlink((dir + name).c_str());}
+        continue;
+      }
+      total += st.st_size;
+      blocks.insert(std::pair<time_t, std::string>(st.st_mtime, name));
+    }
+    closedir(d);
+    if (total > cap){
+      uint64_t target = cap - cap / 10;
+      uint64_t count = 0;
+      for (std::multimap<time_t, std::string>::iterator it = blocks.begin(); it != blocks.end() && total > target; ++it){
+        struct stat st;
+        if (stat((dir + it->second).c_str(), &st) || unlink((dir + it->second).c_str())){continue;}
+        total -= st.st_size;
+        ++count;
+      }
+      __sync_fetch_and_add(&cacheEvicted, count);
+      MEDIUM_MSG("Evicted %" PRIu64 " blocks from cache, %" PRIu64 " bytes remain", count, total);
+    }
+    ::close(lockFd);
+  }
+
+  /// Sends the cache activity since the previous report to the controller.
+  /// Unless forced, reports at most once every five seconds.
+  void BlockCache::reportStats(bool force){
+    uint64_t now = Util::bootMS();
+    uint64_t last = lastCacheReport;
+    if (!force && now < last + 5000){return;}
+    if (!__sync_bool_compare_and_swap(&lastCacheReport, last, now)){return;}
+    uint64_t current[5] = {cacheHits, cacheMisses, cacheReadahead, cacheFetched, cacheEvicted};
+    if (!memcmp(current, reported, sizeof(current))){return;}
+    // Only report when running under a controller, as waiting for one would stall reading
+    if (!IPC::sharedPage(SHM_GLOBAL_CONF, 0, false, false).mapped){return;}
+    JSON::Value APIcall;
+    JSON::Value &cStat = APIcall["blockcache_stat"];
+    cStat["hits"] = current[0] - reported[0];
+    cStat["misses"] = current[1] - reported[1];
+    cStat["readahead"] = current[2] - reported[2];
+    cStat["fetched"] = current[3] - reported[3];
+    cStat["evicted"] = current[4] - reported[4];
+    memcpy(reported, current, sizeof(current));
+    Util::sendUDPApi(APIcall);
+  }
+
   void URIReader::init(){
     handle = -1;
     mapped = 0;
@@ -87,6 +338,8 @@ namespace HTTP{
     clearPointer = true;
     curPos = 0;
     bufPos = 0;
+    cacheBlock = BLOCKCACHE_NO_BLOCK;
+    useCache = false;
   }
 
   URIReader::URIReader(){init();}
@@ -219,10 +472,21 @@ namespace HTTP{
       }else{
         supportRangeRequest = (downer.getHeader("Accept-Ranges").size() > 0);
         std::string header1 = downer.getHeader("Content-Length");
-        if (header1.size()){totalSize = atoi(header1.c_str());}
+        if (header1.size()){totalSize = strtoull(header1.c_str(), 0, 10);}
         myURI = downer.lastURL();
       }
 
+      // Seekable sources are read through the block cache, if enabled. Only a strong ETag reliably
+      // tells versions apart: a source rewritten within a second keeps its size and Last-Modified.
+      std::string etag = downer.getHeader("ETag");
+      if (useCache && supportRangeRequest && totalSize != std::string::npos && etag.size() &&
+          etag.substr(0, 2) != "W/"){
+        if (cache.open(versionId(originalUrl, downer), totalSize)){
+          MEDIUM_MSG("URI get through block cache: %s, totalsize: %zu", myURI.getUrl().c_str(), totalSize);
+          return true;
+        }
+      }
+
       // Other set of headers specified for GET request
       injectHeaders(originalUrl, "GET", downer);
       // streaming mode when size is unknown
@@ -248,6 +512,13 @@ namespace HTTP{
     return false;
   }
 
+  /// Asks the OS to read ahead len bytes from pos, or everything from pos on if len is 0.
+  /// Only file sources are read ahead; for other sources this does nothing.
+  void URIReader::prefetch(uint64_t pos, uint64_t len){
+    if (stateType != HTTP::File || handle == -1){return;}
+    posix_fadvise(handle, startPos + pos, len, POSIX_FADV_WILLNEED);
+  }
+
   // seek to pos, return true if succeeded.
   bool URIReader::seek(const uint64_t pos){
     //Seeking in a non-seekable source? No-op, always fails.
@@ -257,8 +528,8 @@ namespace HTTP{
     allData.truncate(0);
     bufPos = 0;
 
-    //Files always succeed because we use memmap
-    if (stateType == HTTP::File){
+    //Files always succeed because we use memmap, cached sources because blocks are loaded on demand
+    if (stateType == HTTP::File || cache.isOpen()){
       curPos = pos;
       return true;
     }
@@ -287,6 +558,27 @@ namespace HTTP{
     return downer.getSocket().getBinHost();
   }
 
+  /// Returns a string identifying the current version of a remote HTTP(S) or S3 source: its URL
+  /// without credentials and the Content-Length, ETag and Last-Modified of a HEAD request, as also
+  /// used to key the block cache. Returns an empty string for other sources, or on failure.
+  std::string URIReader::remoteVersion(const HTTP::URL &uri){
+    HTTP::Downloader d;
+    HTTP::URL url = uri;
+#ifdef SSL
+    if (url.protocol == "s3+https" || url.protocol == "s3+http"){
+      if (!url.user.size() || !url.pass.size()){
+        if (!std::getenv("S3_ACCESS_KEY_ID") || !std::getenv("S3_SECRET_ACCESS_KEY")){return "";}
+        url.user = std::getenv("S3_ACCESS_KEY_ID");
+        url.pass = std::getenv("S3_SECRET_ACCESS_KEY");
+      }
+      url = injectHeaders(url, "HEAD", d);
+    }
+#endif
+    if (url.protocol != "http" && url.protocol != "https"){return "";}
+    if (!d.head(url) || !d.isOk()){return "";}
+    return versionId(uri, d);
+  }
+
   void URIReader::readAll(size_t (*dataCallback)(const char *data, size_t len)){
     while (!isEOF()){readSome(dataCallback, 419430);}
   }
@@ -324,6 +616,20 @@ namespace HTTP{
       curPos += dataLen;
       return;
     }
+    // HTTP-based read from the block cache, if in use
+    if (stateType == HTTP::HTTP && cache.isOpen()){
+      if (!loadBlock(curPos / cache.blockSize())){
+        FAIL_MSG("Could not read %s at byte %zu", myURI.getUrl().c_str(), curPos);
+        stateType = HTTP::Closed;
+        return;
+      }
+      uint64_t offset = curPos % cache.blockSize();
+      uint64_t dataLen = cacheData.size() - offset;
+      if (dataLen > wantedLen){dataLen = wantedLen;}
+      cb.dataCallback(cacheData + offset, dataLen);
+      curPos += dataLen;
+      return;
+    }
     // HTTP-based read from the Downloader
     if (stateType == HTTP::HTTP){
       // Note: this function returns true if the full read was completed only.
@@ -357,7 +663,7 @@ namespace HTTP{
       bufPos = 0;
     }
     // Read more data if needed
-    while (allData.size() < wantedLen + bufPos && *this && !downer.completed()){
+    while (allData.size() < wantedLen + bufPos && *this && (cache.isOpen() || !downer.completed())){
       readSome(wantedLen - (allData.size() - bufPos), *this);
     }
     // Return wantedLen bytes if we have them
@@ -373,7 +679,89 @@ namespace HTTP{
     bufPos = allData.size();
   }
 
+  /// Makes the given block available in cacheData, from the block cache or from the source.
+  /// When fetching, up to BLOCKCACHE_READAHEAD following blocks that nobody else is fetching are
+  /// requested in the same range request and stored as well.
+  bool URIReader::loadBlock(uint64_t block){
+    if (block == cacheBlock){return true;}
+    cacheBlock = BLOCKCACHE_NO_BLOCK;
+    uint64_t len = cache.blockLen(block);
+    if (!len){return false;}
+    if (!cache.read(block, cacheData)){
+      std::vector<int> locks;
+      int fd = cache.lock(block, true);
+      // Another reader may have fetched the block while we waited for the lock
+      if (fd != -1 && cache.read(block, cacheData)){
+        cache.unlock(block, fd);
+        fd = -1;
+      }else{
+        if (fd != -1){locks.push_back(fd);}
+        uint64_t end = block + 1;
+        while (locks.size() && end - block <= BLOCKCACHE_READAHEAD && cache.blockLen(end) && !cache.has(end)){
+          int aheadFd = cache.lock(end, false);
+          if (aheadFd == -1){break;}
+          if (cache.has(end)){
+            cache.unlock(end, aheadFd);
+            break;
+          }
+          locks.push_back(aheadFd);
+          ++end;
+        }
+        Util::ResizeablePointer fetched;
+        uint64_t start = block * cache.blockSize();
+        uint64_t stop = start + len + (end - block - 1) * cache.blockSize();
+        if (stop > totalSize){stop = totalSize;}
+        bool ok = fetchRange(start, stop, fetched);
+        for (size_t i = 0; i < locks.size(); ++i){
+          if (ok){
+            cache.store(block + i, locks[i], fetched + i * cache.blockSize(), cache.blockLen(block + i));
+          }else{
+            cache.unlock(block + i, locks[i]);
+          }
+        }
+        if (!ok){return false;}
+        __sync_fetch_and_add(&cacheMisses, 1);
+        __sync_fetch_and_add(&cacheReadahead, end - block - 1);
+        __sync_fetch_and_add(&cacheFetched, stop - start);
+        cacheData.assign(fetched, len);
+        cacheBlock = block;
+        BlockCache::reportStats(false);
+        return true;
+      }
+    }
+    __sync_fetch_and_add(&cacheHits, 1);
+    cacheBlock = block;
+    BlockCache::reportStats(false);
+    return true;
+  }
+
+  /// Fetches the bytes from start up to (not including) end from the source into buf, blocking.
+  bool URIReader::fetchRange(uint64_t start, uint64_t end, Util::ResizeablePointer &buf){
+    RangeCollector coll(buf, start, end - start);
+    if (!downer.completed()){downer.clean();}
+    injectHeaders(originalUrl, "GET", downer);
+    if (userAgentOverride.size()){downer.setHeader("User-Agent", userAgentOverride);}
+    if (!downer.getRangeNonBlocking(myURI, start, end, coll)){return false;}
+    while (buf.size() < end - start && !downer.continueNonBlocking(coll)){Util::sleep(5);}
+    // A server ignoring the range would have sent the source from its beginning instead
+    if (buf.size() < end - start || (start && downer.getStatusCode() != 206)){
+      FAIL_MSG("Range request %" PRIu64 "-%" PRIu64 " for %s failed: %" PRIu32 " %s", start, end,
+               myURI.getUrl().c_str(), downer.getStatusCode(), downer.getStatusText().c_str());
+      downer.clean();
+      return false;
+    }
+    // Retried requests continue to the end of the source; don't leave the rest pending on the connection
+    if (!downer.completed()){downer.clean();}
+    return true;
+  }
+
   void URIReader::close(){
+    if (cache.isOpen()){
+      cache.close();
+      BlockCache::reportStats(true);
+    }
+    cacheBlock = BLOCKCACHE_NO_BLOCK;
+    cacheData.truncate(0);
     //Wipe internal state
     curPos = 0;
     allData.truncate(0);
@@ -410,7 +798,7 @@ namespace HTTP{
   }
 
   bool URIReader::isEOF() const{
-    if (stateType == HTTP::File){
+    if (stateType == HTTP::File || (stateType == HTTP::HTTP && cache.isOpen())){
       return (curPos >= totalSize);
     }else if (stateType == HTTP::Stream){
       if (!downer.getSocket() && !downer.getSocket().Received().available(1)){return true;}
@@ -6,6 +6,38 @@ namespace HTTP{
 
   enum URIType{Closed = 0, File, Stream, HTTP};
 
+  /// Shared on-disk cache of fixed-size blocks of remote sources, used by URIReader for seekable
+  /// HTTP(S) and S3 URIs that have a strong ETag, when URIReader::useCache is set. Every block is stored as a separate file named after a hash of the source
+  /// and the block number, so the cache is shared between processes and survives restarts.
+  /// Fetching is single-flight: a block is fetched by whichever reader first locks its ".part" file,
+  /// while other readers of the same block wait for that lock and then read the finished block.
+  /// The least recently used blocks are evicted once the cache grows beyond its size cap.
+  /// Configured through the MIST_BLOCKCACHE_DIR and MIST_BLOCKCACHE_SIZE (in MiB, 0 disables)
+  /// environment variables.
+  class BlockCache{
+  public:
+    BlockCache();
+    bool open(const std::string &sourceId, uint64_t sourceSize);
+    void close();
+    bool isOpen() const{return id.size();}
+    uint64_t blockSize() const;
+    uint64_t blockLen(uint64_t block) const;
+    bool has(uint64_t block) const;
+    bool read(uint64_t block, Util::ResizeablePointer &data) const;
+    int lock(uint64_t block, bool wait) const;
+    void store(uint64_t block, int lockFd, const char *data, size_t len);
+    void unlock(uint64_t block, int lockFd) const;
+    static void reportStats(bool force);
+
+  private:
+    std::string dir; ///< Cache directory, with trailing slash
+    std::string id;  ///< Hash identifying the source; empty if the cache is not in use
+    uint64_t size;   ///< Size of the source in bytes
+    uint64_t cap;    ///< Maximum size of the cache directory in bytes
+    std::string blockPath(uint64_t block) const;
+    void evict();
+  };
+
   /// Opens a generic URI for reading. Supports streams/pipes, HTTP(S) and file access.
   /// Supports seeking, partial and full reads; emulating behaviour where necessary.
   /// Calls progress callback for long-duration operations, if set.
@@ -43,6 +75,10 @@ namespace HTTP{
 
     void readSome(size_t wantedLen, Util::DataCallback &cb);
 
+    /// Hints that the given byte range will be read soon, so it can be read ahead in the background.
+    /// Only has effect for files; a no-op for other URI types.
+    void prefetch(uint64_t pos, uint64_t len);
+
     /// Closes the currently open URI. Does not change the internal URI value.
     void close();
 
@@ -66,10 +102,16 @@ namespace HTTP{
     virtual size_t getDataCallbackPos() const;
 
     std::string userAgentOverride;
+    /// If set, seekable HTTP(S) sources with a strong ETag are read through the block cache.
+    /// Off by default; meant for VoD inputs that seek around in the same file repeatedly.
+    bool useCache;
 
     std::string getHost() const; ///< Gets hostname for connection, or [::] if local.
     std::string getBinHost() const; ///< Gets binary form hostname for connection, or [::] if local.
 
+    /// Identifies the current version of a remote HTTP(S) or S3 source through a HEAD request.
+    static std::string remoteVersion(const HTTP::URL &uri);
+
   private:
     // Internal state variables
     bool (*cbProgress)(uint8_t); ///< The progress callback, if any. Not called if set to a null pointer.
@@ -90,6 +132,11 @@ namespace HTTP{
     bool clearPointer;
     URIType stateType;       ///< Holds the type of URI this is, for internal processing purposes.
     HTTP::Downloader downer; ///< For HTTP(S)-based URIs, the Downloader instance used for the download.
+    BlockCache cache;        ///< Block cache for seekable HTTP(S)-based URIs, if enabled.
+    uint64_t cacheBlock;     ///< Number of the block currently held in cacheData.
+    Util::ResizeablePointer cacheData;
+    bool loadBlock(uint64_t block);
+    bool fetchRange(uint64_t start, uint64_t end, Util::ResizeablePointer &buf);
     void init();
   };
 
@@ -110,11 +110,8 @@ entrypoint_lines.extend([
   # '#include "src/input/mist_in.cpp"',
   # '#include "src/session.cpp"',
   # '#include "src/controller/controller.cpp"',
-  '#ifdef ONE_LIBRARY',
-  'extern "C" { int MistServerMain(int argc, char *argv[]){',
-  '#else',
-  'int main(int argc, char *argv[]){',
-  '#endif',
+  '// Also called by Util::Procs::HandoffMist, to switch binaries in-process',
+  'int MistMain(int argc, char *argv[]){',
   '  if (argc < 2) {',
   '#if defined(__linux__)',
   '    program_invocation_short_name = (char *)"MistController";',
@@ -158,7 +155,9 @@ entrypoint_lines.extend([
   '  return 202;',
   '}',
   '#ifdef ONE_LIBRARY',
-  '}',
+  'extern "C" { int MistServerMain(int argc, char *argv[]){return MistMain(argc, argv);} }',
+  '#else',
+  'int main(int argc, char *argv[]){return MistMain(argc, argv);}',
   '#endif'
 ])
 
@@ -362,6 +362,8 @@ int Controller::handleAPIConnection(Socket::Connection &conn){
   bool authorized = false;
   bool isLocal = false;
   HTTP::Parser H;
+  // Response trees are allocated from here, so nodes are reused between requests
+  JSON::Arena apiArena;
   // while connected and not past login attempt limit
   while (conn && logins < 4){
     if ((conn.spool() || conn.Received().size()) && H.Read(conn)){
@@ -416,7 +418,7 @@ int Controller::handleAPIConnection(Socket::Connection &conn){
           continue;
         }
       }
-      JSON::Value Response;
+      JSON::Value Response(apiArena);
       JSON::Value Request;
       std::string reqContType = H.GetHeader("Content-Type");
       if (reqContType == "application/json"){
@@ -439,6 +441,14 @@ int Controller::handleAPIConnection(Socket::Connection &conn){
         break;
       }
       if (H.url == "/api2"){Request["minimal"] = true;}
+      // Single "clients" requests can be huge; they are written straight into the response below
+      JSON::Value clientsReq;
+      bool streamClients = false;
+      if (Request.isMember("clients") && !Request["clients"].isArray()){
+        clientsReq = Request["clients"];
+        Request.removeMember("clients");
+        streamClients = true;
+      }
       {// lock the config mutex here - do not unlock until done processing
         tthread::lock_guard<tthread::mutex> guard(configMutex);
         if (!Controller::conf.is_active){return 0;}
@@ -464,15 +474,24 @@ int Controller::handleAPIConnection(Socket::Connection &conn){
       std::string jsonp = "";
       if (H.GetVar("callback") != ""){jsonp = H.GetVar("callback");}
       if (H.GetVar("jsonp") != ""){jsonp = H.GetVar("jsonp");}
-      H.Clean();
-      H.SetHeader("Content-Type", "text/javascript");
-      H.setCORSHeaders();
-      if (jsonp == ""){
-        H.SetBody(Response.toString() + "\n\n");
-      }else{
-        H.SetBody(jsonp + "(" + Response.toString() + ");\n\n");
+      HTTP::Parser R;
+      R.SetHeader("Content-Type", "text/javascript");
+      R.setCORSHeaders();
+      // Stream the response as chunks if possible, buffer it into a single body otherwise
+      R.StartResponse("200", "OK", H, conn, H.protocol != "HTTP/1.1" || H.GetHeader("Connection") == "close");
+      {
+        JSON::Writer W(conn, R);
+        if (jsonp.size()){W.raw(jsonp + "(");}
+        W.objBegin();
+        jsonForEachConst(Response, it){W.key(it.key()).value(*it);}
+        if (authorized && streamClients){
+          W.key("clients");
+          Controller::writeClients(clientsReq, W);
+        }
+        W.objEnd();
+        W.raw(jsonp.size() ? ");\n\n" : "\n\n");
       }
-      H.SendResponse("200", "OK", conn);
+      R.Chunkify("", conn);
       H.Clean();
     }// if HTTP request received
   }// while connected
@@ -583,6 +602,62 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
     }
     return;
   }
+  if (Request.isMember("startup_stat")){
+    JSON::Value &sStat = Request["startup_stat"];
+    if (sStat.isMember("connector") && sStat.isMember("first")){
+      Controller::startupLog &sLog = Controller::startupStats[sStat["connector"].asStringRef()];
+      sLog.lastReport = Util::bootSecs();
+      sLog.count++;
+      if (sStat.isMember("warm") && sStat["warm"].asBool()){sLog.warmCount++;}
+      if (sStat.isMember("edge") && sStat["edge"].asBool()){sLog.edgeCount++;}
+      if (sStat.isMember("connect")){sLog.connectMs += sStat["connect"].asInt();}
+      if (sStat.isMember("ready")){sLog.readyMs += sStat["ready"].asInt();}
+      if (sStat.isMember("select")){sLog.selectMs += sStat["select"].asInt();}
+      if (sStat.isMember("seek")){sLog.seekMs += sStat["seek"].asInt();}
+      sLog.firstMs += sStat["first"].asInt();
+    }
+    return;
+  }
+  if (Request.isMember("page_stat")){
+    JSON::Value &pStat = Request["page_stat"];
+    if (pStat.isMember("stream") && pStat.isMember("loaded")){
+      Controller::pageLog &pLog = Controller::pageStats[pStat["stream"].asStringRef()];
+      pLog.loaded = pStat["loaded"].asInt();
+      pLog.reloaded = pStat.isMember("reloaded") ? pStat["reloaded"].asInt() : 0;
+      pLog.prefetched = pStat.isMember("prefetched") ? pStat["prefetched"].asInt() : 0;
+      pLog.prefetchHits = pStat.isMember("prefetch_hits") ? pStat["prefetch_hits"].asInt() : 0;
+      pLog.hits = pStat.isMember("hits") ? pStat["hits"].asInt() : 0;
+      pLog.misses = pStat.isMember("misses") ? pStat["misses"].asInt() : 0;
+    }
+    return;
+  }
+  if (Request.isMember("zygote_stat")){
+    JSON::Value &zStat = Request["zygote_stat"];
+    if (zStat.isMember("connector") && zStat.isMember("idle")){
+      uint64_t zPort = zStat.isMember("port") ? zStat["port"].asInt() : 0;
+      // Keyed on connector and port, so multiple listeners of one connector don't overwrite each other
+      Controller::zygoteLog &zLog = Controller::zygoteStats[zStat["connector"].asString() + ":" + JSON::Value(zPort).asString()];
+      zLog.connector = zStat["connector"].asStringRef();
+      zLog.port = zPort;
+      zLog.idle = zStat["idle"].asInt();
+      zLog.target = zStat.isMember("target") ? zStat["target"].asInt() : 0;
+      zLog.min = zStat.isMember("min") ? zStat["min"].asInt() : 0;
+      zLog.max = zStat.isMember("max") ? zStat["max"].asInt() : 0;
+      zLog.handoffs = zStat.isMember("handoffs") ? zStat["handoffs"].asInt() : 0;
+      zLog.misses = zStat.isMember("misses") ? zStat["misses"].asInt() : 0;
+    }
+    return;
+  }
+  if (Request.isMember("blockcache_stat")){
+    JSON::Value &cStat = Request["blockcache_stat"];
+    Controller::blockCacheLog &cLog = Controller::blockCacheStats;
+    if (cStat.isMember("hits")){cLog.hits += cStat["hits"].asInt();}
+    if (cStat.isMember("misses")){cLog.misses += cStat["misses"].asInt();}
+    if (cStat.isMember("readahead")){cLog.readahead += cStat["readahead"].asInt();}
+    if (cStat.isMember("fetched")){cLog.fetched += cStat["fetched"].asInt();}
+    if (cStat.isMember("evicted")){cLog.evicted += cStat["evicted"].asInt();}
+    return;
+  }
   if (Request.isMember("trigger_fail")){
     Controller::triggerStats[Request["trigger_fail"].asStringRef()].failCount++;
     return;
@@ -1304,12 +1379,22 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
   if (Request.isMember("push_start")){
     std::string stream;
     std::string target;
+    JSON::Value targets;
     if (Request["push_start"].isArray()){
       stream = Request["push_start"][0u].asStringRef();
-      target = Request["push_start"][1u].asStringRef();
+      targets = Request["push_start"][1u];
     }else{
       stream = Request["push_start"]["stream"].asStringRef();
-      target = Request["push_start"]["target"].asStringRef();
+      targets = Request["push_start"]["target"];
+    }
+    // Multiple targets become a single fan-out push, muxed once by one output process
+    if (targets.isArray()){
+      jsonForEach(targets, it){
+        if (target.size()){target += "|";}
+        target += it->asStringRef();
+      }
+    }else{
+      target = targets.asStringRef();
     }
     Util::sanitizeName(stream);
     if (*stream.rbegin() != '+'){
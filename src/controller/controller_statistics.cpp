@@ -4,6 +4,7 @@
 #include "controller_statistics.h"
 #include "controller_storage.h"
 #include <cstdio>
+#include <deque>
 #include <fstream>
 #include <sstream>
 #include <list>
@@ -36,6 +37,8 @@
 #define STAT_CLI_PKTCOUNT 2048
 #define STAT_CLI_PKTLOST 4096
 #define STAT_CLI_PKTRETRANSMIT 8192
+#define STAT_CLI_RTT 16384
+#define STAT_CLI_BUFMS 32768
 #define STAT_CLI_ALL 0xFFFF
 // These are used to store "totals" field requests in a bitfield for speedup.
 #define STAT_TOT_CLIENTS 1
@@ -51,6 +54,10 @@
 std::map<std::string, Controller::statSession> sessions;
 
 std::map<std::string, Controller::triggerLog> Controller::triggerStats; ///< Holds prometheus stats for trigger executions
+std::map<std::string, Controller::startupLog> Controller::startupStats; ///< Holds prometheus stats for output startup times
+std::map<std::string, Controller::pageLog> Controller::pageStats; ///< Holds page buffering stats of VoD inputs
+std::map<std::string, Controller::zygoteLog> Controller::zygoteStats; ///< Holds process pool stats of connectors
+Controller::blockCacheLog Controller::blockCacheStats = {0, 0, 0, 0, 0}; ///< Holds block cache stats of remote sources
 bool Controller::killOnExit = KILL_ON_EXIT;
 tthread::recursive_mutex statsMutex;
 uint64_t Controller::statDropoff = 0;
@@ -84,7 +91,7 @@ class tagQueueItem{
 std::map<std::string, tagQueueItem> tagQueue;
 
 const char nullAddress[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static Controller::statLog emptyLogEntry = {0, 0, 0, 0, 0, 0 ,0 ,0, "", nullAddress, ""};
+static Controller::statLog emptyLogEntry = {0, 0, 0, 0, 0, 0 ,0 ,0, 0, 0, "", nullAddress, ""};
 bool notEmpty(const Controller::statLog & dta){
   return dta.time || dta.firstActive || dta.lastSecond || dta.down || dta.up || dta.streamName.size() || dta.connectors.size();
 }
@@ -112,6 +119,37 @@ struct streamTotals{
 
 Comms::Sessions statComm;
 bool statCommActive = false;
+static pid_t sessionHost = 0;
+
+/// Stops the session in the given statComm record.
+/// Sessions handled by the session host share its PID, so they are asked to disconnect instead.
+static void stopSession(size_t i){
+  uint8_t status = statComm.getStatus(i);
+  if (status & COMM_STATUS_NOKILL){
+    statComm.setStatus(status | COMM_STATUS_REQDISCONNECT, i);
+    INFO_MSG("Requesting disconnect of session %s", statComm.getSessId(i).c_str());
+    return;
+  }
+  uint32_t pid = statComm.getPid(i);
+  if (pid > 1){
+    Util::Procs::Stop(pid);
+    INFO_MSG("Killing PID %" PRIu32, pid);
+  }
+}
+
+/// Starts the session host if it is not running yet.
+/// The session host runs all sessions in a single process, instead of one MistSession process per session.
+static void checkSessionHost(){
+  if (sessionHost && Util::Procs::isRunning(sessionHost)){return;}
+  if (Comms::SessionRequests::hostActive()){return;}
+  if (!Util::Procs::HasMistBinary("MistSession")){return;}
+  std::deque<std::string> args;
+  args.push_back("MistSession");
+  args.push_back("--host");
+  int err = fileno(stderr);
+  sessionHost = Util::Procs::StartPipedMist(args, 0, 0, &err);
+  if (sessionHost){INFO_MSG("Started session host with PID %d", (int)sessionHost);}
+}
 // Global server wide statistics
 static uint64_t servUpBytes = 0;
 static uint64_t servDownBytes = 0;
@@ -204,7 +242,11 @@ void Controller::sessions_invalidate(const std::string &streamname){
     if (statComm.getStream(i) == streamname){
       sessCount++;
       // Re-trigger USER_NEW trigger for this session
-      kill(statComm.getPid(i), SIGUSR1);
+      if (statComm.getStatus(i) & COMM_STATUS_NOKILL){
+        statComm.setStatus(statComm.getStatus(i) | COMM_STATUS_REQTRIGGER, i);
+      }else{
+        kill(statComm.getPid(i), SIGUSR1);
+      }
     }
   }
   INFO_MSG("Invalidated %u session(s) for stream %s", sessCount, streamname.c_str());
@@ -345,12 +387,8 @@ void Controller::sessions_shutdown(const std::string &streamname, const std::str
     if (statComm.getStatus(i) == COMM_STATUS_INVALID || (statComm.getStatus(i) & COMM_STATUS_DISCONNECT)){continue;}
     if ((!streamname.size() || statComm.getStream(i) == streamname) &&
       (!protocol.size() || statComm.hasConnector(i, protocol))){
-      uint32_t pid = statComm.getPid(i);
       sessCount++;
-      if (pid > 1){
-        Util::Procs::Stop(pid);
-        INFO_MSG("Killing PID %" PRIu32, pid);
-      }
+      stopSession(i);
     }
   }
   INFO_MSG("Shut down %u sessions for stream %s/%s", sessCount,
@@ -587,20 +625,35 @@ void Controller::SharedMemStats(void *config){
           Triggers::doTrigger("STREAM_END", payload.str(), streamName);
         }
         streamStats.erase(streamName);
+        pageStats.erase(streamName);
         inactiveStreams.erase(inactiveStreams.begin());
         shiftWrites = true;
       }
+      // Drop startup timings of connectors that have not reported in a while
+      for (std::map<std::string, startupLog>::iterator it = startupStats.begin(); it != startupStats.end();){
+        if (it->second.lastReport + STAT_CUTOFF < Util::bootSecs()){
+          startupStats.erase(it++);
+        }else{
+          ++it;
+        }
+      }
       /*LTS-START*/
       Controller::checkServerLimits();
       /*LTS-END*/
     }
+    checkSessionHost();
     Util::wait(1000);
   }
   statCommActive = false;
   HIGH_MSG("Stopping stats thread");
   if (Util::Config::is_restarting){
+    // Keep the session host running, the restarted controller will pick it up again
+    if (sessionHost){Util::Procs::forget(sessionHost);}
     statComm.setMaster(false);
-  }else{/*LTS-START*/
+  }else{
+    pid_t hostPid = Comms::SessionRequests::hostPid();
+    if (hostPid > 1){Util::Procs::Stop(hostPid);}
+    /*LTS-START*/
     if (Controller::killOnExit){
       WARN_MSG("Killing all connected clients to force full shutdown");
       statComm.finishAll();
@@ -639,13 +692,7 @@ void Controller::killConnections(std::string sessId){
     // Find a matching stream in statComm with a matching sessID and kill it
     for (size_t i = 0; i < statComm.recordCount(); i++){
       if (statComm.getStatus(i) == COMM_STATUS_INVALID || (statComm.getStatus(i) & COMM_STATUS_DISCONNECT)){continue;}
-      if (statComm.getSessId(i) == sessId){
-        uint32_t pid = statComm.getPid(i);
-        if (pid > 1){
-          Util::Procs::Stop(pid);
-          INFO_MSG("Killing PID %" PRIu32, pid);
-        }
-      }
+      if (statComm.getSessId(i) == sessId){stopSession(i);}
     }
   }
 }
@@ -1068,6 +1115,8 @@ void Controller::statStorage::update(Comms::Sessions &statComm, size_t index){
   tmp.pktCount = statComm.getPacketCount(index);
   tmp.pktLost = statComm.getPacketLostCount(index);
   tmp.pktRetransmit = statComm.getPacketRetransmitCount(index);
+  tmp.rtt = statComm.getRoundTripTime(index);
+  tmp.bufms = statComm.getBufferFill(index);
   tmp.connectors = statComm.getConnector(index);
   tmp.streamName = statComm.getStream(index);
   tmp.host = statComm.getHost(index);
@@ -1099,6 +1148,8 @@ void Controller::statOnDisconnect(size_t id){
   // Check to see if cleanup is required (when a Session binary fails)
   const std::string thisSessionId = statComm.getSessId(id);
   sessions[thisSessionId].finish();
+  // Sessions of the session host have no lock or connections page of their own
+  if (statComm.getStatus(id) & COMM_STATUS_NOKILL){return;}
   // Try to lock to see if the session crashed during boot
   IPC::semaphore sessionLock;
   char semName[NAME_BUFFER_SIZE];
@@ -1139,6 +1190,28 @@ bool Controller::hasViewers(std::string streamName){
   return false;
 }
 
+/// Copy of the data of a single session, as reported by a "clients" request.
+struct clientRow{
+  std::string host;
+  std::string stream;
+  std::string proto;
+  std::string sessid;
+  uint64_t conntime;
+  uint64_t position;
+  uint64_t down;
+  uint64_t up;
+  uint64_t downbps;
+  uint64_t upbps;
+  uint64_t pktcount;
+  uint64_t pktlost;
+  uint64_t pktretransmit;
+  uint64_t rtt;
+  uint64_t bufms;
+};
+
+static unsigned int clientsReply(JSON::Value &req, JSON::Value &rep, std::deque<clientRow> &rows);
+static void clientsRow(const clientRow &r, unsigned int fields, JSON::Value &d);
+
 /// This takes a "clients" request, and fills in the response data.
 ///
 /// \api
@@ -1150,7 +1223,7 @@ bool Controller::hasViewers(std::string streamName){
 ///   //array of protocols to accumulate. Empty means all.
 ///   "protocols": ["HLS", "HSS"],
 ///   //list of requested data fields. Empty means all.
-///   "fields": ["host", "stream", "protocol", "conntime", "position", "down", "up", "downbps", "upbps","pktcount","pktlost","pktretransmit"],
+///   "fields": ["host", "stream", "protocol", "conntime", "position", "down", "up", "downbps", "upbps","pktcount","pktlost","pktretransmit","rtt","bufms"],
 ///   //unix timestamp of measuring moment. Negative means X seconds ago. Empty means now.
 ///   "time": 1234567
 ///}
@@ -1175,6 +1248,59 @@ bool Controller::hasViewers(std::string streamName){
 /// ~~~~~~~~~~~~~~~
 /// In case of the second method, the response is an array in the same order as the requests.
 void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
+  std::deque<clientRow> rows;
+  unsigned int fields = clientsReply(req, rep, rows);
+  rep["data"].null();
+  for (std::deque<clientRow>::iterator it = rows.begin(); it != rows.end(); ++it){
+    JSON::Value d;
+    clientsRow(*it, fields, d);
+    rep["data"].append(d);
+  }
+}
+
+/// Writes the response to a single (object-style) "clients" request directly to the given writer.
+/// The output is identical to that of fillClients, but no JSON::Value tree is built for the data
+/// rows. The rows are copied out while the statistics are locked and written afterwards, so a slow
+/// API client cannot block the statistics thread.
+void Controller::writeClients(JSON::Value &req, JSON::Writer &W){
+  JSON::Value rep;
+  std::deque<clientRow> rows;
+  unsigned int fields = clientsReply(req, rep, rows);
+  W.objBegin().key("time").value(rep["time"]).key("fields").value(rep["fields"]);
+  W.key("data").arrBegin();
+  JSON::Value d;
+  for (std::deque<clientRow>::iterator it = rows.begin(); it != rows.end(); ++it){
+    d.null();
+    clientsRow(*it, fields, d);
+    W.value(d);
+  }
+  W.arrEnd().objEnd();
+  W.flush();
+}
+
+/// Appends the wanted fields of a copied session to the data row d.
+static void clientsRow(const clientRow &r, unsigned int fields, JSON::Value &d){
+  if (fields & STAT_CLI_HOST){d.append(r.host);}
+  if (fields & STAT_CLI_STREAM){d.append(r.stream);}
+  if (fields & STAT_CLI_PROTO){d.append(r.proto);}
+  if (fields & STAT_CLI_CONNTIME){d.append(r.conntime);}
+  if (fields & STAT_CLI_POSITION){d.append(r.position);}
+  if (fields & STAT_CLI_DOWN){d.append(r.down);}
+  if (fields & STAT_CLI_UP){d.append(r.up);}
+  if (fields & STAT_CLI_BPS_DOWN){d.append(r.downbps);}
+  if (fields & STAT_CLI_BPS_UP){d.append(r.upbps);}
+  if (fields & STAT_CLI_SESSID){d.append(r.sessid);}
+  if (fields & STAT_CLI_PKTCOUNT){d.append(r.pktcount);}
+  if (fields & STAT_CLI_PKTLOST){d.append(r.pktlost);}
+  if (fields & STAT_CLI_PKTRETRANSMIT){d.append(r.pktretransmit);}
+  if (fields & STAT_CLI_RTT){d.append(r.rtt);}
+  if (fields & STAT_CLI_BUFMS){d.append(r.bufms);}
+}
+
+/// Shared implementation of fillClients and writeClients.
+/// Fills "time" and "fields" in rep and copies the matching sessions into rows, while holding the
+/// statistics lock. Returns the bitmask of wanted fields.
+static unsigned int clientsReply(JSON::Value &req, JSON::Value &rep, std::deque<clientRow> &rows){
   tthread::lock_guard<tthread::recursive_mutex> guard(statsMutex);
   // first, figure out the timestamp wanted
   int64_t reqTime = 0;
@@ -1218,6 +1344,8 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
       if ((*it).asStringRef() == "pktcount"){fields |= STAT_CLI_PKTCOUNT;}
       if ((*it).asStringRef() == "pktlost"){fields |= STAT_CLI_PKTLOST;}
       if ((*it).asStringRef() == "pktretransmit"){fields |= STAT_CLI_PKTRETRANSMIT;}
+      if ((*it).asStringRef() == "rtt"){fields |= STAT_CLI_RTT;}
+      if ((*it).asStringRef() == "bufms"){fields |= STAT_CLI_BUFMS;}
     }
   }
   // select all, if none selected
@@ -1247,39 +1375,41 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
   if (fields & STAT_CLI_PKTCOUNT){rep["fields"].append("pktcount");}
   if (fields & STAT_CLI_PKTLOST){rep["fields"].append("pktlost");}
   if (fields & STAT_CLI_PKTRETRANSMIT){rep["fields"].append("pktretransmit");}
-  // output the data itself
-  rep["data"].null();
-  // loop over all sessions
+  if (fields & STAT_CLI_RTT){rep["fields"].append("rtt");}
+  if (fields & STAT_CLI_BUFMS){rep["fields"].append("bufms");}
+  // copy the data itself
   if (sessions.size()){
-    for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
+    for (std::map<std::string, Controller::statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
       unsigned long long time = reqTime;
       if (now && reqTime - it->second.getEnd() < 5){time = it->second.getEnd();}
-      // data present and wanted? insert it!
+      // data present and wanted? copy it!
       if ((it->second.getEnd() >= time && it->second.getStart() <= time) &&
           (!streams.size() || streams.count(it->second.getStreamName(time))) &&
           (!protos.size() || protos.count(it->second.getConnectors(time)))){
-        const statLog & dta = it->second.curData.getDataFor(time);
+        const Controller::statLog & dta = it->second.curData.getDataFor(time);
         if (notEmpty(dta)){
-          JSON::Value d;
-          if (fields & STAT_CLI_HOST){d.append(it->second.getStrHost(time));}
-          if (fields & STAT_CLI_STREAM){d.append(it->second.getStreamName(time));}
-          if (fields & STAT_CLI_PROTO){d.append(it->second.getConnectors(time));}
-          if (fields & STAT_CLI_CONNTIME){d.append(it->second.getConnTime(time));}
-          if (fields & STAT_CLI_POSITION){d.append(it->second.getLastSecond(time));}
-          if (fields & STAT_CLI_DOWN){d.append(it->second.getDown(time));}
-          if (fields & STAT_CLI_UP){d.append(it->second.getUp(time));}
-          if (fields & STAT_CLI_BPS_DOWN){d.append(it->second.getBpsDown(time));}
-          if (fields & STAT_CLI_BPS_UP){d.append(it->second.getBpsUp(time));}
-          if (fields & STAT_CLI_SESSID){d.append(it->second.getSessId());}
-          if (fields & STAT_CLI_PKTCOUNT){d.append(it->second.getPktCount(time));}
-          if (fields & STAT_CLI_PKTLOST){d.append(it->second.getPktLost(time));}
-          if (fields & STAT_CLI_PKTRETRANSMIT){d.append(it->second.getPktRetransmit(time));}
-          rep["data"].append(d);
+          rows.push_back(clientRow());
+          clientRow &r = rows.back();
+          if (fields & STAT_CLI_HOST){r.host = it->second.getStrHost(time);}
+          if (fields & STAT_CLI_STREAM){r.stream = it->second.getStreamName(time);}
+          if (fields & STAT_CLI_PROTO){r.proto = it->second.getConnectors(time);}
+          if (fields & STAT_CLI_CONNTIME){r.conntime = it->second.getConnTime(time);}
+          if (fields & STAT_CLI_POSITION){r.position = it->second.getLastSecond(time);}
+          if (fields & STAT_CLI_DOWN){r.down = it->second.getDown(time);}
+          if (fields & STAT_CLI_UP){r.up = it->second.getUp(time);}
+          if (fields & STAT_CLI_BPS_DOWN){r.downbps = it->second.getBpsDown(time);}
+          if (fields & STAT_CLI_BPS_UP){r.upbps = it->second.getBpsUp(time);}
+          if (fields & STAT_CLI_SESSID){r.sessid = it->second.getSessId();}
+          if (fields & STAT_CLI_PKTCOUNT){r.pktcount = it->second.getPktCount(time);}
+          if (fields & STAT_CLI_PKTLOST){r.pktlost = it->second.getPktLost(time);}
+          if (fields & STAT_CLI_PKTRETRANSMIT){r.pktretransmit = it->second.getPktRetransmit(time);}
+          if (fields & STAT_CLI_RTT){r.rtt = dta.rtt;}
+          if (fields & STAT_CLI_BUFMS){r.bufms = dta.bufms;}
         }
       }
     }
   }
-  // all done! return is by reference, so no need to return anything here.
+  return fields;
 }
 
 /// This takes a "active_streams" request, and fills in the response data.
@@ -1491,6 +1621,16 @@ void Controller::fillActive(JSON::Value &req, JSON::Value &rep){
         }else if (j->asStringRef() == "health"){
           if (!M || M.getStreamName() != it->first){M.reInit(it->first, false, false);}
           if (M){M.getHealthJSON(F);}
+        }else if (j->asStringRef() == "pages"){
+          if (Controller::pageStats.count(it->first)){
+            const Controller::pageLog &pLog = Controller::pageStats[it->first];
+            F["loaded"] = pLog.loaded;
+            F["reloaded"] = pLog.reloaded;
+            F["prefetched"] = pLog.prefetched;
+            F["prefetch_hits"] = pLog.prefetchHits;
+            F["hits"] = pLog.hits;
+            F["misses"] = pLog.misses;
+          }
         }else if (j->asStringRef() == "tracks"){
           if (!M || M.getStreamName() != it->first){M.reInit(it->first, false, false);}
           if (M){
@@ -1883,6 +2023,53 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"retrans\"}" << it->second.packRetrans << "\n";
       }
 
+      if (Controller::pageStats.size()){
+        response << "\n# HELP mist_pages VoD page buffering statistics per stream.\n";
+        response << "# TYPE mist_pages counter\n";
+        for (std::map<std::string, Controller::pageLog>::iterator it = Controller::pageStats.begin();
+             it != Controller::pageStats.end(); it++){
+          response << "mist_pages{stream=\"" << it->first << "\",type=\"loaded\"}" << it->second.loaded << "\n";
+          response << "mist_pages{stream=\"" << it->first << "\",type=\"reloaded\"}" << it->second.reloaded << "\n";
+          response << "mist_pages{stream=\"" << it->first << "\",type=\"prefetched\"}" << it->second.prefetched << "\n";
+          response << "mist_pages{stream=\"" << it->first << "\",type=\"prefetch_hits\"}" << it->second.prefetchHits << "\n";
+          response << "mist_pages{stream=\"" << it->first << "\",type=\"hits\"}" << it->second.hits << "\n";
+          response << "mist_pages{stream=\"" << it->first << "\",type=\"misses\"}" << it->second.misses << "\n";
+        }
+      }
+
+      if (Controller::zygoteStats.size()){
+        response << "\n# HELP mist_zygote Pre-forked process pool occupancy per connector and port.\n";
+        response << "# TYPE mist_zygote gauge\n";
+        for (std::map<std::string, Controller::zygoteLog>::iterator it = Controller::zygoteStats.begin();
+             it != Controller::zygoteStats.end(); it++){
+          std::stringstream lbl;
+          lbl << "connector=\"" << it->second.connector << "\",port=\"" << it->second.port << "\"";
+          response << "mist_zygote{" << lbl.str() << ",type=\"idle\"}" << it->second.idle << "\n";
+          response << "mist_zygote{" << lbl.str() << ",type=\"target\"}" << it->second.target << "\n";
+          response << "mist_zygote{" << lbl.str() << ",type=\"min\"}" << it->second.min << "\n";
+          response << "mist_zygote{" << lbl.str() << ",type=\"max\"}" << it->second.max << "\n";
+        }
+        response << "\n# HELP mist_zygote_events Pre-forked process pool handoffs and misses per connector and port.\n";
+        response << "# TYPE mist_zygote_events counter\n";
+        for (std::map<std::string, Controller::zygoteLog>::iterator it = Controller::zygoteStats.begin();
+             it != Controller::zygoteStats.end(); it++){
+          std::stringstream lbl;
+          lbl << "connector=\"" << it->second.connector << "\",port=\"" << it->second.port << "\"";
+          response << "mist_zygote_events{" << lbl.str() << ",type=\"handoffs\"}" << it->second.handoffs << "\n";
+          response << "mist_zygote_events{" << lbl.str() << ",type=\"misses\"}" << it->second.misses << "\n";
+        }
+      }
+
+      if (Controller::blockCacheStats.hits || Controller::blockCacheStats.misses){
+        response << "\n# HELP mist_blockcache Remote source block cache activity, in blocks or bytes (fetched).\n";
+        response << "# TYPE mist_blockcache counter\n";
+        response << "mist_blockcache{type=\"hits\"}" << Controller::blockCacheStats.hits << "\n";
+        response << "mist_blockcache{type=\"misses\"}" << Controller::blockCacheStats.misses << "\n";
+        response << "mist_blockcache{type=\"readahead\"}" << Controller::blockCacheStats.readahead << "\n";
+        response << "mist_blockcache{type=\"fetched\"}" << Controller::blockCacheStats.fetched << "\n";
+        response << "mist_blockcache{type=\"evicted\"}" << Controller::blockCacheStats.evicted << "\n";
+      }
+
       if (Controller::triggerStats.size()){
         response << "\n# HELP mist_trigger_count Total executions for the given trigger\n";
         response << "# HELP mist_trigger_time Total execution time in millis for the given trigger\n";
@@ -1895,6 +2082,29 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         }
         response << "\n";
       }
+
+      if (Controller::startupStats.size()){
+        response << "\n# HELP mist_startup_count Total viewer connections that sent their first packet, per output\n";
+        response << "# TYPE mist_startup_count counter\n";
+        response << "# HELP mist_startup_warm Connections that reused an already mapped stream metadata\n";
+        response << "# TYPE mist_startup_warm counter\n";
+        response << "# HELP mist_startup_edge Connections that started at the live edge published by the buffer\n";
+        response << "# TYPE mist_startup_edge counter\n";
+        response << "# HELP mist_startup_ms Total millis spent per startup phase, per output\n";
+        response << "# TYPE mist_startup_ms counter\n";
+        for (std::map<std::string, Controller::startupLog>::iterator it = Controller::startupStats.begin();
+             it != Controller::startupStats.end(); it++){
+          response << "mist_startup_count{output=\"" << it->first << "\"}" << it->second.count << "\n";
+          response << "mist_startup_warm{output=\"" << it->first << "\"}" << it->second.warmCount << "\n";
+          response << "mist_startup_edge{output=\"" << it->first << "\"}" << it->second.edgeCount << "\n";
+          response << "mist_startup_ms{output=\"" << it->first << "\",phase=\"connect\"}" << it->second.connectMs << "\n";
+          response << "mist_startup_ms{output=\"" << it->first << "\",phase=\"ready\"}" << it->second.readyMs << "\n";
+          response << "mist_startup_ms{output=\"" << it->first << "\",phase=\"select\"}" << it->second.selectMs << "\n";
+          response << "mist_startup_ms{output=\"" << it->first << "\",phase=\"seek\"}" << it->second.seekMs << "\n";
+          response << "mist_startup_ms{output=\"" << it->first << "\",phase=\"first\"}" << it->second.firstMs << "\n";
+        }
+        response << "\n";
+      }
     }
     H.Chunkify(response.str(), conn);
   }
@@ -1936,6 +2146,42 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
           tVal["fails"] = it->second.failCount;
         }
       }
+      if (Controller::startupStats.size()){
+        for (std::map<std::string, Controller::startupLog>::iterator it = Controller::startupStats.begin();
+             it != Controller::startupStats.end(); it++){
+          JSON::Value &sVal = resp["startup"][it->first];
+          sVal["count"] = it->second.count;
+          sVal["warm"] = it->second.warmCount;
+          sVal["edge"] = it->second.edgeCount;
+          sVal["connect"] = it->second.connectMs;
+          sVal["ready"] = it->second.readyMs;
+          sVal["select"] = it->second.selectMs;
+          sVal["seek"] = it->second.seekMs;
+          sVal["first"] = it->second.firstMs;
+        }
+      }
+      if (Controller::zygoteStats.size()){
+        for (std::map<std::string, Controller::zygoteLog>::iterator it = Controller::zygoteStats.begin();
+             it != Controller::zygoteStats.end(); it++){
+          JSON::Value &zVal = resp["zygotes"][it->first];
+          zVal["connector"] = it->second.connector;
+          zVal["port"] = it->second.port;
+          zVal["idle"] = it->second.idle;
+          zVal["target"] = it->second.target;
+          zVal["min"] = it->second.min;
+          zVal["max"] = it->second.max;
+          zVal["handoffs"] = it->second.handoffs;
+          zVal["misses"] = it->second.misses;
+        }
+      }
+      if (Controller::blockCacheStats.hits || Controller::blockCacheStats.misses){
+        JSON::Value &cVal = resp["blockcache"];
+        cVal["hits"] = Controller::blockCacheStats.hits;
+        cVal["misses"] = Controller::blockCacheStats.misses;
+        cVal["readahead"] = Controller::blockCacheStats.readahead;
+        cVal["fetched"] = Controller::blockCacheStats.fetched;
+        cVal["evicted"] = Controller::blockCacheStats.evicted;
+      }
       if (Storage["config"].isMember("location") && Storage["config"]["location"].isMember("lat") && Storage["config"]["location"].isMember("lon")){
         resp["loc"]["lat"] = Storage["config"]["location"]["lat"].asDouble();
         resp["loc"]["lon"] = Storage["config"]["location"]["lon"].asDouble();
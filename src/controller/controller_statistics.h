@@ -34,6 +34,8 @@ namespace Controller{
     uint64_t pktCount;
     uint64_t pktLost;
     uint64_t pktRetransmit;
+    uint64_t rtt;   ///< Round trip time in ms, for transports that measure it
+    uint64_t bufms; ///< Transport buffer fill in ms, for transports that measure it
     std::string streamName;
     std::string host;
     std::string connectors;
@@ -106,6 +108,58 @@ namespace Controller{
 
   extern std::map<std::string, triggerLog> triggerStats;
 
+  /// Startup timings of viewer connections, summed per connector
+  struct startupLog{
+    uint64_t count;
+    uint64_t warmCount;
+    uint64_t edgeCount;
+    uint64_t connectMs;
+    uint64_t readyMs;
+    uint64_t selectMs;
+    uint64_t seekMs;
+    uint64_t firstMs;
+    uint64_t lastReport; ///< Time in seconds of the last report, entries are dropped after STAT_CUTOFF without any
+  };
+
+  extern std::map<std::string, startupLog> startupStats;
+
+  /// Page buffering statistics of VoD inputs, as last reported per stream
+  struct pageLog{
+    uint64_t loaded;
+    uint64_t reloaded;
+    uint64_t prefetched;
+    uint64_t prefetchHits;
+    uint64_t hits;
+    uint64_t misses;
+  };
+
+  extern std::map<std::string, pageLog> pageStats;
+
+  /// Pre-forked process pool statistics of output connectors, as last reported per connector and port
+  struct zygoteLog{
+    std::string connector;
+    uint64_t port;
+    uint64_t idle;
+    uint64_t target;
+    uint64_t min;
+    uint64_t max;
+    uint64_t handoffs;
+    uint64_t misses;
+  };
+
+  extern std::map<std::string, zygoteLog> zygoteStats;
+
+  /// Remote source block cache activity, totalled over all reporting processes
+  struct blockCacheLog{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead;
+    uint64_t fetched;
+    uint64_t evicted;
+  };
+
+  extern blockCacheLog blockCacheStats;
+
   void statLeadIn();
   void statOnActive(size_t id);
   void statOnDisconnect(size_t id);
@@ -114,6 +168,7 @@ namespace Controller{
   std::set<std::string> getActiveStreams(const std::string &prefix = "");
   void killStatistics(char *data, size_t len, unsigned int id);
   void fillClients(JSON::Value &req, JSON::Value &rep);
+  void writeClients(JSON::Value &req, JSON::Writer &W);
   void fillActive(JSON::Value &req, JSON::Value &rep);
   void fillHasStats(JSON::Value &req, JSON::Value &rep);
   void fillTotals(JSON::Value &req, JSON::Value &rep);
@@ -1,6 +1,8 @@
+#include <dirent.h>
 #include <fcntl.h>
 #include <semaphore.h>
 #include <sys/stat.h>
+#include <utime.h>
 
 #include "input.h"
 #include <fstream>
@@ -43,6 +45,8 @@ namespace Mist{
     if (endKey == key){++endKey;}
     if (endKey > key + 1000){endKey = key + 1000;}
     DONTEVEN_MSG("User with ID:%zu is on %zu:%zu -> %zu (timestamp %" PRIu64 ")", id, track, key, endKey, time);
+    //Pages that are not buffered yet get read ahead from the source, up to the configured amount
+    size_t toPrefetch = M.getVod() ? config->getInteger("prefetch") : 0;
     for (size_t i = key; i <= endKey; ){
       const Util::RelAccX &tPages = M.pages(track);
       Util::RelAccXFieldData firstkeyEntry = tPages.getFieldData("firstkey");
@@ -65,8 +69,22 @@ namespace Mist{
       uint64_t pageTime = M.getTimeForKeyIndex(track, pageNumber);
       if (pageTime <= time){
         keyLoadPriority[trackKey(track, pageNumber)] += 10000;
+        // Count a hit or miss once per page a viewer moves onto, not on every check
+        trackKey tk(track, pageNumber);
+        if (M.getVod() && !(userPages.count(id) && userPages[id] == tk)){
+          userPages[id] = tk;
+          if (isBuffered(track, pageNumber, meta)){
+            ++pageHits;
+          }else{
+            ++pageMisses;
+          }
+        }
       }else{
         keyLoadPriority[trackKey(track, pageNumber)] += 600 - (pageTime - time) / 1000;
+        if (toPrefetch && !isBuffered(track, pageNumber, meta)){
+          prefetchPage(track, pageNumber, cnt);
+          --toPrefetch;
+        }
       }
       // Make sure we always progress, even in edge cases where there is no full key buffered yet
       if (!cnt){cnt = 1;}
@@ -74,7 +92,7 @@ namespace Mist{
     }
     //Now, we can rest assured that the next ~120 seconds or so is pre-buffered in RAM.
   }
-  void Input::userOnDisconnect(size_t id){}
+  void Input::userOnDisconnect(size_t id){userPages.erase(id);}
   void Input::userLeadOut(){
     if (!keyLoadPriority.size()){return;}
     //Make reverse mapping
@@ -89,6 +107,46 @@ namespace Mist{
     }
   }
 
+  /// Has the source data of the given page read ahead, if its byte range is known and this was
+  /// not done already recently.
+  void Input::prefetchPage(size_t track, uint32_t pageNumber, uint32_t keyCount){
+    trackKey tk(track, pageNumber);
+    uint64_t now = Util::bootSecs();
+    if (prefetched.count(tk) && now < prefetched[tk] + config->getInteger("pagetimeout")){return;}
+    DTSC::Keys keys(M.keys(track));
+    if (pageNumber >= keys.getEndValid()){return;}
+    uint64_t start = keys.getBpos(pageNumber);
+    // The last page has no next key to end at, so it is read ahead until the end of the source
+    uint64_t end = 0;
+    if (pageNumber + keyCount < keys.getEndValid()){
+      end = keys.getBpos(pageNumber + keyCount);
+      if (end <= start){return;}
+    }
+    if (!start){return;}
+    prefetchBytes(track, start, end);
+    prefetched[tk] = now;
+    ++pagesPrefetched;
+    VERYHIGH_MSG("Prefetching track %zu page %" PRIu32 ": bytes %" PRIu64 "-%" PRIu64, track, pageNumber, start, end);
+  }
+
+  /// Sends the VoD page buffering statistics to the controller, at most every 10 seconds.
+  void Input::sendPageStats(bool force){
+    if (!M || !M.getVod() || internalOnly){return;}
+    uint64_t now = Util::bootSecs();
+    if (!force && now < lastPageStats + 10){return;}
+    lastPageStats = now;
+    JSON::Value APIcall;
+    JSON::Value &pStat = APIcall["page_stat"];
+    pStat["stream"] = streamName;
+    pStat["loaded"] = pagesLoaded;
+    pStat["reloaded"] = pagesReloaded;
+    pStat["prefetched"] = pagesPrefetched;
+    pStat["prefetch_hits"] = prefetchHits;
+    pStat["hits"] = pageHits;
+    pStat["misses"] = pageMisses;
+    Util::sendUDPApi(APIcall);
+  }
+
   void Input::reloadClientMeta(){
     if (M.getStreamName() != "" && M.getMaster()){return;}
     meta.reInit(streamName, false);
@@ -147,6 +205,30 @@ namespace Mist{
     capa["optional"]["inputtimeout"]["type"] = "uint";
     capa["optional"]["inputtimeout"]["option"] = "--inputtimeout";
 
+    option.null();
+    option["arg"] = "string";
+    option["long"] = "headercache";
+    option["value"].append("");
+    option["help"] = "Directory for cached headers of VoD sources whose header cannot be stored next to them (remote or read-only sources). Defaults to a folder in the temporary directory; set to \"none\" to disable.";
+    config->addOption("headercache", option);
+    capa["optional"]["headercache"]["name"] = "Header cache directory";
+    capa["optional"]["headercache"]["help"] = "Directory for cached headers of VoD sources whose header cannot be stored next to them (remote or read-only sources), so they do not need to be parsed again on every start. Defaults to a folder in the temporary directory; set to \"none\" to disable.";
+    capa["optional"]["headercache"]["option"] = "--headercache";
+    capa["optional"]["headercache"]["type"] = "str";
+
+    option.null();
+    option["arg"] = "integer";
+    option["long"] = "headercachesize";
+    option["value"].append(256);
+    option["help"] = "Maximum size of the header cache directory in MiB";
+    config->addOption("headercachesize", option);
+    capa["optional"]["headercachesize"]["name"] = "Header cache size";
+    capa["optional"]["headercachesize"]["help"] = "Maximum size of the header cache directory. When exceeded, the least recently used headers are removed until it is back at 75% of this size.";
+    capa["optional"]["headercachesize"]["option"] = "--headercachesize";
+    capa["optional"]["headercachesize"]["type"] = "uint";
+    capa["optional"]["headercachesize"]["unit"] = "MiB";
+    capa["optional"]["headercachesize"]["default"] = 256;
+
     /*LTS-START*/
     /*
     //Encryption
@@ -245,6 +327,18 @@ namespace Mist{
     capa["optional"]["pagetimeout"]["type"] = "uint";
     capa["optional"]["pagetimeout"]["default"] = DEFAULT_PAGE_TIMEOUT;
 
+    option.null();
+    option["long"] = "prefetch";
+    option["arg"] = "integer";
+    option["value"].append(2);
+    option["help"] = "For VoD inputs reading from files, the amount of not yet buffered pages ahead of each viewer to have the system read ahead in the background";
+    config->addOption("prefetch", option);
+    capa["optional"]["prefetch"]["name"] = "Prefetch pages";
+    capa["optional"]["prefetch"]["help"] = "For VoD inputs reading from files, the amount of not yet buffered pages ahead of each viewer to have the system read ahead in the background. Helps against stuttering at page boundaries on slow or network storage. Set to 0 to disable.";
+    capa["optional"]["prefetch"]["option"] = "--prefetch";
+    capa["optional"]["prefetch"]["type"] = "uint";
+    capa["optional"]["prefetch"]["default"] = 2;
+
     /*LTS-END*/
     capa["optional"]["debug"]["name"] = "debug";
     capa["optional"]["debug"]["help"] = "The debug level at which messages need to be printed.";
@@ -257,8 +351,16 @@ namespace Mist{
     bufferPid = 0;
     internalOnly = false;
     isBuffer = false;
+    headerCacheKnown = false;
     startTime = Util::bootSecs();
     lastStats = 0;
+    pagesLoaded = 0;
+    pagesReloaded = 0;
+    pagesPrefetched = 0;
+    prefetchHits = 0;
+    pageHits = 0;
+    pageMisses = 0;
+    lastPageStats = 0;
   }
 
   void Input::checkHeaderTimes(const HTTP::URL & streamFile){
@@ -704,7 +806,12 @@ namespace Mist{
       timer = Util::getMicros(timer);
       INFO_MSG("Created header in %.3f ms (%zu tracks)", (double)timer/1000.0, M?M.trackCount():(size_t)0);
       //Write header to file for caching purposes
-      M.toFile(config->getString("input") + ".dtsh");
+      std::string cacheFile = headerCachePath();
+      if (cacheFile.size() && M.getVod()){
+        storeCachedHeader(cacheFile);
+      }else{
+        M.toFile(config->getString("input") + ".dtsh");
+      }
     }
     postHeader();
     if (config->getBool("headeronly")){return 0;}
@@ -890,6 +997,7 @@ namespace Mist{
 
       // unload pages that haven't been used for a while
       removeUnused();
+      sendPageStats();
       if (!M){
         Util::logExitReason(ER_SHM_LOST, "Lost connection to metadata");
         break;
@@ -911,6 +1019,7 @@ namespace Mist{
         Util::wait(waitMs);
       }
     }
+    sendPageStats(true);
     if (!isThread()){
       if (streamStatus){streamStatus.mapped[0] = STRMSTAT_SHUTDOWN;}
       config->is_active = false;
@@ -968,15 +1077,9 @@ namespace Mist{
     return ret;
   }
 
-  /// Main loop for stream-style inputs.
-  /// This loop will do the following, in order:
-  /// - exit if another stream() input is already open for this streamname
-  /// - start a buffer in push mode
-  /// - connect to it
-  /// - run parseStreamHeader
-  /// - if there are tracks, register as a non-viewer on the user page of the buffer
-  /// - call getNext() in a loop, buffering packets
-  void Input::stream(){
+  /// Starts the buffer process for this live stream (or, for non-singular inputs, makes sure
+  /// it is running so we can push into it). Returns false if there is no buffer to push into.
+  bool Input::startBuffer(){
     std::map<std::string, std::string> overrides;
     overrides["throughboot"] = "";
     if (config->getBool("realtime") ||
@@ -986,23 +1089,36 @@ namespace Mist{
     if (isSingular()){
       if (!config->getBool("realtime") && Util::streamAlive(streamName)){
         WARN_MSG("Stream already online, cancelling");
-        return;
+        return false;
       }
       overrides["singular"] = "";
       if (!Util::startInput(streamName, "push://INTERNAL_ONLY:" + config->getString("input"), true,
                             true, overrides, &bufferPid)){// manually override stream url to start the buffer
         WARN_MSG("Could not start buffer, cancelling");
-        return;
+        return false;
       }
     }else{
       if (!Util::startInput(streamName, "push://INTERNAL_PUSH:" + capa["name"].asStringRef(), true,
                             true, overrides)){// manually override stream url to start the buffer
         WARN_MSG("Could not start buffer, cancelling");
-        return;
+        return false;
       }
     }
 
     INFO_MSG("Input started");
+    return true;
+  }
+
+  /// Main loop for stream-style inputs.
+  /// This loop will do the following, in order:
+  /// - exit if another stream() input is already open for this streamname
+  /// - start a buffer in push mode
+  /// - connect to it
+  /// - run parseStreamHeader
+  /// - if there are tracks, register as a non-viewer on the user page of the buffer
+  /// - call getNext() in a loop, buffering packets
+  void Input::stream(){
+    if (!startBuffer()){return;}
 
     //Simulated real time inputs bypass most normal logic
     if (config->getBool("realtime")){
@@ -1370,6 +1486,7 @@ namespace Mist{
             ++pageNum;
             tPages.setInt("firsttime", keyTime, pageNum);
             tPages.setInt("firstkey", j, pageNum);
+            tPages.setInt("ondisk", 0, pageNum);
 
             newData = false;
           }
@@ -1714,6 +1831,10 @@ namespace Mist{
       INFO_MSG("  (%" PRIu32 "/%" PRIu64 " parts, %" PRIu64 " bytes)", packCounter,
                tPages.getInt("parts", pageIdx), byteCounter);
       pageCounter[idx][pageNumber] = Util::bootSecs();
+      trackKey tk(idx, pageNumber);
+      ++pagesLoaded;
+      if (!everLoaded.insert(tk).second){++pagesReloaded;}
+      if (prefetched.erase(tk)){++prefetchHits;}
       return true;
     }
   }
@@ -1744,8 +1865,19 @@ namespace Mist{
         }
       }
     }
-    // Try to read any existing DTSH file
-    std::string fileName = config->getString("input") + ".dtsh";
+    // Try to read any existing DTSH file, then the header cache
+    if (readHeaderFile(config->getString("input") + ".dtsh")){return true;}
+    std::string cacheFile = headerCachePath();
+    if (!cacheFile.size() || access(cacheFile.c_str(), R_OK) || !readHeaderFile(cacheFile)){return false;}
+    // Mark as recently used, so it is evicted last
+    utime(cacheFile.c_str(), 0);
+    INFO_MSG("Read header from cache");
+    return true;
+  }
+
+  /// Loads the stream metadata from the given DTSH file. Returns false if it does not exist or
+  /// is of an outdated version.
+  bool Input::readHeaderFile(const std::string &fileName){
     HIGH_MSG("Loading metadata for stream '%s' from file '%s'", streamName.c_str(), fileName.c_str());
     char *scanBuf;
     size_t fileSize;
@@ -1765,6 +1897,80 @@ namespace Mist{
     return meta;
   }
 
+  /// Returns the header cache file to use for the current source, or an empty string if the header
+  /// is to be stored next to the source as usual. Local sources in writable directories keep using
+  /// their own .dtsh file. For others the cache key includes the size and modification time of a
+  /// local file, or the Content-Length, ETag and Last-Modified of a remote one, so changed sources
+  /// are not served an outdated header.
+  /// The path is determined once per process, as doing so may require a request to the source.
+  std::string Input::headerCachePath(){
+    if (headerCacheKnown){return headerCacheFile;}
+    headerCacheKnown = true;
+    std::string dir = config->getString("headercache");
+    if (dir == "none"){return "";}
+    if (!dir.size()){dir = Util::getTmpFolder() + "dtsh";}
+    HTTP::URL src = HTTP::localURIResolver().link(config->getString("input"));
+    std::string key = src.getUrl();
+    if (src.isLocalPath()){
+      std::string f = src.getFilePath();
+      std::string folder = f.substr(0, f.rfind('/') + 1);
+      if (!folder.size() || !access(folder.c_str(), W_OK)){return "";}
+      struct stat st;
+      if (stat(f.c_str(), &st)){return "";}
+      key += ":" + JSON::Value((uint64_t)st.st_size).asString() + ":" + JSON::Value((uint64_t)st.st_mtime).asString();
+    }else{
+      key = HTTP::URIReader::remoteVersion(src);
+      if (!key.size()){return "";}
+    }
+    if (*dir.rbegin() != '/'){dir += '/';}
+    headerCacheFile = dir + Secure::md5(key) + ".dtsh";
+    return headerCacheFile;
+  }
+
+  /// Writes the current header to the header cache, first evicting the least recently used
+  /// headers in bulk if the cache exceeds its maximum size.
+  void Input::storeCachedHeader(const std::string &cacheFile){
+    std::string dir = cacheFile.substr(0, cacheFile.rfind('/'));
+    if (access(dir.c_str(), 0) != 0 && mkdir(dir.c_str(), S_IRWXU | S_IRWXG)){
+      WARN_MSG("Could not create header cache directory %s: %s", dir.c_str(), strerror(errno));
+      return;
+    }
+    uint64_t maxSize = config->getInteger("headercachesize") * 1024 * 1024;
+    DIR *d = opendir(dir.c_str());
+    if (d){
+      std::multimap<time_t, std::pair<std::string, uint64_t> > entries;
+      uint64_t total = 0;
+      struct dirent *e;
+      while ((e = readdir(d))){
+        std::string name = e->d_name;
+        if (name.size() < 5 || name.substr(name.size() - 5) != ".dtsh"){continue;}
+        struct stat st;
+        if (stat((dir + "/" + name).c_str(), &st)){continue;}
+        entries.insert(std::make_pair(st.st_mtime, std::make_pair(name, (uint64_t)st.st_size)));
+        total += st.st_size;
+      }
+      closedir(d);
+      if (total > maxSize){
+        size_t removed = 0;
+        std::multimap<time_t, std::pair<std::string, uint64_t> >::iterator it = entries.begin();
+        for (; it != entries.end() && total > maxSize / 4 * 3; ++it){
+          if (!unlink((dir + "/" + it->second.first).c_str())){
+            total -= it->second.second;
+            ++removed;
+          }
+        }
+        INFO_MSG("Evicted %zu least recently used headers from the header cache", removed);
+      }
+    }
+    // Write to a temporary file first, so other inputs never read a partial header
+    std::string tmpFile = cacheFile + "." + JSON::Value((uint64_t)getpid()).asString();
+    M.toFile(tmpFile);
+    if (rename(tmpFile.c_str(), cacheFile.c_str())){
+      WARN_MSG("Could not store header in cache as %s: %s", cacheFile.c_str(), strerror(errno));
+      unlink(tmpFile.c_str());
+    }
+  }
+
   bool Input::keepAlive(){
     if (!userSelect.size()){return config->is_active;}
 
@@ -39,6 +39,10 @@ namespace Mist{
     return a.track < b.track || (a.track == b.track && a.key < b.key);
   }
 
+  inline bool operator== (const trackKey a, const trackKey b){
+    return a.track == b.track && a.key == b.key;
+  }
+
   class Input : public InOutBase{
   public:
     Input(Util::Config *cfg);
@@ -73,6 +77,9 @@ namespace Mist{
     virtual bool isThread(){return false;}
     virtual bool isSingular(){return !config->getBool("realtime");}
     virtual bool readExistingHeader();
+    bool readHeaderFile(const std::string &fileName);
+    std::string headerCachePath();
+    void storeCachedHeader(const std::string &cacheFile);
     virtual bool atKeyFrame();
     virtual void getNext(size_t idx = INVALID_TRACK_ID){}
     virtual void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID){}
@@ -87,6 +94,7 @@ namespace Mist{
     virtual void serve();
     virtual void inputServeStats();
     virtual void stream();
+    bool startBuffer();
     virtual std::string getConnectedBinHost(){return std::string("\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\001", 16);}
     virtual size_t streamByteCount(){
       return 0;
@@ -104,6 +112,12 @@ namespace Mist{
     virtual JSON::Value enumerateSources(const std::string &){ return JSON::Value(); };
     virtual JSON::Value getSourceCapa(const std::string &){ return JSON::Value(); };
     bool bufferFrame(size_t track, uint32_t keyNum);
+    void prefetchPage(size_t track, uint32_t pageNumber, uint32_t keyCount);
+    /// Hints that the source bytes in the given range will be buffered soon. Inputs that read
+    /// from seekable files override this to have the OS read the range ahead in the background.
+    /// Reads ahead the source bytes from start up to end, or until the end of the source if end is 0.
+    virtual void prefetchBytes(size_t track, uint64_t start, uint64_t end){}
+    void sendPageStats(bool force = false);
     void doInputAbortTrigger(pid_t pid, char *mRExitReason, char *exitReason);
     bool exitAndLogReason();
 
@@ -124,6 +138,21 @@ namespace Mist{
 
     std::map<size_t, std::map<uint32_t, uint64_t> > pageCounter;
 
+    bool headerCacheKnown; ///< Whether headerCacheFile has been determined yet
+    std::string headerCacheFile; ///< Header cache file for the current source, see headerCachePath
+
+    // VoD page prefetching and reuse statistics
+    std::map<trackKey, uint64_t> prefetched; ///< Pages read ahead but not buffered yet, with time of read-ahead
+    std::set<trackKey> everLoaded; ///< Pages that have been buffered at least once
+    uint64_t pagesLoaded;   ///< Pages buffered
+    uint64_t pagesReloaded; ///< Pages buffered again after having been unloaded
+    uint64_t pagesPrefetched; ///< Pages read ahead
+    uint64_t prefetchHits;  ///< Pages buffered after having been read ahead
+    uint64_t pageHits;      ///< Pages viewers moved onto that were already buffered
+    uint64_t pageMisses;    ///< Pages viewers moved onto that were not buffered yet
+    std::map<size_t, trackKey> userPages; ///< Current page per viewer, so each page is counted once
+    uint64_t lastPageStats;
+
     static Input *singleton;
 
     bool hasSrt;
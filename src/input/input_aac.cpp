@@ -93,6 +93,7 @@ namespace Mist{
   }
 
   bool InputAAC::preRun(){
+    inFile.useCache = true;
     inFile.open(config->getString("input"));
     if (!inFile || inFile.isEOF()){
       Util::logExitReason(ER_READ_START_FAILURE, "Reading header for '%s' failed: Could not open input stream", config->getString("input").c_str());
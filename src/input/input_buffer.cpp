@@ -1,6 +1,8 @@
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -24,6 +26,10 @@
 #define FRAG_BOOT 3
 /*LTS-END*/
 
+// Amount of bytes moved to the disk tier per pass through removeUnused, so that writing out a
+// page never stalls the buffer for long.
+#define DISK_TIER_CHUNK 1048576
+
 namespace Mist{
   InputBuffer::InputBuffer(Util::Config *cfg) : Input(cfg){
     firstProcTime = 0;
@@ -112,6 +118,29 @@ namespace Mist{
     capa["optional"]["segmentsize"]["type"] = "uint";
     capa["optional"]["segmentsize"]["default"] = DEFAULT_FRAGMENT_DURATION;
 
+    capa["optional"]["disktier"]["name"] = "DVR disk tier directory";
+    capa["optional"]["disktier"]["help"] =
+        "If set, buffered data older than the in-memory buffer time is moved from memory to files "
+        "in this local directory, where it stays available for seeking until it falls outside of "
+        "the buffer time. Allows DVR windows much larger than available memory.";
+    capa["optional"]["disktier"]["type"] = "str";
+    capa["optional"]["disktier"]["default"] = "";
+
+    option["arg"] = "integer";
+    option["long"] = "memtime";
+    option["short"] = "m";
+    option["help"] = "Time in milliseconds data stays in memory before moving to the disk tier";
+    option["value"].append(50000);
+    config->addOption("memtime", option);
+    capa["optional"]["memtime"]["name"] = "In-memory buffer time (ms)";
+    capa["optional"]["memtime"]["help"] =
+        "When a DVR disk tier directory is set, data older than this many milliseconds is moved "
+        "from memory to disk. Has no effect otherwise.";
+    capa["optional"]["memtime"]["option"] = "--memtime";
+    capa["optional"]["memtime"]["type"] = "uint";
+    capa["optional"]["memtime"]["default"] = 50000;
+    option.null();
+
     capa["optional"]["fallback_stream"]["name"] = "Fallback stream";
     capa["optional"]["fallback_stream"]["help"] =
         "Alternative stream to load for playback when there is no active broadcast";
@@ -129,6 +158,7 @@ namespace Mist{
         "that support push input to accept a push into MistServer, where you can accept incoming "
         "streams from everyone, based on a set password, and/or use hostname/IP whitelisting.";
     bufferTime = 50000;
+    memTime = 50000;
     cutTime = 0;
     segmentSize = DEFAULT_FRAGMENT_DURATION;
     hasPush = false;
@@ -138,6 +168,8 @@ namespace Mist{
 
   InputBuffer::~InputBuffer(){
     config->is_active = false;
+    while (diskSpills.size()){abortSpill(diskSpills.begin()->first);}
+    while (diskPages.size()){dropDiskPages(diskPages.begin()->first);}
     if (liveMeta){
       liveMeta->unlink();
       delete liveMeta;
@@ -255,9 +287,49 @@ namespace Mist{
     /*LTS-END*/
     finalMillis = lastms;
     meta.setBufferWindow(lastms - firstms);
+    meta.setLiveEdge(findLiveEdge(validTracks));
     meta.setLive(true);
   }
 
+  /// Finds the newest keyframe of the main track (the video track with the most keys, or any track
+  /// if there is no video) at which all other tracks have data, the same way Output::initialSeek
+  /// looks for a live starting point. Returns 0 if there is no such point.
+  uint64_t InputBuffer::findLiveEdge(const std::set<size_t> &validTracks){
+    size_t mainTrack = INVALID_TRACK_ID;
+    size_t mainKeys = 0;
+    for (std::set<size_t>::const_iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+      if (M.getType(*it) == "meta" || !M.getType(*it).size()){continue;}
+      DTSC::Keys keys(M.keys(*it));
+      size_t keyCount = keys.getValidCount();
+      if (!keyCount){continue;}
+      bool isVideo = (M.getType(*it) == "video");
+      bool mainVideo = (mainTrack != INVALID_TRACK_ID && M.getType(mainTrack) == "video");
+      if (mainTrack == INVALID_TRACK_ID || (isVideo && !mainVideo) || (isVideo == mainVideo && keyCount > mainKeys)){
+        mainTrack = *it;
+        mainKeys = keyCount;
+      }
+    }
+    if (mainTrack == INVALID_TRACK_ID){return 0;}
+    DTSC::Keys keys(M.keys(mainTrack));
+    uint32_t firstKey = keys.getFirstValid();
+    for (int64_t i = keys.getEndValid() - 1; i >= firstKey; --i){
+      uint64_t keyTime = keys.getTime(i);
+      if (keyTime < 5000){break;}
+      bool good = true;
+      for (std::set<size_t>::const_iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+        if (M.getType(*it) == "meta" || !M.getType(*it).size()){continue;}
+        // Point-tracks never catch up; ignore them
+        if (*it != mainTrack && M.getNowms(*it) == M.getFirstms(*it)){continue;}
+        if (M.getNowms(*it) < keyTime + M.getMinKeepAway(*it)){
+          good = false;
+          break;
+        }
+      }
+      if (good){return keyTime;}
+    }
+    return 0;
+  }
+
   /// Checks if removing a key from this track is allowed/safe, and if so, removes it.
   /// Returns true if a key was actually removed, false otherwise
   /// Aborts if any of the following conditions are true (while active):
@@ -324,6 +396,8 @@ namespace Mist{
     INFO_MSG("Should remove track %zu", tid);
     meta.reloadReplacedPagesIfNeeded();
     meta.removeTrack(tid);
+    if (diskSpills.count(tid)){abortSpill(tid);}
+    if (diskPages.count(tid)){dropDiskPages(tid);}
     /*LTS-START*/
     if (!M.getValidTracks().size()){
       if (Triggers::shouldTrigger("STREAM_BUFFER")){
@@ -434,10 +508,111 @@ namespace Mist{
         if (tPages.getInt(firstKeyEnt, j) + tPages.getInt(keyCount, j) > firstKey){break;}
         bufferRemove(i, tPages.getInt(firstKeyEnt, j), j);
       }
+      if (diskPages.count(i)){dropDiskPages(i, keys.getFirstValid());}
+      if (diskTier.size()){spillPages(i);}
     }
     updateMeta();
   }
 
+  /// Moves all completed pages of the given track that ended more than memTime ago from shared
+  /// memory to files in the disk tier directory. The page records stay in the metadata, flagged
+  /// as "ondisk", so outputs can still load them (see Output::loadPageForKey).
+  /// At most DISK_TIER_CHUNK bytes are written per call; a partially written page is continued on
+  /// the next call. Viewers that have the memory page mapped keep using it until they switch pages.
+  void InputBuffer::spillPages(size_t tid){
+    Util::RelAccX &tPages = meta.pages(tid);
+    uint64_t lastms = M.getLastms(tid);
+    if (lastms < memTime){return;}
+    uint64_t budget = DISK_TIER_CHUNK;
+    // The last page is still being written to, so never consider that one
+    for (uint32_t j = tPages.getDeleted(); budget && j + 1 < tPages.getEndPos(); j++){
+      if (tPages.getInt("ondisk", j)){continue;}
+      uint64_t avail = tPages.getInt("avail", j);
+      uint32_t keyCount = tPages.getInt("keycount", j);
+      if (!avail || !keyCount){continue;}
+      // A page ends where the next one starts; pages are in time order so we can stop early
+      if (tPages.getInt("firsttime", j + 1) + memTime > lastms){break;}
+      uint32_t pageNum = tPages.getInt("firstkey", j);
+      // The page we were busy with is gone; start over with this one
+      if (diskSpills.count(tid) && diskSpills[tid].pageNum != pageNum){abortSpill(tid);}
+      char pageId[NAME_BUFFER_SIZE];
+      snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), tid, pageNum);
+      IPC::sharedPage page(pageId, 0, false, false);
+      if (!page.mapped || page.len < avail){
+        if (diskSpills.count(tid)){abortSpill(tid);}
+        continue;
+      }
+      std::string path = diskTier + pageId;
+      std::string tmpPath = path + ".tmp";
+      if (!diskSpills.count(tid)){
+        FILE *f = fopen(tmpPath.c_str(), "w");
+        if (!f){
+          FAIL_MSG("Could not open %s for writing, not moving buffer to disk: %s", tmpPath.c_str(), strerror(errno));
+          return;
+        }
+        diskSpill &S = diskSpills[tid];
+        S.pageNum = pageNum;
+        S.written = 0;
+        S.f = f;
+      }
+      diskSpill &S = diskSpills[tid];
+      uint64_t len = avail - S.written;
+      if (len > budget){len = budget;}
+      if (fwrite(page.mapped + S.written, len, 1, S.f) != 1){
+        FAIL_MSG("Could not write %s, not moving buffer to disk: %s", tmpPath.c_str(), strerror(errno));
+        abortSpill(tid);
+        return;
+      }
+      S.written += len;
+      budget -= len;
+      if (S.written < avail){return;}
+      // Terminate with a zero-length marker, like the unused remainder of a memory page
+      bool written = (fwrite("\000\000\000\000", 4, 1, S.f) == 1);
+      bool closed = !fclose(S.f);
+      diskSpills.erase(tid);
+      if (!closed || !written || rename(tmpPath.c_str(), path.c_str())){
+        FAIL_MSG("Could not write %s, not moving buffer to disk: %s", path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return;
+      }
+      tPages.setInt("ondisk", 1, j);
+      diskPages[tid][pageNum] = pageNum + keyCount;
+      HIGH_MSG("Moved page %" PRIu32 " of track %zu (%" PRIu64 " bytes) to %s", pageNum, tid, avail, path.c_str());
+      // Set the master flag so that the memory page will be destroyed once it leaves scope
+      page.master = true;
+    }
+  }
+
+  /// Stops moving a page of the given track to the disk tier, and removes the partial file.
+  void InputBuffer::abortSpill(size_t tid){
+    std::map<size_t, diskSpill>::iterator it = diskSpills.find(tid);
+    if (it == diskSpills.end()){return;}
+    fclose(it->second.f);
+    char pageId[NAME_BUFFER_SIZE];
+    snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), tid, it->second.pageNum);
+    std::string tmpPath = diskTier + pageId + ".tmp";
+    unlink(tmpPath.c_str());
+    diskSpills.erase(it);
+  }
+
+  /// Deletes the disk tier files of all pages of the given track that contain no keys at or after
+  /// firstKey. Deletes all of them for this track when firstKey is not given.
+  void InputBuffer::dropDiskPages(size_t tid, uint32_t firstKey){
+    std::map<uint32_t, uint32_t> &pages = diskPages[tid];
+    std::map<uint32_t, uint32_t>::iterator it = pages.begin();
+    while (it != pages.end()){
+      if (firstKey != 0xFFFFFFFFul && it->second > firstKey){break;}
+      char pageId[NAME_BUFFER_SIZE];
+      snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), tid, it->first);
+      std::string path = diskTier + pageId;
+      if (unlink(path.c_str()) && errno != ENOENT){
+        WARN_MSG("Could not remove %s: %s", path.c_str(), strerror(errno));
+      }
+      pages.erase(it++);
+    }
+    if (!pages.size()){diskPages.erase(tid);}
+  }
+
   void InputBuffer::userLeadIn(){
     meta.reloadReplacedPagesIfNeeded();
     /*LTS-START*/
@@ -561,6 +736,29 @@ namespace Mist{
       bufferTime = tmpNum;
     }
 
+    //Check if memTime setting is correct
+    tmpNum = retrieveSetting(streamCfg, "memtime");
+    if (tmpNum < 1000){tmpNum = 1000;}
+    if (memTime != tmpNum){
+      DEVEL_MSG("Setting memTime from %" PRIu64 " to new value of %" PRIu64, memTime, tmpNum);
+      memTime = tmpNum;
+    }
+
+    //Check if the disk tier setting is correct
+    std::string tmpStr;
+    if (streamCfg && streamCfg.getMember("disktier")){tmpStr = streamCfg.getMember("disktier").asString();}
+    while (tmpStr.size() > 1 && tmpStr[tmpStr.size() - 1] == '/'){tmpStr.erase(tmpStr.size() - 1);}
+    if (diskTier != tmpStr && (diskPages.size() || diskSpills.size())){
+      WARN_MSG("Not changing DVR disk tier to '%s' while buffered data is stored in '%s'", tmpStr.c_str(), diskTier.c_str());
+    }else if (diskTier != tmpStr){
+      if (tmpStr.size() && mkdir(tmpStr.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) && errno != EEXIST){
+        FAIL_MSG("Could not create DVR disk tier directory %s: %s", tmpStr.c_str(), strerror(errno));
+        tmpStr.clear();
+      }
+      INFO_MSG("Setting DVR disk tier from '%s' to new value of '%s'", diskTier.c_str(), tmpStr.c_str());
+      diskTier = tmpStr;
+    }
+
     //Check if input timeout setting is correct
     tmpNum = retrieveSetting(streamCfg, "inputtimeout");
     if (inputTimeout != tmpNum){
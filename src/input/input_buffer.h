@@ -1,4 +1,5 @@
 #include "input.h"
+#include <cstdio>
 #include <fstream>
 #include <mist/dtsc.h>
 #include <mist/shared_memory.h>
@@ -13,6 +14,8 @@ namespace Mist{
   private:
     void fillBufferDetails(JSON::Value &details) const;
     uint64_t bufferTime;
+    uint64_t memTime;
+    std::string diskTier;
     uint64_t cutTime;
     size_t segmentSize;  /*LTS*/
     uint64_t lastReTime; /*LTS*/
@@ -31,6 +34,7 @@ namespace Mist{
     bool preRun();
     bool checkArguments(){return true;}
     void updateMeta();
+    uint64_t findLiveEdge(const std::set<size_t> &validTracks);
     bool needHeader(){return false;}
     void getNext(size_t idx = INVALID_TRACK_ID){};
     void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID){};
@@ -39,6 +43,9 @@ namespace Mist{
 
     bool removeKey(size_t tid);
     void removeUnused();
+    void spillPages(size_t tid);
+    void abortSpill(size_t tid);
+    void dropDiskPages(size_t tid, uint32_t firstKey = 0xFFFFFFFFul);
     void finish();
 
     uint64_t retrieveSetting(DTSC::Scan &streamCfg, const std::string &setting, const std::string &option = "");
@@ -56,6 +63,16 @@ namespace Mist{
     std::map<std::string, uint32_t> procBoots;
     std::map<std::string, uint64_t> procNextBoot;
 
+    // Pages moved to the disk tier, per track: page number -> first key not on the page
+    std::map<size_t, std::map<uint32_t, uint32_t> > diskPages;
+    // Page being moved to the disk tier, per track, and how much of it has been written so far
+    struct diskSpill{
+      uint32_t pageNum;
+      uint64_t written;
+      FILE *f;
+    };
+    std::map<size_t, diskSpill> diskSpills;
+
     std::set<size_t> generatePids;
     std::map<size_t, size_t> sourcePids;
   };
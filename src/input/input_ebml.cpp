@@ -3,6 +3,12 @@
 #include <mist/defines.h>
 #include <mist/ebml.h>
 
+/// Amount of bytes of a block's payload read while indexing, enough for its track number, time,
+/// flags and frame count.
+#define BLOCK_PEEK 16
+/// Blocks with payloads smaller than this are read whole while indexing anyway.
+#define BLOCK_SKIP_MIN 4096
+
 namespace Mist{
 
   InputEBML::InputEBML(Util::Config *cfg) : Input(cfg){
@@ -70,6 +76,9 @@ namespace Mist{
     readPos = 0;
     readingMinimal = true;
     firstRead = true;
+    indexOnly = false;
+    segmentPos = 0;
+    lastCueTime = 0;
   }
 
   std::string ASStoSRT(const char *ptr, uint32_t len){
@@ -164,6 +173,7 @@ namespace Mist{
       inFile.open(0);
     }else{
       // open File
+      inFile.useCache = true;
       inFile.open(config->getString("input"));
       if (!inFile){
         Util::logExitReason(ER_READ_START_FAILURE, "Opening input '%s' failed", config->getString("input").c_str());
@@ -180,18 +190,48 @@ namespace Mist{
   }
   size_t InputEBML::getDataCallbackPos() const{return readPos + readBuffer.size();}
 
+  /// Returns the amount of bytes of the element at the current read position that need to be
+  /// buffered before readElement can return it. TrackEntry elements are always read whole.
+  /// While indexing, big blocks that readHeader does not need the frame data of are only read up
+  /// to their frame count; readElement then skips the rest of them.
+  uint64_t InputEBML::elementBytes(){
+    const char *p = readBuffer + readBufferOffset;
+    uint64_t avail = readBuffer.size() - readBufferOffset;
+    readingMinimal = true;
+    uint64_t needed = EBML::Element::needBytes(p, avail, readingMinimal);
+    if (avail < needed){return needed;}
+    EBML::Element E(p, true);
+    // Make sure TrackEntry types are read whole
+    if (E.getID() == EBML::EID_TRACKENTRY){
+      readingMinimal = false;
+      return EBML::Element::needBytes(p, avail, readingMinimal);
+    }
+    if (indexOnly && E.getType() == EBML::ELEM_BLOCK){
+      uint64_t peek = E.getHeaderLen() + BLOCK_PEEK;
+      if (needed < peek + BLOCK_SKIP_MIN){return needed;}
+      if (avail < peek){return peek;}
+      // Laced blocks need their lacing headers to calculate the frame sizes
+      EBML::Block B(p);
+      if (B.getLacing() || fullBlockTracks.count(B.getTrackNum())){return needed;}
+      return peek;
+    }
+    return needed;
+  }
+
   bool InputEBML::readElement(){
-    uint32_t needed = EBML::Element::needBytes(readBuffer + readBufferOffset, readBuffer.size() - readBufferOffset, readingMinimal);
-    if (!firstRead && readBuffer.size() >= needed + readBufferOffset){
-      readBufferOffset += needed;
-      needed = EBML::Element::needBytes(readBuffer + readBufferOffset, readBuffer.size() - readBufferOffset, readingMinimal);
-      readingMinimal = true;
+    uint64_t needed = EBML::Element::needBytes(readBuffer + readBufferOffset, readBuffer.size() - readBufferOffset, readingMinimal);
+    if (!firstRead){
       if (readBuffer.size() >= needed + readBufferOffset){
-        // Make sure TrackEntry types are read whole
-        if (readingMinimal && EBML::Element(readBuffer + readBufferOffset).getID() == EBML::EID_TRACKENTRY){
-          readingMinimal = false;
-          needed = EBML::Element::needBytes(readBuffer + readBufferOffset, readBuffer.size() - readBufferOffset, readingMinimal);
-        }
+        readBufferOffset += needed;
+        needed = elementBytes();
+      }else if (indexOnly){
+        // The previous element was only read partially: skip over the rest of it
+        uint64_t nextPos = readPos + readBufferOffset + needed;
+        readBuffer.truncate(0);
+        readBufferOffset = 0;
+        if (!inFile.seek(nextPos)){return false;}
+        readPos = nextPos;
+        needed = elementBytes();
       }
     }
 
@@ -224,14 +264,7 @@ namespace Mist{
         continue;
       }
 
-      needed = EBML::Element::needBytes(readBuffer + readBufferOffset, readBuffer.size() - readBufferOffset, readingMinimal);
-      if (readBuffer.size() >= needed + readBufferOffset){
-        // Make sure TrackEntry types are read whole
-        if (readingMinimal && EBML::Element(readBuffer + readBufferOffset).getID() == EBML::EID_TRACKENTRY){
-          readingMinimal = false;
-          needed = EBML::Element::needBytes(readBuffer + readBufferOffset, readBuffer.size() - readBufferOffset, readingMinimal);
-        }
-      }
+      needed = elementBytes();
     }
     EBML::Element E(readBuffer + readBufferOffset);
     if (E.getID() == EBML::EID_CLUSTER){
@@ -264,6 +297,12 @@ namespace Mist{
       INFO_MSG("Header needs update, regenerating");
       return false;
     }
+    cuePoints.clear();
+    if (M.inputLocalVars.isMember("cues")){
+      jsonForEachConst(M.inputLocalVars["cues"], it){
+        cuePoints[(*it)[0u].asInt()] = (*it)[1u].asInt();
+      }
+    }
     return true;
   }
 
@@ -276,12 +315,22 @@ namespace Mist{
       meta.reInit(isSingular() ? streamName : "");
     }
 
+    // Local VoD files are indexed without reading the frame data of (most) blocks
+    indexOnly = needsLock() && inFile.isSeekable() && inFile.getURI().isLocalPath();
+    std::set<uint64_t> clusterPositions;
+    cuePoints.clear();
     while (readElement()){
       if (!config->is_active){
         WARN_MSG("Aborting header generation due to shutdown: %s", Util::exitReason);
+        indexOnly = false;
         return false;
       }
       EBML::Element E(readBuffer + readBufferOffset, readingMinimal);
+      if (E.getID() == EBML::EID_SEGMENT){segmentPos = readPos + readBufferOffset + E.getHeaderLen();}
+      if (E.getID() == EBML::EID_CUETIME){lastCueTime = E.getValUInt();}
+      if (E.getID() == EBML::EID_CUECLUSTERPOSITION){
+        cuePoints[lastCueTime * timeScale] = segmentPos + E.getValUInt();
+      }
       if (E.getID() == EBML::EID_TRACKENTRY){
         EBML::Element tmpElem = E.findChild(EBML::EID_TRACKNUMBER);
         if (!tmpElem){
@@ -439,6 +488,8 @@ namespace Mist{
           WARN_MSG("Unrecognised codec id %s ignoring", codec.c_str());
           continue;
         }
+        // ASS/SSA subtitles change size when converted, so their data is needed for indexing
+        if (trueCodec == "subtitle" && init.size()){fullBlockTracks.insert(trackID);}
         tmpElem = E.findChild(EBML::EID_LANGUAGE);
         if (tmpElem){lang = tmpElem.getValString();}
         size_t idx = M.trackIDToIndex(trackID, getpid());
@@ -473,6 +524,7 @@ namespace Mist{
       // Live streams stop parsing the header as soon as the first Cluster is encountered
       if (E.getID() == EBML::EID_CLUSTER){
         if (!needsLock()){return true;}
+        clusterPositions.insert(lastClusterBPos);
         //Set progress counter for non-live inputs
         if (streamStatus && streamStatus.len > 1 && inFile.getSize()){
           streamStatus.mapped[1] = (255 * (readPos + readBufferOffset)) / inFile.getSize();
@@ -544,6 +596,26 @@ namespace Mist{
       }
     }
 
+    indexOnly = false;
+
+    // Keep the cue points that point to actual clusters, for seeking
+    std::map<uint64_t, uint64_t>::iterator cue = cuePoints.begin();
+    while (cue != cuePoints.end()){
+      if (!clusterPositions.count(cue->second)){
+        cuePoints.erase(cue++);
+      }else{
+        ++cue;
+      }
+    }
+    meta.inputLocalVars.removeMember("cues");
+    for (cue = cuePoints.begin(); cue != cuePoints.end(); ++cue){
+      JSON::Value c;
+      c.append(cue->first);
+      c.append(cue->second);
+      meta.inputLocalVars["cues"].append(c);
+    }
+    INFO_MSG("Indexed %zu clusters, %zu usable cue points", clusterPositions.size(), cuePoints.size());
+
     meta.inputLocalVars["version"] = 2;
     clearPredictors();
     bufferedPacks = 0;
@@ -727,11 +799,20 @@ namespace Mist{
     DTSC::Keys keys(M.keys(mainTrack));
     DTSC::Parts parts(M.parts(mainTrack));
     uint64_t seekPos = keys.getBpos(0);
-    // Replay the parts of the previous keyframe, so the timestaps match up
-    for (size_t i = 0; i < keys.getEndValid(); i++){
-      if (keys.getTime(i) > seekTime){break;}
-      DONTEVEN_MSG("Seeking to %" PRIu64 ", found %" PRIu64 "...", seekTime, keys.getTime(i));
-      seekPos = keys.getBpos(i);
+    // Resolve through the Cues if possible: start at the cluster of the last cue point at or before
+    // the wanted time. Any packets before that time are skipped by the caller.
+    std::map<uint64_t, uint64_t>::iterator cue = cuePoints.upper_bound(seekTime);
+    if (cue != cuePoints.begin()){
+      --cue;
+      seekPos = cue->second;
+      DONTEVEN_MSG("Seeking to %" PRIu64 ", found cue point %" PRIu64 "...", seekTime, cue->first);
+    }else{
+      // Replay the parts of the previous keyframe, so the timestaps match up
+      for (size_t i = 0; i < keys.getEndValid(); i++){
+        if (keys.getTime(i) > seekTime){break;}
+        DONTEVEN_MSG("Seeking to %" PRIu64 ", found %" PRIu64 "...", seekTime, keys.getTime(i));
+        seekPos = keys.getBpos(i);
+      }
     }
 
 
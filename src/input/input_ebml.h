@@ -148,8 +148,10 @@ namespace Mist{
     bool readHeader();
     void postHeader();
     bool readElement();
+    uint64_t elementBytes();
     void getNext(size_t idx = INVALID_TRACK_ID);
     void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID);
+    void prefetchBytes(size_t track, uint64_t start, uint64_t end){inFile.prefetch(start, end ? end - start : 0);}
     void clearPredictors();
     bool readingMinimal;
     uint64_t lastClusterBPos;
@@ -164,6 +166,11 @@ namespace Mist{
     double timeScale;
     bool wantBlocks;
     size_t totalBytes;
+    bool indexOnly; ///< If true, readElement skips block payloads readHeader does not need
+    std::set<uint64_t> fullBlockTracks; ///< Tracks that need their block payloads for indexing
+    uint64_t segmentPos;  ///< Byte position of the Segment payload, which Cues positions are relative to
+    uint64_t lastCueTime; ///< Time of the CuePoint currently being parsed, in timecode scale units
+    std::map<uint64_t, uint64_t> cuePoints; ///< Cue times in milliseconds to byte positions of their clusters
   };
 }// namespace Mist
 
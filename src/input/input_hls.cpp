@@ -1,7 +1,4 @@
 #include "input_hls.h"
-#ifdef SSL
-#include "mbedtls/aes.h"
-#endif
 #include <algorithm>
 #include <cerrno>
 #include <cstdio>
@@ -290,17 +287,17 @@ namespace Mist{
         return true;
       }
       // Alright, we need to read some more data.
-      // We read 192 bytes at a time: a single TS packet is 188 bytes but AES-128-CBC encryption works in 16-byte blocks.
+      // We read 16 TS packets at a time: 16 * 188 bytes is a multiple of the 16-byte AES-128-CBC block size.
+      // Larger reads let the decryption work on many blocks per call.
       size_t len = 0;
-      segDL.readSome(packetPtr, len, 192);
+      segDL.readSome(packetPtr, len, 188 * 16);
       if (!len){return false;}
       if (len % 16 != 0){
         FAIL_MSG("Read a non-16-multiple of bytes (%zu), cannot decode!", len);
         return false;
       }
       outData.allocate(outData.size() + len);
-      mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_DECRYPT, len, tmpIvec, (const unsigned char *)packetPtr,
-                            ((unsigned char *)(char *)outData) + outData.size());
+      aes.decryptBlockCBC((char *)tmpIvec, packetPtr, ((char *)outData) + outData.size(), len);
       outData.append(0, len);
       // End of the segment? Remove padding data.
       if (segDL.isEOF()){
@@ -467,7 +464,7 @@ namespace Mist{
       encrypted = true;
 #ifdef SSL
       // Load key
-      mbedtls_aes_setkey_dec(&aes, (const unsigned char *)entry.keyAES, 128);
+      aes.setDecryptKey(entry.keyAES);
       // Load initialization vector
       memcpy(tmpIvec, entry.ivec, 16);
 #endif
@@ -68,7 +68,7 @@ namespace Mist{
     size_t encOffset;
     unsigned char tmpIvec[16];
 #ifdef SSL
-    mbedtls_aes_context aes;
+    Encryption::AES aes;
 #endif
     bool isOpen;
   };
@@ -147,6 +147,7 @@ namespace Mist{
 
   bool InputMP4::preRun(){
     // open File
+    inFile.useCache = true;
     inFile.open(config->getString("input"));
     if (!inFile){
       Util::logExitReason(ER_READ_START_FAILURE, "Could not open URL or contains no data");
@@ -82,6 +82,7 @@ namespace Mist{
     void getNext(size_t idx = INVALID_TRACK_ID);
     void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID);
     void handleSeek(uint64_t seekTime, size_t idx);
+    void prefetchBytes(size_t track, uint64_t start, uint64_t end){inFile.prefetch(start, end ? end - start : 0);}
 
     HTTP::URIReader inFile;
     Util::ResizeablePointer readBuffer;
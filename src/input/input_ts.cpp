@@ -15,6 +15,7 @@
 #include <mist/ts_packet.h>
 #include <mist/util.h>
 #include <string>
+#include <vector>
 
 #include <mist/procs.h>
 #include <mist/tinythread.h>
@@ -26,134 +27,212 @@ TS::Stream liveStream;
 Util::Config *cfgPointer = NULL;
 
 #define THREAD_TIMEOUT 15
-std::map<size_t, uint64_t> threadTimer;
-
-std::set<size_t> claimableThreads;
 
 /// Global, so that all tracks stay in sync
 int64_t timeStampOffset = 0;
 
-void parseThread(void *mistIn){
-  uint64_t lastTimeStamp = 0;
-  Mist::InputTS *input = reinterpret_cast<Mist::InputTS *>(mistIn);
-
-  size_t tid = 0;
-  {
-    tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-    if (claimableThreads.size()){
-      tid = *claimableThreads.begin();
-      claimableThreads.erase(claimableThreads.begin());
-    }
+/// Live parsing state of a single track.
+/// Tracks are not bound to a thread: any idle worker of the pool may claim any unclaimed track.
+struct trackWork{
+  trackWork(size_t id) : tid(id), lastActive(Util::bootSecs()), busy(false), idx(INVALID_TRACK_ID), lastTimeStamp(0){
+    dataTrack = liveStream.isDataTrack(tid);
   }
-  if (tid == 0){return;}
-
+  size_t tid;
+  uint64_t lastActive; ///< Last time (in seconds) a packet came in for this track
+  bool busy;           ///< True while claimed by a worker
+  bool dataTrack;
+  size_t idx;
+  uint64_t lastTimeStamp;
   Comms::Users userConn;
   DTSC::Meta meta;
   DTSC::Packet pack;
-  bool dataTrack = liveStream.isDataTrack(tid);
-  size_t idx = INVALID_TRACK_ID;
-  {
+};
+
+tthread::mutex workMutex; ///< Guards liveTracks and the busy flags of its entries
+std::map<size_t, trackWork *> liveTracks;
+std::vector<tthread::thread *> parseWorkers;
+bool parseWorkersActive = false;
+/// Bumped (without locking) by the main thread whenever new TS data was handed to liveStream,
+/// so idle workers can tell whether scanning the tracks again is worthwhile.
+volatile uint32_t workGeneration = 0;
+
+/// Claims the first unclaimed track after the given track ID, wrapping around, so that all
+/// workers spread out over all tracks. Returns null if all tracks are claimed.
+static trackWork *claimTrack(size_t after){
+  tthread::lock_guard<tthread::mutex> guard(workMutex);
+  std::map<size_t, trackWork *>::iterator it = liveTracks.upper_bound(after);
+  for (size_t i = 0; i < liveTracks.size(); ++i, ++it){
+    if (it == liveTracks.end()){it = liveTracks.begin();}
+    if (!it->second->busy){
+      it->second->busy = true;
+      return it->second;
+    }
+  }
+  return 0;
+}
+
+/// Cleans up after a track that is no longer being parsed, and removes it from the track list.
+static void finishTrack(trackWork *w, Mist::InputTS *input){
+  //On shutdown, make sure to clean up stream buffer
+  if (w->idx != INVALID_TRACK_ID){
     tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-    threadTimer[tid] = Util::bootSecs();
+    input->liveFinalize(w->idx);
   }
-  while (Util::bootSecs() - threadTimer[tid] < THREAD_TIMEOUT && cfgPointer->is_active &&
-         (!dataTrack || (userConn ? userConn : true))){
-    liveStream.parse(tid);
-    if (!liveStream.hasPacket(tid)){
-      Util::sleep(100);
-      continue;
+
+  std::string reason = "unknown reason";
+  if (!(Util::bootSecs() - w->lastActive < THREAD_TIMEOUT)){reason = "track timeout";}
+  if (!cfgPointer->is_active || !parseWorkersActive){reason = "input shutting down";}
+  if (!(!w->dataTrack || w->userConn)){
+    reason = "buffer disconnect";
+    cfgPointer->is_active = false;
+  }
+  INFO_MSG("Stopped parsing track %zu because %s", w->tid, reason.c_str());
+  {
+    tthread::lock_guard<tthread::mutex> guard(workMutex);
+    liveTracks.erase(w->tid);
+  }
+  liveStream.eraseTrack(w->tid);
+  if (w->dataTrack && w->userConn){w->userConn.setStatus(COMM_STATUS_DISCONNECT | w->userConn.getStatus());}
+  delete w;
+}
+
+/// Parses and buffers whatever is currently available for the given track.
+/// Returns false if the track is done and should be finished, true otherwise.
+/// Sets didWork to true if any packets were handled; failures to set up the track are retried
+/// later, after the workers backed off.
+static bool parseTrack(trackWork &w, Mist::InputTS *input, bool &didWork){
+  if (!(Util::bootSecs() - w.lastActive < THREAD_TIMEOUT && cfgPointer->is_active &&
+        (!w.dataTrack || (w.userConn ? w.userConn : true)))){
+    return false;
+  }
+  liveStream.parse(w.tid);
+  if (!liveStream.hasPacket(w.tid)){return true;}
+  w.lastActive = Util::bootSecs();
+  //Non-stream tracks simply flush all packets and continue
+  if (!w.dataTrack){
+    didWork = true;
+    while (liveStream.hasPacket(w.tid)){liveStream.getPacket(w.tid, w.pack);}
+    return true;
+  }
+  //If we arrive here, we want the stream data
+  //Make sure the track is valid, loaded, etc
+  if (!w.meta || w.idx == INVALID_TRACK_ID || !w.meta.trackValid(w.idx)){
+    {//Only lock the mutex for as long as strictly necessary
+      tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
+      std::map<std::string, std::string> overrides;
+      overrides["singular"] = "";
+      if (!Util::streamAlive(globalStreamName) && !Util::startInput(globalStreamName, "push://INTERNAL_ONLY:" + cfgPointer->getString("input"), true, true, overrides)){
+        FAIL_MSG("Could not start buffer for %s", globalStreamName.c_str());
+        return false;
+      }
+      if (!input->hasMeta()){input->reloadClientMeta();}
     }
-    threadTimer[tid] = Util::bootSecs();
-    //Non-stream tracks simply flush all packets and continue
-    if (!dataTrack){
-      while (liveStream.hasPacket(tid)){liveStream.getPacket(tid, pack);}
-      continue;
+    //This meta object is local to the track, and only one worker handles it at a time
+    w.meta.reInit(globalStreamName, false);
+    //Meta init failure, retry later
+    if (!w.meta){return true;}
+    liveStream.initializeMetadata(w.meta, w.tid);
+    w.idx = w.meta.trackIDToIndex(w.tid, getpid());
+    if (w.idx != INVALID_TRACK_ID){
+      //Successfully assigned a track index! Inform the buffer we're pushing
+      w.userConn.reload(globalStreamName, w.idx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
     }
-    //If we arrive here, we want the stream data
-    //Make sure the track is valid, loaded, etc
-    if (!meta || idx == INVALID_TRACK_ID || !meta.trackValid(idx)){
-      {//Only lock the mutex for as long as strictly necessary
-        tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-        std::map<std::string, std::string> overrides;
-        overrides["singular"] = "";
-        if (!Util::streamAlive(globalStreamName) && !Util::startInput(globalStreamName, "push://INTERNAL_ONLY:" + cfgPointer->getString("input"), true, true, overrides)){
-          FAIL_MSG("Could not start buffer for %s", globalStreamName.c_str());
-          return;
+    //Any kind of failure? Retry later.
+    if (w.idx == INVALID_TRACK_ID || !w.meta.trackValid(w.idx)){return true;}
+  }
+  didWork = true;
+  while (liveStream.hasPacket(w.tid)){
+    liveStream.getPacket(w.tid, w.pack);
+    if (w.pack){
+      char *data;
+      size_t dataLen;
+      w.pack.getString("data", data, dataLen);
+      uint64_t adjustTime = w.pack.getTime() + timeStampOffset;
+      if (w.lastTimeStamp || timeStampOffset){
+        if (w.lastTimeStamp + 5000 < adjustTime || w.lastTimeStamp > adjustTime + 5000){
+          INFO_MSG("Timestamp jump " PRETTY_PRINT_MSTIME " -> " PRETTY_PRINT_MSTIME ", compensating.", PRETTY_ARG_MSTIME(w.lastTimeStamp), PRETTY_ARG_MSTIME(adjustTime));
+          timeStampOffset += (w.lastTimeStamp-adjustTime);
+          adjustTime = w.pack.getTime() + timeStampOffset;
         }
-        if (!input->hasMeta()){input->reloadClientMeta();}
-      }
-      //This meta object is thread local, no mutex needed
-      meta.reInit(globalStreamName, false);
-      if (!meta){
-        //Meta init failure, retry later
-        Util::sleep(100);
-        continue;
-      }
-      liveStream.initializeMetadata(meta, tid);
-      idx = meta.trackIDToIndex(tid, getpid());
-      if (idx != INVALID_TRACK_ID){
-        //Successfully assigned a track index! Inform the buffer we're pushing
-        userConn.reload(globalStreamName, idx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
       }
-      //Any kind of failure? Retry later.
-      if (idx == INVALID_TRACK_ID || !meta.trackValid(idx)){
-        Util::sleep(100);
-        continue;
-      }
-    }
-    while (liveStream.hasPacket(tid)){
-      liveStream.getPacket(tid, pack);
-      if (pack){
-        char *data;
-        size_t dataLen;
-        pack.getString("data", data, dataLen);
-        uint64_t adjustTime = pack.getTime() + timeStampOffset;
-        if (lastTimeStamp || timeStampOffset){
-          if (lastTimeStamp + 5000 < adjustTime || lastTimeStamp > adjustTime + 5000){
-            INFO_MSG("Timestamp jump " PRETTY_PRINT_MSTIME " -> " PRETTY_PRINT_MSTIME ", compensating.", PRETTY_ARG_MSTIME(lastTimeStamp), PRETTY_ARG_MSTIME(adjustTime));
-            timeStampOffset += (lastTimeStamp-adjustTime);
-            adjustTime = pack.getTime() + timeStampOffset;
-          }
-        }
-        lastTimeStamp = adjustTime;
-        if (!meta.getBootMsOffset()){meta.setBootMsOffset(Util::bootMS() - adjustTime);}
-        {
-          tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-          //If the main thread's local metadata doesn't have this track yet, reload metadata
-          if (!input->trackLoaded(idx)){
-            input->reloadClientMeta();
-            if (!input->trackLoaded(idx)){
-              FAIL_MSG("Track %zu could not be loaded into main thread - throwing away packet", idx);
-              continue;
-            }
+      w.lastTimeStamp = adjustTime;
+      if (!w.meta.getBootMsOffset()){w.meta.setBootMsOffset(Util::bootMS() - adjustTime);}
+      {
+        tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
+        //If the main thread's local metadata doesn't have this track yet, reload metadata
+        if (!input->trackLoaded(w.idx)){
+          input->reloadClientMeta();
+          if (!input->trackLoaded(w.idx)){
+            FAIL_MSG("Track %zu could not be loaded into main thread - throwing away packet", w.idx);
+            continue;
           }
-          input->bufferLivePacket(adjustTime, pack.getInt("offset"), idx, data, dataLen,
-                                pack.getInt("bpos"), pack.getFlag("keyframe"));
         }
+        input->bufferLivePacket(adjustTime, w.pack.getInt("offset"), w.idx, data, dataLen,
+                              w.pack.getInt("bpos"), w.pack.getFlag("keyframe"));
       }
     }
   }
+  return true;
+}
 
-  //On shutdown, make sure to clean up stream buffer
-  if (idx != INVALID_TRACK_ID){
-    tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-    input->liveFinalize(idx);
+/// Body of the parse worker threads. Workers repeatedly claim the next unclaimed track, parse
+/// what is available for it and release it again, so any worker can pick up work for any PID.
+/// When a full pass over the tracks turned up no work and no new data came in, they briefly sleep.
+void parseWorker(void *mistIn){
+  Mist::InputTS *input = reinterpret_cast<Mist::InputTS *>(mistIn);
+  size_t cursor = 0;
+  size_t idleClaims = 0;
+  uint32_t lastGeneration = workGeneration;
+  while (cfgPointer->is_active && parseWorkersActive){
+    trackWork *w = claimTrack(cursor);
+    bool claimed = w;
+    bool didWork = false;
+    if (claimed){
+      cursor = w->tid;
+      if (!parseTrack(*w, input, didWork)){
+        finishTrack(w, input);
+      }else{
+        tthread::lock_guard<tthread::mutex> guard(workMutex);
+        w->busy = false;
+      }
+    }
+    if (didWork){
+      idleClaims = 0;
+      continue;
+    }
+    size_t trackCount;
+    {
+      tthread::lock_guard<tthread::mutex> guard(workMutex);
+      trackCount = liveTracks.size();
+    }
+    if (claimed && ++idleClaims < trackCount){continue;}
+    idleClaims = 0;
+    if (lastGeneration == workGeneration){Util::sleep(10);}
+    lastGeneration = workGeneration;
   }
+}
 
-  std::string reason = "unknown reason";
-  if (!(Util::bootSecs() - threadTimer[tid] < THREAD_TIMEOUT)){reason = "thread timeout";}
-  if (!cfgPointer->is_active){reason = "input shutting down";}
-  if (!(!liveStream.isDataTrack(tid) || userConn)){
-    reason = "buffer disconnect";
-    cfgPointer->is_active = false;
-  }
-  INFO_MSG("Shutting down thread for %zu because %s", tid, reason.c_str());
-  {
-    tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-    threadTimer.erase(tid);
+/// Grows the parse worker pool to one worker per track, up to one worker per CPU core.
+static void startParseWorkers(Mist::InputTS *input, size_t tracks){
+  size_t count = tthread::thread::hardware_concurrency();
+  if (!count){count = 1;}
+  if (count > tracks){count = tracks;}
+  if (parseWorkers.size() >= count){return;}
+  parseWorkersActive = true;
+  while (parseWorkers.size() < count){parseWorkers.push_back(new tthread::thread(parseWorker, input));}
+  INFO_MSG("Now running %zu parse workers", count);
+}
+
+/// Stops the parse worker pool and finishes all remaining tracks.
+static void stopParseWorkers(Mist::InputTS *input){
+  if (!parseWorkersActive && !liveTracks.size()){return;}
+  parseWorkersActive = false;
+  for (size_t i = 0; i < parseWorkers.size(); ++i){
+    parseWorkers[i]->join();
+    delete parseWorkers[i];
   }
-  liveStream.eraseTrack(tid);
-  if (dataTrack && userConn){userConn.setStatus(COMM_STATUS_DISCONNECT | userConn.getStatus());}
+  parseWorkers.clear();
+  while (liveTracks.size()){finishTrack(liveTracks.begin()->second, input);}
 }
 
 namespace Mist{
@@ -280,11 +359,7 @@ namespace Mist{
   }
 
   InputTS::~InputTS(){
-    if (!standAlone){
-      tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-      threadTimer.clear();
-      claimableThreads.clear();
-    }
+    if (!standAlone){stopParseWorkers(this);}
   }
 
   bool skipPipes = false;
@@ -387,6 +462,7 @@ namespace Mist{
     HTTP::URL url = HTTP::localURIResolver().link(inCfg);
     if (url.protocol == "http-ts"){url.protocol = "http";}
     if (url.protocol == "https-ts"){url.protocol = "https";}
+    reader.useCache = true;
     reader.open(url);
     standAlone = reader.isSeekable();
     if (!reader){
@@ -611,6 +687,7 @@ namespace Mist{
                   shiftAmount += 188;
                 }
                 liveReadBuffer.shift(shiftAmount);
+                __sync_fetch_and_add(&workGeneration, 1);
               }
             }
           }
@@ -649,6 +726,7 @@ namespace Mist{
             }
           }else{
             assembler.assemble(liveStream, udpCon.data, udpCon.data.size());
+            __sync_fetch_and_add(&workGeneration, 1);
           }
         }
         if (!received){
@@ -685,11 +763,11 @@ namespace Mist{
 
         std::set<size_t> activeTracks = liveStream.getActiveTracks();
         if (!rawMode){
-          tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-          if (hasStarted && !threadTimer.size()){
+          tthread::lock_guard<tthread::mutex> guard(workMutex);
+          if (hasStarted && !liveTracks.size()){
             if (!isAlwaysOn()){
               config->is_active = false;
-              Util::logExitReason(ER_CLEAN_INACTIVE, "no active threads and we had input in the past");
+              Util::logExitReason(ER_CLEAN_INACTIVE, "no active tracks and we had input in the past");
               return;
             }else{
               liveStream.clear();
@@ -698,23 +776,11 @@ namespace Mist{
           }
           for (std::set<size_t>::iterator it = activeTracks.begin(); it != activeTracks.end(); it++){
             if (!liveStream.isDataTrack(*it)){continue;}
-            if (threadTimer.count(*it) && ((Util::bootSecs() - threadTimer[*it]) > (2 * THREAD_TIMEOUT))){
-              WARN_MSG("Thread for track %zu timed out %" PRIu64
-                       " seconds ago without a clean shutdown.",
-                       *it, Util::bootSecs() - threadTimer[*it]);
-              threadTimer.erase(*it);
-            }
             if (!hasStarted){hasStarted = true;}
-            if (!threadTimer.count(*it)){
-
-              // Add to list of unclaimed threads
-              claimableThreads.insert(*it);
-
-              // Spawn thread here.
-              tthread::thread thisThread(parseThread, this);
-              thisThread.detach();
-            }
+            // Hand new tracks to the parse worker pool
+            if (!liveTracks.count(*it)){liveTracks[*it] = new trackWork(*it);}
           }
+          startParseWorkers(this, liveTracks.size());
         }
         threadCheckTimer = Util::bootSecs();
       }
@@ -735,14 +801,7 @@ namespace Mist{
       Input::finish();
       return;
     }
-    int threadCount = 0;
-    do{
-      {
-        tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
-        threadCount = threadTimer.size();
-      }
-      if (threadCount){Util::sleep(100);}
-    }while (threadCount);
+    stopParseWorkers(this);
   }
 
 
@@ -34,6 +34,7 @@ namespace Mist{
     virtual void postHeader();
     virtual void getNext(size_t idx = INVALID_TRACK_ID);
     void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID);
+    void prefetchBytes(size_t track, uint64_t start, uint64_t end){reader.prefetch(start, end ? end - start : 0);}
     void readPMT();
     bool openStreamSource();
     void streamMainLoop();
@@ -13,16 +13,22 @@
 #include <mist/timing.h>
 #include <mist/ts_packet.h>
 #include <mist/util.h>
+#include <deque>
+#include <vector>
 #include <string>
 
 #include <mist/procs.h>
 #include <mist/tinythread.h>
 #include <sys/stat.h>
 
+/// Maximum amount of messages read from a single push per wakeup of a listener worker
+#define SRT_RECV_BATCH 64
+
 Util::Config *cfgPointer = NULL;
 std::string baseStreamName;
 Socket::SRTServer sSock;
 bool rawMode = false;
+volatile bool workersActive = false;
 
 void (*oldSignal)(int, siginfo_t *,void *) = 0;
 
@@ -42,6 +48,116 @@ static void callThreadCallbackSRT(void *socknum){
   inp.run();
 }
 
+/// A listener worker thread, servicing many accepted pushes through a single SRT epoll instance.
+struct SRTWorker{
+  tthread::mutex lock;
+  std::deque<Mist::InputTSSRT *> incoming; ///< Accepted pushes not yet picked up by the worker
+  size_t load;                             ///< Amount of pushes assigned to this worker
+  tthread::thread *thread;
+};
+
+static void endSession(SRTWorker &W, Mist::InputTSSRT *inp){
+  inp->sessionStop();
+  delete inp;
+  tthread::lock_guard<tthread::mutex> guard(W.lock);
+  if (W.load){--W.load;}
+}
+
+std::vector<SRTWorker *> srtWorkers;
+tthread::mutex setupLock;
+size_t setupCount = 0; ///< Amount of setup threads still running, protected by setupLock
+
+/// Hands a fully started push to the least loaded worker.
+/// Returns false if the workers are shutting down; the caller then ends the push itself.
+static bool assignWorker(Mist::InputTSSRT *inp){
+  tthread::lock_guard<tthread::mutex> setupGuard(setupLock);
+  if (!workersActive || !srtWorkers.size()){return false;}
+  SRTWorker *best = 0;
+  size_t bestLoad = 0;
+  for (size_t i = 0; i < srtWorkers.size(); ++i){
+    tthread::lock_guard<tthread::mutex> guard(srtWorkers[i]->lock);
+    if (!best || srtWorkers[i]->load < bestLoad){
+      best = srtWorkers[i];
+      bestLoad = srtWorkers[i]->load;
+    }
+  }
+  tthread::lock_guard<tthread::mutex> guard(best->lock);
+  best->incoming.push_back(inp);
+  ++best->load;
+  HIGH_MSG("Assigned socket %i to a worker with %zu pushes", inp->getSocket(), bestLoad);
+  return true;
+}
+
+/// Starts the buffer for a newly accepted push, which may take a while, then hands it to a worker.
+/// Runs on its own short-lived thread, so neither the accept loop nor the other pushes on the
+/// workers wait for it.
+static void srtSetupThread(void *inpPtr){
+  Mist::InputTSSRT *inp = (Mist::InputTSSRT *)inpPtr;
+  if (!inp->sessionStart() || !assignWorker(inp)){
+    inp->sessionStop();
+    delete inp;
+  }
+  tthread::lock_guard<tthread::mutex> guard(setupLock);
+  --setupCount;
+}
+
+static void srtWorkerLoop(void *workerPtr){
+  SRTWorker &W = *(SRTWorker *)workerPtr;
+  Socket::SRTPoller poller;
+  std::map<SRTSOCKET, Mist::InputTSSRT *> sessions;
+  std::map<SRTSOCKET, Mist::InputTSSRT *>::iterator it;
+  std::deque<Mist::InputTSSRT *> newSessions;
+  std::vector<SRTSOCKET> ready, failed;
+  uint64_t statTimer = 0;
+  while (workersActive && cfgPointer->is_active){
+    {
+      tthread::lock_guard<tthread::mutex> guard(W.lock);
+      newSessions.swap(W.incoming);
+    }
+    while (newSessions.size()){
+      Mist::InputTSSRT *inp = newSessions.front();
+      newSessions.pop_front();
+      if (!poller.add(inp->getSocket())){
+        endSession(W, inp);
+        continue;
+      }
+      sessions[inp->getSocket()] = inp;
+      HIGH_MSG("Worker now servicing socket %i (%zu pushes)", inp->getSocket(), sessions.size());
+    }
+
+    poller.wait(ready, failed, 100);
+    for (size_t i = 0; i < ready.size() + failed.size(); ++i){
+      bool isFailed = (i >= ready.size());
+      SRTSOCKET sock = isFailed ? failed[i - ready.size()] : ready[i];
+      it = sessions.find(sock);
+      if (it == sessions.end()){continue;}
+      if (!it->second->sessionPump(isFailed)){
+        poller.remove(sock);
+        endSession(W, it->second);
+        sessions.erase(it);
+      }
+    }
+
+    if (Util::bootSecs() != statTimer){
+      statTimer = Util::bootSecs();
+      for (it = sessions.begin(); it != sessions.end(); ++it){it->second->sessionStats();}
+    }
+  }
+  // Shutting down: end all pushes this worker was responsible for
+  for (it = sessions.begin(); it != sessions.end(); ++it){
+    poller.remove(it->first);
+    endSession(W, it->second);
+  }
+  {
+    tthread::lock_guard<tthread::mutex> guard(W.lock);
+    newSessions.swap(W.incoming);
+  }
+  while (newSessions.size()){
+    endSession(W, newSessions.front());
+    newSessions.pop_front();
+  }
+}
+
 namespace Mist{
   /// Constructor of TS Input
   /// \arg cfg Util::Config that contains all current configurations.
@@ -134,6 +250,20 @@ namespace Mist{
     option["help"] = "Which parser to use for data tracks";
     config->addOption("datatrack", option);
 
+    capa["optional"]["workers"]["name"] = "Listener worker threads";
+    capa["optional"]["workers"]["help"] = "Amount of threads that service incoming pushes in listener mode. Each thread "
+                                          "handles many pushes at once. Set to 0 to use a thread per push instead.";
+    capa["optional"]["workers"]["option"] = "--workers";
+    capa["optional"]["workers"]["type"] = "uint";
+    capa["optional"]["workers"]["default"] = 4;
+
+    option.null();
+    option["long"] = "workers";
+    option["arg"] = "integer";
+    option["help"] = "Amount of listener worker threads (0 = thread per push)";
+    option["value"].append(4);
+    config->addOption("workers", option);
+
     // Setup if we are called form with a thread for push-based input.
     if (s.connected()){
       srtConn = s;
@@ -213,73 +343,160 @@ namespace Mist{
     return true;
   }
 
+  /// Feeds data received over SRT into the raw buffer or the TS assembler.
+  /// Returns true if this completed a raw mode packet, which is then available in thisPacket.
+  bool InputTSSRT::receiveData(const char *data, size_t len){
+    if (!rawMode){
+      assembler.assemble(tsStream, data, len, true);
+      return false;
+    }
+    keepAlive();
+    rawBuffer.append(data, len);
+    if (rawBuffer.size() < 1316 || (lastRawPacket && lastRawPacket == Util::bootMS())){return false;}
+    if (rawIdx == INVALID_TRACK_ID){
+      rawIdx = meta.addTrack();
+      meta.setType(rawIdx, "meta");
+      meta.setCodec(rawIdx, "rawts");
+      meta.setID(rawIdx, 1);
+      userSelect[rawIdx].reload(streamName, rawIdx, COMM_STATUS_SOURCE);
+    }
+    uint64_t packetTime = Util::bootMS();
+    thisPacket.genericFill(packetTime, 0, 1, rawBuffer, rawBuffer.size(), 0, 0);
+    thisIdx = rawIdx;
+    lastRawPacket = packetTime;
+    rawBuffer.truncate(0);
+    return true;
+  }
+
+  /// Takes the next complete packet from the TS parser, if any, and corrects its timestamp.
+  /// Packets for tracks that are not (yet) known in the metadata are skipped.
+  /// Returns false if no packet is available right now.
+  bool InputTSSRT::nextPacket(){
+    while (tsStream.hasPacket()){
+      tsStream.getEarliestPacket(thisPacket);
+      if (!thisPacket){return false;}
+      tsStream.initializeMetadata(meta);
+      thisIdx = M.trackIDToIndex(thisPacket.getTrackId(), getpid());
+      if (thisIdx == INVALID_TRACK_ID){continue;}
+
+      uint64_t pktTimeWithOffset = thisPacket.getTime() + timeStampOffset;
+      if (lastTimeStamp || timeStampOffset){
+        uint64_t targetTime = Util::bootMS() - M.getBootMsOffset();
+        if (targetTime + 5000 < pktTimeWithOffset || targetTime > pktTimeWithOffset + 5000){
+          INFO_MSG("Timestamp jump " PRETTY_PRINT_MSTIME " -> " PRETTY_PRINT_MSTIME ", compensating.",
+                   PRETTY_ARG_MSTIME(targetTime), PRETTY_ARG_MSTIME(pktTimeWithOffset));
+          timeStampOffset += (targetTime - pktTimeWithOffset);
+          pktTimeWithOffset = thisPacket.getTime() + timeStampOffset;
+        }
+      }
+      if (!bootMSOffsetCalculated){
+        meta.setBootMsOffset((int64_t)Util::bootMS() - (int64_t)pktTimeWithOffset);
+        bootMSOffsetCalculated = true;
+      }
+      lastTimeStamp = pktTimeWithOffset;
+      thisPacket.setTime(pktTimeWithOffset);
+      thisTime = pktTimeWithOffset;
+      return true;
+    }
+    thisPacket.null();
+    return false;
+  }
+
   // Retrieve the next packet to be played from the srt connection.
   void InputTSSRT::getNext(size_t idx){
     thisPacket.null();
-    bool hasPacket = tsStream.hasPacket();
-    while (!hasPacket && srtConn && config->is_active){
-
+    while (srtConn && config->is_active){
+      if (nextPacket()){return;}
       size_t recvSize = srtConn.RecvNow();
       if (recvSize){
-        if (rawMode){
-          keepAlive();
-          rawBuffer.append(srtConn.recvbuf, recvSize);
-          if (rawBuffer.size() >= 1316 && (lastRawPacket == 0 || lastRawPacket != Util::bootMS())){
-            if (rawIdx == INVALID_TRACK_ID){
-              rawIdx = meta.addTrack();
-              meta.setType(rawIdx, "meta");
-              meta.setCodec(rawIdx, "rawts");
-              meta.setID(rawIdx, 1);
-              userSelect[rawIdx].reload(streamName, rawIdx, COMM_STATUS_SOURCE);
-            }
-            uint64_t packetTime = Util::bootMS();
-            thisPacket.genericFill(packetTime, 0, 1, rawBuffer, rawBuffer.size(), 0, 0);
-            lastRawPacket = packetTime;
-            rawBuffer.truncate(0);
-            return;
-          }
-          continue;
-        }
-        if (assembler.assemble(tsStream, srtConn.recvbuf, recvSize, true)){hasPacket = tsStream.hasPacket();}
+        if (receiveData(srtConn.recvbuf, recvSize)){return;}
       }else if (srtConn){
         // This should not happen as the SRT socket is read blocking and won't return until there is
         // data. But if it does, wait before retry
         Util::sleep(10);
       }
     }
-    if (hasPacket){tsStream.getEarliestPacket(thisPacket);}
+    // Hand out whatever was still parsed before the connection went away
+    if (nextPacket()){return;}
 
-    if (!thisPacket){
-      if (srtConn){
-        INFO_MSG("Could not getNext TS packet!");
-        Util::logExitReason(ER_FORMAT_SPECIFIC, "internal TS parser error");
-      }else{
-        Util::logExitReason(ER_CLEAN_REMOTE_CLOSE, "SRT connection close");
-      }
-      return;
+    if (srtConn){
+      INFO_MSG("Could not getNext TS packet!");
+      Util::logExitReason(ER_FORMAT_SPECIFIC, "internal TS parser error");
+    }else{
+      Util::logExitReason(ER_CLEAN_REMOTE_CLOSE, "SRT connection close");
+    }
+  }
+
+  /// Prepares an accepted push for being serviced by a listener worker thread.
+  /// Does the same as stream() up to the main loop. Returns false if the push cannot continue.
+  bool InputTSSRT::sessionStart(){
+    Util::setStreamName(streamName);
+    if (!srtConn){return false;}
+    if (!startBuffer()){return false;}
+    meta.reInit(streamName, false);
+    sessionBoot = Util::bootSecs();
+    return true;
+  }
+
+  /// Buffers thisPacket for a hosted push. Returns false if the buffer no longer accepts our data.
+  bool InputTSSRT::sessionBuffer(){
+    if (!userSelect.count(thisIdx)){
+      userSelect[thisIdx].reload(streamName, thisIdx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
     }
+    if (!userSelect[thisIdx]){return false;}
+    if (userSelect[thisIdx].getStatus() & COMM_STATUS_REQDISCONNECT){
+      Util::logExitReason(ER_CLEAN_LIVE_BUFFER_REQ, "buffer requested shutdown");
+      return false;
+    }
+    bufferLivePacket(thisPacket);
+    return true;
+  }
 
-    tsStream.initializeMetadata(meta);
-    thisIdx = M.trackIDToIndex(thisPacket.getTrackId(), getpid());
-    if (thisIdx == INVALID_TRACK_ID){getNext(idx);}
-
-    uint64_t pktTimeWithOffset = thisPacket.getTime() + timeStampOffset;
-    if (lastTimeStamp || timeStampOffset){
-      uint64_t targetTime = Util::bootMS() - M.getBootMsOffset();
-      if (targetTime + 5000 < pktTimeWithOffset || targetTime > pktTimeWithOffset + 5000){
-        INFO_MSG("Timestamp jump " PRETTY_PRINT_MSTIME " -> " PRETTY_PRINT_MSTIME ", compensating.",
-                 PRETTY_ARG_MSTIME(targetTime), PRETTY_ARG_MSTIME(pktTimeWithOffset));
-        timeStampOffset += (targetTime - pktTimeWithOffset);
-        pktTimeWithOffset = thisPacket.getTime() + timeStampOffset;
+  /// Services a hosted push whose socket became readable (or failed).
+  /// Drains up to SRT_RECV_BATCH messages without blocking and buffers every completed packet.
+  /// Returns false once the push has ended.
+  bool InputTSSRT::sessionPump(bool failed){
+    Util::setStreamName(streamName);
+    if (failed){srtConn.close();}
+    for (size_t i = 0; i < SRT_RECV_BATCH && srtConn && config->is_active; ++i){
+      size_t recvSize = srtConn.Recv();
+      if (!recvSize){break;}
+      if (receiveData(srtConn.recvbuf, recvSize) && !sessionBuffer()){return false;}
+      while (nextPacket()){
+        if (!sessionBuffer()){return false;}
       }
     }
-    if (!bootMSOffsetCalculated){
-      meta.setBootMsOffset((int64_t)Util::bootMS() - (int64_t)pktTimeWithOffset);
-      bootMSOffsetCalculated = true;
+    if (!srtConn){
+      Util::logExitReason(ER_CLEAN_REMOTE_CLOSE, "SRT connection close");
+      return false;
     }
-    lastTimeStamp = pktTimeWithOffset;
-    thisPacket.setTime(pktTimeWithOffset);
-    thisTime = pktTimeWithOffset;
+    return true;
+  }
+
+  /// Updates the statistics of a hosted push. Called about once per second.
+  void InputTSSRT::sessionStats(){
+    if (!sessionComm){
+      sessionComm.reload(streamName, getConnectedBinHost(), JSON::Value(getpid()).asString(), "INPUT:" + capa["name"].asStringRef(), "");
+    }
+    if (!sessionComm){return;}
+    uint64_t now = Util::bootSecs();
+    sessionComm.setNow(now);
+    sessionComm.setStream(streamName);
+    sessionComm.setTime(now - sessionBoot);
+    sessionComm.setLastSecond(0);
+    connStats(sessionComm);
+  }
+
+  /// Ends a hosted push, the same way stream() ends after its main loop.
+  void InputTSSRT::sessionStop(){
+    Util::setStreamName(streamName);
+    srtConn.close();
+    userSelect.clear();
+    finish();
+    exitAndLogReason();
+    // Exit reasons are per thread; clear it so the next push on this worker can set its own
+    Util::exitReason[0] = 0;
+    Util::mRExitReason = (char *)ER_UNKNOWN;
   }
 
   bool InputTSSRT::openStreamSource(){return true;}
@@ -289,16 +506,64 @@ namespace Mist{
     if (srtConn.getSocket() == -1){
       cfgPointer = config;
       baseStreamName = streamName;
+      size_t workerCount = config->getInteger("workers");
+      if (!workerCount){
+        while (config->is_active && sSock.connected()){
+          Socket::SRTConnection S = sSock.accept();
+          if (S.connected()){// check if the new connection is valid
+            // spawn a new thread for this connection
+            tthread::thread T(callThreadCallbackSRT, (void *)&S);
+            // detach it, no need to keep track of it anymore
+            T.detach();
+            HIGH_MSG("Spawned new thread for socket %i", S.getSocket());
+          }
+        }
+        Socket::SRT::libraryCleanup();
+        return;
+      }
+      // Accepted pushes are divided over a fixed amount of worker threads, which each wait
+      // for data on all their pushes through SRT epoll.
+      // Starting the buffer for a push can block for a long time, so that happens on a separate
+      // setup thread per push; workers only ever get pushes that are ready to be serviced.
+      workersActive = true;
+      for (size_t i = 0; i < workerCount; ++i){
+        SRTWorker *W = new SRTWorker();
+        W->load = 0;
+        W->thread = new tthread::thread(srtWorkerLoop, (void *)W);
+        srtWorkers.push_back(W);
+      }
+      INFO_MSG("Servicing SRT pushes with %zu worker threads", workerCount);
       while (config->is_active && sSock.connected()){
-        Socket::SRTConnection S = sSock.accept();
-        if (S.connected()){// check if the new connection is valid
-          // spawn a new thread for this connection
-          tthread::thread T(callThreadCallbackSRT, (void *)&S);
-          // detach it, no need to keep track of it anymore
-          T.detach();
-          HIGH_MSG("Spawned new thread for socket %i", S.getSocket());
+        Socket::SRTConnection S = sSock.accept(true);
+        if (!S.connected()){continue;}
+        InputTSSRT *inp = new InputTSSRT(config, S);
+        inp->setSingular(false);
+        Util::setStreamName(baseStreamName);
+        {
+          tthread::lock_guard<tthread::mutex> guard(setupLock);
+          ++setupCount;
         }
+        tthread::thread T(srtSetupThread, (void *)inp);
+        T.detach();
+      }
+      {
+        tthread::lock_guard<tthread::mutex> guard(setupLock);
+        workersActive = false;
+      }
+      // Pushes still being set up end themselves now; wait for them before removing the workers
+      while (true){
+        {
+          tthread::lock_guard<tthread::mutex> guard(setupLock);
+          if (!setupCount){break;}
+        }
+        Util::sleep(50);
+      }
+      for (size_t i = 0; i < srtWorkers.size(); ++i){
+        srtWorkers[i]->thread->join();
+        delete srtWorkers[i]->thread;
+        delete srtWorkers[i];
       }
+      srtWorkers.clear();
       Socket::SRT::libraryCleanup();
       return;
     }
@@ -313,11 +578,14 @@ namespace Mist{
   void InputTSSRT::setSingular(bool newSingular){singularFlag = newSingular;}
 
   void InputTSSRT::connStats(Comms::Connections &statComm){
+    srtConn.updateStats();
     statComm.setUp(srtConn.dataUp());
     statComm.setDown(srtConn.dataDown());
     statComm.setPacketCount(srtConn.packetCount());
     statComm.setPacketLostCount(srtConn.packetLostCount());
     statComm.setPacketRetransmitCount(srtConn.packetRetransmitCount());
+    statComm.setRoundTripTime(srtConn.roundTripTime());
+    statComm.setBufferFill(srtConn.bufferFill());
   }
 
 }// namespace Mist
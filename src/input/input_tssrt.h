@@ -19,6 +19,13 @@ namespace Mist{
       if (srtConn){return srtConn.getBinHost();}
       return Input::getConnectedBinHost();
     }
+    SRTSOCKET getSocket(){return srtConn.getSocket();}
+
+    // Used by the listener worker threads to run many pushes without a thread each
+    bool sessionStart();
+    bool sessionPump(bool failed = false);
+    void sessionStats();
+    void sessionStop();
 
   protected:
     // Private Functions
@@ -32,6 +39,9 @@ namespace Mist{
 
     bool openStreamSource();
     void streamMainLoop();
+    bool receiveData(const char *data, size_t len);
+    bool nextPacket();
+    bool sessionBuffer();
     TS::Stream tsStream; ///< Used for parsing the incoming ts stream
     TS::Packet tsBuf;
     TS::Assembler assembler;
@@ -46,6 +56,9 @@ namespace Mist{
     size_t rawIdx;
     uint64_t lastRawPacket;
     bool bootMSOffsetCalculated;
+
+    Comms::Connections sessionComm;
+    uint64_t sessionBoot;
   };
 }// namespace Mist
 
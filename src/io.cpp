@@ -190,6 +190,8 @@ namespace Mist{
       if (tPages.getInt("keycount", i) || tPages.getInt("avail", i)){
         break;
       }
+      // Slots are reused once the page ring wraps around, so new pages must not inherit this flag
+      tPages.setInt("ondisk", 0, tPages.getDeleted());
       tPages.deleteRecords(1);
     }
     // Leaving scope here, the page will now be destroyed
@@ -425,6 +427,7 @@ namespace Mist{
         tPages.setInt("size", DEFAULT_DATA_PAGE_SIZE, endPage);
         tPages.setInt("keycount", 0, endPage);
         tPages.setInt("avail", 0, endPage);
+        tPages.setInt("ondisk", 0, endPage);
         tPages.addRecords(1);
         DONTEVEN_MSG("Opening new page #%zu to track %" PRIu32, curPageNum[packTrack], packTrack);
         if (!bufferStart(packTrack, curPageNum[packTrack], livePage[packTrack], aMeta)){
@@ -460,6 +463,7 @@ namespace Mist{
           tPages.setInt("avail", 0, endPage);
           tPages.setInt("parts", 0, endPage);
           tPages.setInt("lastkeytime", 0, endPage);
+          tPages.setInt("ondisk", 0, endPage);
           tPages.addRecords(1);
           if (livePage[packTrack]){livePage[packTrack].close();}
           DONTEVEN_MSG("Opening new page #%zu to track %" PRIu32, curPageNum[packTrack], packTrack);
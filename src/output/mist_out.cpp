@@ -29,6 +29,11 @@ void handleUSR1Output(int signum, siginfo_t *sigInfo, void *ignore){
 
 template<class T>
 int OutputMain(int argc, char *argv[]){
+  // In the combined binary, Util::Procs::HandoffMist may call this from an output that already
+  // filled in the per-binary state (such as the HTTP connector's url_match and url_prefix), so
+  // reset it to what a freshly started binary would have.
+  T::capa = JSON::Value();
+  Util::defaultTrackSortOrder = Util::TRKSORT_DEFAULT;
   DTSC::trackValidMask = TRACK_VALID_EXT_HUMAN;
   Util::redirectLogsIfNeeded();
   Util::Config conf(argv[0]);
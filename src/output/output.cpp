@@ -20,6 +20,7 @@
 #include <mist/util.h>
 #include <mist/urireader.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <mist/encode.h>
 
 /*LTS-START*/
@@ -39,6 +40,113 @@ namespace Mist{
 
   uint64_t getDTSCTime(char *mapped, uint64_t offset){return Bit::btohll(mapped + offset + 12);}
 
+  AsyncWriter::AsyncWriter(){
+    thread = 0;
+    connFd = -1;
+    destFd = -1;
+    pipeRead = -1;
+    bufferSize = 0;
+  }
+
+  AsyncWriter::~AsyncWriter(){stop();}
+
+  /// Starts writing everything written to fd from a separate thread, buffering up to bufSize bytes.
+  /// The pipe capacity is capped by the system (see /proc/sys/fs/pipe-max-size); if the requested
+  /// size is not allowed, the largest power-of-two fraction of it that is allowed is used instead.
+  bool AsyncWriter::start(int fd, size_t bufSize){
+    if (thread){return true;}
+    int p[2];
+    if (pipe(p)){
+      WARN_MSG("Could not create pipe for pipelined writing: %s", strerror(errno));
+      return false;
+    }
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+    while (bufSize > 65536 && fcntl(p[1], F_SETPIPE_SZ, bufSize) < 0){bufSize /= 2;}
+    bufferSize = fcntl(p[1], F_GETPIPE_SZ);
+#else
+    bufferSize = 65536;
+#endif
+    destFd = dup(fd);
+    if (destFd == -1 || dup2(p[1], fd) == -1){
+      WARN_MSG("Could not redirect output for pipelined writing: %s", strerror(errno));
+      if (destFd != -1){::close(destFd);}
+      ::close(p[0]);
+      ::close(p[1]);
+      destFd = -1;
+      return false;
+    }
+    fcntl(destFd, F_SETFD, FD_CLOEXEC);
+    ::close(p[1]);
+    connFd = fd;
+    pipeRead = p[0];
+    thread = new tthread::thread(AsyncWriter::threadFunc, this);
+    return true;
+  }
+
+  /// Waits for all buffered data to be written, then points the original file descriptor back
+  /// to the real destination. Must be called from the thread that writes to the file descriptor.
+  void AsyncWriter::stop(){
+    if (!thread){return;}
+    // Replacing the pipe's only write end signals end-of-file to the writer thread
+    dup2(destFd, connFd);
+    thread->join();
+    delete thread;
+    thread = 0;
+    if (pipeRead != -1){::close(pipeRead);}
+    ::close(destFd);
+    pipeRead = -1;
+    destFd = -1;
+    connFd = -1;
+  }
+
+  void AsyncWriter::threadFunc(void *arg){((AsyncWriter *)arg)->writeLoop();}
+
+  /// Moves data from the pipe to the destination until the pipe is closed. Uses splice where the
+  /// destination supports it, plain read/write otherwise. On a write error the pipe is closed,
+  /// so the output itself sees the failure on its next write.
+  void AsyncWriter::writeLoop(){
+    bool useSplice = true;
+    char buf[65536];
+    while (true){
+      ssize_t r;
+      if (useSplice){
+        r = splice(pipeRead, 0, destFd, 0, bufferSize, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (r < 0 && errno == EINVAL){
+          useSplice = false;
+          continue;
+        }
+      }else{
+        r = read(pipeRead, buf, sizeof(buf));
+        for (ssize_t done = 0; r > 0 && done < r;){
+          ssize_t w = write(destFd, buf + done, r - done);
+          if (w < 0 && (errno == EINTR || errno == EAGAIN)){
+            if (errno == EAGAIN){Util::sleep(5);}
+            continue;
+          }
+          if (w <= 0){
+            r = -1;
+            break;
+          }
+          done += w;
+        }
+      }
+      if (!r){return;}
+      if (r < 0){
+        if (errno == EINTR){continue;}
+        if (errno == EAGAIN){
+          Util::sleep(5);
+          continue;
+        }
+        FAIL_MSG("Pipelined write failed: %s", strerror(errno));
+        ::close(pipeRead);
+        pipeRead = -1;
+        return;
+      }
+    }
+  }
+
   void Output::init(Util::Config *cfg){
     capa["optional"]["debug"]["name"] = "debug";
     capa["optional"]["debug"]["help"] = "The debug level at which messages need to be printed.";
@@ -119,6 +227,13 @@ namespace Mist{
 
     lastRecv = Util::bootSecs();
     outputStartMs = Util::bootMS();
+    startupConnect = 0;
+    startupReady = 0;
+    startupSelect = 0;
+    startupSeek = 0;
+    startupWarm = false;
+    startupEdge = false;
+    startupReported = false;
     if (myConn){
       setBlocking(true);
       //Make sure that if the socket is a non-stdio socket, we close it when forking
@@ -141,7 +256,8 @@ namespace Mist{
     // If we have a target, scan for trailing ?, remove it, parse into targetParams
     if (config->hasOption("target")){
       std::string tgt = config->getString("target");
-      if (tgt.rfind('?') != std::string::npos){
+      // For fan-out targets (joined by '|'), only options after the last destination apply to the whole push
+      if (tgt.rfind('?') != std::string::npos && (tgt.rfind('|') == std::string::npos || tgt.rfind('?') > tgt.rfind('|'))){
         INFO_MSG("Stripping target options: %s", tgt.substr(tgt.rfind('?') + 1).c_str());
         HTTP::parseVars(tgt.substr(tgt.rfind('?') + 1), targetParams);
         config->getOption("target", true).append(tgt.substr(0, tgt.rfind('?')));
@@ -271,7 +387,7 @@ namespace Mist{
     meta.reloadReplacedPagesIfNeeded();
     bool autoSeek = buffer.size();
     uint64_t seekTarget = buffer.getSyncMode()?currentTime():0;
-    std::set<size_t> trks = Util::wouldSelect(M, targetParams, capa, UA, autoSeek ? seekTarget : 0);
+    std::set<size_t> trks = selCache.wouldSelect(M, targetParams, capa, UA, autoSeek ? seekTarget : 0);
 
     size_t trkCount = 0;
     for (std::set<size_t>::iterator it = trks.begin(); it != trks.end(); ++it){
@@ -300,7 +416,8 @@ namespace Mist{
     }
     userSelect.clear();
     isInitialized = false;
-    meta.clear();
+    // Live viewers keep their metadata mapping, so a reconnect to the same stream is warm
+    if (isPushing() || !meta || !M.getLive()){meta.clear();}
   }
 
   /// Connects or reconnects to the stream.
@@ -309,6 +426,7 @@ namespace Mist{
   void Output::reconnect(){
     Comms::sessionConfigCache();
     thisPacket.null();
+    uint64_t phaseStart = Util::bootMS();
     if (config->hasOption("noinput") && config->getBool("noinput")){
       Util::sanitizeName(streamName);
       if (!Util::streamAlive(streamName)){
@@ -366,16 +484,23 @@ namespace Mist{
     //Wipe currently selected tracks; metadata unload coming up
     userSelect.clear();
 
-    //Connect to stream metadata
-    meta.reInit(streamName, false);
-    unsigned int attempts = 0;
-    while (!meta && ++attempts < 20 && Util::streamAlive(streamName)){
+    //Connect to stream metadata, reusing a still-valid mapping of the same live stream if we have one
+    startupWarm = !isPushing() && meta && meta.getStreamName() == streamName && M.getLive() &&
+                  Util::getStreamStatus(streamName) == STRMSTAT_READY;
+    if (startupWarm){
+      meta.reloadReplacedPagesIfNeeded();
+    }else{
       meta.reInit(streamName, false);
+      unsigned int attempts = 0;
+      while (!meta && ++attempts < 20 && Util::streamAlive(streamName)){
+        meta.reInit(streamName, false);
+      }
     }
     //Abort if this step failed
     if (!meta){return;}
 
     isInitialized = true;
+    startupConnect = Util::bootMS() - phaseStart;
 
     //Connect to stats reporting, if not connected already
     stats(true);
@@ -386,6 +511,7 @@ namespace Mist{
     if (isPushing()){return;}
 
     //live streams that are no push outputs (recordings), wait for stream to be ready
+    phaseStart = Util::bootMS();
     if (!isRecording() && M && M.getLive() && !isReadyForPlay()){
       uint64_t waitUntil = Util::bootSecs() + 45;
       while (M && M.getLive() && !isReadyForPlay()){
@@ -402,9 +528,35 @@ namespace Mist{
         stats();
       }
     }
+    startupReady = Util::bootMS() - phaseStart;
     if (!M){return;}
     //Finally, select the default tracks
+    phaseStart = Util::bootMS();
     selectDefaultTracks();
+    startupSelect = Util::bootMS() - phaseStart;
+  }
+
+  /// Logs how long the startup phases took until the first packet was sent, and reports the timings
+  /// to the controller for aggregation per connector. Only done once, and only for viewers.
+  void Output::reportStartup(){
+    startupReported = true;
+    if (isRecording() || isPushing()){return;}
+    uint64_t firstMs = Util::bootMS() - outputStartMs;
+    MEDIUM_MSG("First packet after %" PRIu64 "ms: connect %" PRIu64 "ms%s, ready %" PRIu64
+               "ms, select %" PRIu64 "ms, seek %" PRIu64 "ms%s",
+               firstMs, startupConnect, startupWarm ? " (warm)" : "", startupReady, startupSelect,
+               startupSeek, startupEdge ? " (live edge)" : "");
+    JSON::Value APIcall;
+    JSON::Value &sStat = APIcall["startup_stat"];
+    sStat["connector"] = capa["name"].asStringRef();
+    sStat["connect"] = startupConnect;
+    sStat["ready"] = startupReady;
+    sStat["select"] = startupSelect;
+    sStat["seek"] = startupSeek;
+    sStat["first"] = firstMs;
+    sStat["warm"] = startupWarm;
+    sStat["edge"] = startupEdge;
+    Util::sendUDPApi(APIcall);
   }
 
   std::set<size_t> Output::getSupportedTracks(const std::string &type) const{
@@ -429,7 +581,7 @@ namespace Mist{
     bool autoSeek = buffer.size();
     uint64_t seekTarget = buffer.getSyncMode()?thisTime:0;
     std::set<size_t> newSelects =
-        Util::wouldSelect(M, targetParams, capa, UA, autoSeek ? seekTarget : 0);
+        selCache.wouldSelect(M, targetParams, capa, UA, autoSeek ? seekTarget : 0);
 
     if (autoSeek){
       std::set<size_t> toRemove;
@@ -538,7 +690,8 @@ namespace Mist{
     return keys.getTime(keyNum+1);
   }
   
-  uint64_t Output::pageNumForKey(size_t trackId, size_t keyNum){
+  /// If pageIdx is given, it is set to the index of the page's record on success.
+  uint64_t Output::pageNumForKey(size_t trackId, size_t keyNum, uint64_t *pageIdx){
     const Util::RelAccX &tPages = M.pages(trackId);
     for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
       uint64_t pageNum = tPages.getInt("firstkey", i);
@@ -546,6 +699,7 @@ namespace Mist{
       uint64_t pageKeys = tPages.getInt("keycount", i);
       if (keyNum > pageNum + pageKeys - 1) continue;
       uint64_t pageAvail = tPages.getInt("avail", i);
+      if (pageIdx){*pageIdx = i;}
       return pageAvail == 0 ? INVALID_KEY_NUM : pageNum;
     }
     return INVALID_KEY_NUM;
@@ -697,7 +851,8 @@ namespace Mist{
     uint64_t micros = Util::getMicros();
     VERYHIGH_MSG("Loading track %zu, containing key %zu", trackId, keyNum);
     uint32_t timeout = 0;
-    uint32_t pageNum = pageNumForKey(trackId, keyNum);
+    uint64_t pageIdx = 0;
+    uint32_t pageNum = pageNumForKey(trackId, keyNum, &pageIdx);
     while (keepGoing() && pageNum == INVALID_KEY_NUM){
       if (!timeout){HIGH_MSG("Requesting page with key %zu:%zu", trackId, keyNum);}
       ++timeout;
@@ -717,7 +872,7 @@ namespace Mist{
       stats(true);
       playbackSleep(50);
       meta.reloadReplacedPagesIfNeeded();
-      pageNum = pageNumForKey(trackId, keyNum);
+      pageNum = pageNumForKey(trackId, keyNum, &pageIdx);
     }
 
     if (!keepGoing()){
@@ -738,13 +893,23 @@ namespace Mist{
     if (thisPacket && thisIdx == trackId){thisPacket.null();}
     char id[NAME_BUFFER_SIZE];
     snprintf(id, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackId, pageNum);
-    curPage[trackId].init(id, DEFAULT_DATA_PAGE_SIZE);
+    if (!M.pageOnDisk(trackId, pageIdx)){curPage[trackId].init(id, DEFAULT_DATA_PAGE_SIZE);}
+    // Aged live pages may have been moved to the buffer's disk tier, possibly while we tried to open them
+    if (!curPage[trackId].mapped && M.pageOnDisk(trackId, pageIdx)){
+      // The buffer never changes its disk tier while pages are stored there, so look it up only once
+      if (!diskTier.size()){diskTier = Util::getStreamConfig(streamName)["disktier"].asString();}
+      curPage[trackId].initFile(diskTier + id);
+    }
     if (!(curPage[trackId].mapped)){
       FAIL_MSG("Initializing page %s failed", curPage[trackId].name.c_str());
       currentPage.erase(trackId);
       return;
     }
     currentPage[trackId] = pageNum;
+    // Pipelined recordings have the kernel read ahead pages that live on the disk tier
+    if (writer.isActive() && M.pageOnDisk(trackId, pageIdx)){
+      madvise(curPage[trackId].mapped, curPage[trackId].len, MADV_WILLNEED);
+    }
     micros = Util::getMicros(micros);
     if (micros > 2000000){
       INFO_MSG("Page %s loaded for %s in %.2fms", id, streamName.c_str(), micros/1000.0);
@@ -985,6 +1150,26 @@ namespace Mist{
     return true;
   }
 
+  /// Returns true if all selected tracks have enough data to start live playback at seekPos.
+  bool Output::liveSeekReady(uint64_t seekPos, size_t mainTrack){
+    for (std::map<size_t, Comms::Users>::iterator ti = userSelect.begin(); ti != userSelect.end(); ++ti){
+      if (meta.getNowms(ti->first) < seekPos + needsLookAhead){return false;}
+      if (mainTrack == ti->first){continue;}// skip self
+      if (!M.trackValid(ti->first)){
+        HIGH_MSG("Skipping track %zu, not in tracks", ti->first);
+        continue;
+      }// ignore missing tracks
+      if (M.getNowms(ti->first) < seekPos + needsLookAhead + M.getMinKeepAway(ti->first)){return false;}
+      if (meta.getNowms(ti->first) == M.getFirstms(ti->first)){
+        HIGH_MSG("Skipping track %zu, last equals first", ti->first);
+        continue;
+      }// ignore point-tracks
+      if (meta.getNowms(ti->first) < seekPos){return false;}
+      HIGH_MSG("Track %zu is good", ti->first);
+    }
+    return true;
+  }
+
   /// This function decides where in the stream initial playback starts.
   /// The default implementation calls seek(0) for VoD.
   /// For live, it seeks to the last sync'ed keyframe of the main track, no closer than
@@ -995,45 +1180,28 @@ namespace Mist{
     meta.removeLimiter();
     uint64_t seekPos = 0;
     if (meta.getLive() && buffer.getSyncMode()){
+      uint64_t seekStart = Util::bootMS();
       size_t mainTrack = getMainSelectedTrack();
       if (mainTrack == INVALID_TRACK_ID){return;}
       DTSC::Keys keys(M.getKeys(mainTrack));
       if (!keys.getValidCount()){return;}
-      // seek to the newest keyframe, unless that is <5s, then seek to the oldest keyframe
       uint32_t firstKey = keys.getFirstValid();
       uint32_t lastKey = keys.getEndValid() - 1;
-      for (int64_t i = lastKey; i >= firstKey; i--){
-        seekPos = keys.getTime(i);
-        if (seekPos < 5000){continue;}// if we're near the start, skip back
-        bool good = true;
-        // check if all tracks have data for this point in time
-        for (std::map<size_t, Comms::Users>::iterator ti = userSelect.begin(); ti != userSelect.end(); ++ti){
-          if (meta.getNowms(ti->first) < seekPos + needsLookAhead){
-            good = false;
-            break;
-          }
-          if (mainTrack == ti->first){continue;}// skip self
-          if (!M.trackValid(ti->first)){
-            HIGH_MSG("Skipping track %zu, not in tracks", ti->first);
-            continue;
-          }// ignore missing tracks
-          if (M.getNowms(ti->first) < seekPos + needsLookAhead + M.getMinKeepAway(ti->first)){
-            good = false;
-            break;
-          }
-          if (meta.getNowms(ti->first) == M.getFirstms(ti->first)){
-            HIGH_MSG("Skipping track %zu, last equals first", ti->first);
-            continue;
-          }// ignore point-tracks
-          if (meta.getNowms(ti->first) < seekPos){
-            good = false;
-            break;
-          }
-          HIGH_MSG("Track %zu is good", ti->first);
-        }
-        // if yes, seek here
-        if (good){break;}
-      }
+      // start at the live edge published by the buffer, if it is a keyframe that suits our tracks
+      seekPos = M.getLiveEdge();
+      startupEdge = seekPos >= 5000 &&
+                    M.getTimeForKeyIndex(mainTrack, M.getKeyIndexForTime(mainTrack, seekPos)) == seekPos &&
+                    liveSeekReady(seekPos, mainTrack);
+      if (!startupEdge){
+        // seek to the newest keyframe, unless that is <5s, then seek to the oldest keyframe
+        for (int64_t i = lastKey; i >= firstKey; i--){
+          seekPos = keys.getTime(i);
+          if (seekPos < 5000){continue;}// if we're near the start, skip back
+          // if all tracks have data for this point in time, seek here
+          if (liveSeekReady(seekPos, mainTrack)){break;}
+        }
+      }
+      startupSeek = Util::bootMS() - seekStart;
     }
     /*LTS-START*/
     if (isRecordingToFile){
@@ -1714,6 +1882,14 @@ namespace Mist{
         INFO_MSG("Recording %s to %s with %s format", streamName.c_str(),
                  newTarget.c_str(), capa["name"].asString().c_str());
       }
+      // Optionally write from a separate thread, so slow storage does not hold up muxing
+      if (targetParams.count("pipeline") && myConn && !Socket::checkTrueSocket(myConn.getSocket())){
+        size_t bufSize = atoll(targetParams["pipeline"].c_str()) * 1024;
+        if (!bufSize){bufSize = 4 * 1024 * 1024;}
+        if (writer.start(myConn.getSocket(), bufSize)){
+          INFO_MSG("Pipelined writing enabled with a %zu byte buffer", writer.getBufferSize());
+        }
+      }
       parseData = true;
       wantRequest = false;
       if (!targetParams.count("realtime")){
@@ -1921,6 +2097,7 @@ namespace Mist{
               }
             }
             sendNext();
+            if (!startupReported){reportStartup();}
           }else{
             parseData = false;
             /*LTS-START*/
@@ -1990,6 +2167,9 @@ namespace Mist{
       }
     }
 
+    // Make sure everything is written before triggers fire for the recording
+    writer.stop();
+
     /*LTS-START*/
     if (Triggers::shouldTrigger("CONN_CLOSE", streamName)){
       std::string payload =
@@ -2441,6 +2621,7 @@ namespace Mist{
           prevLosCount = pktLosNow;
         }
         pData["active_seconds"] = statComm.getTime();
+        pushStatus(pData);
         Util::sendUDPApi(pStat);
         lastPushUpdate = now;
       }
@@ -2557,12 +2738,16 @@ namespace Mist{
       Util::Procs::socketList.insert(tmpFd);
     }
 
+    // Flush anything still buffered for the previous file before switching over
+    bool pipelined = (conn == &myConn && writer.isActive());
+    if (pipelined){writer.stop();}
     int r = dup2(outFile, conn->getSocket());
     if (r == -1){
       ERROR_MSG("Failed to create an alias for the socket %d -> %d using dup2: %s.", outFile, conn->getSocket(), strerror(errno));
       return false;
     }
     close(outFile);
+    if (pipelined){writer.start(conn->getSocket(), writer.getBufferSize());}
     return true;
   }
 
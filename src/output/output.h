@@ -11,11 +11,36 @@
 #include <mist/socket.h>
 #include <mist/timing.h>
 #include <mist/stream.h>
+#include <mist/tinythread.h>
 #include <mist/url.h>
 #include <set>
 
 namespace Mist{
 
+  /// Moves the (possibly blocking) writes of a write-only output target to a separate thread.
+  /// The target's file descriptor is replaced by the write end of a pipe, which serves as a bounded
+  /// single-producer/single-consumer buffer between the muxing thread and the writer thread.
+  /// The writer thread splices the pipe contents into the real destination, so a slow or stalled
+  /// destination only holds up muxing once the buffer is full.
+  class AsyncWriter{
+  public:
+    AsyncWriter();
+    ~AsyncWriter();
+    bool start(int fd, size_t bufSize);
+    void stop();
+    bool isActive() const{return thread;}
+    size_t getBufferSize() const{return bufferSize;}
+
+  private:
+    static void threadFunc(void *arg);
+    void writeLoop();
+    tthread::thread *thread;
+    int connFd;        ///< File descriptor the output writes to; the pipe's write end while active
+    int destFd;        ///< Duplicate of the real destination
+    int pipeRead;      ///< Read end of the pipe, used by the writer thread
+    size_t bufferSize; ///< Actual capacity of the pipe
+  };
+
   /// The output class is intended to be inherited by MistOut process classes.
   /// It contains all generic code and logic, while the child classes implement
   /// anything specific to particular protocols or containers.
@@ -89,8 +114,9 @@ namespace Mist{
     /*LTS-END*/
     std::map<size_t, uint32_t> currentPage;
     void loadPageForKey(size_t trackId, size_t keyNum);
-    uint64_t pageNumForKey(size_t trackId, size_t keyNum);
+    uint64_t pageNumForKey(size_t trackId, size_t keyNum, uint64_t *pageIdx = 0);
     uint64_t pageNumMax(size_t trackId);
+    std::string diskTier; ///< Disk tier directory of the buffer, looked up on first use
     bool isRecordingToFile;
     uint64_t lastStats; ///< Time of last sending of stats.
     void reinitPlaylist(std::string &playlistBuffer, uint64_t &maxAge, uint64_t &maxEntries,
@@ -108,6 +134,17 @@ namespace Mist{
     uint64_t lastPushUpdate;
     uint64_t outputStartMs; ///< bootMS() at time of output start (unrelated to media start)
     bool newUA;
+    // Startup instrumentation, in milliseconds spent per phase
+    uint64_t startupConnect; ///< Starting the input and mapping the stream metadata
+    uint64_t startupReady;   ///< Waiting for the stream to become ready for playback
+    uint64_t startupSelect;  ///< Selecting tracks
+    uint64_t startupSeek;    ///< Finding the initial playback position
+    bool startupWarm;        ///< True if an existing metadata mapping was reused
+    bool startupEdge;        ///< True if the live edge published by the buffer was used
+    bool startupReported;
+    void reportStartup();
+    bool liveSeekReady(uint64_t seekPos, size_t mainTrack);
+    AsyncWriter writer; ///< Writer thread for pipelined recordings
     
   protected:              // these are to be messed with by child classes
     virtual bool inlineRestartCapable() const{
@@ -116,6 +153,7 @@ namespace Mist{
     bool pushing;
     std::map<std::string, std::string> targetParams; /*LTS*/
     std::string UA;                                  ///< User Agent string, if known.
+    Util::SelectionCache selCache;                   ///< Memoized track selections for this connector
     uint64_t uaDelay;                                ///< Seconds to wait before setting the UA.
     uint64_t lastRecv;
     uint64_t dataWaitTimeout; ///< How long to wait for new packets before dropping a track, in tens of milliseconds.
@@ -153,6 +191,7 @@ namespace Mist{
     virtual bool isRecording();
     virtual bool isFileTarget();
     virtual bool isPushing(){return pushing;};
+    virtual void pushStatus(JSON::Value &status){}; ///< Adds output-specific details to push status updates.
     std::string getExitTriggerPayload();
     void recEndTrigger();
     void outputEndTrigger();
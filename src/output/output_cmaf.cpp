@@ -402,7 +402,7 @@ namespace Mist{
     }
 
     if (url.find("init" + hlsMediaFormat) != std::string::npos){
-      std::string headerData = CMAF::trackHeader(M, idx);
+      std::string headerData = CMAF::cachedTrackHeader(M, idx);
       H.StartResponse(H, myConn, config->getBool("nonchunked"));
       H.Chunkify(headerData.c_str(), headerData.size(), myConn);
       H.Chunkify("", 0, myConn);
@@ -441,10 +441,10 @@ namespace Mist{
       return;
     }
 
+    uint64_t mdatSize = 0;
     std::string headerData =
-        CMAF::keyHeader(M, idx, startTime, targetTime, fragmentIndex, false, false);
-
-    uint64_t mdatSize = 8 + CMAF::payloadSize(M, idx, startTime, targetTime);
+        CMAF::cachedKeyHeader(M, idx, startTime, targetTime, fragmentIndex, mdatSize, false, false);
+    mdatSize += 8;
     char mdatHeader[] ={0x00, 0x00, 0x00, 0x00, 'm', 'd', 'a', 't'};
     Bit::htobl(mdatHeader, mdatSize);
 
@@ -67,6 +67,7 @@ namespace Mist{
             r["data"] = "Unsupported codec: "+i->asStringRef();
           }
         }
+        selCache.setCapa(capa);
       }
       selectDefaultTracks();
       sendWebsocketCodecData("codec_data");
@@ -699,7 +699,10 @@ namespace Mist{
     }
     r["data"]["jitter"] = jitter;
     if (M.getLive() && dataWaitTimeout < jitter*1.5){dataWaitTimeout = jitter*1.5;}
-    if (capa.isMember("maxdelay") && capa["maxdelay"].asInt() < jitter*1.5){capa["maxdelay"] = jitter*1.5;}
+    if (capa.isMember("maxdelay") && capa["maxdelay"].asInt() < jitter*1.5){
+      capa["maxdelay"] = jitter*1.5;
+      selCache.setCapa(capa);
+    }
     webSock->sendFrame(r.toString());
   }
 
@@ -955,7 +958,7 @@ namespace Mist{
     if (pipedCapa.isMember("optional")){Util::buildPipedPart(p, argDeq, pipedCapa["optional"]);}
 
     /// start new/better process
-    Util::Procs::ExecMist(argDeq);
+    Util::Procs::HandoffMist(argDeq);
   }
 
   std::string HTTPOutput::getConnectedHost(){
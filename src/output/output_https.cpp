@@ -2,6 +2,15 @@
 #include <mist/procs.h>
 
 namespace Mist{
+  /// Receive callback for mbedtls that never blocks, whatever the socket's blocking mode is.
+  /// Used once the socket is shared with the HTTP process, which may change that mode.
+  static int recvNoWait(void *ctx, unsigned char *buf, size_t len){
+    int r = recv(((mbedtls_net_context *)ctx)->fd, buf, len, MSG_DONTWAIT);
+    if (r >= 0){return r;}
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR){return MBEDTLS_ERR_SSL_WANT_READ;}
+    return MBEDTLS_ERR_NET_RECV_FAILED;
+  }
+
   mbedtls_entropy_context OutHTTPS::entropy;
   mbedtls_ctr_drbg_context OutHTTPS::ctr_drbg;
   mbedtls_ssl_config OutHTTPS::sslConf;
@@ -81,6 +90,7 @@ namespace Mist{
       C.close();
       return;
     }
+    ktls.prepare(&ssl, &sslConf);
 
     // Inform mbedtls how we'd like to use the connection (uses default bio handlers)
     // We tell it to use non-blocking IO here
@@ -99,6 +109,10 @@ namespace Mist{
         Util::sleep(20);
       }
     }
+    // If the kernel can encrypt for us, the HTTP process writes straight to the client socket
+    if (ktls.enable(client_fd.fd, &ssl, true)){
+      mbedtls_ssl_set_bio(&ssl, &client_fd, mbedtls_net_send, recvNoWait, NULL);
+    }
     HIGH_MSG("Started SSL connection handler");
   }
 
@@ -132,7 +146,10 @@ namespace Mist{
     args.push_back("");
     Util::Procs::socketList.insert(fd[0]);
     setenv("MIST_BOUND_ADDR", myConn.getBoundAddress().c_str(), 1);
-    pid_t http_proc = Util::Procs::StartPiped(args, &(fd[1]), &(fd[1]), &fderr);
+    // With kernel TLS, the HTTP process sends its plaintext directly to the client socket and
+    // only incoming data is passed along by us. Otherwise, everything goes through the socket pair.
+    int httpOut = ktls.active ? client_fd.fd : fd[1];
+    pid_t http_proc = Util::Procs::StartPiped(args, &(fd[1]), &httpOut, &fderr);
     unsetenv("MIST_BOUND_ADDR");
     close(fd[1]);
     if (http_proc < 2){
@@ -196,7 +213,11 @@ namespace Mist{
   OutHTTPS::~OutHTTPS(){
     HIGH_MSG("Ending SSL connection handler");
     // close when we're done
-    mbedtls_ssl_close_notify(&ssl);
+    if (ktls.active){
+      ktls.closeNotify(client_fd.fd);
+    }else{
+      mbedtls_ssl_close_notify(&ssl);
+    }
     mbedtls_ssl_free(&ssl);
     mbedtls_net_free(&client_fd);
     myConn.close();
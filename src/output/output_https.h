@@ -31,6 +31,7 @@ namespace Mist{
   private:
     mbedtls_net_context client_fd;
     mbedtls_ssl_context ssl;
+    Socket::TLSOffload ktls;
     static mbedtls_entropy_context entropy;
     static mbedtls_ctr_drbg_context ctr_drbg;
     static mbedtls_ssl_config sslConf;
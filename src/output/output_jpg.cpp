@@ -1,7 +1,10 @@
 #include "output_jpg.h"
 #include <mist/bitfields.h>
+#include <mist/encode.h>
 #include <mist/mp4_generic.h>
 #include <mist/procs.h>
+#include <mist/thumbs.h>
+#include <sstream>
 #include <sys/stat.h>  //for stat
 #include <sys/types.h> //for stat
 #include <unistd.h>    //for stat
@@ -14,10 +17,112 @@ namespace Mist{
     }
   }
 
+  /// Returns true if the request is answered from the thumbnail or sprite sheet cache,
+  /// rather than by waiting for the next keyframe of the stream.
+  bool OutJPG::isCacheRequest(const HTTP::Parser & req){
+    if (req.url.substr(0, 8) == "/thumbs/" || req.url.substr(0, 9) == "/sprites/"){return true;}
+    return req.GetVar("t").size();
+  }
+
+  /// Cache requests go through the same stream connection as any other request, and set up
+  /// their session right away: the image is sent in one go, so access control (CONN_PLAY,
+  /// USER_NEW) has to be settled before responding rather than on the next stats update.
+  void OutJPG::preHTTP(){
+    HTTPOutput::preHTTP();
+    if (isCacheRequest(H) && myConn){stats(true);}
+  }
+
+  /// Answers requests for cached images and their WebVTT indexes:
+  /// - /STREAM.jpg?t=MS : the cached thumbnail at (or just before) the given time
+  /// - /thumbs/STREAM.vtt : index of all cached thumbnails
+  /// - /sprites/STREAM.jpg?t=MS : the cached sprite sheet at (or just before) the given time
+  /// - /sprites/STREAM.vtt : index of all tiles in the cached sprite sheets
+  /// The connection is kept alive, so players can fetch many of these in a row.
+  void OutJPG::respondCache(const HTTP::Parser & req, bool headersOnly){
+    bool sprites = (req.url.substr(0, 9) == "/sprites/");
+    bool vtt = (req.url.find(".vtt") != std::string::npos);
+    responded = true;
+    Thumbs::Cache cache;
+    if (!cache.open(streamName, sprites)){
+      H.SetHeader("Content-Type", "text/plain");
+      H.SetBody(std::string("No ") + (sprites ? "sprite sheets" : "thumbnails") + " available for this stream");
+      H.SendResponse("404", "Not found", myConn);
+      H.Clean();
+      return;
+    }
+
+    if (!vtt){
+      std::string data;
+      Thumbs::Entry info;
+      if (!cache.read(JSON::Value(req.GetVar("t")).asInt(), data, info)){
+        H.SetHeader("Content-Type", "text/plain");
+        H.SetBody("No image available for this time");
+        H.SendResponse("404", "Not found", myConn);
+        H.Clean();
+        return;
+      }
+      H.SetHeader("Content-Type", "image/jpeg");
+      // Sprite sheets gain tiles until they are full, single thumbnails never change
+      H.SetHeader("Cache-Control", sprites ? "no-cache" : "public, max-age=60");
+      H.SetHeader("X-Mist-Time", info.time);
+      if (headersOnly){
+        H.SetHeader("Content-Length", data.size());
+      }else{
+        H.SetBody(data);
+      }
+      H.SendResponse("200", "OK", myConn);
+      H.Clean();
+      return;
+    }
+
+    std::deque<Thumbs::Entry> entries;
+    cache.list(entries);
+    std::string imgBase = Encodings::URL::encode(streamName) + ".jpg?t=";
+    if (!sprites){imgBase = "../" + imgBase;}
+    std::stringstream r;
+    r << "WEBVTT\n\n";
+    for (size_t i = 0; i < entries.size(); ++i){
+      Thumbs::Entry & e = entries[i];
+      if (!sprites){
+        uint64_t end = (i + 1 < entries.size()) ? entries[i + 1].time : e.time + 1000;
+        r << Thumbs::vttTime(e.time) << " --> " << Thumbs::vttTime(end) << "\n";
+        r << imgBase << e.time << "\n\n";
+        continue;
+      }
+      for (size_t j = 0; j < e.tiles && j < THUMB_MAX_TILES; ++j){
+        uint64_t start = e.tileTimes[j];
+        uint64_t end = start + 1000;
+        if (j + 1 < e.tiles){
+          end = e.tileTimes[j + 1];
+        }else if (i + 1 < entries.size()){
+          end = entries[i + 1].time;
+        }
+        r << Thumbs::vttTime(start) << " --> " << Thumbs::vttTime(end) << "\n";
+        r << imgBase << e.time << "#xywh=" << (j % e.columns) * e.tileWidth << ","
+          << (j / e.columns) * e.tileHeight << "," << e.tileWidth << "," << e.tileHeight << "\n\n";
+      }
+    }
+    H.SetHeader("Content-Type", "text/vtt; charset=utf-8");
+    // The index grows while the stream is live
+    H.SetHeader("Cache-Control", "no-cache");
+    if (headersOnly){
+      H.SetHeader("Content-Length", r.str().size());
+    }else{
+      H.SetBody(r.str());
+    }
+    H.SendResponse("200", "OK", myConn);
+    H.Clean();
+  }
+
   void OutJPG::respondHTTP(const HTTP::Parser & req, bool headersOnly){
     // Set global defaults
     HTTPOutput::respondHTTP(req, headersOnly);
 
+    if (isCacheRequest(req)){
+      respondCache(req, headersOnly);
+      return;
+    }
+
     motion = (req.url.find(".mj") != std::string::npos);
     if (motion){
       boundary = Util::getRandomAlphanumeric(24);
@@ -61,6 +166,9 @@ namespace Mist{
     capa["url_match"].append("/$.jpeg");
     capa["url_match"].append("/$.mjpg");
     capa["url_match"].append("/$.mjpeg");
+    capa["url_match"].append("/thumbs/$.vtt");
+    capa["url_match"].append("/sprites/$.vtt");
+    capa["url_match"].append("/sprites/$.jpg");
     capa["codecs"][0u][0u].append("JPEG");
     capa["methods"][0u]["handler"] = "http";
     capa["methods"][0u]["type"] = "html5/image/jpeg";
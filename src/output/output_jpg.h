@@ -6,9 +6,12 @@ namespace Mist{
     OutJPG(Socket::Connection &conn);
     static void init(Util::Config *cfg);
     void respondHTTP(const HTTP::Parser & req, bool headersOnly);
+    virtual void preHTTP();
     void sendNext();
     bool isReadyForPlay();
   protected:
+    bool isCacheRequest(const HTTP::Parser & req);
+    void respondCache(const HTTP::Parser & req, bool headersOnly);
     virtual bool isFileTarget(){return isRecording();}
     virtual bool inlineRestartCapable() const{return true;}
     bool motion;
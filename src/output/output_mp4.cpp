@@ -1401,6 +1401,7 @@ namespace Mist{
 
   void OutMP4::onWebsocketConnect() {
     capa["maxdelay"] = 5000;
+    selCache.setCapa(capa);
     fragSeqNum = 0;
     maxSkipAhead = 0;
     if (M.getLive()){dataWaitTimeout = 450;}
@@ -1429,6 +1430,7 @@ namespace Mist{
             r["data"] = "Unsupported codec: "+i->asStringRef();
           }
         }
+        selCache.setCapa(capa);
       }
       selectDefaultTracks();
       initialSeek();
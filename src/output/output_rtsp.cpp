@@ -7,6 +7,10 @@
 #include <mist/encode.h>
 #include <mist/stream.h>
 #include <mist/triggers.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/file.h>
 #include <sys/stat.h>
 
 namespace Mist{
@@ -120,6 +124,24 @@ namespace Mist{
     capa["optional"]["ignsendport"]["option"] = "--ignore-sending-port";
     capa["optional"]["ignsendport"]["short"] = "I";
 
+    capa["optional"]["multicast"]["name"] = "Multicast address range";
+    capa["optional"]["multicast"]["help"] = "IPv4 multicast address. If set, clients requesting multicast transport receive the stream from a single shared sender, on a group within the /16 of this address. Blank disables multicast.";
+    capa["optional"]["multicast"]["default"] = "";
+    capa["optional"]["multicast"]["type"] = "str";
+    capa["optional"]["multicast"]["option"] = "--multicast";
+
+    capa["optional"]["multicastport"]["name"] = "Multicast port";
+    capa["optional"]["multicastport"]["help"] = "First UDP port used by the multicast sender; every track uses two consecutive ports";
+    capa["optional"]["multicastport"]["default"] = 5004;
+    capa["optional"]["multicastport"]["type"] = "uint";
+    capa["optional"]["multicastport"]["option"] = "--multicast-port";
+
+    capa["optional"]["multicastttl"]["name"] = "Multicast TTL";
+    capa["optional"]["multicastttl"]["help"] = "Time-to-live of packets sent by the multicast sender";
+    capa["optional"]["multicastttl"]["default"] = 16;
+    capa["optional"]["multicastttl"]["type"] = "uint";
+    capa["optional"]["multicastttl"]["option"] = "--multicast-ttl";
+
     cfg->addConnectorOptions(5554, capa);
     config = cfg;
   }
@@ -303,9 +325,19 @@ namespace Mist{
         continue;
       }
       if (HTTP_R.method == "SETUP"){
-        size_t trackNo = sdpState.parseSetup(HTTP_R, getConnectedHost(), source);
         HTTP_S.SetHeader("Expires", HTTP_S.GetHeader("Date"));
         HTTP_S.SetHeader("Cache-Control", "no-cache");
+        if (!isPushing() && HTTP_R.GetHeader("Transport").find("multicast") != std::string::npos){
+          std::string mcTransport = setupMulticast(HTTP_R.url);
+          if (mcTransport.size()){
+            HTTP_S.SetHeader("Transport", mcTransport);
+            HTTP_S.SendResponse("200", "OK", myConn);
+            INFO_MSG("Multicast setup completed: %s", mcTransport.c_str());
+            HTTP_R.Clean();
+            continue;
+          }
+        }
+        size_t trackNo = sdpState.parseSetup(HTTP_R, getConnectedHost(), source);
         if (trackNo != INVALID_TRACK_ID){
           userSelect[trackNo].reload(streamName, trackNo);
           if (isPushing()){userSelect[trackNo].setStatus(COMM_STATUS_SOURCE | userSelect[trackNo].getStatus());}
@@ -323,7 +355,9 @@ namespace Mist{
         continue;
       }
       if (HTTP_R.method == "PLAY"){
-        initialSeek();
+        // If every track comes from the multicast sender, there is nothing for us to send
+        bool multicastOnly = multicastTracks.size() && !userSelect.size();
+        if (!multicastOnly){initialSeek();}
         std::string range = HTTP_R.GetHeader("Range");
         if (range != ""){
           range = range.substr(range.find("npt=") + 4);
@@ -349,9 +383,9 @@ namespace Mist{
           infoString << sdpState.tracks[it->first].rtpInfo(M, it->first, source + "/" + streamName,
                                                            currentTime());
         }
-        HTTP_S.SetHeader("RTP-Info", infoString.str());
+        if (infoString.str().size()){HTTP_S.SetHeader("RTP-Info", infoString.str());}
         HTTP_S.SendResponse("200", "OK", myConn);
-        parseData = true;
+        parseData = !multicastOnly;
         HTTP_R.Clean();
         continue;
       }
@@ -454,6 +488,68 @@ namespace Mist{
     return transportString.str();
   }
 
+  /// Hands out the shared multicast session for the track requested by a SETUP for the given URL.
+  /// The stream is sent to the multicast group by a single SDP push, which is started through the
+  /// controller if needed (duplicate pushes are ignored there), so viewers cost no packetization.
+  /// Returns the transport to answer with, or an empty string to fall back to unicast.
+  std::string OutRTSP::setupMulticast(const std::string &url){
+    std::string base = config->getString("multicast");
+    if (!base.size() || !streamName.size()){return "";}
+    size_t tPos = url.find("/track");
+    if (tPos == std::string::npos){return "";}
+    size_t trackNo = atoi(url.c_str() + tPos + 6);
+    struct in_addr grp;
+    if (!SDP::isMulticast(base) || inet_pton(AF_INET, base.c_str(), &grp) != 1){
+      WARN_MSG("Multicast address range %s is not an IPv4 multicast address", base.c_str());
+      return "";
+    }
+    // Each stream gets its own group within the /16 of the configured address
+    uint32_t hash = strtoul(Secure::md5(streamName).substr(0, 4).c_str(), 0, 16);
+    grp.s_addr = htonl((ntohl(grp.s_addr) & 0xFFFF0000) | hash);
+    char addr[INET_ADDRSTRLEN];
+    if (!inet_ntop(AF_INET, &grp, addr, INET_ADDRSTRLEN)){return "";}
+    std::string group = addr;
+    uint64_t ttl = config->getInteger("multicastttl");
+
+    std::string sdpFile = Util::getTmpFolder() + "mcast_" + streamName + ".sdp";
+    std::stringstream target;
+    target << sdpFile << "?targetIP=" << group << "&startPort=" << config->getInteger("multicastport")
+           << "&ttl=" << ttl << "&sap=1&video=all&audio=all";
+    JSON::Value APIcall;
+    APIcall["push_start"]["stream"] = streamName;
+    APIcall["push_start"]["target"] = target.str();
+    Util::sendUDPApi(APIcall);
+
+    // The sender writes its SDP file once its sockets are set up, and keeps it locked while it runs.
+    // An unlocked file is left over from an earlier sender that is gone, so it is not trusted.
+    std::map<size_t, uint32_t> ports;
+    for (size_t i = 0; i < 50 && keepGoing(); ++i){
+      bool senderActive = false;
+      int lockFd = open(sdpFile.c_str(), O_RDONLY);
+      if (lockFd != -1){
+        if (flock(lockFd, LOCK_SH | LOCK_NB) && errno == EWOULDBLOCK){senderActive = true;}
+        close(lockFd);
+      }
+      std::ifstream sdp(sdpFile.c_str());
+      if (senderActive && sdp){
+        std::stringstream sdpData;
+        sdpData << sdp.rdbuf();
+        ports = SDP::mediaPorts(sdpData.str());
+        if (ports.size()){break;}
+      }
+      Util::sleep(100);
+    }
+    if (!ports.count(trackNo)){
+      INFO_MSG("Track %zu is not available over multicast; using unicast", trackNo);
+      return "";
+    }
+    multicastTracks.insert(trackNo);
+    std::stringstream tStr;
+    tStr << "RTP/AVP;multicast;destination=" << group << ";port=" << ports[trackNo] << "-"
+         << (ports[trackNo] + 1) << ";ttl=" << ttl;
+    return tStr.str();
+  }
+
   /// Attempts to parse TCP RTP packets at the beginning of the header.
   /// Returns whether it is safe to attempt to read HTTP/RTSP packets (true) or not (false).
   bool OutRTSP::handleTCP(){
@@ -33,6 +33,8 @@ namespace Mist{
     std::string generateSDP(std::string reqUrl);
     bool handleTCP();
     void handleUDP();
+    std::string setupMulticast(const std::string &url);
+    std::set<size_t> multicastTracks; ///< Tracks received from the shared multicast sender instead of from us
   };
 }// namespace Mist
 
@@ -11,6 +11,9 @@ namespace Mist{
   OutSDP::OutSDP(Socket::Connection &conn) : HTTPOutput(conn){
     mainConn = &conn;
     exitOnNoRTCP = false;
+    multicastTTL = 0;
+    sapHash = 0;
+    lastSAP = 0;
   }
 
   /// Function used to send RTP packets over UDP
@@ -42,8 +45,20 @@ namespace Mist{
         port+=2;
       }
       sdpState.tracks.insert(std::pair<size_t,SDP::Track>(it->first, newTrk));
+      if (multicastTTL){
+        sdpState.tracks[it->first].data.setMulticastTTL(multicastTTL);
+        sdpState.tracks[it->first].rtcp.setMulticastTTL(multicastTTL);
+      }
     }
   }
+
+  /// Announces the current SDP over SAP (RFC 2974), so set-top boxes and players on the network
+  /// can discover the multicast session without fetching the SDP file.
+  void OutSDP::sendSAP(bool deletion){
+    if (!sapSDP.size()){return;}
+    sapSock.SendNow(SDP::sapPacket(sapSDP, "0.0.0.0", sapHash, deletion));
+    lastSAP = Util::bootSecs();
+  }
   
   void OutSDP::sendHeader(){
     if (isRecording()){
@@ -58,10 +73,26 @@ namespace Mist{
       if (targetParams["startPort"].size()){
         port = atoll(targetParams["startPort"].c_str());
       }
+      if (SDP::isMulticast(targetIP)){
+        multicastTTL = targetParams.count("ttl") ? atoi(targetParams["ttl"].c_str()) : 1;
+        if (multicastTTL < 1){multicastTTL = 1;}
+      }
       // Add meta tracks to sdpState
       initTracks(port, targetIP);
-      myConn.SendNow(generateSDP(targetIP, streamName));
+      std::string sdp = generateSDP(targetIP, streamName);
+      myConn.SendNow(sdp);
       INFO_MSG("Pushing %zu tracks towards target address '%s'.", sdpState.tracks.size(), targetIP.c_str());
+      // Multicast sessions may additionally be announced over SAP
+      if (multicastTTL && targetParams.count("sap") && targetParams["sap"] != "0"){
+        sapSock.setSocketFamily(AF_INET);
+        sapSock.SetDestination(SDP::sapAddress(targetIP), SDP::SAP_PORT);
+        sapSock.setMulticastTTL(multicastTTL);
+        sapSDP = sdp;
+        sapHash = Util::getMS() & 0xFFFF;
+        if (!sapHash){sapHash = 1;}
+        sendSAP();
+        INFO_MSG("Announcing session over SAP to %s", SDP::sapAddress(targetIP).c_str());
+      }
     }
     sentHeader = true;
   }
@@ -80,7 +111,10 @@ namespace Mist{
       "o=- " << Util::getMS() << " 1 IN IP4 " << targetAddress << "\r\n"
       "s=" << streamName << "\r\n"
       "i=" << streamName << "\r\n"
-      "c=IN IP4 " << targetAddress << "\r\n"
+      "c=IN IP4 " << targetAddress;
+    // Multicast connection addresses must carry their TTL
+    if (multicastTTL){sdpAsString << "/" << multicastTTL;}
+    sdpAsString << "\r\n"
       "t=0 0\r\n"
       "a=tool:" APPIDENT "\r\n"
       "a=recvonly\r\n"
@@ -121,6 +155,14 @@ namespace Mist{
 
     config->addStandardPushCapabilities(capa);
     capa["push_urls"].append("/*.sdp");
+    JSON::Value & pp = capa["push_parameters"];
+    pp["ttl"]["name"] = "Multicast TTL";
+    pp["ttl"]["help"] = "Time-to-live of packets sent to a multicast target address";
+    pp["ttl"]["type"] = "int";
+    pp["ttl"]["default"] = 1;
+    pp["sap"]["name"] = "Announce over SAP";
+    pp["sap"]["help"] = "Periodically announce the session with SAP (RFC 2974) when sending to a multicast target address, so receivers can discover it";
+    pp["sap"]["type"] = "bool";
 
     JSON::Value opt;
     opt["arg"] = "string";
@@ -180,7 +222,8 @@ namespace Mist{
     sdpState.tracks[thisIdx].pack.setTimestamp((timestamp + offset) * SDP::getMultiplier(&M, thisIdx));
     sdpState.tracks[thisIdx].pack.sendData(socket, callBack, dataPointer, dataLen,
                                            sdpState.tracks[thisIdx].channel, meta.getCodec(thisIdx));
-    
+    if (sapSDP.size() && Util::bootSecs() - lastSAP >= 5){sendSAP();}
+
     // Update last RTCP received variable
     if (exitOnNoRTCP){
       checkForRTCP(thisIdx);
@@ -243,6 +286,8 @@ namespace Mist{
   /// Disconnects the user
   bool OutSDP::onFinish(){
     INFO_MSG("Shutting down...");
+    sendSAP(true);
+    sapSDP.clear();
     if (myConn){myConn.close();}
     return false;
   }
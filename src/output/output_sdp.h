@@ -23,9 +23,15 @@ namespace Mist{
     void initTracks(uint32_t & port, std::string targetIP);
     void checkForRTCP(uint64_t thisIdx);
     std::string generateSDP(std::string targetAddress, std::string streamName);
+    void sendSAP(bool deletion = false);
     SDP::State sdpState;
     uint32_t prevRTCP;
     bool exitOnNoRTCP;
+    int multicastTTL;               ///< TTL of outgoing multicast packets, if sending to a multicast group
+    Socket::UDPConnection sapSock;  ///< Sends SAP announcements, if enabled
+    std::string sapSDP;             ///< SDP being announced over SAP; empty if not announcing
+    uint16_t sapHash;               ///< SAP message identifier for the current SDP
+    uint64_t lastSAP;               ///< bootSecs() time of the last SAP announcement
     bool isFileTarget(){
       INFO_MSG("Checking file target! %s", isRecording()?"yes":"no");
       return isRecording();
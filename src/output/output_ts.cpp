@@ -4,8 +4,189 @@
 #include <mist/url.h>
 #include <mist/triggers.h>
 #include <mist/stream.h>
+#include <mist/timing.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+/// Maximum amount of TS data buffered for a slow TCP destination of a fan-out push before it gets disconnected
+#define FANOUT_MAX_PENDING 4 * 1024 * 1024
+/// Maximum delay in ms between reconnection attempts of a fan-out destination
+#define FANOUT_MAX_RETRY 30000
 
 namespace Mist{
+  /// Sets up a destination; options in the destination's own ?args override the push-wide defaults.
+  TSFanoutTarget::TSFanoutTarget(const std::string &target, const std::map<std::string, std::string> &defaults)
+      : url(target){
+    bytesUp = 0;
+    isTCP = (url.protocol == "tstcp");
+    wrapRTP = (url.protocol == "tsrtp");
+    curFilled = 0;
+    pendingStart = 0;
+    connecting = -1;
+    tcpAddrLen = 0;
+    nextAttempt = 0;
+    retryDelay = 1000;
+    reconnects = 0;
+    bytesDropped = 0;
+    std::map<std::string, std::string> params = defaults;
+    if (url.args.size()){HTTP::parseVars(url.args, params);}
+    udpSize = 7;
+    if (params.count("pkts")){udpSize = atoi(params["pkts"].c_str());}
+    if (!udpSize){udpSize = 1;}
+    packetBuffer.reserve(188 * udpSize);
+    if (wrapRTP){tsOut = RTP::Packet(33, 1, rand(), rand());}
+    if (!isTCP){
+      udpSock.setBlocking(false);
+      udpSock.SetDestination(url.host, url.getPort());
+      if (params.count("ttl")){udpSock.setMulticastTTL(atoi(params["ttl"].c_str()));}
+      return;
+    }
+    // Resolve once, so reconnecting never blocks on DNS
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int r = getaddrinfo(url.host.c_str(), JSON::Value(url.getPort()).asString().c_str(), &hints, &result);
+    if (r){
+      lastError = gai_strerror(r);
+      FAIL_MSG("Could not resolve fan-out destination %s: %s", url.getUrl().c_str(), lastError.c_str());
+      return;
+    }
+    memcpy(&tcpAddr, result->ai_addr, result->ai_addrlen);
+    tcpAddrLen = result->ai_addrlen;
+    freeaddrinfo(result);
+    connectTCP();
+  }
+
+  TSFanoutTarget::~TSFanoutTarget(){
+    if (connecting != -1){::close(connecting);}
+    tcpConn.close();
+  }
+
+  std::string TSFanoutTarget::getHost() const{return url.host;}
+
+  /// Starts a non-blocking TCP connection attempt; checkTCP picks up the result.
+  void TSFanoutTarget::connectTCP(){
+    nextAttempt = Util::bootMS() + retryDelay;
+    if (!tcpAddrLen){return;}
+    connecting = socket(tcpAddr.ss_family, SOCK_STREAM, 0);
+    if (connecting == -1){
+      lastError = strerror(errno);
+      return;
+    }
+    fcntl(connecting, F_SETFL, fcntl(connecting, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(connecting, (struct sockaddr *)&tcpAddr, tcpAddrLen) && errno != EINPROGRESS){
+      lastError = strerror(errno);
+      ::close(connecting);
+      connecting = -1;
+    }
+  }
+
+  /// Completes pending connection attempts and retries failed destinations with exponential backoff.
+  void TSFanoutTarget::checkTCP(){
+    if (tcpConn){return;}
+    if (connecting != -1){
+      struct pollfd pfd;
+      pfd.fd = connecting;
+      pfd.events = POLLOUT;
+      if (!poll(&pfd, 1, 0)){
+        // Still connecting; give up once the next attempt is due
+        if (Util::bootMS() < nextAttempt){return;}
+        lastError = "connection timed out";
+        ::close(connecting);
+        connecting = -1;
+      }else{
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        getsockopt(connecting, SOL_SOCKET, SO_ERROR, &err, &errLen);
+        if (!err){
+          tcpConn.open(connecting);
+          tcpConn.setBlocking(false);
+          connecting = -1;
+          retryDelay = 1000;
+          INFO_MSG("Fan-out destination %s connected", url.getUrl().c_str());
+          return;
+        }
+        lastError = strerror(err);
+        ::close(connecting);
+        connecting = -1;
+      }
+      WARN_MSG("Fan-out destination %s failed: %s; retrying in %" PRIu64 "ms", url.getUrl().c_str(), lastError.c_str(), retryDelay);
+      retryDelay *= 2;
+      if (retryDelay > FANOUT_MAX_RETRY){retryDelay = FANOUT_MAX_RETRY;}
+      nextAttempt = Util::bootMS() + retryDelay;
+      return;
+    }
+    if (Util::bootMS() >= nextAttempt){
+      ++reconnects;
+      connectTCP();
+    }
+  }
+
+  void TSFanoutTarget::disconnect(const std::string &reason){
+    WARN_MSG("Disconnecting fan-out destination %s: %s", url.getUrl().c_str(), reason.c_str());
+    lastError = reason;
+    tcpConn.close();
+    bytesDropped += pending.size() - pendingStart;
+    pending.truncate(0);
+    pendingStart = 0;
+    nextAttempt = Util::bootMS() + retryDelay;
+  }
+
+  void TSFanoutTarget::sendTS(const char *tsData, size_t len){
+    if (isTCP){
+      checkTCP();
+      if (!tcpConn){
+        bytesDropped += len;
+        return;
+      }
+      // Unsent data is consumed from the front through pendingStart; the buffer is only compacted
+      // once more than half of it has been sent, so a backlog never gets copied per write.
+      pending.append(tsData, len);
+      size_t written = tcpConn.iwrite((char *)pending + pendingStart, pending.size() - pendingStart);
+      bytesUp += written;
+      pendingStart += written;
+      if (pendingStart == pending.size()){
+        pending.truncate(0);
+        pendingStart = 0;
+      }else if (pendingStart > pending.size() / 2){
+        pending.shift(pendingStart);
+        pendingStart = 0;
+      }
+      if (!tcpConn){
+        disconnect("connection closed by peer");
+      }else if (pending.size() - pendingStart > FANOUT_MAX_PENDING){
+        disconnect("destination too slow");
+      }
+      return;
+    }
+    packetBuffer.append(tsData, len);
+    if (++curFilled < udpSize){return;}
+    if (wrapRTP){
+      tsOut.sendTS(&udpSock, packetBuffer.data(), packetBuffer.size());
+      bytesUp += tsOut.getHsize() + tsOut.getPayloadSize();
+    }else{
+      udpSock.SendNow(packetBuffer);
+      bytesUp += packetBuffer.size();
+    }
+    packetBuffer.clear();
+    curFilled = 0;
+  }
+
+  void TSFanoutTarget::getStatus(JSON::Value &status){
+    status["target"] = url.getUrl();
+    status["active"] = (!isTCP || tcpConn) ? 1 : 0;
+    status["bytes"] = bytesUp;
+    if (isTCP){
+      status["reconnects"] = reconnects;
+      status["dropped_bytes"] = bytesDropped;
+      status["buffered_bytes"] = pending.size() - pendingStart;
+    }
+    if (lastError.size()){status["last_error"] = lastError;}
+  }
+
   OutTS::OutTS(Socket::Connection &conn) : TSOutput(conn){
     sendRepeatingHeaders = 500; // PAT/PMT every 500ms (DVB spec)
     streamName = config->getString("streamname");
@@ -14,7 +195,40 @@ namespace Mist{
     wrapRTP = false;
     dropPercentage = 0;
     std::string tracks = config->getString("tracks");
-    if (config->getString("target").size()){
+    if (config->getString("target").find('|') != std::string::npos){
+      // Fan-out push: the stream is muxed once and sent to every destination.
+      // Options after the last destination (already parsed into targetParams) apply to the whole
+      // push and are the defaults for every destination; options given on an earlier destination
+      // apply to that destination only.
+      std::string targets = config->getString("target");
+      size_t pos = 0;
+      while (pos < targets.size()){
+        size_t end = targets.find('|', pos);
+        if (end == std::string::npos){end = targets.size();}
+        HTTP::URL target(targets.substr(pos, end - pos));
+        pos = end + 1;
+        if (!target.host.size()){continue;}
+        if (target.protocol != "tsudp" && target.protocol != "tsrtp" && target.protocol != "tstcp"){
+          FAIL_MSG("Target %s must begin with tsudp:// or tsrtp:// or tstcp://, aborting", target.getUrl().c_str());
+          onFail("Invalid TS target: doesn't start with tsudp:// or tsrtp:// or tstcp://", true);
+          return;
+        }
+        if (!target.getPort()){
+          FAIL_MSG("Target %s must contain a port, aborting", target.getUrl().c_str());
+          onFail("Invalid TS target: missing port", true);
+          return;
+        }
+        fanout.push_back(new TSFanoutTarget(target.getUrl(), targetParams));
+      }
+      if (!fanout.size()){
+        onFail("Invalid TS target: no destinations", true);
+        return;
+      }
+      INFO_MSG("Pushing to %zu destinations", fanout.size());
+      if (targetParams.count("tracks")){tracks = targetParams["tracks"];}
+      myConn.setHost(fanout.front()->getHost());
+      pushing = false;
+    }else if (config->getString("target").size()){
       HTTP::URL target(config->getString("target"));
       if (target.protocol != "tsudp" && target.protocol != "tsrtp" && target.protocol != "tstcp"){
         FAIL_MSG("Target %s must begin with tsudp:// or tsrtp:// or tstcp://, aborting", target.getUrl().c_str());
@@ -85,6 +299,15 @@ namespace Mist{
         }
       }
       pushSock.SetDestination(target.host, target.getPort());
+      if (targetParams.count("ttl")){
+        // Multicast TTL; only affects packets sent to a multicast group
+        int ttl = atoi(targetParams["ttl"].c_str());
+        pushSock.setMulticastTTL(ttl);
+        if (sendFEC){
+          fecColumnSock.setMulticastTTL(ttl);
+          fecRowSock.setMulticastTTL(ttl);
+        }
+      }
       myConn.setHost(target.host);
       pushing = false;
     }else{
@@ -151,7 +374,12 @@ namespace Mist{
     }
   }
 
-  OutTS::~OutTS(){}
+  OutTS::~OutTS(){
+    while (fanout.size()){
+      delete fanout.front();
+      fanout.pop_front();
+    }
+  }
 
   void OutTS::init(Util::Config *cfg){
     Output::init(cfg);
@@ -188,6 +416,11 @@ namespace Mist{
     capa["push_urls"].append("tsudp://*");
     capa["push_urls"].append("tsrtp://*");
     capa["push_urls"].append("tstcp://*");
+    JSON::Value & pp = capa["push_parameters"];
+    pp["ttl"]["name"] = "Multicast TTL";
+    pp["ttl"]["help"] = "Time-to-live of packets sent to a multicast target address";
+    pp["ttl"]["type"] = "int";
+    pp["ttl"]["default"] = 1;
 
     JSON::Value opt;
     opt["arg"] = "string";
@@ -223,6 +456,16 @@ namespace Mist{
   }
 
   void OutTS::sendTS(const char *tsData, size_t len){
+    if (fanout.size()){
+      uint64_t sent = 0;
+      for (std::deque<TSFanoutTarget *>::iterator it = fanout.begin(); it != fanout.end(); ++it){
+        sent -= (*it)->bytesUp;
+        (*it)->sendTS(tsData, len);
+        sent += (*it)->bytesUp;
+      }
+      myConn.addUp(sent);
+      return;
+    }
     if (pushOut){
       static size_t curFilled = 0;
       if (curFilled == udpSize){
@@ -261,7 +504,17 @@ namespace Mist{
     }
   }
 
+  /// Adds the status of each destination of a fan-out push
+  void OutTS::pushStatus(JSON::Value &status){
+    for (std::deque<TSFanoutTarget *>::iterator it = fanout.begin(); it != fanout.end(); ++it){
+      JSON::Value tStat;
+      (*it)->getStatus(tStat);
+      status["targets"].append(tStat);
+    }
+  }
+
   std::string OutTS::getConnectedHost(){
+    if (fanout.size()){return fanout.front()->getHost();}
     if (!pushOut) { return Output::getConnectedHost(); }
     std::string hostname;
     uint32_t port;
@@ -269,6 +522,7 @@ namespace Mist{
     return hostname;
   }
   std::string OutTS::getConnectedBinHost(){
+    if (fanout.size()){return Socket::getBinForms(fanout.front()->getHost());}
     if (!pushOut) { return Output::getConnectedBinHost(); }
     return pushSock.getBinDestination();
   }
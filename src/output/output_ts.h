@@ -1,7 +1,49 @@
 #include "output_ts_base.h"
 #include <mist/ts_stream.h>
 #include <mist/rtp.h>
+#include <mist/url.h>
+#include <mist/util.h>
+#include <deque>
+#include <map>
+#include <sys/socket.h>
 namespace Mist{
+  /// A single destination of a fan-out push (several targets joined by '|').
+  /// Keeps its own connection, reconnect backoff and statistics, so a failing or slow
+  /// destination does not hold up the other destinations of the same push.
+  class TSFanoutTarget{
+  public:
+    TSFanoutTarget(const std::string &target, const std::map<std::string, std::string> &defaults);
+    ~TSFanoutTarget();
+    void sendTS(const char *tsData, size_t len);
+    void getStatus(JSON::Value &status);
+    std::string getHost() const;
+    uint64_t bytesUp;
+
+  private:
+    void connectTCP();
+    void checkTCP();
+    void disconnect(const std::string &reason);
+    HTTP::URL url;
+    bool isTCP;
+    bool wrapRTP;
+    size_t udpSize;
+    size_t curFilled;
+    std::string packetBuffer;
+    Socket::UDPConnection udpSock;
+    RTP::Packet tsOut;
+    struct sockaddr_storage tcpAddr;
+    socklen_t tcpAddrLen;
+    int connecting;         ///< Socket of a TCP connection attempt in progress, or -1
+    Socket::Connection tcpConn;
+    Util::ResizeablePointer pending; ///< TS data not yet accepted by the TCP socket, from pendingStart on
+    size_t pendingStart;    ///< Offset of the first unsent byte in pending
+    uint64_t nextAttempt;   ///< Time in ms of the next TCP (re)connection attempt
+    uint64_t retryDelay;
+    uint64_t reconnects;
+    uint64_t bytesDropped;
+    std::string lastError;
+  };
+
   class OutTS : public TSOutput{
   public:
     OutTS(Socket::Connection &conn);
@@ -14,6 +56,7 @@ namespace Mist{
     void onRequest();
     std::string getConnectedHost();
     std::string getConnectedBinHost();
+    void pushStatus(JSON::Value &status);
 
   private:
     size_t udpSize;
@@ -29,6 +72,7 @@ namespace Mist{
     TS::Stream tsIn;
     std::string getStatsName();
     RTP::Packet tsOut;
+    std::deque<TSFanoutTarget *> fanout;
 
   protected:
     inline virtual bool keepGoing(){
@@ -3,7 +3,7 @@
 #include "output_http.h"
 #include <mist/defines.h>
 #include <mist/mp4_generic.h>
-#include <mist/ts_packet.h>
+#include <mist/ts_muxer.h>
 
 #ifndef TS_BASECLASS
 #define TS_BASECLASS Output
@@ -12,14 +12,11 @@
 namespace Mist{
 
   template<class T>
-  class TSOutputTmpl : public T{
+  class TSOutputTmpl : public T, public TS::Muxer{
   public:
     TSOutputTmpl(Socket::Connection &conn);
     virtual ~TSOutputTmpl(){};
     virtual void sendNext();
-    virtual void sendTS(const char *tsData, size_t len = 188){};
-    void fillPacket(char const *data, size_t dataLen, bool &firstPack, bool video, bool keyframe,
-                    size_t pkgPid, uint16_t &contPkg);
     virtual void sendHeader(){
       this->sentHeader = true;
       this->packCounter = 0;
@@ -27,15 +24,7 @@ namespace Mist{
 
   protected:
     virtual bool inlineRestartCapable() const{return true;}
-    std::map<size_t, bool> first;
-    std::map<size_t, uint16_t> contCounters;
-    uint16_t contPAT;
-    uint16_t contPMT;
-    uint16_t contSDT;
-    size_t packCounter; ///\todo update constructors?
-    TS::Packet packData;
-    uint64_t sendRepeatingHeaders; ///< Amount of ms between PAT/PMT. Zero means do not repeat.
-    uint64_t lastHeaderTime;       ///< Timestamp last PAT/PMT were sent.
+    virtual void getHeaderInfo(std::set<size_t> &tracks, std::string &serviceName);
     uint64_t ts_from;              ///< Starting time to subtract from timestamps
   };
 
@@ -413,12 +413,15 @@ namespace Mist{
 
   void OutTSSRT::connStats(uint64_t now, Comms::Connections &statComm){
     if (!srtConn){return;}
+    srtConn.updateStats();
     statComm.setUp(srtConn.dataUp());
     statComm.setDown(srtConn.dataDown());
     statComm.setTime(now - srtConn.connTime());
     statComm.setPacketCount(srtConn.packetCount());
     statComm.setPacketLostCount(srtConn.packetLostCount());
     statComm.setPacketRetransmitCount(srtConn.packetRetransmitCount());
+    statComm.setRoundTripTime(srtConn.roundTripTime());
+    statComm.setBufferFill(srtConn.bufferFill());
   }
 
 }// namespace Mist
@@ -544,15 +547,23 @@ int main(int argc, char *argv[]){
     }
     Comms::defaultCommFlags = COMM_STATUS_NOKILL;
     Util::Procs::socketList.insert(server_socket.getSocket());
+    // Wait for incoming connections through SRT epoll instead of polling accept
+    Socket::SRTPoller poller;
+    std::vector<SRTSOCKET> ready, failed;
+    server_socket.setBlocking(false);
+    poller.add(server_socket.getSocket());
     while (conf.is_active && server_socket.connected()){
-      Socket::SRTConnection S = server_socket.accept(false, "output");
-      if (S.connected()){// check if the new connection is valid
+      poller.wait(ready, failed, 1000);
+      if (failed.size()){break;}
+      if (!ready.size()){continue;}
+      // Accept everything that is pending at once
+      while (server_socket.connected()){
+        Socket::SRTConnection S = server_socket.accept(false, "output");
+        if (!S.connected()){break;}
         // spawn a new thread for this connection
         tthread::thread T(callThreadCallbackSRT, (void *)new Socket::SRTConnection(S));
         // detach it, no need to keep track of it anymore
         T.detach();
-      }else{
-        Util::sleep(10); // sleep 10ms
       }
     }
     Util::Procs::socketList.erase(server_socket.getSocket());
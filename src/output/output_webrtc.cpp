@@ -776,6 +776,7 @@ namespace Mist{
         capa["codecs"][0u][2u].append(std::string("+") + metaCodec);
       }
     }
+    selCache.setCapa(capa);
 
     sdpAnswer.setDirection("sendonly");
 
@@ -938,6 +939,7 @@ namespace Mist{
         metaCodec++;
       }
     }
+    selCache.setCapa(capa);
   }
 
   // This function is called to handle an offer from a peer that wants to push data towards us.
@@ -4,6 +4,7 @@
 #include <mist/h264.h>
 #include <mist/mp4_generic.h>
 #include <mist/nal.h>
+#include <mist/thumbs.h>
 #include <mist/tinythread.h>
 #include <mist/util.h>
 #include <ostream>
@@ -73,6 +74,56 @@ char *inputFrameCount = 0;                        ///< Stats: frames/samples ing
 char *outputFrameCount = 0;                       ///< Stats: frames/samples outputted
 Util::ResizeablePointer ptr;                      ///< Buffer for raw pixels / audio samples
 
+#define LADDER_QUEUE 4 ///< Max decoded frames waiting per ladder rung before decoding blocks
+
+/// One rendition of a decode-once ABR ladder.
+/// The source thread decodes every input frame once and hands each rung a reference to it;
+/// every rung scales and encodes on its own worker thread into its own output track.
+struct LadderRung{
+  size_t id;
+  uint64_t width;
+  uint64_t height;
+  uint64_t bitrate;
+  AVCodecContext *ctx;          ///< Encoding context of this rung
+  AVFrame *scaled;              ///< Scaled frame in the encoder pixel format
+  AVFrame *hwFrame;             ///< Upload buffer if the encoder is hardware accelerated
+  AVPixelFormat softFmt;        ///< Software pixel format of a hardware encoder
+  SwsContext *scaleCtx;
+  AVPacket *pkt;
+  uint64_t pts;
+  std::deque<AVFrame *> frames; ///< Shared decoded frames waiting for this rung
+  std::deque<uint64_t> sentTimes; ///< Timestamps of frames sent to the encoder, in order
+  tthread::thread *worker;
+  size_t trkIdx;                ///< Sink track index, owned by the sink thread
+  Util::ResizeablePointer spsInfo;
+  Util::ResizeablePointer ppsInfo;
+  LadderRung(){
+    id = 0;
+    width = height = bitrate = 0;
+    ctx = 0;
+    scaled = hwFrame = 0;
+    softFmt = AV_PIX_FMT_NONE;
+    scaleCtx = 0;
+    pkt = 0;
+    pts = 0;
+    worker = 0;
+    trkIdx = INVALID_TRACK_ID;
+  }
+};
+
+/// Encoded ladder packet waiting to be buffered by the sink
+struct LadderPacket{
+  LadderRung *rung;
+  uint64_t time;
+  AVPacket *pkt;
+};
+
+std::deque<LadderRung *> ladder;         ///< Ladder rungs; empty when encoding a single output
+std::deque<LadderPacket> ladderPackets;  ///< Encoded ladder packets, guarded by avMutex
+tthread::mutex ladderMutex;              ///< Lock for the per-rung frame queues
+tthread::condition_variable ladderCV;    ///< Signalled when a rung frame queue changes
+uint64_t ladderFrames = 0;               ///< Frames handed to the ladder, for keyframe alignment
+
 namespace Mist{
 
   class ProcessSink : public Input{
@@ -80,10 +131,13 @@ namespace Mist{
     size_t trkIdx;
     Util::ResizeablePointer ppsInfo;
     Util::ResizeablePointer spsInfo;
+    Thumbs::Cache thumbCache; ///< Shared cache of the JPEG images, if enabled
+    size_t thumbCount;
 
   public:
     ProcessSink(Util::Config *cfg) : Input(cfg){
       trkIdx = INVALID_TRACK_ID;
+      thumbCount = 0;
       capa["name"] = "AV";
       streamName = opt["sink"].asString();
       if (!streamName.size()){streamName = opt["source"].asString();}
@@ -94,6 +148,9 @@ namespace Mist{
         pStat["proc_status_update"]["source"] = opt["source"];
       }
       Util::setStreamName(opt["source"].asString() + "→" + streamName);
+      if (codecOut == "JPEG" && opt["thumbs"].asBool()){
+        if (!thumbCache.open(streamName, false, true)){WARN_MSG("Could not open thumbnail cache");}
+      }
       if (opt.isMember("target_mask") && !opt["target_mask"].isNull() && opt["target_mask"].asString() != ""){
         DTSC::trackValidDefault = opt["target_mask"].asInt();
       }
@@ -106,12 +163,12 @@ namespace Mist{
 
     ~ProcessSink(){ }
 
-    void parseH264(bool isKey){
+    void parseH264(const char *data, uint64_t dataSize, bool isKey, Util::ResizeablePointer &sps, Util::ResizeablePointer &pps){
       // Get buffer pointers
-      const char* bufIt = (char*)packet_out->data;
-      uint64_t bufSize = packet_out->size;
+      const char* bufIt = data;
+      uint64_t bufSize = dataSize;
       const char *nextPtr;
-      const char *pesEnd = (char*)packet_out->data + bufSize;
+      const char *pesEnd = data + bufSize;
       uint32_t nalSize = 0;
 
       // Parse H264-specific data
@@ -133,9 +190,9 @@ namespace Mist{
           // Set PPS/SPS info
           uint8_t typeNal = bufIt[0] & 0x1F;
           if (typeNal == 0x07){
-            spsInfo.assign(std::string(bufIt, (nextPtr - bufIt)));
+            sps.assign(std::string(bufIt, (nextPtr - bufIt)));
           } else if (typeNal == 0x08){
-            ppsInfo.assign(std::string(bufIt, (nextPtr - bufIt)));
+            pps.assign(std::string(bufIt, (nextPtr - bufIt)));
           }
           thisPacket.appendNal(bufIt, nalSize);
         }
@@ -146,12 +203,9 @@ namespace Mist{
       }
     }
 
-    void parseAV1(bool isKey){
+    void parseAV1(const char *data, uint64_t dataSize, bool isKey){
       thisPacket.null();
-      // Get buffer pointers
-      const char* bufIt = (char*)packet_out->data;
-      uint64_t bufSize = packet_out->size;
-      thisPacket.genericFill(thisTime, 0, 1, bufIt, bufSize, 0, isKey);
+      thisPacket.genericFill(thisTime, 0, 1, data, dataSize, 0, isKey);
     }
 
     void parseJPEG(){
@@ -160,6 +214,16 @@ namespace Mist{
       const char* bufIt = (char*)packet_out->data;
       uint64_t bufSize = packet_out->size;
       thisPacket.genericFill(thisTime, 0, 1, bufIt, bufSize, 0, 1);
+      if (thumbCache){
+        Thumbs::Entry info;
+        memset(&info, 0, sizeof(info));
+        info.time = info.endTime = thisTime;
+        info.width = context_out->width;
+        info.height = context_out->height;
+        if (!thumbCache.write(thumbCount++, info, bufIt, bufSize)){
+          WARN_MSG("Could not cache %" PRIu64 "B thumbnail @%" PRIu64 "ms", bufSize, thisTime);
+        }
+      }
     }
 
     /// \brief Outputs buffer as video
@@ -174,9 +238,9 @@ namespace Mist{
         }
 
         if (codecOut == "AV1"){
-          parseAV1(isKey);
+          parseAV1((char*)packet_out->data, packet_out->size, isKey);
         }else if (codecOut == "H264"){
-          parseH264(isKey);
+          parseH264((char*)packet_out->data, packet_out->size, isKey, spsInfo, ppsInfo);
         }else if (codecOut == "JPEG"){
           parseJPEG();
         }
@@ -218,13 +282,51 @@ namespace Mist{
       bufferLivePacket(thisTime, 0, thisIdx, ptr, ptrSize, 0, true);
     }
 
+    /// \brief Outputs an encoded ladder packet to the track of its rung
+    void bufferLadder(LadderPacket &lp){
+      LadderRung &r = *lp.rung;
+      thisIdx = INVALID_TRACK_ID;
+      thisTime = lp.time;
+      if (thisTime >= statSinkMs){statSinkMs = thisTime;}
+      if (meta && meta.getBootMsOffset() != bootMsOffset){meta.setBootMsOffset(bootMsOffset);}
+      bool isKey = lp.pkt->flags & AV_PKT_FLAG_KEY;
+      VERYHIGH_MSG("Buffering %iB %s for rung %zu @%zums", lp.pkt->size, isKey ? "keyframe" : "packet", r.id, thisTime);
+      if (codecOut == "AV1"){
+        parseAV1((char*)lp.pkt->data, lp.pkt->size, isKey);
+      }else{
+        parseH264((char*)lp.pkt->data, lp.pkt->size, isKey, r.spsInfo, r.ppsInfo);
+      }
+      if (!thisPacket){return;}
+      if (r.trkIdx == INVALID_TRACK_ID){
+        r.trkIdx = initEncodedTrack(r.ctx, r.width, r.height, r.id + 1, r.spsInfo, r.ppsInfo);
+        if (r.trkIdx == INVALID_TRACK_ID){return;}
+      }
+      thisIdx = r.trkIdx;
+      bufferLivePacket(thisPacket);
+    }
+
     void streamMainLoop(){
       uint64_t statTimer = 0;
       uint64_t startTime = Util::bootSecs();
       Comms::Connections statComm;
       while (config->is_active){
-        // Get current frame time
-        {
+        if (ladder.size()){
+          LadderPacket lp;
+          {
+            tthread::lock_guard<tthread::mutex> guard(avMutex);
+            uint64_t sleepTime = Util::getMicros();
+            while (!ladderPackets.size() && config->is_active){avCV.wait(avMutex);}
+            totalSinkSleep += Util::getMicros(sleepTime);
+            if (!config->is_active){return;}
+            lp = ladderPackets.front();
+            ladderPackets.pop_front();
+          }
+          // Buffer outside of the lock, so the rung encoders can keep going meanwhile
+          bufferLadder(lp);
+          av_packet_free(&lp.pkt);
+          if (thisIdx == INVALID_TRACK_ID){continue;}
+        }else{
+          // Get current frame time
           tthread::lock_guard<tthread::mutex> guard(avMutex);
           // Wait for frame/samples to become available
           uint64_t sleepTime = Util::getMicros();
@@ -290,70 +392,79 @@ namespace Mist{
       }
     }
 
+    /// \brief Adds a track for encoded video, initialized from the given encoder and SPS/PPS data
+    /// \returns The new track index, or INVALID_TRACK_ID if the H264 SPS/PPS is not known yet
+    size_t initEncodedTrack(AVCodecContext *ctx, uint64_t width, uint64_t height, size_t trackId,
+                            Util::ResizeablePointer &sps, Util::ResizeablePointer &pps){
+      size_t idx = INVALID_TRACK_ID;
+      if (codecOut == "AV1"){
+        // Add a single track and init some metadata
+        meta.reInit(streamName, false);
+        idx = meta.addTrack();
+        meta.setType(idx, "video");
+        meta.setCodec(idx, codecOut);
+        meta.setID(idx, trackId);
+        meta.setWidth(idx, width);
+        meta.setHeight(idx, height);
+        meta.setFpks(idx, inFpks);
+        meta.setInit(idx, (char*)ctx->extradata, ctx->extradata_size);
+        if (idx != INVALID_TRACK_ID && !userSelect.count(idx)){
+          userSelect[idx].reload(streamName, idx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
+        }
+        INFO_MSG("AV1 track index is %zu", idx);
+      } else if (codecOut == "JPEG"){
+        meta.reInit(streamName, false);
+        idx = meta.addTrack();
+        meta.setType(idx, "video");
+        meta.setCodec(idx, codecOut);
+        meta.setID(idx, trackId);
+        meta.setWidth(idx, width);
+        meta.setHeight(idx, height);
+        meta.setFpks(idx, inFpks);
+        if (idx != INVALID_TRACK_ID && !userSelect.count(idx)){
+          userSelect[idx].reload(streamName, idx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
+        }
+        INFO_MSG("MJPEG track index is %zu", idx);
+      }else if (codecOut == "H264"){
+        if (!sps.size() || !pps.size()){return INVALID_TRACK_ID;}
+        // First generate needed data
+        h264::sequenceParameterSet spsParser(sps, sps.size());
+        h264::SPSMeta spsChar = spsParser.getCharacteristics();
+
+        MP4::AVCC avccBox;
+        avccBox.setVersion(1);
+        avccBox.setProfile(sps[1]);
+        avccBox.setCompatibleProfiles(sps[2]);
+        avccBox.setLevel(sps[3]);
+        avccBox.setSPSCount(1);
+        avccBox.setSPS(sps, sps.size());
+        avccBox.setPPSCount(1);
+        avccBox.setPPS(pps, pps.size());
+
+        // Add a single track and init some metadata
+        meta.reInit(streamName, false);
+        idx = meta.addTrack();
+        meta.setType(idx, "video");
+        meta.setCodec(idx, "H264");
+        meta.setID(idx, trackId);
+        if (avccBox.payloadSize()){meta.setInit(idx, avccBox.payload(), avccBox.payloadSize());}
+        meta.setWidth(idx, spsChar.width);
+        meta.setHeight(idx,  spsChar.height);
+        meta.setFpks(idx, inFpks);
+        if (idx != INVALID_TRACK_ID && !userSelect.count(idx)){
+          userSelect[idx].reload(streamName, idx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
+        }
+        INFO_MSG("H264 track index is %zu", idx);
+      }
+      return idx;
+    }
+
     /// \brief Sets init data based on the last loaded SPS and PPS data
     void setVideoInit(){
       if (trkIdx != INVALID_TRACK_ID){return;}
       // We're encoding to a target codec
       if (codec_out){
-        if (codecOut == "AV1"){
-          // Add a single track and init some metadata
-          meta.reInit(streamName, false);
-          trkIdx = meta.addTrack();
-          meta.setType(trkIdx, "video");
-          meta.setCodec(trkIdx, codecOut);
-          meta.setID(trkIdx, 1);
-          meta.setWidth(trkIdx, frameConverted->width);
-          meta.setHeight(trkIdx,  frameConverted->height);
-          meta.setFpks(trkIdx, inFpks);
-          meta.setInit(trkIdx, (char*)context_out->extradata, context_out->extradata_size);
-          if (trkIdx != INVALID_TRACK_ID && !userSelect.count(trkIdx)){
-            userSelect[trkIdx].reload(streamName, trkIdx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
-          }
-          INFO_MSG("AV1 track index is %zu", trkIdx);
-        } else if (codecOut == "JPEG"){
-          meta.reInit(streamName, false);
-          trkIdx = meta.addTrack();
-          meta.setType(trkIdx, "video");
-          meta.setCodec(trkIdx, codecOut);
-          meta.setID(trkIdx, 1);
-          meta.setWidth(trkIdx, frameConverted->width);
-          meta.setHeight(trkIdx,  frameConverted->height);
-          meta.setFpks(trkIdx, inFpks);
-          if (trkIdx != INVALID_TRACK_ID && !userSelect.count(trkIdx)){
-            userSelect[trkIdx].reload(streamName, trkIdx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
-          }
-          INFO_MSG("MJPEG track index is %zu", trkIdx);
-        }else if (codecOut == "H264"){
-          if (!spsInfo.size() || !ppsInfo.size()){return;}
-          // First generate needed data
-          h264::sequenceParameterSet sps(spsInfo, spsInfo.size());
-          h264::SPSMeta spsChar = sps.getCharacteristics();
-
-          MP4::AVCC avccBox;
-          avccBox.setVersion(1);
-          avccBox.setProfile(spsInfo[1]);
-          avccBox.setCompatibleProfiles(spsInfo[2]);
-          avccBox.setLevel(spsInfo[3]);
-          avccBox.setSPSCount(1);
-          avccBox.setSPS(spsInfo, spsInfo.size());
-          avccBox.setPPSCount(1);
-          avccBox.setPPS(ppsInfo, ppsInfo.size());
-
-          // Add a single track and init some metadata
-          meta.reInit(streamName, false);
-          trkIdx = meta.addTrack();
-          meta.setType(trkIdx, "video");
-          meta.setCodec(trkIdx, "H264");
-          meta.setID(trkIdx, 1);
-          if (avccBox.payloadSize()){meta.setInit(trkIdx, avccBox.payload(), avccBox.payloadSize());}
-          meta.setWidth(trkIdx, spsChar.width);
-          meta.setHeight(trkIdx,  spsChar.height);
-          meta.setFpks(trkIdx, inFpks);
-          if (trkIdx != INVALID_TRACK_ID && !userSelect.count(trkIdx)){
-            userSelect[trkIdx].reload(streamName, trkIdx, COMM_STATUS_ACTIVE | COMM_STATUS_SOURCE | COMM_STATUS_DONOTTRACK);
-          }
-          INFO_MSG("H264 track index is %zu", trkIdx);
-        }
+        trkIdx = initEncodedTrack(context_out, frameConverted->width, frameConverted->height, 1, spsInfo, ppsInfo);
       }else{
         // Add a single track and init some metadata
         meta.reInit(streamName, false);
@@ -425,6 +536,18 @@ namespace Mist{
     AVPixelFormat hw_decode_fmt;
     AVPixelFormat hw_decode_sw_fmt;
     uint64_t skippedFrames; //< Amount of frames since last JPEG image
+    uint64_t lastImageTime; //< Time of the last JPEG image
+
+    // Sprite sheet vars
+    Thumbs::Cache spriteCache;
+    Thumbs::Entry spriteInfo;  ///< Layout and tile times of the sheet being filled
+    size_t spriteRows;
+    size_t spriteSheet;        ///< Number of the sheet being filled, used as cache slot
+    AVCodecContext *spriteCtx;
+    AVFrame *spriteFrame;      ///< Canvas holding all tiles of the current sheet
+    AVFrame *spriteDownload;   ///< Software copy of hardware decoded frames
+    AVPacket *spritePkt;
+    SwsContext *spriteScale;
 
     // Filter vars
 //    AVFilterContext *buffersink_ctx;
@@ -432,7 +555,7 @@ namespace Mist{
 //    AVFilterGraph *filter_graph;
 
     /// \brief Prints error codes from LibAV
-    void printError(std::string preamble, int code){
+    static void printError(std::string preamble, int code){
       char err[128];
       av_strerror(code, err, sizeof(err));
       ERROR_MSG("%s: `%s` (%i)", preamble.c_str(), err, code);
@@ -456,12 +579,50 @@ namespace Mist{
       softDecodeFormat = AV_PIX_FMT_NONE;
       hw_decode_ctx = 0;
       skippedFrames = 99999; //< Init high so that it does not skip the first keyframe
+      lastImageTime = 0;
+      memset(&spriteInfo, 0, sizeof(spriteInfo));
+      spriteRows = 0;
+      spriteSheet = 0;
+      spriteCtx = 0;
+      spriteFrame = 0;
+      spriteDownload = 0;
+      spritePkt = 0;
+      spriteScale = 0;
+      if (codecOut == "JPEG" && opt.isMember("sprite") && opt["sprite"].asString().size()){
+        std::string grid = opt["sprite"].asString();
+        std::string tile = opt["sprite_resolution"].asString();
+        if (!tile.size()){tile = "160x90";}
+        spriteInfo.columns = strtol(grid.substr(0, grid.find("x")).c_str(), NULL, 0);
+        spriteRows = strtol(grid.substr(grid.find("x") + 1).c_str(), NULL, 0);
+        // Tiles are placed on chroma-subsampled planes, so keep their sizes even
+        spriteInfo.tileWidth = strtol(tile.substr(0, tile.find("x")).c_str(), NULL, 0) & ~1;
+        spriteInfo.tileHeight = strtol(tile.substr(tile.find("x") + 1).c_str(), NULL, 0) & ~1;
+        if (!spriteInfo.columns || !spriteRows || !spriteInfo.tileWidth || !spriteInfo.tileHeight ||
+            spriteInfo.columns * spriteRows > THUMB_MAX_TILES){
+          WARN_MSG("Invalid sprite sheet layout %s of %s tiles; not generating sprite sheets", grid.c_str(), tile.c_str());
+          spriteInfo.columns = 0;
+        }else{
+          // Sheets are stored under the name of the sink stream, like the thumbnails
+          std::string sink = opt["sink"].asString();
+          if (!sink.size()){sink = opt["source"].asString();}
+          Util::streamVariables(sink, opt["source"].asString());
+          if (!spriteCache.open(sink, true, true)){
+            WARN_MSG("Could not open sprite sheet cache");
+            spriteInfo.columns = 0;
+          }
+        }
+      }
     };
 
     ~ProcessSource(){
       if (convertCtx){
         sws_freeContext(convertCtx);
       }
+      if (spriteScale){sws_freeContext(spriteScale);}
+      if (spriteCtx){avcodec_free_context(&spriteCtx);}
+      if (spriteFrame){av_frame_free(&spriteFrame);}
+      if (spriteDownload){av_frame_free(&spriteDownload);}
+      if (spritePkt){av_packet_free(&spritePkt);}
       if (resampleContext){
         swr_free(&resampleContext);
       }
@@ -529,6 +690,27 @@ namespace Mist{
 
     /// \brief Tries to open a given encoder. On success immediately configures it
     bool tryEncoder(std::string encoder, AVHWDeviceType hwDev, AVPixelFormat pixFmt, AVPixelFormat softFmt){
+      uint64_t reqWidth = M.getWidth(getMainSelectedTrack());
+      uint64_t reqHeight = M.getHeight(getMainSelectedTrack());
+      if (opt.isMember("resolution") && opt["resolution"]){
+        reqWidth = strtol(opt["resolution"].asString().substr(0, opt["resolution"].asString().find("x")).c_str(), NULL, 0);
+        reqHeight = strtol(opt["resolution"].asString().substr(opt["resolution"].asString().find("x") + 1).c_str(), NULL, 0);
+      }
+      AVCodecContext *tmpCtx = openEncoder(encoder, hwDev, pixFmt, softFmt, reqWidth, reqHeight, Mist::opt["bitrate"].asInt(), frameInHW);
+      if (!tmpCtx){
+        softFormat = AV_PIX_FMT_NONE;
+        return false;
+      }
+      if (hwDev != AV_HWDEVICE_TYPE_NONE){softFormat = softFmt;}
+      context_out = tmpCtx;
+      return true;
+    }
+
+    /// \brief Opens and configures a video encoder for the given output size and bitrate
+    /// \param hwFrame Set to a hardware upload frame if hwDev is not AV_HWDEVICE_TYPE_NONE
+    /// \returns The opened encoding context, or 0 on failure
+    AVCodecContext *openEncoder(std::string encoder, AVHWDeviceType hwDev, AVPixelFormat pixFmt, AVPixelFormat softFmt,
+                                uint64_t reqWidth, uint64_t reqHeight, uint64_t bitrate, AVFrame *&hwFrame){
       av_logLevel = AV_LOG_DEBUG;
       if (encoder.size()){
         codec_out = avcodec_find_encoder_by_name(encoder.c_str());
@@ -545,7 +727,7 @@ namespace Mist{
       if (!tmpCtx) {
         ERROR_MSG("Could not allocate %s %s encode context", encoder.c_str(), codecOut.c_str());
         av_logLevel = AV_LOG_WARNING;
-        return false;
+        return 0;
       }
 
       uint64_t targetFPKS = M.getFpks(getMainSelectedTrack());
@@ -553,16 +735,10 @@ namespace Mist{
         WARN_MSG("No FPS set, assuming 60 FPS for the encoder.");
         targetFPKS = 60000;
       }
-      uint64_t reqWidth = M.getWidth(getMainSelectedTrack());
-      uint64_t reqHeight = M.getHeight(getMainSelectedTrack());
-      if (opt.isMember("resolution") && opt["resolution"]){
-        reqWidth = strtol(opt["resolution"].asString().substr(0, opt["resolution"].asString().find("x")).c_str(), NULL, 0);
-        reqHeight = strtol(opt["resolution"].asString().substr(opt["resolution"].asString().find("x") + 1).c_str(), NULL, 0);
-      }
-      tmpCtx->bit_rate = Mist::opt["bitrate"].asInt();
-      tmpCtx->rc_max_rate = 1.20 * Mist::opt["bitrate"].asInt();
+      tmpCtx->bit_rate = bitrate;
+      tmpCtx->rc_max_rate = 1.20 * bitrate;
       tmpCtx->rc_min_rate = 0;
-      tmpCtx->rc_buffer_size = 2 * Mist::opt["bitrate"].asInt();
+      tmpCtx->rc_buffer_size = 2 * bitrate;
       tmpCtx->time_base.num = 1000;
       tmpCtx->time_base.den = targetFPKS;
       tmpCtx->codec_type = AVMEDIA_TYPE_VIDEO;
@@ -595,8 +771,7 @@ namespace Mist{
           INFO_MSG("Could not open %s %s hardware acceleration", encoder.c_str(), codecOut.c_str());
           avcodec_free_context(&tmpCtx);
           av_logLevel = AV_LOG_WARNING;
-          softFormat = AV_PIX_FMT_NONE;
-          return false;
+          return 0;
         }
 
         INFO_MSG("Creating hw frame context");
@@ -607,7 +782,6 @@ namespace Mist{
         frames_ctx->initial_pool_size = 1;
         frames_ctx->format    = pixFmt;
         frames_ctx->sw_format = softFmt;
-        softFormat = softFmt;
         frames_ctx->width     = reqWidth;
         frames_ctx->height    = reqHeight;
 
@@ -616,14 +790,20 @@ namespace Mist{
 
         INFO_MSG("Creating hw frame memory");
 
-        frameInHW = av_frame_alloc();
-        av_hwframe_get_buffer(tmpCtx->hw_frames_ctx, frameInHW, 0);
+        hwFrame = av_frame_alloc();
+        av_hwframe_get_buffer(tmpCtx->hw_frames_ctx, hwFrame, 0);
       }
 
       INFO_MSG("Initing codec...");
       int ret;
+      AVDictionary *avDict = NULL;
+      if (ladder.size()){
+        // Ladder rungs only place keyframes where they are forced, so they stay aligned between rungs
+        av_dict_set(&avDict, "forced-idr", "1", 0);
+        if (hwDev == AV_HWDEVICE_TYPE_CUDA){av_dict_set(&avDict, "no-scenecut", "1", 0);}
+        if (hwDev == AV_HWDEVICE_TYPE_NONE && codecOut == "H264"){av_dict_set(&avDict, "x264-params", "scenecut=0", 0);}
+      }
       if (hwDev == AV_HWDEVICE_TYPE_CUDA){
-        AVDictionary *avDict = NULL;
         if (codecOut == "H264" && Mist::opt["tune"].asString() == "zerolatency"){
           av_dict_set(&avDict, "preset", "ll", 0);
           av_dict_set(&avDict, "tune", "ull", 0);
@@ -642,14 +822,12 @@ namespace Mist{
         }
         ret = avcodec_open2(tmpCtx, codec_out, &avDict);
       }else if (hwDev == AV_HWDEVICE_TYPE_QSV){
-        AVDictionary *avDict = NULL;
         if (codecOut == "H264"){
           av_dict_set(&avDict, "preset", "medium", 0);
         }
         av_dict_set(&avDict, "look_ahead", "0", 0);
         ret = avcodec_open2(tmpCtx, codec_out, &avDict);
       }else{
-        AVDictionary *avDict = NULL;
         if (codecOut == "H264"){
           if (Mist::opt["tune"] == "zerolatency-lq"){Mist::opt["tune"] = "zerolatency";}
           if (Mist::opt["tune"] == "zerolatency-hq"){Mist::opt["tune"] = "zerolatency";}
@@ -663,17 +841,15 @@ namespace Mist{
 
       if (ret < 0) {
         if (hw_device_ctx){av_buffer_unref(&hw_device_ctx);}
-        if (frameInHW){av_frame_free(&frameInHW);}
+        if (hwFrame){av_frame_free(&hwFrame);}
         avcodec_free_context(&tmpCtx);
         printError("Could not open " + codecIn + " codec context", ret);
         av_logLevel = AV_LOG_WARNING;
-        softFormat = AV_PIX_FMT_NONE;
-        return false;
+        return 0;
       }
-      context_out = tmpCtx;
 
       av_logLevel = AV_LOG_WARNING;
-      return true;
+      return tmpCtx;
     }
 
     /// \brief Tries various encoders for video transcoding
@@ -1175,8 +1351,8 @@ namespace Mist{
         // Config based on the target codec.
         // NOTE: this assumes that we're transcoding from RAW->non-RAW
         // NOTE: this needs adjustment if we ever add a variable output resolution
-        frame_RAW->width  = context_out->width;
-        frame_RAW->height = context_out->height;
+        frame_RAW->width  = context_out ? context_out->width : M.getWidth(thisIdx);
+        frame_RAW->height = context_out ? context_out->height : M.getHeight(thisIdx);
         frame_RAW->format = pixelFormat;
 
         // Allocate buffer
@@ -1523,6 +1699,104 @@ namespace Mist{
       return true;
     }
 
+    /// \brief Opens the JPEG encoder and canvas frame used for sprite sheets
+    bool openSpriteEncoder(){
+      const AVCodec *spriteCodec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+      if (!spriteCodec){return false;}
+      spriteCtx = avcodec_alloc_context3(spriteCodec);
+      if (!spriteCtx){return false;}
+      spriteInfo.width = spriteInfo.columns * spriteInfo.tileWidth;
+      spriteInfo.height = spriteRows * spriteInfo.tileHeight;
+      spriteCtx->width = spriteInfo.width;
+      spriteCtx->height = spriteInfo.height;
+      spriteCtx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+      spriteCtx->time_base.num = 1;
+      spriteCtx->time_base.den = 1000;
+      spriteCtx->codec_type = AVMEDIA_TYPE_VIDEO;
+      spriteCtx->flags |= AV_CODEC_FLAG_QSCALE;
+      int ret = avcodec_open2(spriteCtx, spriteCodec, 0);
+      if (ret < 0){
+        printError("Could not open sprite sheet encoder", ret);
+        return false;
+      }
+      spriteFrame = av_frame_alloc();
+      spritePkt = av_packet_alloc();
+      if (!spriteFrame || !spritePkt){return false;}
+      spriteFrame->format = AV_PIX_FMT_YUVJ420P;
+      spriteFrame->width = spriteInfo.width;
+      spriteFrame->height = spriteInfo.height;
+      ret = av_frame_get_buffer(spriteFrame, 0);
+      if (ret < 0){
+        printError("Could not allocate sprite sheet", ret);
+        return false;
+      }
+      INFO_MSG("Generating %" PRIu32 "x%zu sprite sheets of %" PRIu32 "x%" PRIu32 " tiles", spriteInfo.columns,
+               spriteRows, spriteInfo.tileWidth, spriteInfo.tileHeight);
+      return true;
+    }
+
+    /// \brief Scales the decoded frame into the next tile of the current sprite sheet, then
+    /// encodes the sheet and stores it in the sprite cache, so new tiles are available right away.
+    void addSpriteTile(){
+      if (!spriteCtx && !openSpriteEncoder()){
+        WARN_MSG("Could not initialize sprite sheets; disabling them");
+        spriteInfo.columns = 0;
+        return;
+      }
+      AVFrame *src = frame_RAW;
+      // Frames that stay on the hardware for encoding are not downloaded into frame_RAW, so do it here
+      if (frameDecodeHW && frameDecodeHW != frame_RAW && frameInHW){
+        if (!spriteDownload){spriteDownload = av_frame_alloc();}
+        av_frame_unref(spriteDownload);
+        int ret = av_hwframe_transfer_data(spriteDownload, frameDecodeHW, 0);
+        if (ret){
+          printError("Unable to download frame for the sprite sheet", ret);
+          return;
+        }
+        src = spriteDownload;
+      }
+      if (av_frame_make_writable(spriteFrame) < 0){return;}
+      // Start a new sheet when the current one is full, with a black canvas
+      if (!spriteInfo.tiles || spriteInfo.tiles >= spriteInfo.columns * spriteRows){
+        if (spriteInfo.tiles){++spriteSheet;}
+        spriteInfo.tiles = 0;
+        memset(spriteFrame->data[0], 0, spriteFrame->linesize[0] * spriteFrame->height);
+        memset(spriteFrame->data[1], 128, spriteFrame->linesize[1] * (spriteFrame->height / 2));
+        memset(spriteFrame->data[2], 128, spriteFrame->linesize[2] * (spriteFrame->height / 2));
+      }
+      spriteScale = sws_getCachedContext(spriteScale, src->width, src->height, (AVPixelFormat)src->format,
+                                         spriteInfo.tileWidth, spriteInfo.tileHeight, AV_PIX_FMT_YUVJ420P,
+                                         SWS_FAST_BILINEAR | SWS_FULL_CHR_H_INT | SWS_ACCURATE_RND, NULL, NULL, NULL);
+      if (!spriteScale){
+        FAIL_MSG("Could not allocate sprite scaling context");
+        return;
+      }
+      size_t tile = spriteInfo.tiles;
+      size_t x = (tile % spriteInfo.columns) * spriteInfo.tileWidth;
+      size_t y = (tile / spriteInfo.columns) * spriteInfo.tileHeight;
+      uint8_t *dst[4] = {spriteFrame->data[0] + y * spriteFrame->linesize[0] + x,
+                         spriteFrame->data[1] + (y / 2) * spriteFrame->linesize[1] + x / 2,
+                         spriteFrame->data[2] + (y / 2) * spriteFrame->linesize[2] + x / 2, 0};
+      int dstStride[4] = {spriteFrame->linesize[0], spriteFrame->linesize[1], spriteFrame->linesize[2], 0};
+      sws_scale(spriteScale, src->data, src->linesize, 0, src->height, dst, dstStride);
+
+      if (!tile){spriteInfo.time = thisTime;}
+      spriteInfo.tileTimes[tile] = thisTime;
+      spriteInfo.endTime = thisTime;
+      ++spriteInfo.tiles;
+
+      spriteFrame->pts = thisTime;
+      spriteFrame->quality = FF_QP2LAMBDA * Mist::opt["quality"].asInt();
+      int ret = avcodec_send_frame(spriteCtx, spriteFrame);
+      if (ret < 0){
+        printError("Unable to send sprite sheet to the encoder", ret);
+        return;
+      }
+      if (avcodec_receive_packet(spriteCtx, spritePkt) < 0){return;}
+      spriteCache.write(spriteSheet, spriteInfo, (char *)spritePkt->data, spritePkt->size);
+      av_packet_unref(spritePkt);
+    }
+
     /// @brief Takes raw video buffer and encode it to create an output packet
     void encodeVideo(){
       // Encode to target codec. Force P frame to prevent keyframe-only outputs from appearing
@@ -1641,6 +1915,168 @@ namespace Mist{
       }
     }
 
+    /// \brief Opens the encoders of all ladder rungs and starts their worker threads
+    bool allocateLadder(){
+      if (ladder.front()->ctx){return true;}
+      inFpks = M.getFpks(thisIdx);
+      uint64_t srcWidth = M.getWidth(thisIdx);
+      uint64_t srcHeight = M.getHeight(thisIdx);
+      for (std::deque<LadderRung *>::iterator it = ladder.begin(); it != ladder.end(); ++it){
+        LadderRung &r = **it;
+        // Fill in missing dimensions from the source, keeping its aspect ratio at even sizes
+        if (!r.width && !r.height){
+          r.width = srcWidth;
+          r.height = srcHeight;
+        }else if (!r.width && srcHeight){
+          r.width = ((r.height * srcWidth / srcHeight) + 1) & ~(uint64_t)1;
+        }else if (!r.height && srcWidth){
+          r.height = ((r.width * srcHeight / srcWidth) + 1) & ~(uint64_t)1;
+        }
+        std::string hwEnc = (codecOut == "H264") ? "h264_nvenc" : "av1_nvenc";
+        if (allowHW){
+          r.ctx = openEncoder(hwEnc, AV_HWDEVICE_TYPE_CUDA, AV_PIX_FMT_CUDA, AV_PIX_FMT_YUV420P, r.width, r.height, r.bitrate, r.hwFrame);
+          if (r.ctx){r.softFmt = AV_PIX_FMT_YUV420P;}
+        }
+        if (!r.ctx && allowSW){
+          r.ctx = openEncoder("", AV_HWDEVICE_TYPE_NONE, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE, r.width, r.height, r.bitrate, r.hwFrame);
+        }
+        if (!r.ctx){
+          ERROR_MSG("Could not allocate %s context for ladder rung %zu (%" PRIu64 "x%" PRIu64 ")", codecOut.c_str(), r.id, r.width, r.height);
+          exit(1);
+        }
+        r.scaled = av_frame_alloc();
+        r.scaled->format = (r.softFmt != AV_PIX_FMT_NONE) ? r.softFmt : r.ctx->pix_fmt;
+        r.scaled->width = r.width;
+        r.scaled->height = r.height;
+        int ret = av_frame_get_buffer(r.scaled, 0);
+        if (ret < 0){
+          printError("Could not allocate ladder frame buffer", ret);
+          exit(1);
+        }
+        r.pkt = av_packet_alloc();
+        INFO_MSG("Ladder rung %zu: %" PRIu64 "x%" PRIu64 " @ %" PRIu64 " bps", r.id, r.width, r.height, r.bitrate);
+      }
+      for (std::deque<LadderRung *>::iterator it = ladder.begin(); it != ladder.end(); ++it){
+        (*it)->worker = new tthread::thread(ladderWorker, *it);
+      }
+      static char scaleTxt[100];
+      snprintf(scaleTxt, 100, "Ladder: %zu rungs", ladder.size());
+      scaler = scaleTxt;
+      return true;
+    }
+
+    /// \brief Hands the last decoded frame to every ladder rung.
+    /// Decoded frames are reference counted, so the rungs share the decoded buffers instead of copying them.
+    bool sendLadderFrame(){
+      AVFrame *shared = 0;
+      if (frameDecodeHW && frameDecodeHW != frame_RAW){
+        // Download from the hardware once, rather than once per rung
+        shared = av_frame_alloc();
+        shared->format = softDecodeFormat;
+        int ret = av_hwframe_transfer_data(shared, frameDecodeHW, 0);
+        if (ret){
+          av_frame_free(&shared);
+          printError("Unable to download frame from the hardware", ret);
+          return false;
+        }
+      }else if (context_in){
+        shared = av_frame_clone(frame_RAW);
+      }else{
+        // RAW input frames point into the packet buffer, so they need a copy of their own
+        shared = av_frame_alloc();
+        shared->format = frame_RAW->format;
+        shared->width = frame_RAW->width;
+        shared->height = frame_RAW->height;
+        if (av_frame_get_buffer(shared, 0) < 0 || av_frame_copy(shared, frame_RAW) < 0){av_frame_free(&shared);}
+      }
+      if (!shared){
+        FAIL_MSG("Could not share decoded frame with the ladder rungs");
+        return false;
+      }
+      shared->pts = thisTime;
+      // Force keyframes on the same source frames in every rung, so all renditions are switchable there
+      shared->pict_type = (ladderFrames++ % Mist::opt["gopsize"].asInt()) ? AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_I;
+      {
+        tthread::lock_guard<tthread::mutex> guard(ladderMutex);
+        for (std::deque<LadderRung *>::iterator it = ladder.begin(); it != ladder.end(); ++it){
+          while ((*it)->frames.size() >= LADDER_QUEUE && conf.is_active && co.is_active){ladderCV.wait(ladderMutex);}
+          (*it)->frames.push_back(av_frame_clone(shared));
+        }
+        ladderCV.notify_all();
+      }
+      av_frame_free(&shared);
+      return true;
+    }
+
+    /// \brief Worker thread of a single ladder rung: scales and encodes shared frames until shutdown
+    static void ladderWorker(void *rungPtr){
+      LadderRung &r = *(LadderRung *)rungPtr;
+#ifdef WITH_THREADNAMES
+      pthread_setname_np(pthread_self(), ("ladderRung" + JSON::Value(r.id).asString()).c_str());
+#endif
+      AVPixelFormat dstFmt = (r.softFmt != AV_PIX_FMT_NONE) ? r.softFmt : r.ctx->pix_fmt;
+      while (conf.is_active && co.is_active){
+        AVFrame *src = 0;
+        {
+          tthread::lock_guard<tthread::mutex> guard(ladderMutex);
+          while (!r.frames.size() && conf.is_active && co.is_active){ladderCV.wait(ladderMutex);}
+          if (!r.frames.size()){break;}
+          src = r.frames.front();
+          r.frames.pop_front();
+          ladderCV.notify_all();
+        }
+        uint64_t startTime = Util::getMicros();
+        // The cached context is only rebuilt when the source size or format changes
+        r.scaleCtx = sws_getCachedContext(r.scaleCtx, src->width, src->height, (enum AVPixelFormat)src->format, r.width, r.height, dstFmt, SWS_FAST_BILINEAR | SWS_FULL_CHR_H_INT | SWS_ACCURATE_RND, NULL, NULL, NULL);
+        if (!r.scaleCtx || av_frame_make_writable(r.scaled) < 0){
+          FAIL_MSG("Could not scale frame for ladder rung %zu", r.id);
+          av_frame_free(&src);
+          continue;
+        }
+        sws_scale(r.scaleCtx, (const uint8_t * const *)src->data, src->linesize, 0, src->height, r.scaled->data, r.scaled->linesize);
+        r.scaled->pict_type = src->pict_type;
+        r.scaled->pts = r.pts++;
+        r.sentTimes.push_back(src->pts);
+        av_frame_free(&src);
+        uint64_t scaleTime = Util::getMicros();
+        __sync_fetch_and_add(&totalTransform, scaleTime - startTime);
+
+        int ret;
+        if (r.hwFrame){
+          ret = av_hwframe_transfer_data(r.hwFrame, r.scaled, 0);
+          if (ret){
+            printError("Unable to upload frame to the hardware", ret);
+            r.sentTimes.pop_back();
+            continue;
+          }
+          r.hwFrame->pict_type = r.scaled->pict_type;
+          r.hwFrame->pts = r.scaled->pts;
+          ret = avcodec_send_frame(r.ctx, r.hwFrame);
+        }else{
+          ret = avcodec_send_frame(r.ctx, r.scaled);
+        }
+        if (ret < 0){
+          printError("Unable to send frame to the encoder", ret);
+          r.sentTimes.pop_back();
+          continue;
+        }
+        // No B-frames are used, so packets come out in the order their frames went in
+        while (!avcodec_receive_packet(r.ctx, r.pkt)){
+          LadderPacket lp;
+          lp.rung = &r;
+          lp.time = r.sentTimes.size() ? r.sentTimes.front() : 0;
+          if (r.sentTimes.size()){r.sentTimes.pop_front();}
+          lp.pkt = av_packet_alloc();
+          av_packet_move_ref(lp.pkt, r.pkt);
+          tthread::lock_guard<tthread::mutex> guard(avMutex);
+          ladderPackets.push_back(lp);
+          if (!r.id){++outputFrameCount;}
+          avCV.notify_all();
+        }
+        __sync_fetch_and_add(&totalEncode, Util::getMicros(scaleTime));
+      }
+    }
+
     void sendNext(){
       // Wait for the other side to process the last frame that was ready for buffering
       uint64_t sleepTime = Util::getMicros();
@@ -1667,11 +2103,13 @@ namespace Mist{
       // Keyframe only mode for MJPEG output
       if (codecOut == "JPEG"){
         ++skippedFrames;
-        if(!thisPacket.getFlag("keyframe") || skippedFrames < Mist::opt["gopsize"].asInt()){
+        if(!thisPacket.getFlag("keyframe") || skippedFrames < Mist::opt["gopsize"].asInt() ||
+           (lastImageTime && thisTime < lastImageTime + Mist::opt["interval"].asInt())){
           sinkClass->setNowMS(thisTime);
           return;
         }
         skippedFrames = 0;
+        lastImageTime = thisTime;
       }
 
       needsLookAhead = 0;
@@ -1730,12 +2168,22 @@ namespace Mist{
             }
           }
         }
-        allocateVideoEncoder();
+        if (ladder.size()){
+          if (!allocateLadder()){ return; }
+        }else{
+          allocateVideoEncoder();
+        }
         if (!configVideoDecoder()){ return; }
         uint64_t startTime = Util::getMicros();
         if (!decodeVideoFrame(dataPointer, dataLen)){ return; }
         uint64_t decodeTime = Util::getMicros();
+        if (ladder.size()){
+          totalDecode += decodeTime - startTime;
+          sendLadderFrame();
+          return;
+        }
         if(!transformVideoFrame()){ return; }
+        if (spriteInfo.columns){addSpriteTile();}
         uint64_t transformTime = Util::getMicros();
         totalDecode += decodeTime - startTime;
         totalTransform += transformTime - decodeTime;
@@ -1780,9 +2228,56 @@ namespace Mist{
       INFO_MSG("No sink explicitly set, using source as sink");
     }
 
+    if (opt.isMember("ladder") && opt["ladder"].isArray() && opt["ladder"].size()){
+      if (codecOut != "H264" && codecOut != "AV1"){
+        FAIL_MSG("A ladder can only be encoded to H264 or AV1, not %s", codecOut.c_str());
+        return false;
+      }
+      jsonForEach(opt["ladder"], it){
+        LadderRung *r = new LadderRung();
+        r->id = ladder.size();
+        std::string res = (*it)["resolution"].asString();
+        r->width = strtol(res.substr(0, res.find("x")).c_str(), NULL, 0);
+        r->height = strtol(res.substr(res.find("x") + 1).c_str(), NULL, 0);
+        r->bitrate = (*it)["bitrate"].asInt() ? (*it)["bitrate"].asInt() : opt["bitrate"].asInt();
+        ladder.push_back(r);
+      }
+      INFO_MSG("Encoding a ladder of %zu renditions from a single decode", ladder.size());
+    }
+
     return true;
   }
 
+  /// \brief Stops the ladder worker threads and frees all ladder state
+  void ProcAV::StopLadder(){
+    {
+      tthread::lock_guard<tthread::mutex> guard(ladderMutex);
+      ladderCV.notify_all();
+    }
+    while (ladder.size()){
+      LadderRung *r = ladder.front();
+      ladder.pop_front();
+      if (r->worker){
+        r->worker->join();
+        delete r->worker;
+      }
+      while (r->frames.size()){
+        av_frame_free(&r->frames.front());
+        r->frames.pop_front();
+      }
+      if (r->scaleCtx){sws_freeContext(r->scaleCtx);}
+      if (r->scaled){av_frame_free(&r->scaled);}
+      if (r->hwFrame){av_frame_free(&r->hwFrame);}
+      if (r->ctx){avcodec_free_context(&r->ctx);}
+      if (r->pkt){av_packet_free(&r->pkt);}
+      delete r;
+    }
+    while (ladderPackets.size()){
+      av_packet_free(&ladderPackets.front().pkt);
+      ladderPackets.pop_front();
+    }
+  }
+
   void ProcAV::Run(){
     uint64_t lastProcUpdate = Util::bootSecs();
     {
@@ -1824,6 +2319,7 @@ namespace Mist{
           pData["ainfo"]["decoder"] = "None (raw)";
         }
         pData["ainfo"]["scaler"] = scaler;
+        if (ladder.size()){pData["ainfo"]["rungs"] = (uint64_t)ladder.size();}
         Util::sendUDPApi(pStat);
         lastProcUpdate = Util::bootSecs();
       }
@@ -1843,6 +2339,10 @@ void sinkThread(void *){
   INFO_MSG("Stop sink thread...");
   conf.is_active = false;
   avCV.notify_all();
+  {
+    tthread::lock_guard<tthread::mutex> guard(ladderMutex);
+    ladderCV.notify_all();
+  }
 }
 
 void sourceThread(void *){
@@ -1868,6 +2368,10 @@ void sourceThread(void *){
   INFO_MSG("Stop source thread...");
   co.is_active = false;
   avCV.notify_all();
+  {
+    tthread::lock_guard<tthread::mutex> guard(ladderMutex);
+    ladderCV.notify_all();
+  }
 }
 
 /// \brief Custom log function for LibAV-related messages
@@ -1937,6 +2441,7 @@ int main(int argc, char *argv[]){
   capa["ainfo"]["decoder"]["name"] = "Decoder";
   capa["ainfo"]["encoder"]["name"] = "Encoder";
   capa["ainfo"]["scaler"]["name"] = "Scaler";
+  capa["ainfo"]["rungs"]["name"] = "Ladder renditions";
 
   if (!(config.parseArgs(argc, argv))){return 1;}
   if (config.getBool("json")){
@@ -2091,6 +2596,50 @@ int main(int argc, char *argv[]){
     capa["optional"]["resolution"]["sort"] = "aca";
     capa["optional"]["resolution"]["dependent"]["x-LSP-kind"] = "video";
 
+    capa["optional"]["ladder"]["name"] = "Ladder";
+    capa["optional"]["ladder"]["type"] = "sublist";
+    capa["optional"]["ladder"]["itemLabel"] = "rendition";
+    capa["optional"]["ladder"]["help"] = "Encode several renditions at once, each into its own track. The source is decoded only once and all renditions get their keyframes on the same frames. Overrides the resolution option; only for H264 and AV1.";
+    capa["optional"]["ladder"]["sort"] = "acb";
+    capa["optional"]["ladder"]["dependent"]["x-LSP-kind"] = "video";
+    {
+      JSON::Value &grp = capa["optional"]["ladder"]["optional"];
+      grp["resolution"]["name"] = "Resolution";
+      grp["resolution"]["help"] = "Resolution of this rendition, e.g. 1280x720. Leave a side at 0 to keep the source aspect ratio.";
+      grp["resolution"]["type"] = "str";
+      grp["resolution"]["n"] = 0;
+      grp["bitrate"]["name"] = "Bitrate";
+      grp["bitrate"]["help"] = "Target bitrate of this rendition. Defaults to the bitrate option.";
+      grp["bitrate"]["unit"] = "bits per second";
+      grp["bitrate"]["type"] = "uint";
+      grp["bitrate"]["n"] = 1;
+    }
+
+    capa["optional"]["interval"]["name"] = "Image interval";
+    capa["optional"]["interval"]["help"] = "When outputting JPEG, the minimum time between images. Only keyframes are decoded, so images are spaced at least a GOP apart.";
+    capa["optional"]["interval"]["unit"] = "ms";
+    capa["optional"]["interval"]["type"] = "uint";
+    capa["optional"]["interval"]["default"] = 0;
+    capa["optional"]["interval"]["dependent"]["codec"] = "JPEG";
+
+    capa["optional"]["thumbs"]["name"] = "Thumbnail cache";
+    capa["optional"]["thumbs"]["help"] = "When outputting JPEG, also keep the most recent images in a shared cache. The JPG output serves them by time through /STREAM.jpg?t=MS, and indexes them at /thumbs/STREAM.vtt.";
+    capa["optional"]["thumbs"]["type"] = "bool";
+    capa["optional"]["thumbs"]["default"] = false;
+    capa["optional"]["thumbs"]["dependent"]["codec"] = "JPEG";
+
+    capa["optional"]["sprite"]["name"] = "Sprite sheet layout";
+    capa["optional"]["sprite"]["help"] = "When outputting JPEG, also compose the images into sprite sheets of this many columns by rows, e.g. 5x5. The JPG output serves them through /sprites/STREAM.jpg?t=MS, and indexes their tiles at /sprites/STREAM.vtt.";
+    capa["optional"]["sprite"]["type"] = "str";
+    capa["optional"]["sprite"]["default"] = "";
+    capa["optional"]["sprite"]["dependent"]["codec"] = "JPEG";
+
+    capa["optional"]["sprite_resolution"]["name"] = "Sprite tile resolution";
+    capa["optional"]["sprite_resolution"]["help"] = "Resolution of a single sprite sheet tile";
+    capa["optional"]["sprite_resolution"]["type"] = "str";
+    capa["optional"]["sprite_resolution"]["default"] = "160x90";
+    capa["optional"]["sprite_resolution"]["dependent"]["codec"] = "JPEG";
+
     capa["optional"]["quality"]["name"] = "Quality";
     capa["optional"]["quality"]["help"] = "Level of compression similar to the `qscale` option in FFMPEG. Takes on a value between 1-31. A lower value provides a better quality output";
     capa["optional"]["quality"]["type"] = "int";
@@ -2197,6 +2746,10 @@ int main(int argc, char *argv[]){
   co.is_active = false;
   conf.is_active = false;
   avCV.notify_all();
+  {
+    tthread::lock_guard<tthread::mutex> guard(ladderMutex);
+    ladderCV.notify_all();
+  }
 
   source.join();
   HIGH_MSG("source thread joined");
@@ -2204,6 +2757,8 @@ int main(int argc, char *argv[]){
   sink.join();
   HIGH_MSG("sink thread joined");
 
+  Enc.StopLadder();
+
   if (context_out){avcodec_free_context(&context_out);}
   av_packet_free(&packet_out);
 
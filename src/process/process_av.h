@@ -14,6 +14,7 @@ namespace Mist{
     ProcAV(){};
     bool CheckConfig();
     void Run();
+    void StopLadder();
   };
 
 }// namespace Mist
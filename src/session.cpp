@@ -4,36 +4,12 @@
 #include <mist/config.h>
 #include <mist/auth.h>
 #include <mist/comms.h>
+#include <mist/tinythread.h>
 #include <mist/triggers.h>
 #include <signal.h>
 #include <stdio.h>
 #include <sstream>
 
-// Global counters
-uint64_t thisType = 0;
-uint64_t now = Util::bootSecs();
-uint64_t currentConnections = 0;
-uint64_t lastSecond = 0;
-uint64_t globalTime = 0;
-uint64_t globalDown = 0;
-uint64_t globalUp = 0;
-uint64_t globalPktcount = 0;
-uint64_t globalPktloss = 0;
-uint64_t globalPktretrans = 0;
-// Stores last values of each connection
-std::map<size_t, uint64_t> connTime;
-std::map<size_t, uint64_t> connDown;
-std::map<size_t, uint64_t> connUp;
-std::map<size_t, uint64_t> connPktcount;
-std::map<size_t, uint64_t> connPktloss;
-std::map<size_t, uint64_t> connPktretrans;
-// Counts the duration a connector has been active
-std::map<std::string, uint64_t> connectorCount;
-std::map<std::string, uint64_t> connectorLastActive;
-std::map<std::string, uint64_t> hostCount;
-std::map<std::string, uint64_t> hostLastActive;
-std::map<std::string, uint64_t> streamCount;
-std::map<std::string, uint64_t> streamLastActive;
 // Set to True when a session gets invalidated, so that we know to run a new USER_NEW trigger
 bool forceTrigger = false;
 void handleSignal(int signum){
@@ -44,15 +20,283 @@ void handleSignal(int signum){
 
 const char nullAddress[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-void userOnActive(Comms::Connections &connections, size_t idx){
-  uint64_t lastUpdate = connections.getNow(idx);
+/// Same as Triggers::shouldTrigger, but safe to use while other threads are running triggers.
+static bool hasTrigger(const std::string &type, const std::string &streamName){
+  std::string response;
+  return Triggers::doTrigger(type, "", streamName, true, response);
+}
+
+/// Serializes trigger execution: running a trigger changes the environment and forks, which is
+/// not safe to do from several threads at once.
+static tthread::mutex triggerMutex;
+
+/// Same as Triggers::doTrigger, but safe to use while other threads are running triggers.
+/// Triggers run one at a time; callers wait for any trigger already running.
+static bool runTrigger(const std::string &type, const std::string &payload, const std::string &streamName){
+  tthread::lock_guard<tthread::mutex> guard(triggerMutex);
+  std::string response;
+  return Triggers::doTrigger(type, payload, streamName, false, response);
+}
+
+/// Aggregates the statistics of all connections in a single session and runs its USER_NEW and
+/// USER_END triggers. A stand-alone MistSession process handles exactly one session, with its own
+/// connections page. The session host (MistSession --host) handles all sessions requested through
+/// Comms::SessionRequests, whose connections share the host's sharded connection table.
+class Session{
+public:
+  enum sessionState{SESSION_RUNNING, SESSION_SLEEPING, SESSION_DONE};
+
+  Session(const std::string &_sessId, const std::string &_streamName, const std::string &_host,
+          const std::string &_tkn, const std::string &_protocol, const std::string &_reqUrl, bool _hosted);
+  ~Session();
+  int start(Comms::Sessions &_stats, Comms::Connections *table = 0);
+  bool needsUserNew() const;
+  void userNew();
+  bool active();
+  void beginUpdate();
+  void userOnActive(size_t idx);
+  void userOnDisconnect(size_t idx);
+  void endUpdate();
+  void update();
+  bool retriggerNeeded();
+  bool retrigger();
+  void checkControl();
+  void finish();
+  void release();
+  void markConnections(uint8_t flags);
+
+  std::string sessId;
+  sessionState state;
+  uint64_t sleepStart;
+  bool forceTrigger;
+  volatile bool busy;     ///< True while a trigger thread is working on this session
+  volatile bool admitted; ///< True once USER_NEW has decided on a hosted session
+  volatile bool rejected; ///< True if USER_NEW rejected a hosted session
+
+private:
+  bool hosted;
+  uint64_t thisType;
+  std::string streamName;
+  std::string host;
+  std::string ipStr;
+  std::string tkn;
+  std::string protocol;
+  std::string reqUrl;
+  uint64_t bootTime;
+
+  Comms::Sessions *stats;
+  size_t statIdx;
+  Comms::Connections *connections; ///< Own connections page, or the host's connection table shard
+  IPC::semaphore sessionLock;
+  bool shouldSleep;
+
+  uint64_t now;
+  uint64_t lastSeen;
+  uint64_t currentConnections;
+  uint64_t lastSecond;
+  uint64_t globalTime;
+  uint64_t globalDown;
+  uint64_t globalUp;
+  uint64_t globalPktcount;
+  uint64_t globalPktloss;
+  uint64_t globalPktretrans;
+  uint64_t highestRtt;   ///< Highest round trip time of the currently active connections
+  uint64_t highestBufms; ///< Highest transport buffer fill of the currently active connections
+  // Stores last values of each connection
+  std::map<size_t, uint64_t> connTime;
+  std::map<size_t, uint64_t> connDown;
+  std::map<size_t, uint64_t> connUp;
+  std::map<size_t, uint64_t> connPktcount;
+  std::map<size_t, uint64_t> connPktloss;
+  std::map<size_t, uint64_t> connPktretrans;
+  // Counts the duration a connector has been active
+  std::map<std::string, uint64_t> connectorCount;
+  std::map<std::string, uint64_t> connectorLastActive;
+  std::map<std::string, uint64_t> hostCount;
+  std::map<std::string, uint64_t> hostLastActive;
+  std::map<std::string, uint64_t> streamCount;
+  std::map<std::string, uint64_t> streamLastActive;
+};
+
+Session::Session(const std::string &_sessId, const std::string &_streamName, const std::string &_host,
+                 const std::string &_tkn, const std::string &_protocol, const std::string &_reqUrl, bool _hosted){
+  sessId = _sessId;
+  streamName = _streamName;
+  host = _host;
+  if (host.size() > 16){host = host.substr(0, 16);}
+  if (host.size() < 16){host.append(16 - host.size(), '\000');}
+  Socket::hostBytesToStr(host.data(), host.size(), ipStr);
+  tkn = _tkn;
+  protocol = _protocol;
+  reqUrl = _reqUrl;
+  hosted = _hosted;
+  state = SESSION_RUNNING;
+  sleepStart = 0;
+  forceTrigger = false;
+  busy = false;
+  admitted = false;
+  rejected = false;
+  shouldSleep = false;
+  bootTime = Util::getMicros();
+  stats = 0;
+  statIdx = INVALID_RECORD_INDEX;
+  connections = 0;
+  now = Util::bootSecs();
+  lastSeen = now;
+  currentConnections = 0;
+  lastSecond = 0;
+  globalTime = 0;
+  globalDown = 0;
+  globalUp = 0;
+  globalPktcount = 0;
+  globalPktloss = 0;
+  globalPktretrans = 0;
+  highestRtt = 0;
+  highestBufms = 0;
+  // Determine session type, since triggers only get run for viewer type sessions
+  thisType = 0;
+  if (sessId[0] == 'I'){
+    thisType = 1;
+  }else if (sessId[0] == 'O'){
+    thisType = 2;
+  }else if (sessId[0] == 'U'){
+    thisType = 3;
+  }
+}
+
+Session::~Session(){
+  if (connections && !hosted){delete connections;}
+  connections = 0;
+  release();
+  sessionLock.close();
+}
+
+/// Locks the session, claims a record on the statistics page and creates the connections page.
+/// Hosted sessions use the given shard of the host's connection table instead, and need no lock
+/// as the host only starts a session once.
+/// Returns 0 on success, after which userNew must be called to unlock the session again.
+/// Returns 1 on failure, 2 if the session is already being handled elsewhere.
+int Session::start(Comms::Sessions &_stats, Comms::Connections *table){
+  VERYHIGH_MSG("Starting a new session. Passed variables are stream name '%s', session token '%s', protocol '%s', requested URL '%s', IP '%s' and session id '%s'",
+  streamName.c_str(), tkn.c_str(), protocol.c_str(), reqUrl.c_str(), ipStr.c_str(), sessId.c_str());
+
+  if (!hosted){
+    // Try to lock to ensure we are the only process initialising this session
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_SESSION, sessId.c_str());
+    sessionLock.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    // If the lock fails, the previous Session process must've failed in spectacular fashion
+    // It's the Controller's task to clean everything up. When the lock fails, this cleanup hasn't happened yet
+    if (!sessionLock.tryWaitOneSecond()){
+      FAIL_MSG("Session '%s' already locked", sessId.c_str());
+      return 1;
+    }
+
+    // Check if a page already exists for this session ID. If so, quit
+    IPC::sharedPage dataPage;
+    char userPageName[NAME_BUFFER_SIZE];
+    snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, sessId.c_str());
+    dataPage.init(userPageName, 0, false, false);
+    if (dataPage){
+      INFO_MSG("Session '%s' already has a running process", sessId.c_str());
+      sessionLock.post();
+      return 2;
+    }
+  }
+
+  // Claim a spot in shared memory for this session on the global statistics page
+  stats = &_stats;
+  // Hosted sessions share their PID with all other hosted sessions; they must never be killed
+  statIdx = stats->claimRecord(hosted ? COMM_STATUS_NOKILL : 0);
+  if (statIdx == INVALID_RECORD_INDEX){
+    FAIL_MSG("Unable to register entry for session '%s' on the stats page", sessId.c_str());
+    if (!hosted){sessionLock.post();}
+    return 1;
+  }
+
+  // Initialise global session data
+  stats->setHost(host, statIdx);
+  stats->setSessId(sessId, statIdx);
+  stats->setStream(streamName, statIdx);
+  if (protocol.size() && protocol != "HTTP"){connectorLastActive[protocol] = now;}
+  if (streamName.size()){streamLastActive[streamName] = now;}
+  if (memcmp(host.data(), nullAddress, 16)){hostLastActive[host] = now;}
+
+  if (hosted){
+    connections = table;
+    return 0;
+  }
+  // Open the shared memory page containing statistics for each individual connection in this session
+  connections = new Comms::Connections();
+  connections->reload(sessId, true);
+  return 0;
+}
+
+/// Returns true if starting this session involves a (potentially slow) USER_NEW trigger.
+bool Session::needsUserNew() const{
+  return !thisType && hasTrigger("USER_NEW", streamName);
+}
+
+/// Runs the USER_NEW trigger if needed, then allows viewers to connect.
+void Session::userNew(){
+  // Do a USER_NEW trigger if it is defined for this stream
+  if (!thisType && hasTrigger("USER_NEW", streamName)){
+    std::string payload = streamName + "\n" + ipStr + "\n" + tkn + "\n" + protocol + "\n" + reqUrl + "\n" + sessId;
+    if (!runTrigger("USER_NEW", payload, streamName)){
+      // Mark all connections of this session as finished, since this viewer is not allowed to view this stream
+      if (hosted){
+        rejected = true;
+      }else{
+        Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
+        connections->setExit();
+        connections->finishAll();
+      }
+    }
+  }
+
+  //start allowing viewers; the session host admits waiting connections once this is set
+  if (hosted){
+    __sync_synchronize();
+    admitted = true;
+  }else{
+    sessionLock.post();
+  }
+
+  INFO_MSG("Started new session %s in %.3f ms", sessId.c_str(), (double)Util::getMicros(bootTime)/1000.0);
+}
+
+/// Returns true as long as the session should stay active.
+bool Session::active(){
+  if (!connections){return false;}
+  if (hosted){
+    if (rejected || (stats->getStatus(statIdx) & COMM_STATUS_REQDISCONNECT)){return false;}
+  }else if (connections->getExit()){
+    return false;
+  }
+  return currentConnections || Util::bootSecs() - lastSeen <= STATS_DELAY;
+}
+
+/// Picks up requests from the controller for hosted sessions. Stand-alone sessions get signals instead.
+void Session::checkControl(){
+  if (!hosted || statIdx == INVALID_RECORD_INDEX){return;}
+  uint8_t status = stats->getStatus(statIdx);
+  if (status & COMM_STATUS_REQTRIGGER){
+    forceTrigger = true;
+    stats->setStatus(status & ~COMM_STATUS_REQTRIGGER, statIdx);
+  }
+}
+
+void Session::userOnActive(size_t idx){
+  uint64_t lastUpdate = connections->getNow(idx);
   if (lastUpdate < now - 10 && thisType != 1){return;}
   ++currentConnections;
-  std::string thisConnector = connections.getConnector(idx);
-  std::string thisStreamName = connections.getStream(idx);
-  const std::string& thisHost = connections.getHost(idx);
+  std::string thisConnector = connections->getConnector(idx);
+  std::string thisStreamName = connections->getStream(idx);
+  const std::string& thisHost = connections->getHost(idx);
 
-  if (connections.getLastSecond(idx) > lastSecond){lastSecond = connections.getLastSecond(idx);}
+  if (connections->getLastSecond(idx) > lastSecond){lastSecond = connections->getLastSecond(idx);}
+  if (connections->getRoundTripTime(idx) > highestRtt){highestRtt = connections->getRoundTripTime(idx);}
+  if (connections->getBufferFill(idx) > highestBufms){highestBufms = connections->getBufferFill(idx);}
   // Save info on the latest active stream, protocol and host separately
   if (thisConnector.size() && thisConnector != "HTTP"){
     connectorCount[thisConnector]++;
@@ -67,43 +311,43 @@ void userOnActive(Comms::Connections &connections, size_t idx){
     if (!hostLastActive.count(thisHost) || hostLastActive[thisHost] < lastUpdate){hostLastActive[thisHost] = lastUpdate;}
   }
   // Sanity checks
-  if (connections.getDown(idx) < connDown[idx]){
+  if (connections->getDown(idx) < connDown[idx]){
     MEDIUM_MSG("Connection downloaded bytes should be a counter, but has decreased in value");
-    connDown[idx] = connections.getDown(idx);
+    connDown[idx] = connections->getDown(idx);
   }
-  if (connections.getUp(idx) < connUp[idx]){
+  if (connections->getUp(idx) < connUp[idx]){
     MEDIUM_MSG("Connection uploaded bytes should be a counter, but has decreased in value");
-    connUp[idx] = connections.getUp(idx);
+    connUp[idx] = connections->getUp(idx);
   }
-  if (connections.getPacketCount(idx) < connPktcount[idx]){
+  if (connections->getPacketCount(idx) < connPktcount[idx]){
     MEDIUM_MSG("Connection packet count should be a counter, but has decreased in value");
-    connPktcount[idx] = connections.getPacketCount(idx);
+    connPktcount[idx] = connections->getPacketCount(idx);
   }
-  if (connections.getPacketLostCount(idx) < connPktloss[idx]){
+  if (connections->getPacketLostCount(idx) < connPktloss[idx]){
     MEDIUM_MSG("Connection packet loss count should be a counter, but has decreased in value");
-    connPktloss[idx] = connections.getPacketLostCount(idx);
+    connPktloss[idx] = connections->getPacketLostCount(idx);
   }
-  if (connections.getPacketRetransmitCount(idx) < connPktretrans[idx]){
+  if (connections->getPacketRetransmitCount(idx) < connPktretrans[idx]){
     MEDIUM_MSG("Connection packets retransmitted should be a counter, but has decreased in value");
-    connPktretrans[idx] = connections.getPacketRetransmitCount(idx);
+    connPktretrans[idx] = connections->getPacketRetransmitCount(idx);
   }
   // Add increase in stats to global stats
-  globalDown += connections.getDown(idx) - connDown[idx];
-  globalUp += connections.getUp(idx) - connUp[idx];
-  globalPktcount += connections.getPacketCount(idx) - connPktcount[idx];
-  globalPktloss += connections.getPacketLostCount(idx) - connPktloss[idx];
-  globalPktretrans += connections.getPacketRetransmitCount(idx) - connPktretrans[idx];
+  globalDown += connections->getDown(idx) - connDown[idx];
+  globalUp += connections->getUp(idx) - connUp[idx];
+  globalPktcount += connections->getPacketCount(idx) - connPktcount[idx];
+  globalPktloss += connections->getPacketLostCount(idx) - connPktloss[idx];
+  globalPktretrans += connections->getPacketRetransmitCount(idx) - connPktretrans[idx];
   // Set last values of this connection
   connTime[idx]++;
-  connDown[idx] = connections.getDown(idx);
-  connUp[idx] = connections.getUp(idx);
-  connPktcount[idx] = connections.getPacketCount(idx);
-  connPktloss[idx] = connections.getPacketLostCount(idx);
-  connPktretrans[idx] = connections.getPacketRetransmitCount(idx);
+  connDown[idx] = connections->getDown(idx);
+  connUp[idx] = connections->getUp(idx);
+  connPktcount[idx] = connections->getPacketCount(idx);
+  connPktloss[idx] = connections->getPacketLostCount(idx);
+  connPktretrans[idx] = connections->getPacketRetransmitCount(idx);
 }
 
 /// \brief Remove mappings of inactive connections
-void userOnDisconnect(Comms::Connections & connections, size_t idx){
+void Session::userOnDisconnect(size_t idx){
   connTime.erase(idx);
   connDown.erase(idx);
   connUp.erase(idx);
@@ -112,9 +356,433 @@ void userOnDisconnect(Comms::Connections & connections, size_t idx){
   connPktretrans.erase(idx);
 }
 
+/// Starts collecting the statistics of the connections in this session.
+void Session::beginUpdate(){
+  currentConnections = 0;
+  lastSecond = 0;
+  highestRtt = 0;
+  highestBufms = 0;
+  now = Util::bootSecs();
+}
+
+/// Collects the statistics of all connections on the own connections page of a stand-alone session
+/// and writes the summary to the stats page. The session host collects for hosted sessions.
+void Session::update(){
+  beginUpdate();
+  // Loop through all connection entries to get a summary of statistics
+  Comms::Connections &conns = *connections;
+  COMM_LOOP(conns, userOnActive(id), userOnDisconnect(id));
+  endUpdate();
+}
+
+/// Writes the summary of the collected connection statistics to the stats page.
+void Session::endUpdate(){
+  if (currentConnections){
+    globalTime++;
+    lastSeen = now;
+  }
+
+  stats->setTime(globalTime, statIdx);
+  stats->setDown(globalDown, statIdx);
+  stats->setUp(globalUp, statIdx);
+  stats->setPacketCount(globalPktcount, statIdx);
+  stats->setPacketLostCount(globalPktloss, statIdx);
+  stats->setPacketRetransmitCount(globalPktretrans, statIdx);
+  stats->setRoundTripTime(highestRtt, statIdx);
+  stats->setBufferFill(highestBufms, statIdx);
+  stats->setLastSecond(lastSecond, statIdx);
+  stats->setNow(now, statIdx);
+
+  if (currentConnections){
+    {
+      // Convert active protocols to string
+      std::stringstream connectorSummary;
+      for (std::map<std::string, uint64_t>::iterator it = connectorLastActive.begin();
+            it != connectorLastActive.end(); ++it){
+        if (now - it->second < STATS_DELAY){
+          connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
+        }
+      }
+      stats->setConnector(connectorSummary.str(), statIdx);
+    }
+
+    {
+      // Set active host to last active or 0 if there were various hosts active recently
+      std::string thisHost;
+      for (std::map<std::string, uint64_t>::iterator it = hostLastActive.begin();
+            it != hostLastActive.end(); ++it){
+        if (now - it->second < STATS_DELAY){
+          if (!thisHost.size()){
+            thisHost = it->first;
+          }else if (thisHost != it->first){
+            thisHost = nullAddress;
+            break;
+          }
+        }
+      }
+      if (!thisHost.size()){
+        thisHost = nullAddress;
+      }
+      stats->setHost(thisHost, statIdx);
+    }
+
+    {
+      // Set active stream name to last active or "" if there were multiple streams active recently
+      std::string thisStream = "";
+      for (std::map<std::string, uint64_t>::iterator it = streamLastActive.begin();
+            it != streamLastActive.end(); ++it){
+        if (now - it->second < STATS_DELAY){
+          if (!thisStream.size()){
+            thisStream = it->first;
+          }else if (thisStream != it->first){
+            thisStream = "";
+            break;
+          }
+        }
+      }
+      stats->setStream(thisStream, statIdx);
+    }
+  }
+}
+
+/// Returns true if a re-sync was requested and USER_NEW should run again.
+bool Session::retriggerNeeded(){
+  if (thisType || !forceTrigger){return false;}
+  forceTrigger = false;
+  return hasTrigger("USER_NEW", streamName);
+}
+
+/// Re-runs the USER_NEW trigger. Returns false if the session is no longer allowed.
+bool Session::retrigger(){
+  INFO_MSG("Triggering USER_NEW for stream %s", streamName.c_str());
+  std::string payload = streamName + "\n" + ipStr + "\n" + tkn + "\n" + protocol + "\n" + reqUrl + "\n" + sessId;
+  if (!runTrigger("USER_NEW", payload, streamName)){
+    INFO_MSG("USER_NEW rejected stream %s", streamName.c_str());
+    if (hosted){
+      rejected = true;
+    }else{
+      Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
+      connections->setExit();
+      connections->finishAll();
+    }
+    return false;
+  }
+  INFO_MSG("USER_NEW accepted stream %s", streamName.c_str());
+  return true;
+}
+
+/// Ends the session: removes the connections page and runs the USER_END trigger.
+/// Connections of a hosted session are told to go away through their status instead.
+/// Invalidated viewer sessions go to the sleeping state afterwards, others are done.
+void Session::finish(){
+  if (connections){
+    if (hosted){
+      shouldSleep = rejected;
+      // Rejected connections learn so through getExit(), the others are asked to disconnect
+      markConnections(rejected ? (COMM_STATUS_WAITING | COMM_STATUS_REQDISCONNECT) : COMM_STATUS_REQDISCONNECT);
+    }else{
+      shouldSleep = connections->getExit();
+      // Ensure the connections page is deleted before other cleanup happens
+      delete connections;
+    }
+    connections = 0;
+  }
+  if (!hosted && Util::bootSecs() - lastSeen > STATS_DELAY){
+    Util::logExitReason(ER_CLEAN_INACTIVE, "Session inactive for %d seconds", STATS_DELAY);
+  }
+
+  // Trigger USER_END
+  if (!thisType && hasTrigger("USER_END", streamName)){
+
+    // Convert connector, host and stream into lists and counts
+    std::stringstream connectorSummary;
+    std::stringstream connectorTimes;
+    for (std::map<std::string, uint64_t>::iterator it = connectorCount.begin(); it != connectorCount.end(); ++it){
+      connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
+      connectorTimes << (connectorTimes.str().size() ? "," : "") << it->second;
+    }
+    std::stringstream hostSummary;
+    std::stringstream hostTimes;
+    for (std::map<std::string, uint64_t>::iterator it = hostCount.begin(); it != hostCount.end(); ++it){
+      std::string host;
+      Socket::hostBytesToStr(it->first.data(), 16, host);
+      hostSummary << (hostSummary.str().size() ? "," : "") << host;
+      hostTimes << (hostTimes.str().size() ? "," : "") << it->second;
+    }
+    std::stringstream streamSummary;
+    std::stringstream streamTimes;
+    for (std::map<std::string, uint64_t>::iterator it = streamCount.begin(); it != streamCount.end(); ++it){
+      streamSummary << (streamSummary.str().size() ? "," : "") << it->first;
+      streamTimes << (streamTimes.str().size() ? "," : "") << it->second;
+    }
+
+    std::stringstream summary;
+    summary << tkn << "\n"
+          << streamSummary.str() << "\n"
+          << connectorSummary.str() << "\n"
+          << hostSummary.str() << "\n"
+          << globalTime << "\n"
+          << globalUp << "\n"
+          << globalDown << "\n"
+          << stats->getTags(statIdx) << "\n"
+          << hostTimes.str() << "\n"
+          << connectorTimes.str() << "\n"
+          << streamTimes.str() << "\n"
+          << sessId;
+    runTrigger("USER_END", summary.str(), streamName);
+  }
+
+  // Keep invalidated sessions around for a while, so they cannot simply reconnect
+  if (!thisType && shouldSleep){
+    state = SESSION_SLEEPING;
+    sleepStart = Util::bootSecs();
+    forceTrigger = false;
+  }else{
+    state = SESSION_DONE;
+  }
+}
+
+/// Gives up the record on the statistics page.
+void Session::release(){
+  if (stats && statIdx != INVALID_RECORD_INDEX){
+    stats->setStatus(COMM_STATUS_DISCONNECT | stats->getStatus(statIdx), statIdx);
+    statIdx = INVALID_RECORD_INDEX;
+  }
+}
+
+/// Sets the given status flags on all connections of this hosted session.
+void Session::markConnections(uint8_t flags){
+  for (size_t i = 0; i < connections->recordCount(); ++i){
+    uint8_t status = connections->getStatus(i);
+    if (status == COMM_STATUS_INVALID || (status & COMM_STATUS_DISCONNECT)){continue;}
+    if (connections->getSessId(i) == sessId){connections->setStatus(status | flags, i);}
+  }
+}
+
+static void userNewThread(void *arg){
+  Session *S = (Session *)arg;
+  S->userNew();
+  __sync_synchronize();
+  S->busy = false;
+}
+
+static void retriggerThread(void *arg){
+  Session *S = (Session *)arg;
+  S->retrigger();
+  __sync_synchronize();
+  S->busy = false;
+}
+
+/// Runs the given function for a session in a detached thread, so slow triggers don't hold up
+/// the other sessions. The triggers themselves still run one at a time, see runTrigger.
+static void runDetached(void (*func)(void *), Session *S){
+  S->busy = true;
+  __sync_synchronize();
+  tthread::thread T(func, S);
+  T.detach();
+}
+
+/// Admits or rejects the connections that wait for their hosted session, once USER_NEW decided.
+/// Connections of sessions the host does not run (yet) keep waiting for their session request.
+static void admitConnections(Comms::Connections *table, std::map<std::string, Session *> &sessions){
+  for (size_t s = 0; s < COMMS_SESSCONN_SHARDS; ++s){
+    Comms::Connections &conns = table[s];
+    for (size_t i = 0; i < conns.recordCount(); ++i){
+      uint8_t status = conns.getStatus(i);
+      if (!(status & COMM_STATUS_WAITING) || (status & (COMM_STATUS_REQDISCONNECT | COMM_STATUS_DISCONNECT))){continue;}
+      std::map<std::string, Session *>::iterator it = sessions.find(conns.getSessId(i));
+      if (it == sessions.end()){continue;}
+      Session *S = it->second;
+      if (S->state != Session::SESSION_RUNNING || !S->admitted){continue;}
+      if (S->rejected){
+        conns.setStatus(status | COMM_STATUS_REQDISCONNECT, i);
+      }else{
+        conns.setStatus(status & ~COMM_STATUS_WAITING, i);
+      }
+    }
+  }
+}
+
+/// Collects the statistics of all connections on the connection table into their sessions, and
+/// frees the records of connections that went away.
+static void collectConnections(Comms::Connections *table, std::map<std::string, Session *> &sessions){
+  for (std::map<std::string, Session *>::iterator it = sessions.begin(); it != sessions.end(); ++it){
+    if (it->second->state == Session::SESSION_RUNNING){it->second->beginUpdate();}
+  }
+  for (size_t s = 0; s < COMMS_SESSCONN_SHARDS; ++s){
+    Comms::Connections &conns = table[s];
+    for (size_t i = 0; i < conns.recordCount(); ++i){
+      uint8_t status = conns.getStatus(i);
+      if (status == COMM_STATUS_INVALID){continue;}
+      if (!(status & COMM_STATUS_DISCONNECT) && conns.getPid(i) && !Util::Procs::isRunning(conns.getPid(i))){
+        status |= COMM_STATUS_DISCONNECT;
+        conns.setStatus(status, i);
+      }
+      std::map<std::string, Session *>::iterator it = sessions.find(conns.getSessId(i));
+      Session *S = 0;
+      if (it != sessions.end() && it->second->state == Session::SESSION_RUNNING){S = it->second;}
+      if (S && !(status & COMM_STATUS_WAITING)){S->userOnActive(i);}
+      if (status & COMM_STATUS_DISCONNECT){
+        if (S){S->userOnDisconnect(i);}
+        conns.setStatus(COMM_STATUS_INVALID, i);
+      }
+    }
+  }
+}
+
+/// Handles all sessions requested through the session request page in this single process.
+/// The connections of all sessions are kept on one connection table, sharded over
+/// COMMS_SESSCONN_SHARDS pages by session ID, so no session needs a page or semaphore of its own.
+int SessionHost(Util::Config &config){
+  // Opening the request page as master would take it over, so check for a running host first
+  pid_t otherHost = Comms::SessionRequests::hostPid();
+  if (otherHost > 1 && otherHost != getpid() && Util::Procs::isRunning(otherHost)){
+    INFO_MSG("Session host already running as PID %d", (int)otherHost);
+    return 0;
+  }
+  {
+    // A page left behind with the exit flag set would never accept requests again
+    IPC::sharedPage stalePage(COMMS_SESSREQ, 0, false, false);
+    if (stalePage.mapped && Util::RelAccX(stalePage.mapped, false).isExit()){stalePage.master = true;}
+  }
+  Comms::SessionRequests requests;
+  requests.reload(true);
+  if (!requests){
+    FAIL_MSG("Could not create session request page");
+    return 1;
+  }
+  // Clear records left behind by a previous host, then mark our own record
+  for (size_t i = 0; i < requests.recordCount(); ++i){
+    if (requests.getStatus(i) & COMM_STATUS_SOURCE){requests.setStatus(COMM_STATUS_INVALID, i);}
+  }
+  // The connection table must exist before outputs see the host as active
+  Comms::Connections table[COMMS_SESSCONN_SHARDS];
+  for (size_t i = 0; i < COMMS_SESSCONN_SHARDS; ++i){
+    table[i].reloadShard(i, true);
+    if (!table[i]){
+      FAIL_MSG("Could not create session connection table");
+      return 1;
+    }
+  }
+  size_t hostIdx = requests.claimRecord(COMM_STATUS_SOURCE);
+  if (hostIdx == INVALID_RECORD_INDEX){
+    FAIL_MSG("Could not register on session request page");
+    return 1;
+  }
+  Comms::Sessions stats;
+  while (config.is_active){
+    stats.borrow();
+    if (stats){break;}
+    Util::sleep(500);
+  }
+  INFO_MSG("Session host started");
+
+  std::map<std::string, Session *> sessions;
+  uint64_t lastTick = 0;
+  while (config.is_active){
+    // Start any newly requested sessions
+    for (size_t i = 0; i < requests.recordCount(); ++i){
+      if (requests.getStatus(i) == COMM_STATUS_INVALID || i == hostIdx){continue;}
+      std::string sessId = requests.getSessId(i);
+      if (!sessId.size()){
+        // Still being filled in, unless the requesting process has gone away
+        if (!Util::Procs::isRunning(requests.getPid(i))){requests.setStatus(COMM_STATUS_INVALID, i);}
+        continue;
+      }
+      std::map<std::string, Session *>::iterator prev = sessions.find(sessId);
+      if (prev != sessions.end() && !prev->second->busy){
+        // An inactive session is ended now rather than on the next update, so it can be replaced
+        if (prev->second->state == Session::SESSION_RUNNING && !prev->second->active()){prev->second->finish();}
+        if (prev->second->state != Session::SESSION_RUNNING){
+          // Sleeping or finished sessions no longer admit connections; start over with a fresh
+          // session, as a new stand-alone session process would.
+          INFO_MSG("Restarting session %s", sessId.c_str());
+          delete prev->second;
+          sessions.erase(prev);
+          prev = sessions.end();
+        }
+      }
+      if (prev != sessions.end()){
+        // Still running or starting up: the requester is admitted once the session allows it
+        requests.setStatus(COMM_STATUS_INVALID, i);
+        continue;
+      }
+      Session *S = new Session(sessId, requests.getStream(i), requests.getHost(i), requests.getTkn(i),
+                               requests.getProtocol(i), requests.getReqUrl(i), true);
+      requests.setStatus(COMM_STATUS_INVALID, i);
+      if (S->start(stats, &table[Comms::Connections::sessionShard(sessId)])){
+        delete S;
+        continue;
+      }
+      sessions[sessId] = S;
+      if (S->needsUserNew()){
+        runDetached(userNewThread, S);
+      }else{
+        S->userNew();
+      }
+    }
+
+    admitConnections(table, sessions);
+
+    // Once per second, update all sessions
+    uint64_t nowMs = Util::bootMS();
+    if (nowMs - lastTick >= 1000){
+      lastTick = nowMs;
+      uint64_t nowSecs = Util::bootSecs();
+      collectConnections(table, sessions);
+      std::map<std::string, Session *>::iterator it = sessions.begin();
+      while (it != sessions.end()){
+        Session *S = it->second;
+        if (S->busy){
+          ++it;
+          continue;
+        }
+        S->checkControl();
+        if (S->state == Session::SESSION_RUNNING){
+          if (S->active()){
+            S->endUpdate();
+            if (S->retriggerNeeded()){runDetached(retriggerThread, S);}
+          }else{
+            S->finish();
+          }
+        }
+        if (S->state == Session::SESSION_SLEEPING &&
+            (nowSecs - S->sleepStart >= SESS_TIMEOUT || S->forceTrigger)){
+          S->state = Session::SESSION_DONE;
+        }
+        if (S->state == Session::SESSION_DONE){
+          INFO_MSG("Shutting down session %s", S->sessId.c_str());
+          delete S;
+          sessions.erase(it++);
+          continue;
+        }
+        ++it;
+      }
+    }
+    Util::sleep(50);
+  }
+
+  // No longer accept requests, then end all sessions
+  requests.setExit();
+  for (size_t i = 0; i < requests.recordCount(); ++i){requests.setStatus(COMM_STATUS_INVALID, i);}
+  for (size_t wait = 0; wait < 100; ++wait){
+    bool anyBusy = false;
+    for (std::map<std::string, Session *>::iterator it = sessions.begin(); it != sessions.end(); ++it){
+      if (it->second->busy){anyBusy = true;}
+    }
+    if (!anyBusy){break;}
+    Util::sleep(100);
+  }
+  for (std::map<std::string, Session *>::iterator it = sessions.begin(); it != sessions.end(); ++it){
+    if (it->second->busy){continue;}// Leaked on purpose; its trigger thread may still use it
+    if (it->second->state == Session::SESSION_RUNNING){it->second->finish();}
+    delete it->second;
+  }
+  INFO_MSG("Session host shutting down: %s", Util::exitReason);
+  return 0;
+}
+
 int SessionMain(int argc, char **argv){
-  Comms::Sessions sessions;
-  uint64_t lastSeen = Util::bootSecs();
   Util::redirectLogsIfNeeded();
   signal(SIGUSR1, handleSignal);
   // Init config and parse arguments
@@ -125,9 +793,17 @@ int SessionMain(int argc, char **argv){
   option.null();
   option["arg_num"] = 1;
   option["arg"] = "string";
-  option["help"] = "Session identifier of the entire session";
+  option["help"] = "Session identifier of the entire session. Required unless running as session host";
+  option["value"].append("");
   config.addOption("sessionid", option);
 
+  option.null();
+  option["long"] = "host";
+  option["short"] = "H";
+  option["help"] = "Run as session host, handling all requested sessions in this process";
+  option["value"].append(0);
+  config.addOption("host", option);
+
   option.null();
   option["long"] = "streamname";
   option["short"] = "s";
@@ -180,253 +856,45 @@ int SessionMain(int argc, char **argv){
     return 1;
   }
 
-  const uint64_t bootTime = Util::getMicros();
-  // Get session ID, session mode and other variables used as payload for the USER_NEW and USER_END triggers
-  const std::string thisStreamName = config.getString("streamname");
-  const std::string thisToken = config.getString("tkn");
-  const std::string thisProtocol = config.getString("protocol");
-  const std::string thisReqUrl = config.getString("requrl");
-  const std::string thisSessionId = config.getString("sessionid");
-  std::string thisHost = Socket::getBinForms(config.getString("ip"));
-  if (thisHost.size() > 16){thisHost = thisHost.substr(0, 16);}
-
-  std::string ipHex;
-  Socket::hostBytesToStr(thisHost.c_str(), thisHost.size(), ipHex);
-  VERYHIGH_MSG("Starting a new session. Passed variables are stream name '%s', session token '%s', protocol '%s', requested URL '%s', IP '%s' and session id '%s'",
-  thisStreamName.c_str(), thisToken.c_str(), thisProtocol.c_str(), thisReqUrl.c_str(), ipHex.c_str(), thisSessionId.c_str());
-
-  // Try to lock to ensure we are the only process initialising this session
-  IPC::semaphore sessionLock;
-  char semName[NAME_BUFFER_SIZE];
-  snprintf(semName, NAME_BUFFER_SIZE, SEM_SESSION, thisSessionId.c_str());
-  sessionLock.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
-  // If the lock fails, the previous Session process must've failed in spectacular fashion
-  // It's the Controller's task to clean everything up. When the lock fails, this cleanup hasn't happened yet
-  if (!sessionLock.tryWaitOneSecond()){
-    FAIL_MSG("Session '%s' already locked", thisSessionId.c_str());
-    return 1;
-  }
-
-  // Check if a page already exists for this session ID. If so, quit
-  {
-    IPC::sharedPage dataPage;
-    char userPageName[NAME_BUFFER_SIZE];
-    snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, thisSessionId.c_str());
-    dataPage.init(userPageName, 0, false, false);
-    if (dataPage){
-      INFO_MSG("Session '%s' already has a running process", thisSessionId.c_str());
-      sessionLock.post();
-      return 0;
-    }
-  }
-
-  // Claim a spot in shared memory for this session on the global statistics page
-  sessions.reload();
-  if (!sessions){
-    FAIL_MSG("Unable to register entry for session '%s' on the stats page", thisSessionId.c_str());
-    sessionLock.post();
+  if (config.getBool("host")){return SessionHost(config);}
+  if (!config.getString("sessionid").size()){
+    config.printHelp(std::cout);
+    FAIL_MSG("Cannot start a new session without a session identifier");
     return 1;
   }
 
-  // Initialise global session data
-  sessions.setHost(thisHost);
-  sessions.setSessId(thisSessionId);
-  sessions.setStream(thisStreamName);
-  if (thisProtocol.size() && thisProtocol != "HTTP"){connectorLastActive[thisProtocol] = now;}
-  if (thisStreamName.size()){streamLastActive[thisStreamName] = now;}
-  if (memcmp(thisHost.data(), nullAddress, 16)){hostLastActive[thisHost] = now;}
-
-  // Determine session type, since triggers only get run for viewer type sessions
-  if (thisSessionId[0] == 'I'){
-    thisType = 1;
-  } else if (thisSessionId[0] == 'O'){
-    thisType = 2;
-  } else if (thisSessionId[0] == 'U'){
-    thisType = 3;
-  }
-  bool shouldSleep = false;
-
-  //Scope to ensure the connections page is deleted before other cleanup happens
-  {
-    // Open the shared memory page containing statistics for each individual connection in this session
-    Comms::Connections connections;
-    connections.reload(thisSessionId, true);
-
-    // Do a USER_NEW trigger if it is defined for this stream
-    if (!thisType && Triggers::shouldTrigger("USER_NEW", thisStreamName)){
-      std::string payload = thisStreamName + "\n" + config.getString("ip") + "\n" +
-                            thisToken + "\n" + thisProtocol +
-                            "\n" + thisReqUrl + "\n" + thisSessionId;
-      if (!Triggers::doTrigger("USER_NEW", payload, thisStreamName)){
-        // Mark all connections of this session as finished, since this viewer is not allowed to view this stream
-        Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
-        connections.setExit();
-        connections.finishAll();
-      }
-    }
-
-    //start allowing viewers
-    sessionLock.post();
-
-    INFO_MSG("Started new session %s in %.3f ms", thisSessionId.c_str(), (double)Util::getMicros(bootTime)/1000.0);
-
-    // Stay active until Mist exits or we no longer have an active connection
-    while (config.is_active && (currentConnections || now - lastSeen <= STATS_DELAY) && !connections.getExit()){
-      currentConnections = 0;
-      lastSecond = 0;
-      now = Util::bootSecs();
-
-      // Loop through all connection entries to get a summary of statistics
-      COMM_LOOP(connections, userOnActive(connections, id), userOnDisconnect(connections, id));
-      if (currentConnections){
-        globalTime++;
-        lastSeen = now;
-      }
-
-
-      sessions.setTime(globalTime);
-      sessions.setDown(globalDown);
-      sessions.setUp(globalUp);
-      sessions.setPacketCount(globalPktcount);
-      sessions.setPacketLostCount(globalPktloss);
-      sessions.setPacketRetransmitCount(globalPktretrans);
-      sessions.setLastSecond(lastSecond);
-      sessions.setNow(now);
-
-      if (currentConnections){
-        {
-          // Convert active protocols to string
-          std::stringstream connectorSummary;
-          for (std::map<std::string, uint64_t>::iterator it = connectorLastActive.begin();
-                it != connectorLastActive.end(); ++it){
-            if (now - it->second < STATS_DELAY){
-              connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
-            }
-          }
-          sessions.setConnector(connectorSummary.str());
-        }
-
-        {
-          // Set active host to last active or 0 if there were various hosts active recently
-          std::string thisHost;
-          for (std::map<std::string, uint64_t>::iterator it = hostLastActive.begin();
-                it != hostLastActive.end(); ++it){
-            if (now - it->second < STATS_DELAY){
-              if (!thisHost.size()){
-                thisHost = it->first;
-              }else if (thisHost != it->first){
-                thisHost = nullAddress;
-                break;
-              }
-            }
-          }
-          if (!thisHost.size()){
-            thisHost = nullAddress;
-          }
-          sessions.setHost(thisHost);
-        }
-
-        {
-          // Set active stream name to last active or "" if there were multiple streams active recently
-          std::string thisStream = "";
-          for (std::map<std::string, uint64_t>::iterator it = streamLastActive.begin();
-                it != streamLastActive.end(); ++it){
-            if (now - it->second < STATS_DELAY){
-              if (!thisStream.size()){
-                thisStream = it->first;
-              }else if (thisStream != it->first){
-                thisStream = "";
-                break;
-              }
-            }
-          }
-          sessions.setStream(thisStream);
-        }
-      }
-
-      // Retrigger USER_NEW if a re-sync was requested
-      if (!thisType && forceTrigger){
-        forceTrigger = false;
-        std::string host;
-        Socket::hostBytesToStr(thisHost.data(), 16, host);
-        if (Triggers::shouldTrigger("USER_NEW", thisStreamName)){
-          INFO_MSG("Triggering USER_NEW for stream %s", thisStreamName.c_str());
-          std::string payload = thisStreamName + "\n" + host + "\n" +
-                                thisToken + "\n" + thisProtocol +
-                                "\n" + thisReqUrl + "\n" + thisSessionId;
-          if (!Triggers::doTrigger("USER_NEW", payload, thisStreamName)){
-            INFO_MSG("USER_NEW rejected stream %s", thisStreamName.c_str());
-            Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
-            connections.setExit();
-            connections.finishAll();
-            break;
-          }else{
-            INFO_MSG("USER_NEW accepted stream %s", thisStreamName.c_str());
-          }
-        }
-      }
-
-      // Remember latest activity so we know when this session ends
-      if (currentConnections){
-      }
-      Util::wait(1000);
-    }
-    shouldSleep = connections.getExit();
-  }//connections scope end
-  if (Util::bootSecs() - lastSeen > STATS_DELAY){
-    Util::logExitReason(ER_CLEAN_INACTIVE, "Session inactive for %d seconds", STATS_DELAY);
-  }
-
-  // Trigger USER_END
-  if (!thisType && Triggers::shouldTrigger("USER_END", thisStreamName)){
-
-    // Convert connector, host and stream into lists and counts
-    std::stringstream connectorSummary;
-    std::stringstream connectorTimes;
-    for (std::map<std::string, uint64_t>::iterator it = connectorCount.begin(); it != connectorCount.end(); ++it){
-      connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
-      connectorTimes << (connectorTimes.str().size() ? "," : "") << it->second;
-    }
-    std::stringstream hostSummary;
-    std::stringstream hostTimes;
-    for (std::map<std::string, uint64_t>::iterator it = hostCount.begin(); it != hostCount.end(); ++it){
-      std::string host;
-      Socket::hostBytesToStr(it->first.data(), 16, host);
-      hostSummary << (hostSummary.str().size() ? "," : "") << host;
-      hostTimes << (hostTimes.str().size() ? "," : "") << it->second;
-    }
-    std::stringstream streamSummary;
-    std::stringstream streamTimes;
-    for (std::map<std::string, uint64_t>::iterator it = streamCount.begin(); it != streamCount.end(); ++it){
-      streamSummary << (streamSummary.str().size() ? "," : "") << it->first;
-      streamTimes << (streamTimes.str().size() ? "," : "") << it->second;
+  // Get session ID, session mode and other variables used as payload for the USER_NEW and USER_END triggers
+  std::string thisHost = Socket::getBinForms(config.getString("ip"));
+  Comms::Sessions sessions;
+  sessions.borrow();
+  Session S(config.getString("sessionid"), config.getString("streamname"), thisHost,
+            config.getString("tkn"), config.getString("protocol"), config.getString("requrl"), false);
+  int ret = S.start(sessions);
+  if (ret){return (ret == 2) ? 0 : 1;}
+  S.userNew();
+
+  // Stay active until Mist exits or we no longer have an active connection
+  while (config.is_active && S.active()){
+    if (forceTrigger){
+      forceTrigger = false;
+      S.forceTrigger = true;
     }
-
-    std::stringstream summary;
-    summary << thisToken << "\n"
-          << streamSummary.str() << "\n"
-          << connectorSummary.str() << "\n"
-          << hostSummary.str() << "\n"
-          << globalTime << "\n"
-          << globalUp << "\n"
-          << globalDown << "\n"
-          << sessions.getTags() << "\n"
-          << hostTimes.str() << "\n"
-          << connectorTimes.str() << "\n"
-          << streamTimes.str() << "\n"
-          << thisSessionId;
-    Triggers::doTrigger("USER_END", summary.str(), thisStreamName);
+    S.update();
+    // Retrigger USER_NEW if a re-sync was requested
+    if (S.retriggerNeeded() && !S.retrigger()){break;}
+    Util::wait(1000);
   }
+  S.finish();
 
-  if (!thisType && shouldSleep){
-    uint64_t sleepStart = Util::bootSecs();
+  if (S.state == Session::SESSION_SLEEPING){
+    forceTrigger = false;
     // Keep session invalidated for 10 minutes, or until the session stops
-    while (config.is_active && Util::bootSecs() - sleepStart < SESS_TIMEOUT){
+    while (config.is_active && Util::bootSecs() - S.sleepStart < SESS_TIMEOUT){
       Util::sleep(1000);
       if (forceTrigger){break;}
     }
   }
-  INFO_MSG("Shutting down session %s: %s", thisSessionId.c_str(), Util::exitReason);
+  INFO_MSG("Shutting down session %s: %s", S.sessId.c_str(), Util::exitReason);
   return 0;
 }
 
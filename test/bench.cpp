@@ -0,0 +1,491 @@
+/// \file bench.cpp
+/// Throughput benchmark for the container (de)muxing and packetization paths used by the inputs and outputs.
+/// Every output path writes into a Socket::Connection backed by /dev/null, every input path parses a
+/// fixture generated in memory by the matching output path. For each path the throughput, the heap
+/// allocations per packet and the system calls per packet are reported.
+/// Allocation and system call counts (and the amount of bytes written per packet) do not depend on the
+/// machine the benchmark runs on, so they are compared against a stored baseline. Throughput numbers are
+/// printed relative to the baseline, but never cause a failure.
+///
+/// Usage: mist_bench [-s seconds] [-b baseline.json] [-w results.json]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mist/bitfields.h>
+#include <mist/cmaf.h>
+#include <mist/dtsc.h>
+#include <mist/ebml_socketglue.h>
+#include <mist/flv_tag.h>
+#include <mist/json.h>
+#include <mist/mp4_generic.h>
+#include <mist/rtmpchunks.h>
+#include <mist/rtp.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <mist/ts_muxer.h>
+#include <mist/ts_packet.h>
+#include <mist/ts_stream.h>
+#include <new>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+static uint64_t allocations = 0;
+
+void *operator new(size_t size) throw(std::bad_alloc){
+  __sync_fetch_and_add(&allocations, 1);
+  void *p = malloc(size ? size : 1);
+  if (!p){throw std::bad_alloc();}
+  return p;
+}
+void *operator new[](size_t size) throw(std::bad_alloc){
+  __sync_fetch_and_add(&allocations, 1);
+  void *p = malloc(size ? size : 1);
+  if (!p){throw std::bad_alloc();}
+  return p;
+}
+void operator delete(void *p) throw(){free(p);}
+void operator delete[](void *p) throw(){free(p);}
+
+/// Returns the amount of read and write system calls done by this process so far, or 0 if unknown.
+/// Reading the counters costs system calls of its own, which the caller compensates for.
+static uint64_t syscalls(){
+  int fd = open("/proc/self/io", O_RDONLY);
+  if (fd == -1){return 0;}
+  char buf[512];
+  ssize_t r = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (r <= 0){return 0;}
+  buf[r] = 0;
+  uint64_t ret = 0;
+  const char *p = strstr(buf, "syscr: ");
+  if (p){ret += strtoull(p + 7, 0, 10);}
+  p = strstr(buf, "syscw: ");
+  if (p){ret += strtoull(p + 7, 0, 10);}
+  return ret;
+}
+
+/// Synthetic 25fps H264 + 48kHz AAC stream, used as input for all output paths
+static DTSC::Meta M;
+static size_t vidTrack, audTrack;
+static std::vector<DTSC::Packet> packets;
+
+/// Sink for all output paths
+static Socket::Connection sink;
+/// Fixtures for the input paths, as written by the output paths
+static std::string tsFixture, flvFixture, rtmpFixture, ebmlFixture;
+/// Fixture currently being recorded, if any
+static std::string *recording = 0;
+
+static void send(const char *data, size_t len){
+  if (recording){
+    recording->append(data, len);
+    return;
+  }
+  sink.SendNow(data, len);
+}
+static void send(const std::string &data){send(data.data(), data.size());}
+
+static void makeStream(uint64_t seconds){
+  M.reInit("", true);
+  vidTrack = M.addTrack();
+  M.setType(vidTrack, "video");
+  M.setCodec(vidTrack, "H264");
+  M.setID(vidTrack, 1);
+  M.setWidth(vidTrack, 1280);
+  M.setHeight(vidTrack, 720);
+  M.setFpks(vidTrack, 25000);
+  M.setInit(vidTrack, std::string("\001\144\000\037\377\341\000\032\147\144\000\037\254\331\100\120\005\273\001\020\000"
+                                  "\000\003\000\020\000\000\003\003\300\361\203\031\140\001\000\006\150\353\343\313\042\300",
+                                  42));
+  audTrack = M.addTrack();
+  M.setType(audTrack, "audio");
+  M.setCodec(audTrack, "AAC");
+  M.setID(audTrack, 2);
+  M.setRate(audTrack, 48000);
+  M.setChannels(audTrack, 2);
+  M.setSize(audTrack, 16);
+  M.setInit(audTrack, std::string("\021\220", 2));
+
+  // Deterministic pseudo-random payloads, so all runs produce identical output
+  uint32_t seed = 12345;
+  std::string data;
+  uint64_t vidFrames = seconds * 25;
+  uint64_t audFrames = seconds * 48000 / 1024;
+  uint64_t v = 0, a = 0, bpos = 0;
+  while (v < vidFrames || a < audFrames){
+    uint64_t vTime = v * 40;
+    uint64_t aTime = a * 1024 * 1000 / 48000;
+    bool isVideo = v < vidFrames && (a >= audFrames || vTime <= aTime);
+    bool key = isVideo && !(v % 50);
+    size_t len = isVideo ? (key ? 60000 : 4000 + seed % 16000) : 300 + seed % 200;
+    seed = seed * 1103515245 + 12345;
+    data.assign(len, 0);
+    for (size_t i = 0; i < len; ++i){data[i] = (char)((seed >> 16) + i);}
+    if (isVideo){
+      // One slice NAL unit, length-prefixed as in all DTSC video data
+      Bit::htobl((char *)data.data(), len - 4);
+      data[4] = key ? 0x65 : 0x41;
+      // Keep the slice free of start code emulation, so the TS demuxer finds the same units back
+      for (size_t i = 5; i < len; ++i){
+        if (!data[i]){data[i] = 1;}
+      }
+    }
+    size_t idx = isVideo ? vidTrack : audTrack;
+    uint64_t time = isVideo ? vTime : aTime;
+    packets.push_back(DTSC::Packet());
+    packets.back().genericFill(time, 0, idx, data.data(), len, bpos, key);
+    M.update(time, 0, idx, len, bpos, key || !isVideo);
+    bpos += len;
+    if (isVideo){
+      ++v;
+    }else{
+      ++a;
+    }
+  }
+}
+
+// Output paths. Each returns the amount of packets it handled.
+
+/// Muxes through the same code as the TS outputs, listing both tracks in the PMT
+class BenchMuxer : public TS::Muxer{
+public:
+  void sendTS(const char *tsData, size_t len = 188){send(tsData, len);}
+
+protected:
+  void getHeaderInfo(std::set<size_t> &tracks, std::string &serviceName){
+    tracks.insert(vidTrack);
+    tracks.insert(audTrack);
+  }
+};
+
+static size_t tsMux(){
+  BenchMuxer mux;
+  for (size_t p = 0; p < packets.size(); ++p){mux.muxPacket(M, packets[p].getTrackId(), packets[p]);}
+  return packets.size();
+}
+
+static size_t flvMux(){
+  FLV::Tag tag;
+  if (tag.DTSCVideoInit(M, vidTrack)){send(tag.data, tag.len);}
+  if (tag.DTSCAudioInit(M.getCodec(audTrack), M.getRate(audTrack), M.getSize(audTrack), M.getChannels(audTrack),
+                        M.getInit(audTrack))){
+    send(tag.data, tag.len);
+  }
+  for (size_t p = 0; p < packets.size(); ++p){
+    tag.DTSCLoader(packets[p], M, packets[p].getTrackId());
+    send(tag.data, tag.len);
+  }
+  return packets.size();
+}
+
+static size_t rtmpMux(){
+  RTMPStream::chunk_snd_max = 65536;
+  RTMPStream::lastsend.clear();
+  FLV::Tag tag;
+  for (size_t p = 0; p < packets.size(); ++p){
+    tag.DTSCLoader(packets[p], M, packets[p].getTrackId());
+    send(RTMPStream::SendMedia(tag));
+  }
+  return packets.size();
+}
+
+static size_t ebmlMux(){
+  Socket::Connection &C = sink;
+  std::string::size_type start = recording ? recording->size() : 0;
+  // The EBML helpers write to a connection directly; fixtures are captured through a temporary file
+  FILE *tmp = 0;
+  Socket::Connection fileConn;
+  if (recording){
+    tmp = tmpfile();
+    fileConn.open(fileno(tmp), -1);
+  }
+  Socket::Connection &out = recording ? fileConn : C;
+  EBML::sendElemEBML(out, "matroska");
+  EBML::sendElemHead(out, EBML::EID_SEGMENT, 0xFFFFFFFFFFFFFFull);
+  uint64_t clusterTime = 0;
+  for (size_t p = 0; p < packets.size(); ++p){
+    DTSC::Packet &pkt = packets[p];
+    if (pkt.getTrackId() == vidTrack && pkt.getFlag("keyframe")){
+      // Clusters start at each keyframe, sized up to the next one
+      clusterTime = pkt.getTime();
+      uint64_t clusterSize = EBML::sizeElemUInt(EBML::EID_TIMECODE, clusterTime);
+      for (size_t q = p; q < packets.size(); ++q){
+        if (q > p && packets[q].getTrackId() == vidTrack && packets[q].getFlag("keyframe")){break;}
+        char *d;
+        size_t l;
+        packets[q].getString("data", d, l);
+        clusterSize += EBML::sizeSimpleBlock(packets[q].getTrackId(), l);
+      }
+      EBML::sendElemHead(out, EBML::EID_CLUSTER, clusterSize);
+      EBML::sendElemUInt(out, EBML::EID_TIMECODE, clusterTime);
+    }
+    EBML::sendSimpleBlock(out, pkt, clusterTime);
+  }
+  if (recording){
+    fflush(tmp);
+    size_t len = ftell(tmp);
+    rewind(tmp);
+    recording->resize(start + len);
+    if (fread((char *)recording->data() + start, 1, len, tmp) != len){recording->resize(start);}
+    fileConn.close();
+  }
+  return packets.size();
+}
+
+/// Sends a fragment per video keyframe interval and track, as the CMAF-based outputs do
+static size_t cmafMux(){
+  size_t count = 0;
+  uint64_t segNum = 0;
+  DTSC::Keys keys(M.keys(vidTrack));
+  for (size_t k = keys.getFirstValid(); k < keys.getEndValid(); ++k){
+    uint64_t start = keys.getTime(k);
+    uint64_t end = (k + 1 < keys.getEndValid()) ? keys.getTime(k + 1) : M.getLastms(vidTrack) + 1;
+    size_t trks[2] = {vidTrack, audTrack};
+    for (size_t t = 0; t < 2; ++t){
+      send(CMAF::keyHeader(M, trks[t], start, end, ++segNum));
+      char mdatHead[8] = {0, 0, 0, 0, 'm', 'd', 'a', 't'};
+      Bit::htobl(mdatHead, 8 + CMAF::payloadSize(M, trks[t], start, end));
+      send(mdatHead, 8);
+      for (size_t p = 0; p < packets.size(); ++p){
+        DTSC::Packet &pkt = packets[p];
+        if (pkt.getTrackId() != trks[t] || pkt.getTime() < start || pkt.getTime() >= end){continue;}
+        char *d;
+        size_t l;
+        pkt.getString("data", d, l);
+        send(d, l);
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+static void rtpCallback(void *, const char *data, size_t len, uint8_t){send(data, len);}
+
+/// Packetizes all packets into RTP packets of WebRTC size
+static size_t rtpPacketize(){
+  RTP::MAX_SEND = 1350 - 28;
+  RTP::Packet vid(96, 1, 0, 0x1234), aud(97, 1, 0, 0x5678);
+  for (size_t p = 0; p < packets.size(); ++p){
+    DTSC::Packet &pkt = packets[p];
+    char *d;
+    size_t l;
+    pkt.getString("data", d, l);
+    bool video = (pkt.getTrackId() == vidTrack);
+    RTP::Packet &r = video ? vid : aud;
+    r.setTimestamp(pkt.getTime() * (video ? 90 : 48));
+    r.sendData(0, rtpCallback, d, l, 0, M.getCodec(pkt.getTrackId()));
+  }
+  return packets.size();
+}
+
+// Input paths. Each returns the amount of packets it extracted.
+
+static size_t tsDemux(){
+  TS::Stream tsStream;
+  DTSC::Packet pkt;
+  size_t count = 0;
+  for (size_t i = 0; i + 188 <= tsFixture.size(); i += 188){
+    tsStream.parse((char *)tsFixture.data() + i, i);
+    while (tsStream.hasPacket()){
+      tsStream.getEarliestPacket(pkt);
+      if (pkt){++count;}
+    }
+  }
+  tsStream.finish();
+  while (tsStream.hasPacket()){
+    tsStream.getEarliestPacket(pkt);
+    if (pkt){++count;}
+  }
+  return count;
+}
+
+static size_t flvDemux(){
+  FLV::Tag tag;
+  DTSC::Packet pkt;
+  unsigned int pos = 0;
+  size_t count = 0;
+  while (pos < flvFixture.size()){
+    // Tag headers and bodies are read by separate calls
+    unsigned int prevPos = pos;
+    if (!tag.MemLoader(flvFixture.data(), flvFixture.size(), pos)){
+      if (pos == prevPos){break;}
+      continue;
+    }
+    if (tag.getDataLen() < 2){continue;}
+    // Skip the codec headers sent up front
+    if (tag.data[0] == 0x09 && tag.data[12] == 0x00){continue;}
+    if (tag.data[0] == 0x08 && tag.data[12] == 0x00){continue;}
+    pkt.genericFill(tag.tagTime(), 0, tag.data[0] == 0x09 ? vidTrack : audTrack, tag.getData(), tag.getDataLen(), pos, tag.isKeyframe);
+    ++count;
+  }
+  return count;
+}
+
+static size_t rtmpDemux(){
+  RTMPStream::chunk_rec_max = 65536;
+  RTMPStream::lastrecv.clear();
+  Socket::Buffer buf;
+  RTMPStream::Chunk chunk;
+  DTSC::Packet pkt;
+  size_t count = 0;
+  // Fed in parts, as received from a socket
+  for (size_t i = 0; i < rtmpFixture.size(); i += 16384){
+    buf.append(rtmpFixture.data() + i, std::min((size_t)16384, rtmpFixture.size() - i));
+    while (chunk.Parse(buf)){
+      if (chunk.msg_type_id != 8 && chunk.msg_type_id != 9){continue;}
+      pkt.genericFill(chunk.timestamp, 0, chunk.msg_type_id == 9 ? vidTrack : audTrack, chunk.data.data(),
+                      chunk.data.size(), 0, chunk.msg_type_id == 9 && (chunk.data[0] & 0xF0) == 0x10);
+      ++count;
+    }
+  }
+  return count;
+}
+
+static size_t ebmlDemux(){
+  DTSC::Packet pkt;
+  size_t count = 0;
+  uint64_t pos = 0;
+  uint64_t clusterTime = 0;
+  while (pos < ebmlFixture.size()){
+    const char *p = ebmlFixture.data() + pos;
+    if (EBML::Element::needBytes(p, ebmlFixture.size() - pos) > ebmlFixture.size() - pos){break;}
+    EBML::Element E(p);
+    switch (E.getID()){
+    case EBML::EID_SEGMENT:
+    case EBML::EID_CLUSTER: pos += E.getHeaderLen(); continue;
+    case EBML::EID_TIMECODE: clusterTime = E.getValUInt(); break;
+    case EBML::EID_SIMPLEBLOCK:{
+      EBML::Block B(p);
+      size_t trk = B.getTrackNum() == vidTrack ? vidTrack : audTrack;
+      for (uint8_t f = 0; f < B.getFrameCount(); ++f){
+        pkt.genericFill(clusterTime + B.getTimecode(), 0, trk, B.getFrameData(f), B.getFrameSize(f), pos, B.isKeyframe());
+        ++count;
+      }
+    }break;
+    default: break;
+    }
+    pos += E.getOuterLen();
+  }
+  return count;
+}
+
+struct bench{
+  const char *name;
+  size_t (*func)();
+  std::string *fixture; ///< Fixture this path generates (output paths) or parses (input paths), if any
+  bool input;
+};
+
+static bench benches[] ={
+    {"ts_mux", tsMux, &tsFixture, false},
+    {"flv_mux", flvMux, &flvFixture, false},
+    {"rtmp_mux", rtmpMux, &rtmpFixture, false},
+    {"ebml_mux", ebmlMux, &ebmlFixture, false},
+    {"cmaf_mux", cmafMux, 0, false},
+    {"webrtc_rtp", rtpPacketize, 0, false},
+    {"ts_demux", tsDemux, &tsFixture, true},
+    {"flv_demux", flvDemux, &flvFixture, true},
+    {"rtmp_demux", rtmpDemux, &rtmpFixture, true},
+    {"ebml_demux", ebmlDemux, &ebmlFixture, true},
+};
+static const size_t benchCount = sizeof(benches) / sizeof(benches[0]);
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = 0;
+  uint64_t seconds = 60;
+  std::string baseFile, writeFile;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:b:w:")) != -1){
+    switch (opt){
+    case 's': seconds = atoi(optarg); break;
+    case 'b': baseFile = optarg; break;
+    case 'w': writeFile = optarg; break;
+    default: std::cerr << "Usage: " << argv[0] << " [-s seconds] [-b baseline.json] [-w results.json]" << std::endl; return 2;
+    }
+  }
+
+  makeStream(seconds);
+  sink.open(open("/dev/null", O_WRONLY), -1);
+  sink.setBlocking(true);
+
+  // Record the fixtures for the input paths first
+  for (size_t i = 0; i < benchCount; ++i){
+    if (!benches[i].fixture || benches[i].input){continue;}
+    recording = benches[i].fixture;
+    benches[i].func();
+  }
+  recording = 0;
+
+  // Compensate for the system calls done by reading the counters
+  uint64_t callCost = syscalls();
+  callCost = syscalls() - callCost;
+
+  JSON::Value base, results;
+  if (baseFile.size()){
+    std::ifstream f(baseFile.c_str());
+    std::stringstream s;
+    s << f.rdbuf();
+    base = JSON::fromString(s.str());
+    // Per-packet numbers shift slightly with the stream length; only compare like with like
+    if (base.isMember("seconds") && (uint64_t)base["seconds"].asInt() != seconds){
+      std::cerr << "Baseline was made for " << base["seconds"].asInt() << "s of media, not comparing" << std::endl;
+      base.null();
+    }
+  }
+  results["seconds"] = seconds;
+  int failures = 0;
+  printf("%-12s %9s %9s %11s %11s %12s %11s\n", "path", "packets", "MB/s", "packets/s", "allocs/pkt", "syscalls/pkt", "bytes/pkt");
+  for (size_t i = 0; i < benchCount; ++i){
+    bench &b = benches[i];
+    uint64_t bytesBefore = sink.dataUp();
+    uint64_t allocsBefore = allocations;
+    uint64_t callsBefore = syscalls();
+    uint64_t start = Util::getMicros();
+    size_t count = b.func();
+    uint64_t taken = Util::getMicros(start);
+    uint64_t calls = syscalls() - callsBefore - callCost;
+    uint64_t allocs = allocations - allocsBefore;
+    // Input paths read their fixture instead of writing
+    uint64_t bytes = b.input ? b.fixture->size() : sink.dataUp() - bytesBefore;
+    if (!count || !taken){
+      printf("%-12s FAILED: no packets handled\n", b.name);
+      ++failures;
+      continue;
+    }
+    double mbps = (double)bytes / taken;
+    printf("%-12s %9zu %9.1f %11.0f %11.2f %12.2f %11.1f", b.name, count, mbps, (double)count * 1000000 / taken,
+           (double)allocs / count, (double)calls / count, (double)bytes / count);
+
+    JSON::Value &res = results[b.name];
+    res["mbps"] = (int64_t)mbps;
+    res["allocs"] = (int64_t)((allocs * 100 + count / 2) / count);
+    res["syscalls"] = (int64_t)((calls * 100 + count / 2) / count);
+    res["bytes"] = (int64_t)((bytes + count / 2) / count);
+
+    if (base.isMember(b.name)){
+      // Counts are stored in hundredths per packet; allow some leeway for rounding
+      JSON::Value &ref = base[b.name];
+      std::string problems;
+      if (ref.isMember("allocs") && res["allocs"].asInt() > ref["allocs"].asInt() * 11 / 10 + 5){problems += " allocations";}
+      if (ref.isMember("syscalls") && res["syscalls"].asInt() > ref["syscalls"].asInt() * 11 / 10 + 5){problems += " syscalls";}
+      if (ref.isMember("bytes") && res["bytes"].asInt() != ref["bytes"].asInt()){problems += " output size";}
+      if (ref.isMember("mbps") && ref["mbps"].asInt()){printf("  (%+.0f%% MB/s)", (mbps * 100 / ref["mbps"].asInt()) - 100);}
+      if (problems.size()){
+        printf("  REGRESSION:%s", problems.c_str());
+        ++failures;
+      }
+    }
+    printf("\n");
+  }
+
+  if (writeFile.size()){
+    std::ofstream f(writeFile.c_str());
+    f << results.toPrettyString() << std::endl;
+  }
+  return failures ? 1 : 0;
+}
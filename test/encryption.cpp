@@ -0,0 +1,83 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <mist/bitfields.h>
+#include <mist/encode.h>
+#include <mist/encryption.h>
+
+/// Runs all test vectors against the currently enabled AES implementation.
+/// Returns the CTR ciphertext of a fixed input, so the implementations can be compared.
+static std::string runVectors(){
+  // NIST SP 800-38A, F.2.1 CBC-AES128.Encrypt
+  std::string key = Encodings::Hex::decode("2b7e151628aed2a6abf7158809cf4f3c");
+  std::string plain = Encodings::Hex::decode("6bc1bee22e409f96e93d7e117393172a"
+                                             "ae2d8a571e03ac9c9eb76fac45af8e51"
+                                             "30c81c46a35ce411e5fbc1191a0a52ef"
+                                             "f69f2445df4f9b17ad2b417be66c3710");
+  std::string cipher = Encodings::Hex::decode("7649abac8119b246cee98e9b12e9197d"
+                                              "5086cb9b507219ee95db113a917678b2"
+                                              "73bed6b8e3c1743b7116e69e22229516"
+                                              "3ff1caa1681fac09120eca307586e1a7");
+  std::string iv = Encodings::Hex::decode("000102030405060708090a0b0c0d0e0f");
+
+  Encryption::AES enc;
+  enc.setEncryptKey(key.data());
+  char ivec[16];
+  memcpy(ivec, iv.data(), 16);
+  assert(enc.encryptBlockCBC(ivec, plain) == cipher);
+  // The ivec must chain on to the last ciphertext block
+  assert(!memcmp(ivec, cipher.data() + 48, 16));
+
+  Encryption::AES dec;
+  dec.setDecryptKey(key.data());
+  memcpy(ivec, iv.data(), 16);
+  char out[64];
+  assert(dec.decryptBlockCBC(ivec, cipher.data(), out, 64));
+  assert(!memcmp(out, plain.data(), 64));
+
+  // Long enough to use the multi-block path, decrypted in-place in two uneven calls
+  char big[37 * 16];
+  char orig[37 * 16];
+  for (size_t i = 0; i < sizeof(big); ++i){orig[i] = big[i] = (char)(i * 7 + 3);}
+  memcpy(ivec, iv.data(), 16);
+  assert(enc.encryptBlockCBC(ivec, big, big, sizeof(big)));
+  memcpy(ivec, iv.data(), 16);
+  assert(dec.decryptBlockCBC(ivec, big, big, 11 * 16));
+  assert(dec.decryptBlockCBC(ivec, big + 11 * 16, big + 11 * 16, 26 * 16));
+  assert(!memcmp(big, orig, sizeof(big)));
+
+  // CTR: each keystream block is the encryption of the 64-bit ivec followed by a 64-bit block counter
+  uint64_t ctrIvec = 0x0123456789abcdefull;
+  std::string ctrPlain(1000, 'x');
+  std::string ctrCipher = enc.encryptBlockCTR(ctrIvec, ctrPlain);
+  assert(ctrCipher.size() == ctrPlain.size());
+  for (size_t blk = 0; blk * 16 < ctrPlain.size(); ++blk){
+    char counter[16];
+    Bit::htobll(counter, ctrIvec);
+    Bit::htobll(counter + 8, blk);
+    char zero[16];
+    memset(zero, 0, 16);
+    std::string stream = enc.encryptBlockCBC(zero, std::string(counter, 16));
+    for (size_t i = 0; i < 16 && blk * 16 + i < ctrPlain.size(); ++i){
+      assert((char)(ctrCipher[blk * 16 + i] ^ ctrPlain[blk * 16 + i]) == stream[i]);
+    }
+  }
+  assert(enc.encryptBlockCTR(ctrIvec, ctrCipher) == ctrPlain);
+  return ctrCipher;
+}
+
+int main(int argc, char **argv){
+  // The portable implementation is always available
+  assert(Encryption::setHardwareAES(false));
+  assert(!Encryption::hasHardwareAES());
+  std::cout << "Testing portable AES" << std::endl;
+  std::string portableCTR = runVectors();
+
+  if (!Encryption::setHardwareAES(true)){
+    std::cout << "Hardware AES not available, not tested" << std::endl;
+    return 0;
+  }
+  std::cout << "Testing hardware AES" << std::endl;
+  assert(runVectors() == portableCTR);
+  return 0;
+}
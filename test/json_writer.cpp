@@ -0,0 +1,65 @@
+#include <cassert>
+#include <iostream>
+#include <mist/json.h>
+
+int main(int argc, char **argv){
+  JSON::Arena A(4);
+  {
+    JSON::Value V(A);
+    V["name"] = "test \"quoted\"\n";
+    V["int"] = (int64_t)-42;
+    V["big"] = (uint64_t)1234567890123ull;
+    V["bool"] = true;
+    V["dbl"] = 1.5;
+    V["null"].null();
+    V["arr"].append(1);
+    V["arr"].append("two");
+    V["arr"].append().append(3);
+    V["obj"]["nested"]["deeper"] = "value";
+    V["empty_arr"].append(1);
+    V["empty_arr"].shrink(0);
+    assert(A.used() > 4);
+    assert(A.capacity() >= A.used());
+
+    // Copies into an arena-backed value should allocate from the arena as well
+    JSON::Value copy = V;
+    JSON::Value copy2(A);
+    size_t before = A.used();
+    copy2 = copy;
+    assert(A.used() > before);
+    assert(copy2 == V);
+
+    // A Value written through the Writer must match toString exactly
+    std::string out;
+    {
+      JSON::Writer W(out);
+      W.value(V);
+    }
+    assert(out == V.toString());
+
+    // Building the same structure manually must match as well
+    std::string manual;
+    {
+      JSON::Writer W(manual);
+      W.objBegin();
+      W.key("arr").arrBegin().value(1).value("two").arrBegin().value(3).arrEnd().arrEnd();
+      W.key("big").value((uint64_t)1234567890123ull);
+      W.key("bool").value(true);
+      W.key("dbl").value(1.5);
+      W.key("empty_arr").arrBegin().arrEnd();
+      W.key("int").value((int64_t)-42);
+      W.key("name").value("test \"quoted\"\n");
+      W.key("null").null();
+      W.key("obj").objBegin().key("nested").objBegin().key("deeper").value("value").objEnd().objEnd();
+      W.objEnd();
+    }
+    if (manual != out){
+      std::cerr << manual << std::endl << out << std::endl;
+      return 1;
+    }
+    assert(JSON::fromString(manual) == V);
+  }
+  // All nodes must have been handed back to the arena
+  assert(A.used() == 0);
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mist/bitfields.h>
+#include <mist/nal.h>
+#include <mist/timing.h>
+
+// Reference implementations: the original byte-at-a-time versions.
+static const char *refScanAnnexB(const char *data, uint32_t dataSize){
+  char *offset = (char *)data;
+  const char *maxData = data + dataSize - 2;
+  while (offset < maxData){
+    if (offset[2] > 1){
+      offset += 3;
+      continue;
+    }
+    if (!offset[2]){
+      ++offset;
+      continue;
+    }
+    if (!offset[0] && !offset[1]){return offset;}
+    offset += 3;
+  }
+  return 0;
+}
+
+static const char *refNalEndPosition(const char *data, uint32_t dataSize){
+  while (dataSize && !data[dataSize - 1]){--dataSize;}
+  return data + dataSize;
+}
+
+static std::string refRemoveEmulationPrevention(const std::string &data){
+  std::string result;
+  result.resize(data.size());
+  result[0] = data[0];
+  result[1] = data[1];
+  size_t dataPtr = 2;
+  size_t dataLen = data.size();
+  size_t resPtr = 2;
+  while (dataPtr + 2 < dataLen){
+    if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){
+      result[resPtr++] = data[dataPtr++];
+      result[resPtr++] = data[dataPtr++];
+      dataPtr++;
+    }else{
+      result[resPtr++] = data[dataPtr++];
+    }
+  }
+  while (dataPtr < dataLen){result[resPtr++] = data[dataPtr++];}
+  return result.substr(0, resPtr);
+}
+
+static unsigned long refFromAnnexB(const char *data, unsigned long dataSize, char *result){
+  const char *lastCheck = data + dataSize - 3;
+  int offset = 0;
+  int newOffset = 0;
+  while (offset < dataSize){
+    const char *begin = data + offset;
+    while (begin < lastCheck && !(!begin[0] && !begin[1] && begin[2] == 0x01)){
+      begin++;
+      if (begin < lastCheck && begin[0]){begin++;}
+    }
+    begin += 3;
+    if (begin > data + dataSize){
+      offset = dataSize;
+      continue;
+    }
+    const char *end = (const char *)memmem(begin, dataSize - (begin - data), "\000\000\001", 3);
+    if (!end){end = data + dataSize;}
+    if (end > begin && (end - data) != dataSize && end[-1] == 0x00){end--;}
+    unsigned int nalSize = end - begin;
+    Bit::htobl(result + newOffset, nalSize);
+    memcpy(result + newOffset + 4, begin, nalSize);
+    newOffset += 4 + nalSize;
+    offset = end - data;
+  }
+  return newOffset;
+}
+
+/// Fills buf with random bytes, heavily biased towards the values that matter to the scanners.
+static void fillRandom(char *buf, size_t len){
+  for (size_t i = 0; i < len; ++i){
+    switch (rand() % 8){
+    case 0:
+    case 1:
+    case 2: buf[i] = 0; break;
+    case 3: buf[i] = 1; break;
+    case 4: buf[i] = 3; break;
+    default: buf[i] = rand() % 256; break;
+    }
+  }
+}
+
+static void checkImpl(){
+  char buf[600];
+  char out1[1400];
+  char out2[1400];
+  for (size_t iter = 0; iter < 200000; ++iter){
+    size_t align = rand() % 16;
+    size_t len = rand() % (sizeof(buf) - 16);
+    char *data = buf + align;
+    fillRandom(data, len);
+
+    assert(nalu::scanAnnexB(data, len) == refScanAnnexB(data, len));
+    assert(nalu::nalEndPosition(data, len) == refNalEndPosition(data, len));
+    if (len >= 2){
+      std::string str(data, len);
+      assert(nalu::removeEmulationPrevention(str) == refRemoveEmulationPrevention(str));
+    }
+
+    // Well-formed Annex B data starts with a start code; only then do both versions agree exactly.
+    if (len >= 3){
+      data[0] = 0;
+      data[1] = 0;
+      data[2] = 1;
+      char *res = out1;
+      unsigned long newLen = nalu::fromAnnexB(data, len, res);
+      unsigned long refLen = refFromAnnexB(data, len, out2);
+      assert(newLen == refLen);
+      assert(!memcmp(out1, out2, newLen));
+
+      std::deque<nalu::nalPos> nals;
+      size_t count = nalu::findNalUnits(data, len, nals);
+      assert(count == nals.size());
+      size_t pos = 0;
+      for (std::deque<nalu::nalPos>::iterator it = nals.begin(); it != nals.end(); ++it){
+        assert(Bit::btohl(out1 + pos) == it->size);
+        assert(!memcmp(out1 + pos + 4, data + it->offset, it->size));
+        pos += 4 + it->size;
+      }
+      assert(pos == newLen);
+    }
+  }
+}
+
+/// Scans a large buffer with sparse start codes using every available implementation.
+static void bench(){
+  size_t len = 64 * 1024 * 1024;
+  char *data = (char *)malloc(len);
+  for (size_t i = 0; i < len; ++i){data[i] = (rand() % 255) + 1;}
+  for (size_t i = 0; i + 3 < len; i += 1400 + rand() % 200){
+    data[i] = 0;
+    data[i + 1] = 0;
+    data[i + 2] = 1;
+  }
+  nalu::scanImpl impls[] ={nalu::SCAN_SCALAR, nalu::SCAN_SSE2, nalu::SCAN_AVX2, nalu::SCAN_NEON};
+  for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i){
+    if (!nalu::setScanImpl(impls[i])){continue;}
+    uint64_t start = Util::getMicros();
+    size_t found = 0;
+    for (size_t rep = 0; rep < 10; ++rep){
+      const char *p = data;
+      const char *end = data + len;
+      while ((p = nalu::scanAnnexB(p, end - p))){
+        ++found;
+        p += 3;
+      }
+    }
+    uint64_t micros = Util::getMicros(start);
+    std::cout << nalu::scanImplName() << ": " << (10.0 * len / micros) << " MB/s (" << found << " start codes)" << std::endl;
+  }
+  free(data);
+}
+
+int main(int argc, char **argv){
+  if (argc > 1 && !strcmp(argv[1], "bench")){
+    bench();
+    return 0;
+  }
+  nalu::scanImpl impls[] ={nalu::SCAN_SCALAR, nalu::SCAN_SSE2, nalu::SCAN_AVX2, nalu::SCAN_NEON};
+  for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i){
+    if (!nalu::setScanImpl(impls[i])){continue;}
+    srand(42 + i);
+    checkImpl();
+    std::cout << nalu::scanImplName() << ": OK" << std::endl;
+  }
+  nalu::setScanImpl(nalu::SCAN_AUTO);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mist/bitfields.h>
+#include <mist/rtp.h>
+#include <mist/timing.h>
+#include <vector>
+
+static uint64_t delivered = 0;
+static uint16_t lastSeq = 0;
+static bool haveLast = false;
+
+// Checks that packets come out in increasing order, with their own contents intact.
+static void onPacket(const uint64_t track, const RTP::Packet &p){
+  uint16_t seq = p.getSequence();
+  assert(Bit::btohs(p.ptr() + 12) == seq);
+  if (haveLast){assert((int16_t)(seq - lastSeq) > 0);}
+  lastSeq = seq;
+  haveLast = true;
+  ++delivered;
+}
+
+/// Feeds a sorter a stream that is reordered and lossy, checking its output and timing it.
+/// Every `reorder`th pair of packets is swapped, every `loss`th packet is dropped.
+static void run(const char *name, size_t count, size_t reorder, size_t loss){
+  static const size_t packSize = 1200;
+  std::vector<char> stream(count * packSize, 0);
+  std::vector<size_t> order;
+  order.reserve(count);
+  size_t dropped = 0;
+  for (size_t i = 0; i < count; ++i){
+    char *pkt = &stream[i * packSize];
+    pkt[0] = 0x80;
+    pkt[1] = 96;
+    Bit::htobs(pkt + 2, (uint16_t)(60000 + i)); // wraps around partway
+    Bit::htobs(pkt + 12, (uint16_t)(60000 + i));
+    if (loss && i > 10 && !(i % loss)){
+      ++dropped;
+      continue;
+    }
+    order.push_back(i);
+  }
+  if (reorder){
+    for (size_t i = 10; i + 1 < order.size(); i += reorder){std::swap(order[i], order[i + 1]);}
+  }
+
+  RTP::Sorter sorter(1, onPacket);
+  delivered = 0;
+  haveLast = false;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < order.size(); ++i){sorter.addPacket(&stream[order[i] * packSize], packSize);}
+  uint64_t taken = Util::getMicros(start);
+
+  // Nothing may be lost besides the dropped packets; only the tail may still be buffered.
+  assert(sorter.lostTotal <= (int32_t)dropped);
+  assert(delivered + RTP::PACKET_DROP_TIMEOUT + 5 >= order.size());
+  std::cout << name << ": " << delivered << "/" << order.size() << " delivered, " << sorter.lostTotal
+            << " lost, " << (taken ? order.size() * 1000000 / taken : 0) << " packets/s" << std::endl;
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = 0; // Reordering is logged per packet otherwise
+  size_t count = argc > 1 ? atoi(argv[1]) : 200000;
+  run("In order", count, 0, 0);
+  run("Reordered", count, 7, 0);
+  run("Lossy", count, 0, 50);
+  run("Reordered and lossy", count, 7, 50);
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <cassert>
+#include <iostream>
+#include <mist/dtsc.h>
+#include <mist/json.h>
+#include <mist/stream.h>
+#include <mist/timing.h>
+
+static DTSC::Meta M;
+
+static size_t addTrack(const std::string &type, const std::string &codec, const std::string &lang){
+  size_t idx = M.addTrack();
+  M.setType(idx, type);
+  M.setCodec(idx, codec);
+  M.setLang(idx, lang);
+  M.setID(idx, idx + 1);
+  if (type == "video"){
+    M.setWidth(idx, 1280);
+    M.setHeight(idx, 720);
+  }else{
+    M.setRate(idx, 48000);
+    M.setChannels(idx, 2);
+  }
+  for (uint64_t i = 0; i < 250; ++i){M.update(i * 40, 0, idx, 1000, i * 1000, !(i % 50));}
+  return idx;
+}
+
+static std::string print(const std::set<size_t> &s){
+  std::string ret;
+  for (std::set<size_t>::const_iterator it = s.begin(); it != s.end(); ++it){
+    ret += JSON::Value(*it).asString() + " ";
+  }
+  return ret;
+}
+
+static void check(Util::SelectionCache &cache, const std::map<std::string, std::string> &params,
+                  const JSON::Value &capa, const std::string &UA){
+  std::set<size_t> cached = cache.wouldSelect(M, params, capa, UA);
+  std::set<size_t> direct = Util::wouldSelect(M, params, capa, UA);
+  if (cached != direct){
+    std::cerr << "Cached selection " << print(cached) << "!= direct selection " << print(direct) << std::endl;
+    assert(false);
+  }
+}
+
+int main(int argc, char **argv){
+  M.reInit("", true);
+  size_t h264 = addTrack("video", "H264", "und");
+  addTrack("video", "HEVC", "und");
+  addTrack("audio", "AAC", "eng");
+  size_t mp3 = addTrack("audio", "MP3", "dut");
+
+  JSON::Value capa;
+  capa["codecs"][0u][0u].append("H264");
+  capa["codecs"][0u][0u].append("HEVC");
+  capa["codecs"][0u][1u].append("AAC");
+  capa["codecs"][0u][1u].append("MP3");
+  capa["exceptions"]["codec:MP3"] = JSON::fromString("[[\"blacklist\",[\"Mozilla/\"]]]");
+
+  std::map<std::string, std::string> none, langSel, allSel;
+  langSel["audio"] = "dut";
+  allSel["video"] = "all";
+  allSel["audio"] = "all";
+
+  Util::SelectionCache cache;
+  const char *agents[] ={"", "Mozilla/5.0", "VLC/3.0"};
+  for (size_t i = 0; i < 3; ++i){
+    check(cache, none, capa, agents[i]);
+    check(cache, langSel, capa, agents[i]);
+    check(cache, allSel, capa, agents[i]);
+  }
+  // Repeated calls are served from the cache and must give the same answers
+  for (size_t i = 0; i < 3; ++i){
+    check(cache, none, capa, agents[i]);
+    check(cache, langSel, capa, agents[i]);
+    check(cache, allSel, capa, agents[i]);
+  }
+
+  // Metadata changes must invalidate cached results
+  M.setLang(mp3, "fre");
+  check(cache, langSel, capa, "");
+  M.setCodec(h264, "VP8");
+  check(cache, none, capa, "");
+  check(cache, allSel, capa, "");
+  M.setCodec(h264, "H264");
+  check(cache, none, capa, "");
+
+  // Changed capabilities take effect once the cache is told about them
+  capa["codecs"][0u][0u].shrink(1);
+  cache.setCapa(capa);
+  check(cache, none, capa, "");
+  check(cache, allSel, capa, "");
+
+  // Measure the cost of a cache hit against a full selection
+  size_t rounds = 20000;
+  Util::SelectionCache timed;
+  timed.wouldSelect(M, none, capa, "VLC/3.0");
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < rounds; ++i){Util::wouldSelect(M, none, capa, "VLC/3.0");}
+  uint64_t direct = Util::getMicros() - start;
+  start = Util::getMicros();
+  for (size_t i = 0; i < rounds; ++i){timed.wouldSelect(M, none, capa, "VLC/3.0");}
+  uint64_t cached = Util::getMicros() - start;
+  std::cout << "Selection: " << (double)direct / rounds << " us direct, " << (double)cached / rounds
+            << " us cached" << std::endl;
+  assert(cached < direct);
+  return 0;
+}